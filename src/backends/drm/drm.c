@@ -14,19 +14,23 @@
 #include <pthread.h>  
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <drm/drm_fourcc.h>
 #include <libinput.h>
 #include <xkbcommon/xkbcommon-keysyms.h>
 #include <stdarg.h>
+#include <inttypes.h>
 #include <string.h>
 
 #include <errno.h>
+#include <sys/timerfd.h>
 
 #include <wayland-server-core.h>
 #include <wayland-util.h>
 #include <pthread.h>
 
 #include "core/compositor.h"
+#include "core/scene.h"
 #include "render/renderer.h"
 
 #include "./drm.h"
@@ -36,6 +40,7 @@
 #include "input/wl_seat.h"
 #include "protocols/linux_dmabuf.h"
 #include "protocols/linux_explicit_sync.h"
+#include "protocols/presentation_time.h"
 #include "protocols/wl_shm.h"
 #include "render/dmabuf.h"
 
@@ -44,6 +49,92 @@
 
 #define _SUBSYS_NAME "DRM"
 
+#ifndef DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP
+#define DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP 0x15
+#endif
+
+// Output names are built from these (indexed by DRM_MODE_CONNECTOR_*) 
+// and the type ID of the connector, e.g. "DP-1".
+static const char* _drm_connector_type_names[] = {
+  "Unknown", "VGA", "DVI-I", "DVI-D", "DVI-A", "Composite", "SVIDEO", 
+  "LVDS", "Component", "DIN", "DP", "HDMI-A", "HDMI-B", "TV", "eDP", 
+  "Virtual", "DSI", "DPI", "Writeback", "SPI", "USB"
+};
+
+// Cached KMS property IDs, resolved once per object so that 
+// building an atomic request does not need any property lookups.
+struct drm_connector_props_t {
+  uint32_t crtc_id;
+};
+
+struct drm_crtc_props_t {
+  uint32_t mode_id, active;
+  uint32_t vrr_enabled; // 0 if the driver has no adaptive sync
+};
+
+struct drm_plane_props_t {
+  uint32_t type, fb_id, crtc_id,
+           src_x, src_y, src_w, src_h,
+           crtc_x, crtc_y, crtc_w, crtc_h;
+};
+
+// Most overlays a single output puts client buffers on
+#define _DRM_MAX_OVERLAYS_PER_OUTPUT 8
+#define _DRM_PRIME_COPY_BUFFERS 3
+// Latest time before a vblank a held back atomic commit is flushed
+#define _DRM_COMMIT_MARGIN_NS 1000000ull
+
+// Overlay plane of a device, it can be used by any 
+// of the CRTCs in 'possible_crtcs' but only one at a time.
+struct drm_plane_t {
+  uint32_t id;
+  uint32_t possible_crtcs;
+  struct drm_plane_props_t props;
+  // Formats/modifiers the plane can scan out (array of vt_dmabuf_drm_format_t)
+  struct wl_array formats;
+  bool has_zpos;
+  uint64_t zpos;
+
+  // Output the plane is currently used by (NULL if free)
+  struct vt_output_t* output;
+};
+
+// Client buffer put on an overlay plane
+struct drm_overlay_t {
+  struct drm_plane_t* plane;
+  struct vt_linux_dmabuf_v1_buffer_t* dmabuf;
+  uint32_t fb_id;
+  uint32_t format;
+  uint64_t mod;
+  // Destination rectangle in CRTC coordinates
+  int32_t x, y;
+  uint32_t w, h;
+};
+
+// Frame the main GPU rendered for an output of a secondary GPU, imported into 
+// the secondary device via PRIME. Kept in the user data of the rendered BO.
+struct drm_prime_buffer_t {
+  struct gbm_bo* imported;
+};
+
+// CPU mapped buffer of a secondary GPU that frames are copied into 
+// when the secondary device cannot scan out the imported buffer.
+struct drm_dumb_buffer_t {
+  uint32_t handle, fb_id, stride;
+  uint64_t size;
+  void* map;
+};
+
+// KMS framebuffer attached to a gbm_bo or a client DMABUF,
+// lives as long as the buffer itself
+struct drm_fb_t {
+  uint32_t fb_id;
+  int32_t drm_fd;
+
+  // Result of the last direct scanout test commit (client buffers only)
+  uint32_t tested_crtc_id;
+  bool test_passed;
+};
 
 struct drm_backend_state_t {
   int drm_fd;
@@ -63,17 +154,39 @@ struct drm_backend_state_t {
 
   struct vt_device_t* dev;
 
-  struct wl_event_source *event_source 
+  struct wl_event_source *event_source;
+
+  // Atomic modesetting: frames of all outputs on this device that latch on 
+  // the same vblank go out as one commit. The commit is flushed once the last 
+  // of them is staged, or by 'commit_timer' shortly before that vblank.
+  bool atomic;
+  struct wl_event_source* commit_source;
+  struct wl_event_source* commit_timer;
+  int32_t commit_timer_fd;
+  uint64_t commit_deadline;
+
+  // Size of the buffers the cursor planes of this device take
+  uint64_t cursor_width, cursor_height;
+
+  // Flip events carry CLOCK_MONOTONIC timestamps
+  bool monotonic_timestamps;
+
+  // Flips can skip waiting for vblank (DRM_MODE_PAGE_FLIP_ASYNC)
+  bool async_flip_legacy, async_flip_atomic;
+
+  // Overlay planes (atomic devices only)
+  struct drm_plane_t* overlays;
+  uint32_t n_overlays;
 };
 
 struct drm_backend_master_state_t {
   struct wl_list backends;
-  uint32_t x_ptr;
   int32_t vt_fd;
   struct vt_compositor_t* comp;
 
   struct wl_listener session_terminate_listener,
-  seat_disable_listener, seat_enable_listener;
+  seat_disable_listener, seat_enable_listener, 
+  change_card_listener;
 
   struct drm_backend_state_t* main_drm;
   uint32_t n_drm;
@@ -95,25 +208,131 @@ struct drm_output_state_t {
   bool needs_modeset;
   bool flip_inflight;
   bool modeset_bootstrapped;
+  // The in-flight flip does not wait for vblank
+  bool flip_async;
+
+  // Multi-GPU: the output belongs to a secondary device and the main device 
+  // renders its frames into linear BOs. They are imported via PRIME if possible, 
+  // otherwise copied into dumb buffers of the secondary device.
+  bool prime, prime_copy;
+  struct drm_dumb_buffer_t prime_copies[_DRM_PRIME_COPY_BUFFERS];
+  uint32_t prime_copy_idx;
 
   struct gbm_surface* gbm_surf;
 
+  // Software rendering: the renderer writes frames into two dumb buffers
+  // in turn, 'sw_target' points it to the one that is not on screen.
+  bool software;
+  struct drm_dumb_buffer_t sw_buffers[2];
+  struct vt_renderer_cpu_target_t sw_target;
+
+  // Renderers without GBM surfaces (Vulkan) get two BOs of ours to render 
+  // into in turn, handed over as 'bo_targets'. Their FBs are cached in 'bo_fbs'.
+  bool bo_rendering;
+  struct gbm_bo* bos[2];
+  struct vt_renderer_dmabuf_target_t bo_targets[2];
+  uint32_t bo_fbs[2];
+
+  // Buffer (of the two above) the next frame is rendered into
+  uint32_t back_idx;
+
   drmModeModeInfo mode;
   uint32_t conn_id;
   uint32_t crtc_id;
+
+  // Atomic modesetting, outputs whose CRTC lacks atomic properties 
+  // use legacy flips even if the rest of the device is atomic.
+  bool atomic;
+  uint32_t plane_id, mode_blob_id;
+  uint32_t crtc_idx;
+  bool has_primary_zpos;
+  uint64_t primary_zpos;
+  // VRR_ENABLED of the CRTC, changed with the next commit while 'vrr_dirty' is set
+  bool vrr_enabled, vrr_dirty;
+  struct drm_connector_props_t conn_props;
+  struct drm_crtc_props_t crtc_props;
+  struct drm_plane_props_t plane_props;
+  bool commit_queued;
+
+  // Formats/modifiers the primary plane can scan out (array of vt_dmabuf_drm_format_t)
+  struct wl_array scanout_formats;
+
+  // Client buffers that are scanned out directly, they take the
+  // place of the GBM buffer at the same position in the flip rotation.
+  struct vt_linux_dmabuf_v1_buffer_t* pending_dmabuf;
+  struct vt_linux_dmabuf_v1_buffer_t* current_dmabuf;
+
+  // Cursor plane: the image is written to the buffer that is not on screen 
+  struct gbm_bo* cursor_bos[2];
+  uint32_t cursor_front;
+  bool cursor_visible;
+
+  // Client buffers on overlay planes, they move through 
+  // the flip rotation just like pending/current_dmabuf.
+  struct drm_overlay_t pending_overlays[_DRM_MAX_OVERLAYS_PER_OUTPUT];
+  struct drm_overlay_t current_overlays[_DRM_MAX_OVERLAYS_PER_OUTPUT];
+  uint32_t n_pending_overlays, n_current_overlays;
+  // Overlays (indices into the device's overlays) that the last commit enabled
+  uint32_t overlay_mask;
 };
 
 static void   _drm_page_flip_handler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data);
+static void   _drm_page_flip_handler_atomic(int fd, unsigned int frame, unsigned int sec, unsigned int usec, unsigned int crtc_id, void *data);
+static void   _drm_finish_flip_for_output(int fd, struct vt_output_t* output, unsigned int frame, unsigned int sec, unsigned int usec);
+static uint32_t _drm_get_prop_id(int fd, uint32_t obj_id, uint32_t obj_type, const char* name, uint64_t* value);
+static bool   _drm_get_plane_props(int fd, uint32_t plane_id, struct drm_plane_props_t* p);
+static bool   _drm_get_plane_formats(struct drm_backend_state_t* drm, uint32_t plane_id, struct wl_array* formats);
+static bool   _drm_init_atomic_props_for_output(struct drm_backend_state_t* drm, struct drm_output_state_t* drm_output);
+static bool   _drm_init_scanout_formats_for_output(struct drm_backend_state_t* drm, struct drm_output_state_t* drm_output);
+static bool   _drm_init_overlays_for_device(struct drm_backend_state_t* drm);
+static void   _drm_free_format_set(struct wl_array* set);
+static bool   _drm_format_set_has(struct wl_array* set, uint32_t format, uint64_t mod);
+static bool   _drm_surface_is_opaque(struct vt_surface_t* surf, struct vt_linux_dmabuf_v1_buffer_t* buf);
+static bool   _drm_atomic_add_output(struct drm_backend_state_t* drm, drmModeAtomicReq* req, struct vt_output_t* output, uint32_t* flags);
+static void   _drm_atomic_add_overlays(struct drm_backend_state_t* drm, drmModeAtomicReq* req, struct vt_output_t* output);
+static bool   _drm_can_flip_async(struct vt_output_t* output);
+static void   _drm_reset_pending_overlays(struct drm_output_state_t* drm_output);
+static bool   _drm_claim_overlay(struct vt_output_t* output, struct vt_surface_t* surf, void* user_data);
+static void   _drm_atomic_commit_for_device(void* data);
+static void   _drm_schedule_commit_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output);
+static uint64_t _drm_commit_deadline(struct drm_backend_state_t* drm, struct vt_output_t* output);
+static uint64_t _drm_next_vblank(struct vt_output_t* output, uint64_t now);
+static int    _drm_commit_timer_handler(int fd, uint32_t mask, void* data);
+static void   _drm_flush_staged_commit(struct drm_backend_state_t* drm);
 static void   _drm_release_all_scanout(struct vt_output_t* output);
+static void   _drm_fb_destroy_handler(struct gbm_bo* bo, void* data);
+static uint32_t _drm_fb_from_bo(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_bo* bo);
+static void   _drm_prime_buffer_destroy_handler(struct gbm_bo* bo, void* data);
+static uint32_t _drm_prime_fb_from_bo(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_bo* bo);
+static uint32_t _drm_prime_copy_bo(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_bo* bo);
+static bool   _drm_create_dumb_buffer(struct drm_backend_state_t* drm, struct drm_dumb_buffer_t* buf, uint32_t width, uint32_t height, uint32_t format);
+static void   _drm_destroy_dumb_buffer(struct drm_backend_state_t* drm, struct drm_dumb_buffer_t* buf);
+static bool   _drm_create_render_bos(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_device* gbm_dev, uint32_t format);
+static void   _drm_destroy_render_bos(struct vt_output_t* output);
+static void   _drm_dmabuf_fb_destroy_handler(struct vt_linux_dmabuf_v1_buffer_t* buf, void* data);
+static struct drm_fb_t* _drm_fb_from_dmabuf(struct drm_backend_state_t* drm, struct vt_output_t* output, struct vt_linux_dmabuf_v1_buffer_t* buf);
+static bool   _drm_test_scanout_fb(struct drm_backend_state_t* drm, struct vt_output_t* output, struct drm_fb_t* fb);
+static bool   _drm_queue_flip_for_output(struct drm_backend_state_t* drm, struct vt_output_t* output);
 static bool   _drm_devices_equal(drmDevicePtr a, drmDevicePtr b);
 static bool   _drm_can_share_dmabuf(struct vt_device_t* main_dev, struct vt_device_t* dev);
-static bool   _drm_build_dmabuf_feedback(struct drm_backend_master_state_t* master, struct vt_dmabuf_feedback_t* feedback); 
+static bool   _drm_build_dmabuf_feedback(struct drm_backend_master_state_t* master, struct vt_dmabuf_feedback_t* feedback);
+static bool   _drm_add_scanout_tranche(struct drm_backend_master_state_t* master, struct vt_dmabuf_feedback_t* feedback);
 static bool   _drm_suspend(struct drm_backend_state_t* backend);
 static bool   _drm_resume(struct drm_backend_state_t* backend);
 static int    _drm_dispatch(int fd, uint32_t mask, void *data);
 static bool   _drm_init_for_device(struct vt_compositor_t* comp, struct drm_backend_state_t* drm, struct vt_device_t* dev); 
 static bool   _drm_init_active_outputs_for_device(struct drm_backend_state_t* drm);
+static struct vt_output_t* _drm_add_output_for_connector(struct drm_backend_state_t* drm, drmModeConnector* conn);
+static bool   _drm_update_outputs_for_device(struct drm_backend_state_t* drm);
+static void   _drm_remove_output_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output);
+static bool   _drm_atomic_disable_output(struct drm_backend_state_t* drm, struct vt_output_t* output);
+static bool   _drm_crtc_in_use(struct drm_backend_state_t* drm, uint32_t crtc_id);
 static bool   _drm_handle_frame_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output);
+static bool   _drm_scanout_surface_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, struct vt_surface_t* surf);
+static bool   _drm_set_cursor_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, struct vt_surface_t* surf, int32_t hotspot_x, int32_t hotspot_y);
+static bool   _drm_move_cursor_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, int32_t x, int32_t y);
+static bool   _drm_assign_planes_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output);
+static bool   _drm_set_vrr_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, bool enabled);
 static bool   _drm_create_output_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, void* data);
 static bool   _drm_destroy_output_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output);
 static bool   _drm_terminate_for_device(struct drm_backend_state_t* drm);
@@ -121,6 +340,7 @@ static bool   _drm_terminate_for_device(struct drm_backend_state_t* drm);
 static void   _drm_on_session_terminate(struct wl_listener* listener, void* data); 
 static void   _drm_on_seat_enable(struct wl_listener* listener, void* data); 
 static void   _drm_on_seat_disable(struct wl_listener* listener, void* data); 
+static void   _drm_on_card_change(struct wl_listener* listener, void* data); 
 
 static void   _drm_keybind_switch_vt(struct vt_compositor_t* comp, void* user_data); 
 
@@ -128,14 +348,47 @@ void
 _drm_page_flip_handler(int fd, unsigned int frame,
                        unsigned int sec, unsigned int usec, void *data) {
   struct vt_output_t* output = (struct vt_output_t*)data; 
-  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
   struct vt_compositor_t* comp = output->backend->comp;
 
   VT_TRACE(comp->log, "_drm_page_flip_handler(): Handling page flip event.")
 
-  // Release the old, unused backbuffer
+  _drm_finish_flip_for_output(fd, output, frame, sec, usec);
+}
+
+void 
+_drm_page_flip_handler_atomic(int fd, unsigned int frame,
+                              unsigned int sec, unsigned int usec, 
+                              unsigned int crtc_id, void *data) {
+  struct drm_backend_state_t* drm = (struct drm_backend_state_t*)data; 
+
+  // One atomic commit covers several CRTCs, the kernel sends 
+  // one event per CRTC, so find the output that flipped.
+  struct vt_output_t* output;
+  wl_list_for_each(output, &drm->outputs, link_local) {
+    struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+    if(!drm_output || drm_output->crtc_id != crtc_id) continue;
+    VT_TRACE(drm->comp->log, "Handling atomic page flip event for CRTC %u.", crtc_id);
+    _drm_finish_flip_for_output(fd, output, frame, sec, usec);
+    return;
+  }
+  VT_WARN(drm->comp->log, "Got page flip event for unknown CRTC %u.", crtc_id);
+}
+
+void 
+_drm_finish_flip_for_output(int fd, struct vt_output_t* output, unsigned int frame, unsigned int sec, unsigned int usec) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  struct vt_compositor_t* comp = output->backend->comp;
+
+  // The vblank the flip happened on, the repaint scheduler predicts the next one from it
+  output->last_vblank_ns = drm_output->drm_backend->monotonic_timestamps ?
+    (uint64_t)sec * 1000000000ull + (uint64_t)usec * 1000ull : vt_util_get_time_nsec();
+  output->msc = frame;
+  output->presentation_flags = VT_PRESENTATION_HW_COMPLETION | 
+    (drm_output->flip_async ? 0 : VT_PRESENTATION_VSYNC) |
+    (drm_output->drm_backend->monotonic_timestamps ? VT_PRESENTATION_HW_CLOCK : 0);
+
+  // Release the old, unused backbuffer (its FB stays cached on the BO)
   if (drm_output->older_bo) {
-    drmModeRmFB(fd, drm_output->older_fb);
     gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->older_bo);
     drm_output->older_bo = NULL;
   }
@@ -152,42 +405,1025 @@ _drm_page_flip_handler(int fd, unsigned int frame,
   drm_output->current_bo = drm_output->pending_bo;
   drm_output->current_fb = drm_output->pending_fb;
 
+  // A directly scanned out client buffer is off screen now,
+  // so the client can have it back.
+  vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->current_dmabuf);
+  drm_output->current_dmabuf = drm_output->pending_dmabuf;
+  for(uint32_t i = 0; i < drm_output->n_current_overlays; i++) {
+    vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->current_overlays[i].dmabuf);
+  }
+  memcpy(drm_output->current_overlays, drm_output->pending_overlays, 
+         sizeof(*drm_output->pending_overlays) * drm_output->n_pending_overlays);
+  drm_output->n_current_overlays = drm_output->n_pending_overlays;
+  drm_output->n_pending_overlays = 0;
+
   // Reset pending buffer (so we can set it in the next frame)
   drm_output->pending_bo = NULL;
   drm_output->pending_fb = 0;
+  drm_output->pending_dmabuf = NULL;
 
   drm_output->flip_inflight = false;
   uint32_t t = vt_util_get_time_msec(); 
 
+  // The frame is on screen now
+  vt_proto_presentation_presented(output);
+
   // Send the frame callbacks to all clients, establishing correct frame pacing
   vt_comp_frame_done(comp, output, t);
 
-  if(output->needs_repaint) {
-    vt_comp_schedule_repaint(comp, output);
+  vt_comp_frame_presented(comp, output);
+}
+
+uint32_t
+_drm_get_prop_id(int fd, uint32_t obj_id, uint32_t obj_type, const char* name, uint64_t* value) {
+  drmModeObjectProperties* props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+  if(!props) return 0;
+
+  uint32_t id = 0;
+  for(uint32_t i = 0; i < props->count_props && !id; i++) {
+    drmModePropertyRes* prop = drmModeGetProperty(fd, props->props[i]);
+    if(!prop) continue;
+    if(strcmp(prop->name, name) == 0) {
+      id = prop->prop_id;
+      if(value) *value = props->prop_values[i];
+    }
+    drmModeFreeProperty(prop);
+  }
+
+  drmModeFreeObjectProperties(props);
+  return id;
+}
+
+bool
+_drm_get_plane_props(int fd, uint32_t plane_id, struct drm_plane_props_t* p) {
+  p->type     = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "type", NULL);
+  p->fb_id    = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID", NULL);
+  p->crtc_id  = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID", NULL);
+  p->src_x    = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X", NULL);
+  p->src_y    = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y", NULL);
+  p->src_w    = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W", NULL);
+  p->src_h    = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H", NULL);
+  p->crtc_x   = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X", NULL);
+  p->crtc_y   = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y", NULL);
+  p->crtc_w   = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W", NULL);
+  p->crtc_h   = _drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H", NULL);
+
+  return p->fb_id && p->crtc_id &&
+    p->src_x && p->src_y && p->src_w && p->src_h &&
+    p->crtc_x && p->crtc_y && p->crtc_w && p->crtc_h;
+}
+
+bool
+_drm_init_atomic_props_for_output(struct drm_backend_state_t* drm, struct drm_output_state_t* drm_output) {
+  int fd = drm->drm_fd;
+
+  // Find the index of the CRTC, planes report their compatible CRTCs as a bitmask of indices
+  int32_t crtc_idx = -1;
+  for(int32_t i = 0; i < drm->res->count_crtcs; i++) {
+    if(drm->res->crtcs[i] == drm_output->crtc_id) {
+      crtc_idx = i;
+      break;
+    }
+  }
+  if(crtc_idx < 0) return false;
+
+  drmModePlaneRes* plane_res = drmModeGetPlaneResources(fd);
+  if(!plane_res) {
+    VT_ERROR(drm->comp->log, "drmModeGetPlaneResources() failed: %s", strerror(errno));
+    return false;
+  }
+
+  // Find the primary plane of the CRTC
+  drm_output->plane_id = 0;
+  for(uint32_t i = 0; i < plane_res->count_planes && !drm_output->plane_id; i++) {
+    drmModePlane* plane = drmModeGetPlane(fd, plane_res->planes[i]);
+    if(!plane) continue;
+    uint64_t type = 0;
+    if((plane->possible_crtcs & (1u << crtc_idx)) &&
+      _drm_get_prop_id(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) &&
+      type == DRM_PLANE_TYPE_PRIMARY) {
+      drm_output->plane_id = plane->plane_id;
+    }
+    drmModeFreePlane(plane);
+  }
+  drmModeFreePlaneResources(plane_res);
+
+  if(!drm_output->plane_id) {
+    VT_ERROR(drm->comp->log, "No primary plane found for CRTC %u.", drm_output->crtc_id);
+    return false;
+  }
+  drm_output->crtc_idx = (uint32_t)crtc_idx;
+  drm_output->has_primary_zpos = _drm_get_prop_id(fd, drm_output->plane_id, DRM_MODE_OBJECT_PLANE, 
+                                                  "zpos", &drm_output->primary_zpos) != 0;
+
+  struct drm_connector_props_t* c = &drm_output->conn_props;
+  c->crtc_id  = _drm_get_prop_id(fd, drm_output->conn_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", NULL);
+
+  struct drm_crtc_props_t* cr = &drm_output->crtc_props;
+  cr->mode_id = _drm_get_prop_id(fd, drm_output->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", NULL);
+  cr->active  = _drm_get_prop_id(fd, drm_output->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", NULL);
+
+  // Adaptive sync needs both a capable sink and a CRTC that can drive it
+  uint64_t vrr_capable = 0;
+  if(_drm_get_prop_id(fd, drm_output->conn_id, DRM_MODE_OBJECT_CONNECTOR, "vrr_capable", &vrr_capable) && vrr_capable) {
+    cr->vrr_enabled = _drm_get_prop_id(fd, drm_output->crtc_id, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED", NULL);
+  } else {
+    cr->vrr_enabled = 0;
+  }
+
+  if(!c->crtc_id || !cr->mode_id || !cr->active || 
+    !_drm_get_plane_props(fd, drm_output->plane_id, &drm_output->plane_props)) {
+    VT_ERROR(drm->comp->log, "Missing atomic KMS properties for connector %u.", drm_output->conn_id);
+    return false;
+  }
+
+  VT_TRACE(drm->comp->log, "Cached atomic properties for connector %u (CRTC %u, primary plane %u).", 
+           drm_output->conn_id, drm_output->crtc_id, drm_output->plane_id);
+
+  return true;
+}
+
+bool
+_drm_init_scanout_formats_for_output(struct drm_backend_state_t* drm, struct drm_output_state_t* drm_output) {
+  if(!_drm_get_plane_formats(drm, drm_output->plane_id, &drm_output->scanout_formats)) return false;
+
+  VT_TRACE(drm->comp->log, "Primary plane %u of connector %u can scan out %zu format(s).",
+           drm_output->plane_id, drm_output->conn_id,
+           drm_output->scanout_formats.size / sizeof(struct vt_dmabuf_drm_format_t));
+  return true;
+}
+
+bool
+_drm_get_plane_formats(struct drm_backend_state_t* drm, uint32_t plane_id, struct wl_array* formats) {
+  int fd = drm->drm_fd;
+  wl_array_init(formats);
+
+  drmModePlane* plane = drmModeGetPlane(fd, plane_id);
+  if(!plane) {
+    VT_ERROR(drm->comp->log, "drmModeGetPlane() failed for plane %u: %s", plane_id, strerror(errno));
+    return false;
+  }
+
+  uint64_t blob_id = 0;
+  drmModePropertyBlobRes* blob = NULL;
+  if(_drm_get_prop_id(fd, plane_id, DRM_MODE_OBJECT_PLANE, "IN_FORMATS", &blob_id) && blob_id) {
+    blob = drmModeGetPropertyBlob(fd, (uint32_t)blob_id);
+  }
+  const bool have_in_formats = blob != NULL;
+
+  if(blob) {
+    // IN_FORMATS lists the formats of the plane together with a set of modifiers,
+    // each modifier carries a bitmask of the (up to 64) formats starting at 'offset'
+    // that it can be used with.
+    const struct drm_format_modifier_blob* hdr = blob->data;
+    const uint32_t* formats = (const uint32_t*)((const uint8_t*)hdr + hdr->formats_offset);
+    const struct drm_format_modifier* mods =
+      (const struct drm_format_modifier*)((const uint8_t*)hdr + hdr->modifiers_offset);
+
+    for(uint32_t i = 0; i < hdr->count_formats; i++) {
+      struct vt_dmabuf_drm_format_t* fmt = wl_array_add(formats, sizeof(*fmt));
+      if(!fmt) break;
+      fmt->format = formats[i];
+      fmt->len = 0;
+      if(!(fmt->mods = calloc(hdr->count_modifiers ? hdr->count_modifiers : 1, sizeof(*fmt->mods)))) continue;
+      for(uint32_t j = 0; j < hdr->count_modifiers; j++) {
+        if(i < mods[j].offset || i >= mods[j].offset + 64) continue;
+        if(!(mods[j].formats & (1ull << (i - mods[j].offset)))) continue;
+        fmt->mods[fmt->len++].mod = mods[j].modifier;
+      }
+    }
+    drmModeFreePropertyBlob(blob);
+  } else {
+    // Without IN_FORMATS, only linear and implicit modifiers are known to work
+    for(uint32_t i = 0; i < plane->count_formats; i++) {
+      struct vt_dmabuf_drm_format_t* fmt = wl_array_add(formats, sizeof(*fmt));
+      if(!fmt) break;
+      fmt->format = plane->formats[i];
+      fmt->len = 0;
+      if(!(fmt->mods = calloc(2, sizeof(*fmt->mods)))) continue;
+      fmt->mods[fmt->len++].mod = DRM_FORMAT_MOD_LINEAR;
+      fmt->mods[fmt->len++].mod = DRM_FORMAT_MOD_INVALID;
+    }
+  }
+
+  if(!have_in_formats) {
+    VT_TRACE(drm->comp->log, "Plane %u has no IN_FORMATS, assuming linear and implicit modifiers.", plane_id);
+  }
+
+  drmModeFreePlane(plane);
+  return true;
+}
+
+bool
+_drm_init_overlays_for_device(struct drm_backend_state_t* drm) {
+  int fd = drm->drm_fd;
+  drmModePlaneRes* plane_res = drmModeGetPlaneResources(fd);
+  if(!plane_res) {
+    VT_ERROR(drm->comp->log, "drmModeGetPlaneResources() failed: %s", strerror(errno));
+    return false;
+  }
+
+  // Overlays are referenced through a 32 bit mask per output
+  if(!(drm->overlays = calloc(plane_res->count_planes < 32 ? plane_res->count_planes : 32, sizeof(*drm->overlays)))) {
+    drmModeFreePlaneResources(plane_res);
+    return false;
+  }
+
+  for(uint32_t i = 0; i < plane_res->count_planes && drm->n_overlays < 32; i++) {
+    drmModePlane* plane = drmModeGetPlane(fd, plane_res->planes[i]);
+    if(!plane) continue;
+    uint64_t type = 0;
+    if(_drm_get_prop_id(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) &&
+      type == DRM_PLANE_TYPE_OVERLAY) {
+      struct drm_plane_t* overlay = &drm->overlays[drm->n_overlays];
+      overlay->id = plane->plane_id;
+      overlay->possible_crtcs = plane->possible_crtcs;
+      overlay->has_zpos = _drm_get_prop_id(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "zpos", &overlay->zpos) != 0;
+      if(_drm_get_plane_props(fd, plane->plane_id, &overlay->props) &&
+        _drm_get_plane_formats(drm, plane->plane_id, &overlay->formats)) {
+        drm->n_overlays++;
+      } else {
+        _drm_free_format_set(&overlay->formats);
+        memset(overlay, 0, sizeof(*overlay));
+      }
+    }
+    drmModeFreePlane(plane);
+  }
+  drmModeFreePlaneResources(plane_res);
+
+  VT_TRACE(drm->comp->log, "Found %u usable overlay plane(s) on GPU %s.", drm->n_overlays, drm->dev->path);
+  return true;
+}
+
+void
+_drm_free_format_set(struct wl_array* set) {
+  struct vt_dmabuf_drm_format_t* fmt;
+  wl_array_for_each(fmt, set) {
+    free(fmt->mods);
+  }
+  wl_array_release(set);
+  wl_array_init(set);
+}
+
+bool
+_drm_format_set_has(struct wl_array* set, uint32_t format, uint64_t mod) {
+  struct vt_dmabuf_drm_format_t* fmt;
+  wl_array_for_each(fmt, set) {
+    if(fmt->format != format) continue;
+    for(size_t i = 0; i < fmt->len; i++) {
+      if(fmt->mods[i].mod == mod) return true;
+    }
+  }
+  return false;
+}
+
+bool
+_drm_surface_is_opaque(struct vt_surface_t* surf, struct vt_linux_dmabuf_v1_buffer_t* buf) {
+  if(!vt_util_drm_format_has_alpha(buf->attr.format)) return true;
+  pixman_box32_t box = { 0, 0, buf->attr.width, buf->attr.height };
+  return pixman_region32_contains_rectangle(&surf->opaque_region, &box) == PIXMAN_REGION_IN;
+}
+
+bool
+_drm_atomic_add_output(struct drm_backend_state_t* drm, drmModeAtomicReq* req, struct vt_output_t* output, uint32_t* flags) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  if(drm_output->needs_modeset) {
+    if(!drm_output->mode_blob_id &&
+      drmModeCreatePropertyBlob(drm->drm_fd, &drm_output->mode, 
+                                sizeof(drm_output->mode), &drm_output->mode_blob_id) != 0) {
+      VT_ERROR(drm->comp->log, "Cannot create mode blob for output %p: %s", output, strerror(errno));
+      return false;
+    }
+    drmModeAtomicAddProperty(req, drm_output->conn_id, drm_output->conn_props.crtc_id, drm_output->crtc_id);
+    drmModeAtomicAddProperty(req, drm_output->crtc_id, drm_output->crtc_props.mode_id, drm_output->mode_blob_id);
+    drmModeAtomicAddProperty(req, drm_output->crtc_id, drm_output->crtc_props.active, 1);
+    *flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+  }
+  if((drm_output->vrr_dirty || drm_output->needs_modeset) && drm_output->crtc_props.vrr_enabled) {
+    drmModeAtomicAddProperty(req, drm_output->crtc_id, drm_output->crtc_props.vrr_enabled, drm_output->vrr_enabled);
+  }
+
+  const struct drm_plane_props_t* p = &drm_output->plane_props;
+  const uint32_t plane = drm_output->plane_id;
+  const uint32_t w = drm_output->mode.hdisplay, h = drm_output->mode.vdisplay;
+  drmModeAtomicAddProperty(req, plane, p->fb_id, drm_output->pending_fb);
+  drmModeAtomicAddProperty(req, plane, p->crtc_id, drm_output->crtc_id);
+  // Source coordinates are 16.16 fixed point
+  drmModeAtomicAddProperty(req, plane, p->src_x, 0);
+  drmModeAtomicAddProperty(req, plane, p->src_y, 0);
+  drmModeAtomicAddProperty(req, plane, p->src_w, (uint64_t)w << 16);
+  drmModeAtomicAddProperty(req, plane, p->src_h, (uint64_t)h << 16);
+  drmModeAtomicAddProperty(req, plane, p->crtc_x, 0);
+  drmModeAtomicAddProperty(req, plane, p->crtc_y, 0);
+  drmModeAtomicAddProperty(req, plane, p->crtc_w, w);
+  drmModeAtomicAddProperty(req, plane, p->crtc_h, h);
+
+  _drm_atomic_add_overlays(drm, req, output);
+
+  return true;
+}
+
+void
+_drm_atomic_add_overlays(struct drm_backend_state_t* drm, drmModeAtomicReq* req, struct vt_output_t* output) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  uint32_t mask = 0;
+  for(uint32_t i = 0; i < drm_output->n_pending_overlays; i++) {
+    const struct drm_overlay_t* o = &drm_output->pending_overlays[i];
+    const struct drm_plane_props_t* p = &o->plane->props;
+    const uint32_t plane = o->plane->id;
+    drmModeAtomicAddProperty(req, plane, p->fb_id, o->fb_id);
+    drmModeAtomicAddProperty(req, plane, p->crtc_id, drm_output->crtc_id);
+    drmModeAtomicAddProperty(req, plane, p->src_x, 0);
+    drmModeAtomicAddProperty(req, plane, p->src_y, 0);
+    drmModeAtomicAddProperty(req, plane, p->src_w, (uint64_t)o->w << 16);
+    drmModeAtomicAddProperty(req, plane, p->src_h, (uint64_t)o->h << 16);
+    drmModeAtomicAddProperty(req, plane, p->crtc_x, o->x);
+    drmModeAtomicAddProperty(req, plane, p->crtc_y, o->y);
+    drmModeAtomicAddProperty(req, plane, p->crtc_w, o->w);
+    drmModeAtomicAddProperty(req, plane, p->crtc_h, o->h);
+    mask |= 1u << (uint32_t)(o->plane - drm->overlays);
+  }
+
+  // Turn off the overlays that the output does not use anymore
+  for(uint32_t i = 0; i < drm->n_overlays; i++) {
+    if(!(drm_output->overlay_mask & (1u << i)) || (mask & (1u << i))) continue;
+    drmModeAtomicAddProperty(req, drm->overlays[i].id, drm->overlays[i].props.fb_id, 0);
+    drmModeAtomicAddProperty(req, drm->overlays[i].id, drm->overlays[i].props.crtc_id, 0);
+  }
+}
+
+bool
+_drm_can_flip_async(struct vt_output_t* output) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  struct drm_backend_state_t* drm = drm_output->drm_backend;
+  if(!output->tearing || drm_output->needs_modeset) return false;
+  if(!drm_output->atomic) return drm->async_flip_legacy;
+
+  // Async commits may only swap the FB of the primary plane
+  return drm->async_flip_atomic && !drm_output->vrr_dirty &&
+    !drm_output->n_pending_overlays && !drm_output->overlay_mask;
+}
+
+void
+_drm_reset_pending_overlays(struct drm_output_state_t* drm_output) {
+  for(uint32_t i = 0; i < drm_output->n_pending_overlays; i++) {
+    vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->pending_overlays[i].dmabuf);
+  }
+  drm_output->n_pending_overlays = 0;
+}
+
+void
+_drm_atomic_commit_for_device(void* data) {
+  struct drm_backend_state_t* drm = (struct drm_backend_state_t*)data;
+  struct vt_compositor_t* comp = drm->comp;
+  drm->commit_source = NULL;
+  if(drm->commit_deadline) {
+    struct itimerspec its = {0};
+    timerfd_settime(drm->commit_timer_fd, 0, &its, NULL);
+    drm->commit_deadline = 0;
+  }
+
+  drmModeAtomicReq* req = drmModeAtomicAlloc();
+  if(!req) {
+    VT_ERROR(comp->log, "drmModeAtomicAlloc() failed.");
+    return;
+  }
+
+  uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
+  uint32_t n_outputs = 0;
+  bool failed = false, async = drm->async_flip_atomic;
+
+  // 1. Gather the state of every output that staged a frame since the last commit
+  struct vt_output_t* output;
+  wl_list_for_each(output, &drm->outputs, link_local) {
+    struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+    if(!drm_output || !drm_output->commit_queued) continue;
+    if(!_drm_atomic_add_output(drm, req, output, &flags)) {
+      failed = true;
+      break;
+    }
+    // The flag applies to the whole commit, so every output in it has to want tearing
+    async = async && _drm_can_flip_async(output);
+    n_outputs++;
+  }
+
+  // 2. Validate layout changes before touching the hardware. A plain flip only 
+  // changes FB_ID on already validated planes so it does not need a test commit.
+  int ret = failed ? -1 : 0;
+  if(!failed && n_outputs && (flags & DRM_MODE_ATOMIC_ALLOW_MODESET)) {
+    ret = drmModeAtomicCommit(drm->drm_fd, req, 
+                              DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, drm);
+    if(ret != 0) {
+      VT_ERROR(comp->log, "Atomic test commit on device %s failed: %s", drm->dev->path, strerror(errno));
+    }
+  }
+
+  // 3. Commit all outputs in one go, flip events arrive per CRTC. Drivers
+  // refuse async commits they cannot do, those flips wait for vblank instead.
+  if(ret == 0 && n_outputs && async) {
+    ret = drmModeAtomicCommit(drm->drm_fd, req, flags | DRM_MODE_PAGE_FLIP_ASYNC, drm);
+    if(ret != 0) {
+      VT_TRACE(comp->log, "Async atomic commit on device %s refused: %s", drm->dev->path, strerror(errno));
+      async = false;
+    }
+  }
+  if(ret == 0 && n_outputs && !async) {
+    ret = drmModeAtomicCommit(drm->drm_fd, req, flags, drm);
+    if(ret != 0) {
+      VT_ERROR(comp->log, "Atomic commit on device %s failed: %s", drm->dev->path, strerror(errno));
+    } else {
+      VT_TRACE(comp->log, "Submitted atomic commit for %u output(s) on device %s.", n_outputs, drm->dev->path);
+    }
+  }
+
+  drmModeAtomicFree(req);
+
+  // 4. Update the per-output state according to the result
+  wl_list_for_each(output, &drm->outputs, link_local) {
+    struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+    if(!drm_output || !drm_output->commit_queued) continue;
+    drm_output->commit_queued = false;
+    if(ret != 0) {
+      // Commit refused; free pending and try again later
+      if(drm_output->pending_bo) {
+        gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->pending_bo);
+      }
+      vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->pending_dmabuf);
+      _drm_reset_pending_overlays(drm_output);
+      drm_output->pending_bo = NULL; drm_output->pending_fb = 0;
+      drm_output->pending_dmabuf = NULL;
+      drm_output->flip_inflight = false;
+      vt_comp_frame_discarded(comp, output);
+      continue;
+    }
+    drm_output->overlay_mask = 0;
+    for(uint32_t i = 0; i < drm_output->n_pending_overlays; i++) {
+      drm_output->overlay_mask |= 1u << (uint32_t)(drm_output->pending_overlays[i].plane - drm->overlays);
+    }
+    drm_output->vrr_dirty = false;
+    drm_output->flip_async = async;
+    if(drm_output->needs_modeset) {
+      VT_TRACE(comp->log, "Successfully performed atomic mode set for output %p (%ux%u@%.2f, ID: %i)", output,
+               output->width, output->height, output->refresh_rate, drm_output->conn_id);
+      drm_output->needs_modeset = false;
+      drm_output->modeset_bootstrapped = true;
+    }
+  }
+}
+
+void
+_drm_flush_staged_commit(struct drm_backend_state_t* drm) {
+  // Submit frames that are staged but whose commit did not run yet, 
+  // so that waiting on flip_inflight cannot block forever.
+  if(!drm->commit_source && !drm->commit_deadline) return;
+  if(drm->commit_source) wl_event_source_remove(drm->commit_source);
+  _drm_atomic_commit_for_device(drm);
+}
+
+uint64_t
+_drm_next_vblank(struct vt_output_t* output, uint64_t now) {
+  // Vblanks keep happening on the grid of the last one
+  uint64_t next = output->last_vblank_ns + output->refresh_ns;
+  if(next <= now) {
+    next += ((now - next) / output->refresh_ns + 1) * output->refresh_ns;
   }
+  return next;
+}
+
+uint64_t
+_drm_commit_deadline(struct drm_backend_state_t* drm, struct vt_output_t* output) {
+  // Frames that do not latch on a vblank have nothing to wait for
+  if(output->tearing || output->vrr_enabled || !output->refresh_ns || !output->last_vblank_ns) return 0;
+
+  uint64_t now = vt_util_get_time_nsec();
+  uint64_t vblank = _drm_next_vblank(output, now);
+  if(vblank <= now + _DRM_COMMIT_MARGIN_NS) return 0;
+
+  // Wait for the outputs of the device that are about to render 
+  // a frame for the same vblank, so that one commit takes them all.
+  struct vt_output_t* other;
+  wl_list_for_each(other, &drm->outputs, link_local) {
+    struct drm_output_state_t* drm_other = BACKEND_DATA(other, struct drm_output_state_t);
+    if(other == output || !drm_other || !drm_other->atomic) continue;
+    if(drm_other->commit_queued || drm_other->flip_inflight) continue;
+    if(other->frame_state != VT_OUTPUT_FRAME_SCHEDULED && 
+      other->frame_state != VT_OUTPUT_FRAME_RENDERING) continue;
+    if(other->tearing || other->vrr_enabled || !other->refresh_ns || !other->last_vblank_ns) continue;
+    uint64_t v = _drm_next_vblank(other, now);
+    uint64_t dist = v > vblank ? v - vblank : vblank - v;
+    if(dist < output->refresh_ns / 4) return vblank - _DRM_COMMIT_MARGIN_NS;
+  }
+  return 0;
+}
+
+void
+_drm_schedule_commit_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output) {
+  struct vt_compositor_t* comp = drm->comp;
+  if(drm->commit_source) return;
+
+  uint64_t deadline = _drm_commit_deadline(drm, output);
+  if(!deadline) {
+    drm->commit_source = wl_event_loop_add_idle(comp->wl.evloop, _drm_atomic_commit_for_device, drm);
+    return;
+  }
+  // Another staged output may already need the commit earlier
+  if(drm->commit_deadline && drm->commit_deadline <= deadline) return;
+
+  if(!drm->commit_timer) {
+    drm->commit_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    drm->commit_timer = drm->commit_timer_fd >= 0 ? 
+      wl_event_loop_add_fd(comp->wl.evloop, drm->commit_timer_fd, WL_EVENT_READABLE, _drm_commit_timer_handler, drm) : NULL;
+    if(!drm->commit_timer) {
+      VT_ERROR(comp->log, "Failed to create commit timer for device %s: %s", drm->dev->path, strerror(errno));
+      if(drm->commit_timer_fd >= 0) close(drm->commit_timer_fd);
+      drm->commit_timer_fd = -1;
+    }
+  }
+
+  struct itimerspec its = {0};
+  its.it_value.tv_sec = deadline / 1000000000ull;
+  its.it_value.tv_nsec = deadline % 1000000000ull;
+  if(!drm->commit_timer || timerfd_settime(drm->commit_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+    // Without a timer nothing guarantees the commit, so submit right away
+    drm->commit_source = wl_event_loop_add_idle(comp->wl.evloop, _drm_atomic_commit_for_device, drm);
+    return;
+  }
+  drm->commit_deadline = deadline;
+  VT_TRACE(comp->log, "Holding atomic commit on device %s for other outputs (%.3fms left).", 
+           drm->dev->path, (double)(deadline - vt_util_get_time_nsec()) / 1e6);
+}
+
+int
+_drm_commit_timer_handler(int fd, uint32_t mask, void* data) {
+  struct drm_backend_state_t* drm = (struct drm_backend_state_t*)data;
+  (void)mask;
+
+  uint64_t expirations;
+  if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return 0;
+  // An idle commit is already on its way
+  if(drm->commit_source) return 0;
+  _drm_atomic_commit_for_device(drm);
+  return 0;
 }
 
 void 
 _drm_release_all_scanout(struct vt_output_t* output) {
-  struct drm_backend_state_t* drm = BACKEND_DATA(output->backend, struct drm_backend_state_t);
   struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t) ;
 
-  // Basically release all used DRM scanout buffers  
+  // Basically release all used DRM scanout buffers. The FBs are removed 
+  // by _drm_fb_destroy_handler() once GBM destroys the BOs.
   if (drm_output->pending_bo) {
-    drmModeRmFB(drm->drm_fd, drm_output->pending_fb);
     gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->pending_bo);
     drm_output->pending_bo = NULL; drm_output->pending_fb = 0;
   }
   if (drm_output->current_bo) {
-    drmModeRmFB(drm->drm_fd, drm_output->current_fb);
     gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->current_bo);
     drm_output->current_bo = NULL; drm_output->current_fb = 0;
   }
   if (drm_output->prev_bo) {
-    drmModeRmFB(drm->drm_fd, drm_output->prev_fb);
     gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->prev_bo);
     drm_output->prev_bo = NULL; drm_output->prev_fb = 0;
   }
+  if (drm_output->older_bo) {
+    gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->older_bo);
+    drm_output->older_bo = NULL; drm_output->older_fb = 0;
+  }
+
+  // Hand directly scanned out client buffers back
+  vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->pending_dmabuf);
+  vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->current_dmabuf);
+  drm_output->pending_dmabuf = NULL;
+  drm_output->current_dmabuf = NULL;
+  _drm_reset_pending_overlays(drm_output);
+  for(uint32_t i = 0; i < drm_output->n_current_overlays; i++) {
+    vt_proto_linux_dmabuf_v1_buffer_unlock(drm_output->current_overlays[i].dmabuf);
+  }
+  drm_output->n_current_overlays = 0;
+  drm_output->pending_fb = 0;
+  drm_output->current_fb = 0;
+}
+
+void
+_drm_fb_destroy_handler(struct gbm_bo* bo, void* data) {
+  struct drm_fb_t* fb = (struct drm_fb_t*)data;
+  if(!fb) return;
+  if(fb->fb_id && fb->drm_fd >= 0) drmModeRmFB(fb->drm_fd, fb->fb_id);
+  free(fb);
+}
+
+uint32_t
+_drm_fb_from_bo(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_bo* bo) {
+  // GBM surfaces rotate a small set of BOs, so the FB is created once 
+  // per BO and kept in its user data until GBM destroys the BO.
+  struct drm_fb_t* fb = gbm_bo_get_user_data(bo);
+  if(fb) {
+    output->frame_stats.fb_cache_hits++;
+    return fb->fb_id;
+  }
+  output->frame_stats.fb_cache_misses++;
+
+  uint32_t w = gbm_bo_get_width(bo);
+  uint32_t h = gbm_bo_get_height(bo);
+  uint32_t fmt = gbm_bo_get_format(bo);
+  uint64_t modifier = gbm_bo_get_modifier(bo);
+  uint32_t handles[4] = { 0 }, strides[4] = { 0 }, offsets[4] = { 0 };
+  uint64_t mods[4] = { 0 };
+
+  int32_t n_planes = gbm_bo_get_plane_count(bo);
+  for (int32_t i = 0; i < n_planes && i < 4; i++) {
+    handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+    strides[i] = gbm_bo_get_stride_for_plane(bo, i);
+    offsets[i] = gbm_bo_get_offset(bo, i);
+    mods[i] = modifier;
+  }
+
+  uint32_t fb_id = 0;
+  int ret;
+  // If the BO wants modifiers, add the FB with modifier arguments
+  if (modifier != DRM_FORMAT_MOD_INVALID) {
+    ret = drmModeAddFB2WithModifiers(drm->drm_fd, w, h, fmt,
+                                     handles, strides, offsets, mods, &fb_id,
+                                     DRM_MODE_FB_MODIFIERS);
+  } else {
+    ret = drmModeAddFB2(drm->drm_fd, w, h, fmt,
+                        handles, strides, offsets, &fb_id, 0);
+  }
+  if (ret != 0) {
+    VT_ERROR(drm->comp->log, "cannot create DRM frame buffer: drmModeAddFB2(%ux%u, fmt=0x%08x) failed: %s",
+             w, h, fmt, strerror(errno));
+    return 0;
+  }
+
+  if(!(fb = calloc(1, sizeof(*fb)))) {
+    drmModeRmFB(drm->drm_fd, fb_id);
+    return 0;
+  }
+  fb->fb_id = fb_id;
+  fb->drm_fd = drm->drm_fd;
+  gbm_bo_set_user_data(bo, fb, _drm_fb_destroy_handler);
+
+  VT_TRACE(drm->comp->log, "Registered FB %u for BO %p.", fb_id, bo);
+
+  return fb_id;
+}
+
+void
+_drm_prime_buffer_destroy_handler(struct gbm_bo* bo, void* data) {
+  (void)bo;
+  struct drm_prime_buffer_t* prime = (struct drm_prime_buffer_t*)data;
+  if(!prime) return;
+  // Takes the FB cached on the imported BO with it
+  if(prime->imported) gbm_bo_destroy(prime->imported);
+  free(prime);
+}
+
+uint32_t
+_drm_prime_fb_from_bo(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_bo* bo) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  if(drm_output->prime_copy) return _drm_prime_copy_bo(drm, output, bo);
+
+  // Like the FB cache, every BO of the GBM surface is imported only once
+  struct drm_prime_buffer_t* prime = gbm_bo_get_user_data(bo);
+  if(prime) return _drm_fb_from_bo(drm, output, prime->imported);
+
+  struct gbm_import_fd_modifier_data data = {
+    .width = gbm_bo_get_width(bo),
+    .height = gbm_bo_get_height(bo),
+    .format = gbm_bo_get_format(bo),
+    .modifier = gbm_bo_get_modifier(bo),
+  };
+  int32_t n_planes = gbm_bo_get_plane_count(bo);
+  int32_t fd = gbm_bo_get_fd(bo);
+  data.num_fds = n_planes > 4 ? 4 : n_planes;
+  for(uint32_t i = 0; i < data.num_fds; i++) {
+    data.fds[i] = fd;
+    data.strides[i] = gbm_bo_get_stride_for_plane(bo, i);
+    data.offsets[i] = gbm_bo_get_offset(bo, i);
+  }
+
+  struct gbm_bo* imported = fd >= 0 ? 
+    gbm_bo_import(drm->gbm_dev, GBM_BO_IMPORT_FD_MODIFIER, &data, GBM_BO_USE_SCANOUT) : NULL;
+  if(fd >= 0) close(fd);
+
+  uint32_t fb = imported ? _drm_fb_from_bo(drm, output, imported) : 0;
+  // Importing and adding the FB can succeed for buffers the CRTC cannot scan out
+  if(fb && BACKEND_DATA(output, struct drm_output_state_t)->atomic && !_drm_test_scanout_fb(drm, output, gbm_bo_get_user_data(imported))) fb = 0;
+  if(!fb || !(prime = calloc(1, sizeof(*prime)))) {
+    if(imported) gbm_bo_destroy(imported);
+    // The secondary device cannot scan out memory of the main device
+    VT_WARN(drm->comp->log, "Cannot scan out PRIME buffer on device %s, copying frames of output %p instead.", 
+            drm->dev->path, output);
+    drm_output->prime_copy = true;
+    return _drm_prime_copy_bo(drm, output, bo);
+  }
+  prime->imported = imported;
+  gbm_bo_set_user_data(bo, prime, _drm_prime_buffer_destroy_handler);
+
+  VT_TRACE(drm->comp->log, "Imported BO %p of the main device into device %s (FB %u).", bo, drm->dev->path, fb);
+  return fb;
+}
+
+uint32_t
+_drm_prime_copy_bo(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_bo* bo) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  const uint32_t w = gbm_bo_get_width(bo), h = gbm_bo_get_height(bo);
+
+  // Only one flip is in flight, so the buffer after the one on screen is free
+  struct drm_dumb_buffer_t* dst = &drm_output->prime_copies[drm_output->prime_copy_idx];
+  if(!dst->map && !_drm_create_dumb_buffer(drm, dst, w, h, gbm_bo_get_format(bo))) return 0;
+
+  uint32_t src_stride = 0;
+  void* map_data = NULL;
+  uint8_t* src = gbm_bo_map(bo, 0, 0, w, h, GBM_BO_TRANSFER_READ, &src_stride, &map_data);
+  if(!src) {
+    VT_ERROR(drm->comp->log, "Cannot map BO %p of output %p for copying: %s", bo, output, strerror(errno));
+    return 0;
+  }
+  const uint32_t row = w * (vt_util_drm_format_bpp(gbm_bo_get_format(bo)) / 8);
+  for(uint32_t y = 0; y < h; y++) {
+    memcpy((uint8_t*)dst->map + (uint64_t)y * dst->stride, src + (uint64_t)y * src_stride, row);
+  }
+  gbm_bo_unmap(bo, map_data);
+
+  drm_output->prime_copy_idx = (drm_output->prime_copy_idx + 1) % _DRM_PRIME_COPY_BUFFERS;
+  return dst->fb_id;
+}
+
+bool
+_drm_create_dumb_buffer(struct drm_backend_state_t* drm, struct drm_dumb_buffer_t* buf, uint32_t width, uint32_t height, uint32_t format) {
+  const uint32_t bpp = vt_util_drm_format_bpp(format);
+  if(!bpp) {
+    VT_ERROR(drm->comp->log, "Cannot create dumb buffer on device %s for format 0x%08x.", drm->dev->path, format);
+    return false;
+  }
+  if(drmModeCreateDumbBuffer(drm->drm_fd, width, height, bpp, 0, &buf->handle, &buf->stride, &buf->size) != 0) {
+    VT_ERROR(drm->comp->log, "Cannot create %ux%u dumb buffer on device %s: %s", width, height, drm->dev->path, strerror(errno));
+    return false;
+  }
+
+  uint32_t handles[4] = { buf->handle }, strides[4] = { buf->stride }, offsets[4] = { 0 };
+  uint64_t offset = 0;
+  if(drmModeAddFB2(drm->drm_fd, width, height, format, handles, strides, offsets, &buf->fb_id, 0) != 0 ||
+    drmModeMapDumbBuffer(drm->drm_fd, buf->handle, &offset) != 0) {
+    VT_ERROR(drm->comp->log, "Cannot set up dumb buffer on device %s: %s", drm->dev->path, strerror(errno));
+    _drm_destroy_dumb_buffer(drm, buf);
+    return false;
+  }
+
+  buf->map = mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, drm->drm_fd, offset);
+  if(buf->map == MAP_FAILED) {
+    buf->map = NULL;
+    VT_ERROR(drm->comp->log, "Cannot map dumb buffer on device %s: %s", drm->dev->path, strerror(errno));
+    _drm_destroy_dumb_buffer(drm, buf);
+    return false;
+  }
+  return true;
+}
+
+void
+_drm_destroy_dumb_buffer(struct drm_backend_state_t* drm, struct drm_dumb_buffer_t* buf) {
+  if(buf->map) munmap(buf->map, buf->size);
+  if(buf->fb_id) drmModeRmFB(drm->drm_fd, buf->fb_id);
+  if(buf->handle) drmModeDestroyDumbBuffer(drm->drm_fd, buf->handle);
+  memset(buf, 0, sizeof(*buf));
+}
+
+bool
+_drm_create_render_bos(struct drm_backend_state_t* drm, struct vt_output_t* output, struct gbm_device* gbm_dev, uint32_t format) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  const uint32_t w = drm_output->mode.hdisplay, h = drm_output->mode.vdisplay;
+
+  // Modifiers the primary plane can scan out, PRIME buffers have to be linear
+  uint64_t* mods = NULL;
+  uint32_t n_mods = 0;
+  struct vt_dmabuf_drm_format_t* fmt;
+  if(!drm_output->prime) {
+    wl_array_for_each(fmt, &drm_output->scanout_formats) {
+      if(fmt->format != format || !fmt->len) continue;
+      if(!(mods = calloc(fmt->len, sizeof(*mods)))) break;
+      for(size_t i = 0; i < fmt->len; i++) {
+        if(fmt->mods[i].mod != DRM_FORMAT_MOD_INVALID) mods[n_mods++] = fmt->mods[i].mod;
+      }
+      break;
+    }
+  }
+
+  bool ok = true;
+  for(uint32_t i = 0; i < 2 && ok; i++) {
+    struct gbm_bo* bo = n_mods ? 
+      gbm_bo_create_with_modifiers2(gbm_dev, w, h, format, mods, n_mods, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING) : NULL;
+    bool linear = !bo;
+    if(!bo) {
+      bo = gbm_bo_create(gbm_dev, w, h, format, drm_output->prime ? 
+                         GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING : 
+                         GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+    }
+    if(!bo) {
+      VT_ERROR(drm->comp->log, "Cannot create %ux%u render buffer for output %p: %s", w, h, output, strerror(errno));
+      ok = false;
+      break;
+    }
+    drm_output->bos[i] = bo;
+
+    // The renderer imports the buffer with an explicit layout
+    struct vt_renderer_dmabuf_target_t* target = &drm_output->bo_targets[i];
+    memset(target, 0, sizeof(*target));
+    target->id = i + 1;
+    target->attr.width = w;
+    target->attr.height = h;
+    target->attr.format = format;
+    target->attr.mod = linear ? DRM_FORMAT_MOD_LINEAR : gbm_bo_get_modifier(bo);
+    target->attr.num_planes = gbm_bo_get_plane_count(bo);
+    if(target->attr.num_planes > VT_DMABUF_PLANES_CAP) target->attr.num_planes = VT_DMABUF_PLANES_CAP;
+    int32_t fd = gbm_bo_get_fd(bo);
+    for(int32_t j = 0; j < target->attr.num_planes; j++) {
+      target->attr.fds[j] = fd;
+      target->attr.strides[j] = gbm_bo_get_stride_for_plane(bo, j);
+      target->attr.offsets[j] = gbm_bo_get_offset(bo, j);
+    }
+    if(fd < 0) {
+      VT_ERROR(drm->comp->log, "Cannot export render buffer of output %p.", output);
+      ok = false;
+    }
+  }
+  free(mods);
+
+  if(!ok) _drm_destroy_render_bos(output);
+  return ok;
+}
+
+void
+_drm_destroy_render_bos(struct vt_output_t* output) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  for(uint32_t i = 0; i < 2; i++) {
+    // The FB goes together with the BO
+    if(drm_output->bos[i]) gbm_bo_destroy(drm_output->bos[i]);
+    if(drm_output->bo_targets[i].attr.num_planes && drm_output->bo_targets[i].attr.fds[0] >= 0) {
+      close(drm_output->bo_targets[i].attr.fds[0]);
+    }
+    drm_output->bos[i] = NULL;
+    drm_output->bo_fbs[i] = 0;
+    memset(&drm_output->bo_targets[i], 0, sizeof(drm_output->bo_targets[i]));
+  }
+}
+
+void
+_drm_dmabuf_fb_destroy_handler(struct vt_linux_dmabuf_v1_buffer_t* buf, void* data) {
+  (void)buf;
+  struct drm_fb_t* fb = (struct drm_fb_t*)data;
+  if(!fb) return;
+  if(fb->fb_id && fb->drm_fd >= 0) drmModeRmFB(fb->drm_fd, fb->fb_id);
+  free(fb);
+}
+
+struct drm_fb_t*
+_drm_fb_from_dmabuf(struct drm_backend_state_t* drm, struct vt_output_t* output, struct vt_linux_dmabuf_v1_buffer_t* buf) {
+  // Clients cycle through a small swapchain as well, so the FB is
+  // kept on the buffer until the client destroys it.
+  struct drm_fb_t* fb = buf->user_data;
+  if(fb) {
+    // Buffers the device could not add an FB for are not tried again
+    if(fb->drm_fd != drm->drm_fd || !fb->fb_id) return NULL;
+    output->frame_stats.fb_cache_hits++;
+    return fb;
+  }
+  output->frame_stats.fb_cache_misses++;
+
+  const struct vt_dmabuf_attr_t* a = &buf->attr;
+  uint32_t handles[4] = { 0 };
+  uint64_t mods[4] = { 0 };
+
+  // Import the planes as GEM handles on the KMS device
+  bool imported = true;
+  for (int32_t i = 0; i < a->num_planes && i < 4; i++) {
+    if (drmPrimeFDToHandle(drm->drm_fd, a->fds[i], &handles[i]) != 0) {
+      VT_WARN(drm->comp->log, "Cannot import plane %i of DMABUF %p for scanout: %s", i, buf, strerror(errno));
+      imported = false;
+      break;
+    }
+    mods[i] = a->mod;
+  }
+
+  uint32_t fb_id = 0;
+  int ret = -1;
+  if (imported) {
+    if (a->mod != DRM_FORMAT_MOD_INVALID) {
+      ret = drmModeAddFB2WithModifiers(drm->drm_fd, a->width, a->height, a->format,
+                                       handles, a->strides, a->offsets, mods, &fb_id,
+                                       DRM_MODE_FB_MODIFIERS);
+    } else {
+      ret = drmModeAddFB2(drm->drm_fd, a->width, a->height, a->format,
+                          handles, a->strides, a->offsets, &fb_id, 0);
+    }
+    if (ret != 0) {
+      VT_WARN(drm->comp->log, "Cannot create DRM frame buffer for DMABUF %p (%ix%i, fmt=0x%08x): %s",
+              buf, a->width, a->height, a->format, strerror(errno));
+    }
+  }
+
+  // The FB holds its own reference on the buffer, planes
+  // can share one handle so every handle is closed only once.
+  for (int32_t i = 0; i < a->num_planes && i < 4; i++) {
+    if (!handles[i]) continue;
+    bool closed = false;
+    for (int32_t j = 0; j < i; j++) {
+      if (handles[j] == handles[i]) closed = true;
+    }
+    if (!closed) drmCloseBufferHandle(drm->drm_fd, handles[i]);
+  }
+
+  if(!(fb = calloc(1, sizeof(*fb)))) {
+    if (ret == 0) drmModeRmFB(drm->drm_fd, fb_id);
+    return NULL;
+  }
+  fb->drm_fd = drm->drm_fd;
+  if (ret != 0) {
+    // Remember the failure for as long as the buffer lives
+    vt_proto_linux_dmabuf_v1_buffer_set_user_data(buf, fb, _drm_dmabuf_fb_destroy_handler);
+    return NULL;
+  }
+  fb->fb_id = fb_id;
+  fb->drm_fd = drm->drm_fd;
+  vt_proto_linux_dmabuf_v1_buffer_set_user_data(buf, fb, _drm_dmabuf_fb_destroy_handler);
+
+  VT_TRACE(drm->comp->log, "Registered FB %u for client DMABUF %p.", fb_id, buf);
+
+  return fb;
+}
+
+bool
+_drm_test_scanout_fb(struct drm_backend_state_t* drm, struct vt_output_t* output, struct drm_fb_t* fb) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  // The result only changes with the CRTC the buffer is shown on
+  if(fb->tested_crtc_id == drm_output->crtc_id) return fb->test_passed;
+
+  drmModeAtomicReq* req = drmModeAtomicAlloc();
+  if(!req) return false;
+
+  uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY;
+  drm_output->pending_fb = fb->fb_id;
+  bool passed = _drm_atomic_add_output(drm, req, output, &flags) &&
+    drmModeAtomicCommit(drm->drm_fd, req, flags, NULL) == 0;
+  drm_output->pending_fb = 0;
+  drmModeAtomicFree(req);
+
+  fb->tested_crtc_id = drm_output->crtc_id;
+  fb->test_passed = passed;
+
+  VT_TRACE(drm->comp->log, "Direct scanout test of FB %u on CRTC %u %s.",
+           fb->fb_id, drm_output->crtc_id, passed ? "passed" : "failed");
+  return passed;
+}
+
+bool
+_drm_queue_flip_for_output(struct drm_backend_state_t* drm, struct vt_output_t* output) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  struct vt_compositor_t* comp = drm->comp;
+
+  if (drm_output->flip_inflight) {
+    // compositor.c keeps frames from being submitted while one is in flight, 
+    // another flip now would replace the pending one before it reached the screen.
+    VT_ERROR(comp->log, "Dropping flip on output %p, the previous one is still in flight.", output);
+    output->frame_stats.dropped_flips++;
+    return false;
+  }
+
+  if (drm_output->atomic) {
+    // Stage the frame, it is submitted together with all other
+    // outputs of this device in _drm_atomic_commit_for_device().
+    drm_output->commit_queued = true;
+    drm_output->flip_inflight = true;
+    _drm_schedule_commit_for_device(drm, output);
+    return true;
+  }
+
+  // Legacy flips on atomic devices report through the atomic handler, which finds the output by CRTC
+  void* flip_data = drm->atomic ? (void*)drm : (void*)output;
+
+  // Try to flip right away if the output tears, drivers may still refuse 
+  // async flips (e.g. when the buffer layout changes), so fall back to vblank.
+  bool async = _drm_can_flip_async(output);
+  if(async &&
+    drmModePageFlip(drm->drm_fd, drm_output->crtc_id, drm_output->pending_fb,
+                    DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_PAGE_FLIP_ASYNC, flip_data) != 0) {
+    VT_TRACE(comp->log, "Async page flip refused: %s", strerror(errno));
+    async = false;
+  }
+  if(!async &&
+    drmModePageFlip(drm->drm_fd, drm_output->crtc_id, drm_output->pending_fb,
+                    DRM_MODE_PAGE_FLIP_EVENT, flip_data) != 0) {
+    VT_ERROR(comp->log, "cannot do a page flip: drmModePageFlip() failed: %s",
+             strerror(errno));
+    return false;
+  }
+  VT_TRACE(comp->log, "Successfully performed drmModePageFlip() call.");
+
+  drm_output->flip_inflight = true;
+  drm_output->flip_async = async;
+  return true;
 }
 
 static bool _drm_devices_equal(drmDevicePtr a, drmDevicePtr b) {
@@ -417,6 +1653,10 @@ _drm_build_dmabuf_feedback(
     _log_dmabuf_tranche(master->comp, tranche, dev->path);
 
   }
+
+  // Buffers that the main device can scan out directly are preferred over everything else
+  _drm_add_scanout_tranche(master, feedback);
+
   // Adding a generic fallback tranche (LINEAR DRM_FORMAT_ARGB8888) 
   struct vt_dmabuf_tranche_t* fallback = wl_array_add(&feedback->tranches, sizeof(*fallback));
 
@@ -450,15 +1690,84 @@ _drm_build_dmabuf_feedback(
   return true;
 }
 
+bool
+_drm_add_scanout_tranche(struct drm_backend_master_state_t* master, struct vt_dmabuf_feedback_t* feedback) {
+  struct drm_backend_state_t* drm = master->main_drm;
+  // Direct scanout needs test commits, see _drm_scanout_surface_for_device()
+  if(!drm || !drm->atomic) return false;
+
+  struct vt_dmabuf_tranche_t* render = NULL, *t;
+  wl_array_for_each(t, &feedback->tranches) {
+    if(t->target_device == drm->dev) {
+      render = t;
+      break;
+    }
+  }
+  if(!render) return false;
+
+  struct vt_dmabuf_tranche_t scanout = {
+    .target_device = drm->dev,
+    .flags = VT_DMABUF_TRANCHE_FLAG_DIRECT_SCANOUT,
+  };
+  wl_array_init(&scanout.formats);
+
+  // Only advertise what the renderer can import and every output of the device can scan out
+  struct vt_dmabuf_drm_format_t* fmt;
+  wl_array_for_each(fmt, &render->formats) {
+    struct vt_dmabuf_drm_format_t add = {
+      .format = fmt->format,
+      .len = 0,
+      .mods = calloc(fmt->len ? fmt->len : 1, sizeof(*add.mods)),
+    };
+    if(!add.mods) continue;
+    for(size_t i = 0; i < fmt->len; i++) {
+      if(fmt->mods[i]._egl_ext_only) continue;
+      bool supported = true;
+      struct vt_output_t* output;
+      wl_list_for_each(output, &drm->outputs, link_local) {
+        struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+        if(!_drm_format_set_has(&drm_output->scanout_formats, fmt->format, fmt->mods[i].mod)) {
+          supported = false;
+          break;
+        }
+      }
+      if(supported) add.mods[add.len++] = fmt->mods[i];
+    }
+    struct vt_dmabuf_drm_format_t* dst = add.len ? wl_array_add(&scanout.formats, sizeof(*dst)) : NULL;
+    if(!dst) {
+      free(add.mods);
+      continue;
+    }
+    *dst = add;
+  }
+
+  if(!scanout.formats.size || !wl_array_add(&feedback->tranches, sizeof(scanout))) {
+    wl_array_for_each(fmt, &scanout.formats) {
+      free(fmt->mods);
+    }
+    wl_array_release(&scanout.formats);
+    return false;
+  }
+
+  // Tranches are sent in order of preference, so the scanout tranche goes first
+  // and the render tranche of the device no longer claims to be scanout capable.
+  memmove((uint8_t*)feedback->tranches.data + sizeof(scanout), feedback->tranches.data,
+          feedback->tranches.size - sizeof(scanout));
+  memcpy(feedback->tranches.data, &scanout, sizeof(scanout));
+  wl_array_for_each(t, &feedback->tranches) {
+    if(t != feedback->tranches.data && t->target_device == drm->dev) t->flags = 0;
+  }
+
+  _log_dmabuf_tranche(master->comp, &scanout, drm->dev->path);
+  return true;
+}
+
 bool 
 _drm_suspend(struct drm_backend_state_t* backend) {
   if (!backend)
     return false;
-  if (backend->comp->suspended)
-    return true;
 
-  backend->comp->suspended = true;
-  VT_TRACE(backend->comp->log, "Suspending seat session (VT switch away)...");
+  VT_TRACE(backend->comp->log, "Suspending device %s (VT switch away)...", backend->dev->path);
 
   // we stop submitting new flips immediately
   struct vt_output_t* output;
@@ -466,6 +1775,8 @@ _drm_suspend(struct drm_backend_state_t* backend) {
     output->needs_repaint = false;
   }
 
+  _drm_flush_staged_commit(backend);
+
   // Drain any in-flight page flips 
   bool any_inflight;
   do {
@@ -506,11 +1817,8 @@ bool
 _drm_resume(struct drm_backend_state_t* backend) {
   if (!backend)
     return false;
-  if (!backend->comp->suspended)
-    return true;
 
-  backend->comp->suspended = false;
-  VT_TRACE(backend->comp->log, "Resuming seat session (VT switch back)...");
+  VT_TRACE(backend->comp->log, "Resuming device %s (VT switch back)...", backend->dev->path);
 
 
   struct vt_output_t* output;
@@ -519,7 +1827,7 @@ _drm_resume(struct drm_backend_state_t* backend) {
       continue;
 
     struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
-    if (!drm_output->current_bo || drm_output->current_fb == 0)
+    if (drm_output->current_fb == 0)
       continue;
 
     VT_TRACE(backend->comp->log,
@@ -528,7 +1836,10 @@ _drm_resume(struct drm_backend_state_t* backend) {
 
     // libseat has already called drmSetMaster() for us.
     // we can safely re-enable CRTCs and resume rendering.
-    if (drmModeSetCrtc(backend->drm_fd, drm_output->crtc_id,
+    if (drm_output->atomic) {
+      // The next atomic commit restores the mode together with a fresh frame
+      drm_output->needs_modeset = true;
+    } else if (drmModeSetCrtc(backend->drm_fd, drm_output->crtc_id,
                        drm_output->current_fb, 0, 0,
                        &drm_output->conn_id, 1, &drm_output->mode) != 0) {
       VT_ERROR(backend->comp->log,
@@ -560,6 +1871,9 @@ _drm_resume(struct drm_backend_state_t* backend) {
     vt_comp_schedule_repaint(backend->comp, output);
   }
 
+  // Another DRM master might have used the cursor planes meanwhile
+  vt_comp_update_cursor(backend->comp);
+
   uint32_t t = vt_util_get_time_msec();
   vt_comp_frame_done_all(backend->comp, t);
   wl_display_flush_clients(backend->comp->wl.dsp);
@@ -594,8 +1908,29 @@ bool _drm_init_for_device(struct vt_compositor_t* comp, struct drm_backend_state
 
   VT_TRACE(comp->log, "Successfully created GBM device on FD: %i", drm->drm_fd);  
 
+  // Prefer atomic modesetting, VT_DRM_NO_ATOMIC forces the legacy path
+  drm->commit_timer_fd = -1;
+  drm->atomic = !getenv("VT_DRM_NO_ATOMIC") &&
+    drmSetClientCap(drm->drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) == 0 &&
+    drmSetClientCap(drm->drm_fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+  VT_TRACE(comp->log, "Using %s modesetting on GPU %s.", drm->atomic ? "atomic" : "legacy", dev->path);
+
+  uint64_t cap = 0;
+  drm->monotonic_timestamps = drmGetCap(drm->drm_fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap) == 0 && cap;
+  cap = 0;
+  drm->async_flip_legacy = drmGetCap(drm->drm_fd, DRM_CAP_ASYNC_PAGE_FLIP, &cap) == 0 && cap;
+  cap = 0;
+  drm->async_flip_atomic = drm->atomic && 
+    drmGetCap(drm->drm_fd, DRM_CAP_ATOMIC_ASYNC_PAGE_FLIP, &cap) == 0 && cap;
+
+  if(drmGetCap(drm->drm_fd, DRM_CAP_CURSOR_WIDTH, &drm->cursor_width) != 0 || !drm->cursor_width) 
+    drm->cursor_width = 64;
+  if(drmGetCap(drm->drm_fd, DRM_CAP_CURSOR_HEIGHT, &drm->cursor_height) != 0 || !drm->cursor_height) 
+    drm->cursor_height = 64;
+
   drm->evctx.version = DRM_EVENT_CONTEXT_VERSION;
   drm->evctx.page_flip_handler = _drm_page_flip_handler;
+  drm->evctx.page_flip_handler2 = drm->atomic ? _drm_page_flip_handler_atomic : NULL;
   drm->evctx.vblank_handler = NULL;
 
   drm->event_source = wl_event_loop_add_fd(comp->wl.evloop, drm->drm_fd, WL_EVENT_READABLE, _drm_dispatch, drm);
@@ -613,79 +1948,224 @@ bool _drm_init_for_device(struct vt_compositor_t* comp, struct drm_backend_state
     VT_TRACE(comp->log, "Chose DRM main device: GPU %s (FD: %i).", dev->path, drm->drm_fd);
   }
 
-  _drm_init_active_outputs_for_device(drm);
-
   VT_TRACE(comp->log, "Successfully initialized DRM/KMS backend for GPU %s (FD: %i).", dev->path, drm->drm_fd);
 
-  return true;
+  return true;
+}
+
+bool 
+_drm_init_active_outputs_for_device(struct drm_backend_state_t* drm) {
+  if(!drm) return false;
+  struct vt_compositor_t* comp = drm->comp;
+
+  VT_TRACE(comp->log, "Initializing active outputs.");
+
+  if (!comp->renderer || !comp->renderer->impl.setup_renderable_output) {
+    VT_ERROR(comp->log, "Renderer backend not initialized before output setup.");
+    return false;
+  }
+
+
+  drm->res = drmModeGetResources(drm->drm_fd);
+  if (!drm->res) {
+    VT_ERROR(comp->log, "drmModeGetResources() failed: %s", strerror(errno));
+    return false;
+  }
+
+  if (drm->atomic) {
+    _drm_init_overlays_for_device(drm);
+  }
+
+  for (int i = 0; i < drm->res->count_connectors; i++) {
+    drmModeConnector *conn = drmModeGetConnector(drm->drm_fd, drm->res->connectors[i]);
+    if (!conn) continue;
+    if (conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0) {
+      _drm_add_output_for_connector(drm, conn);
+    }
+    drmModeFreeConnector(conn);
+  }
+
+  if (wl_list_empty(&drm->outputs)) {
+    VT_ERROR(comp->log, "No connected connector found");
+    drmModeFreeResources(drm->res);
+    return false;
+  }
+
+  return true;
+}
+
+struct vt_output_t* 
+_drm_add_output_for_connector(struct drm_backend_state_t* drm, drmModeConnector* conn) {
+  struct vt_compositor_t* comp = drm->comp;
+
+  // Outputs come and go with hotplug, so they live outside the arena
+  struct vt_output_t* output = calloc(1, sizeof(struct vt_output_t));
+  if (!output) {
+    VT_ERROR(comp->log, "allocation failed for output.");
+    return NULL;
+  }
+  output->needs_damage_rebuild = true;
+  wl_list_init(&output->link_local);
+  wl_list_init(&output->link_global);
+  pixman_region32_init(&output->damage);
+  output->backend = comp->backend;
+  if (!_drm_create_output_for_device(drm, output, conn)) {
+    VT_ERROR(comp->log, "Failed to setup internal DRM output output.");
+    if(!_drm_destroy_output_for_device(drm, output)) {
+      pixman_region32_fini(&output->damage);
+      free(output);
+    }
+    return NULL;
+  } 
+  if(!comp->renderer->impl.setup_renderable_output(comp->renderer, output)) {
+    VT_ERROR(comp->log, "Failed to setup renderable output for DRM output (%ix%i@%.2f)",
+             output->width, output->height, output->refresh_rate);
+    _drm_destroy_output_for_device(drm, output);
+    return NULL;
+  }
+  return output;
 }
 
-bool 
-_drm_init_active_outputs_for_device(struct drm_backend_state_t* drm) {
+bool
+_drm_update_outputs_for_device(struct drm_backend_state_t* drm) {
   if(!drm) return false;
   struct vt_compositor_t* comp = drm->comp;
 
-  VT_TRACE(comp->log, "Initializing active outputs.");
+  VT_TRACE(comp->log, "Re-probing connectors of device %s.", drm->dev->path);
 
-  if (!comp->renderer || !comp->renderer->impl.setup_renderable_output) {
-    VT_ERROR(comp->log, "Renderer backend not initialized before output setup.");
+  drmModeRes* res = drmModeGetResources(drm->drm_fd);
+  if (!res) {
+    VT_ERROR(comp->log, "drmModeGetResources() failed: %s", strerror(errno));
     return false;
   }
+  if (drm->res) drmModeFreeResources(drm->res);
+  drm->res = res;
 
-
-  drm->res = drmModeGetResources(drm->drm_fd);
-  if (!drm->res) {
-    VT_ERROR(comp->log, "drmModeGetResources() failed: %s", strerror(errno));
-    return false;
+  /* 1. Remove the outputs whose connector went away */
+  bool changed = false;
+  struct vt_output_t *output, *tmp;
+  wl_list_for_each_safe(output, tmp, &drm->outputs, link_local) {
+    struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+    drmModeConnector* conn = drmModeGetConnector(drm->drm_fd, drm_output->conn_id);
+    bool connected = conn && conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0;
+    if (conn) drmModeFreeConnector(conn);
+    if (connected) continue;
+
+    VT_TRACE(comp->log, "Connector %u of device %s got disconnected.", drm_output->conn_id, drm->dev->path);
+    _drm_remove_output_for_device(drm, output);
+    changed = true;
   }
 
+  /* 2. Create outputs for newly connected connectors, the layout 
+   * places them without moving the other outputs. */
   for (int i = 0; i < drm->res->count_connectors; i++) {
+    bool known = false;
+    wl_list_for_each(output, &drm->outputs, link_local) {
+      if (BACKEND_DATA(output, struct drm_output_state_t)->conn_id == drm->res->connectors[i]) {
+        known = true;
+        break;
+      }
+    }
+    if (known) continue;
+
     drmModeConnector *conn = drmModeGetConnector(drm->drm_fd, drm->res->connectors[i]);
     if (!conn) continue;
     if (conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0) {
-      struct vt_output_t* output = VT_ALLOC(comp, sizeof(struct vt_output_t));
-      output->needs_damage_rebuild = true;
-      wl_list_init(&output->link_local);
-      wl_list_init(&output->link_global);
-      if (!output) {
-        VT_ERROR(comp->log, "allocation failed for output.");
-        drmModeFreeConnector(conn);
-        continue;
-      }
-      pixman_region32_init(&output->damage);
-      output->backend = comp->backend;
-      if (!_drm_create_output_for_device(drm, output, conn)) {
-        VT_ERROR(comp->log, "Failed to setup internal DRM output output.");
-        _drm_destroy_output_for_device(drm, output);
-        drmModeFreeConnector(conn);
-        continue;
-      } 
-      if(!comp->renderer->impl.setup_renderable_output(comp->renderer, output)) {
-        VT_ERROR(comp->log, "Failed to setup renderable output for DRM output (%ix%i@%.2f)",
-                 output->width, output->height, output->refresh_rate);
-        _drm_destroy_output_for_device(drm, output);
-        drmModeFreeConnector(conn);
-        continue;
+      VT_TRACE(comp->log, "Connector %u of device %s got connected.", conn->connector_id, drm->dev->path);
+      struct vt_output_t* added = _drm_add_output_for_connector(drm, conn);
+      if (added) {
+        vt_comp_output_layout_changed(comp, added);
+        changed = true;
       }
     }
     drmModeFreeConnector(conn);
   }
 
-  if (wl_list_empty(&drm->outputs)) {
-    VT_ERROR(comp->log, "No connected connector found");
-    drmModeFreeResources(drm->res);
+  /* 3. New outputs need the cursor on their planes too */
+  if (changed) vt_comp_update_cursor(comp);
+
+  return true;
+}
+
+void
+_drm_remove_output_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output) {
+  struct vt_compositor_t* comp = drm->comp;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  // The flip events of the output need to arrive before its state is gone
+  output->needs_repaint = false;
+  _drm_flush_staged_commit(drm);
+  while (drm_output->flip_inflight) {
+    if (drmHandleEvent(drm->drm_fd, &drm->evctx) != 0) break;
+  }
+
+  VT_TRACE(comp->log, "Disabling CRTC %u for connector %u.", drm_output->crtc_id, drm_output->conn_id);
+  if(!drm_output->atomic || !_drm_atomic_disable_output(drm, output)) {
+    drmModeSetCrtc(drm->drm_fd, drm_output->crtc_id, 0, 0, 0, NULL, 0, NULL);
+  }
+
+  _drm_destroy_output_for_device(drm, output);
+}
+
+bool
+_drm_atomic_disable_output(struct drm_backend_state_t* drm, struct vt_output_t* output) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  int fd = drm->drm_fd;
+
+  drmModeAtomicReq* req = drmModeAtomicAlloc();
+  if(!req) {
+    VT_ERROR(drm->comp->log, "drmModeAtomicAlloc() failed.");
     return false;
   }
 
+  drmModeAtomicAddProperty(req, drm_output->crtc_id, drm_output->crtc_props.active, 0);
+  drmModeAtomicAddProperty(req, drm_output->crtc_id, drm_output->crtc_props.mode_id, 0);
+  drmModeAtomicAddProperty(req, drm_output->conn_id, drm_output->conn_props.crtc_id, 0);
+
+  // The kernel refuses to turn off a CRTC that still has planes on it. Besides
+  // the primary plane and our overlays that includes the cursor plane, which
+  // is driven through the legacy cursor API and so has no cached properties.
+  drmModePlaneRes* plane_res = drmModeGetPlaneResources(fd);
+  if(plane_res) {
+    for(uint32_t i = 0; i < plane_res->count_planes; i++) {
+      drmModePlane* plane = drmModeGetPlane(fd, plane_res->planes[i]);
+      if(!plane) continue;
+      struct drm_plane_props_t props = {0};
+      if(plane->crtc_id == drm_output->crtc_id && _drm_get_plane_props(fd, plane->plane_id, &props)) {
+        drmModeAtomicAddProperty(req, plane->plane_id, props.crtc_id, 0);
+        drmModeAtomicAddProperty(req, plane->plane_id, props.fb_id, 0);
+      }
+      drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(plane_res);
+  }
+
+  int ret = drmModeAtomicCommit(fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+  drmModeAtomicFree(req);
+  if(ret != 0) {
+    VT_WARN(drm->comp->log, "Atomic disable of CRTC %u failed, falling back to drmModeSetCrtc(): %s",
+            drm_output->crtc_id, strerror(errno));
+    return false;
+  }
+  drm_output->overlay_mask = 0;
   return true;
 }
 
+bool
+_drm_crtc_in_use(struct drm_backend_state_t* drm, uint32_t crtc_id) {
+  struct vt_output_t* output;
+  wl_list_for_each(output, &drm->outputs, link_local) {
+    if (BACKEND_DATA(output, struct drm_output_state_t)->crtc_id == crtc_id) return true;
+  }
+  return false;
+}
+
 bool 
 _drm_create_output_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, void* data) {
   if(!drm || !output || !data) return false;
 
   VT_TRACE(drm->comp->log, "Creating DRM internal output.");
-  if(!(output->user_data = VT_ALLOC(drm->comp, sizeof(struct drm_output_state_t)))) {
+  if(!(output->user_data = calloc(1, sizeof(struct drm_output_state_t)))) {
     return false;
   }
 
@@ -720,17 +2200,19 @@ _drm_create_output_for_device(struct drm_backend_state_t* drm, struct vt_output_
   if (conn->encoder_id)
     enc = drmModeGetEncoder(drm->drm_fd, conn->encoder_id);
 
+  // Connectors plugged in at runtime must not take the CRTC of another output
   if (enc) {
-    drm_output->crtc_id = enc->crtc_id;
+    if (!_drm_crtc_in_use(drm, enc->crtc_id)) drm_output->crtc_id = enc->crtc_id;
     drmModeFreeEncoder(enc);
-  } else if (drm->res->count_encoders > 0) {
+  } 
+  if (!drm_output->crtc_id && drm->res->count_encoders > 0) {
     // fallback: try all encoders for this connector
     // (the voices are getting too loud)
     for (int i = 0; i < conn->count_encoders; i++) {
       enc = drmModeGetEncoder(drm->drm_fd, conn->encoders[i]);
       if (!enc) continue;
       for (int j = 0; j < drm->res->count_crtcs; j++) {
-        if (enc->possible_crtcs & (1 << j)) {
+        if ((enc->possible_crtcs & (1 << j)) && !_drm_crtc_in_use(drm, drm->res->crtcs[j])) {
           drm_output->crtc_id = drm->res->crtcs[j];
           break;
         }
@@ -742,16 +2224,61 @@ _drm_create_output_for_device(struct drm_backend_state_t* drm, struct vt_output_
 
   if (!drm_output->crtc_id) {
     VT_ERROR(comp->log, "Failed to find CRTC for connector %u", drm_output->conn_id);
-    drmModeFreeConnector(conn);
     return false;
   }
 
+  // Outputs that cannot be driven atomically use legacy flips, 
+  // the other outputs of the device keep batching atomic commits.
+  drm_output->atomic = drm->atomic;
+  if (drm_output->atomic && !_drm_init_atomic_props_for_output(drm, drm_output)) {
+    VT_WARN(comp->log, "Cannot use atomic modesetting for connector %u, falling back to legacy modesetting.",
+            drm_output->conn_id);
+    drm_output->atomic = false;
+  }
+  if (drm_output->atomic) {
+    _drm_init_scanout_formats_for_output(drm, drm_output);
+    output->vrr_capable = drm_output->crtc_props.vrr_enabled != 0;
+    // Start with VRR off, whatever the previous DRM master left behind
+    drm_output->vrr_dirty = output->vrr_capable;
+  } else {
+    wl_array_init(&drm_output->scanout_formats);
+  }
+  output->tearing_capable = drm_output->atomic ? drm->async_flip_atomic : drm->async_flip_legacy;
+
+  // Outputs of secondary GPUs are rendered on the main device into linear 
+  // buffers, which other devices can import or map.
+  struct drm_backend_master_state_t* drm_master = BACKEND_DATA(output->backend, struct drm_backend_master_state_t); 
+  drm_output->software = comp->renderer->rendering_backend == VT_RENDERING_BACKEND_PIXMAN;
+  drm_output->bo_rendering = comp->renderer->rendering_backend == VT_RENDERING_BACKEND_VULKAN;
+  drm_output->prime = !drm_output->software && drm != drm_master->main_drm;
+  if (drm_output->prime) {
+    VT_TRACE(comp->log, "Output on connector %u of device %s is rendered by main device %s.", 
+             drm_output->conn_id, drm->dev->path, drm_master->main_drm->dev->path);
+  }
+
   const uint32_t desired_format = comp->renderer->_desired_render_buffer_format;
-  if(!(drm_output->gbm_surf = gbm_surface_create(
-    drm->gbm_dev,
+  if (drm_output->software) {
+    // CPU rendered frames go straight into mapped scanout memory of the device
+    for (uint32_t i = 0; i < 2; i++) {
+      if (!_drm_create_dumb_buffer(drm, &drm_output->sw_buffers[i], 
+                                   drm_output->mode.hdisplay, drm_output->mode.vdisplay, desired_format)) {
+        VT_ERROR(comp->log, "cannot create dumb buffers (%ux%u) for output on connector %i for rendering.", 
+                 drm_output->mode.hdisplay, drm_output->mode.vdisplay, drm_output->conn_id);
+        return false;
+      }
+    }
+  } else if (drm_output->bo_rendering) {
+    if (!_drm_create_render_bos(drm, output, drm_output->prime ? drm_master->main_drm->gbm_dev : drm->gbm_dev, 
+                                desired_format)) {
+      VT_ERROR(comp->log, "cannot create render buffers (%ux%u) for output on connector %i.", 
+               drm_output->mode.hdisplay, drm_output->mode.vdisplay, drm_output->conn_id);
+      return false;
+    }
+  } else if(!(drm_output->gbm_surf = gbm_surface_create(
+    drm_output->prime ? drm_master->main_drm->gbm_dev : drm->gbm_dev,
     drm_output->mode.hdisplay, drm_output->mode.vdisplay,
     desired_format,
-    GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING
+    drm_output->prime ? GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING : GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING
   ))) {
     VT_ERROR(comp->log, "cannot create GBM surface (%ux%u@%u) for output on connector %i for rendering.", 
              drm_output->mode.hdisplay, drm_output->mode.vdisplay, drm_output->mode.vrefresh, drm_output->conn_id);
@@ -763,22 +2290,30 @@ _drm_create_output_for_device(struct drm_backend_state_t* drm, struct vt_output_
            drm_output->conn_id, drm_output->crtc_id,
            drm_output->mode.hdisplay, drm_output->mode.vdisplay, drm_output->mode.vrefresh, output);
 
-  struct drm_backend_master_state_t* drm_master = BACKEND_DATA(output->backend, struct drm_backend_master_state_t); 
-  // TODO: Implement correct output layouting e.g vertical monitors
+  // The position is up to the output layout
+  uint32_t type = conn->connector_type;
+  snprintf(output->name, sizeof(output->name), "%s-%u",
+           type < sizeof(_drm_connector_type_names) / sizeof(*_drm_connector_type_names) ?
+           _drm_connector_type_names[type] : "Unknown", conn->connector_type_id);
   output->width = (uint32_t)drm_output->mode.hdisplay; 
   output->height = (uint32_t)drm_output->mode.vdisplay; 
-  output->x = drm_master->x_ptr;
-  output->y = 0; 
-  output->height = (uint32_t)drm_output->mode.vdisplay; 
   output->refresh_rate = (uint32_t)drm_output->mode.vrefresh; 
-  output->native_window = drm_output->gbm_surf;
+  // The mode clock (kHz) gives the exact length of a refresh cycle 
+  if (drm_output->mode.clock && drm_output->mode.htotal && drm_output->mode.vtotal) {
+    uint64_t pixels = (uint64_t)drm_output->mode.htotal * drm_output->mode.vtotal;
+    if (drm_output->mode.flags & DRM_MODE_FLAG_INTERLACE) pixels /= 2;
+    if (drm_output->mode.flags & DRM_MODE_FLAG_DBLSCAN) pixels *= 2;
+    if (drm_output->mode.vscan > 1) pixels *= drm_output->mode.vscan;
+    output->refresh_ns = pixels * 1000000ull / drm_output->mode.clock;
+    output->refresh_rate = 1e9f / (float)output->refresh_ns;
+  }
+  output->native_window = drm_output->software ? (void*)&drm_output->sw_target : 
+    drm_output->bo_rendering ? (void*)&drm_output->bo_targets[0] : (void*)drm_output->gbm_surf;
   output->format = desired_format; 
-  output->id = drm_output->conn_id;
-
-  drm_master->x_ptr += output->width;
 
+  // Connector IDs are sparse, the output gets a dense ID instead
+  if (!vt_comp_add_output(comp, output)) return false;
   wl_list_insert(&drm->outputs, &output->link_local);
-  wl_list_insert(&drm->comp->outputs, &output->link_global);
 
 
   return true;
@@ -791,20 +2326,56 @@ _drm_destroy_output_for_device(struct drm_backend_state_t* drm, struct vt_output
 
   VT_TRACE(drm->comp->log, "Destroying output %p.\n", output);
 
+  vt_comp_cancel_repaint(drm->comp, output);
+  vt_proto_presentation_output_destroy(output);
   _drm_release_all_scanout(output);
   struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  if (drm_output->mode_blob_id) {
+    drmModeDestroyPropertyBlob(drm->drm_fd, drm_output->mode_blob_id);
+    drm_output->mode_blob_id = 0;
+  }
+  _drm_free_format_set(&drm_output->scanout_formats);
+  for (uint32_t i = 0; i < drm->n_overlays; i++) {
+    if (drm->overlays[i].output == output) drm->overlays[i].output = NULL;
+  }
+  if (drm_output->cursor_visible) {
+    drmModeSetCursor(drm->drm_fd, drm_output->crtc_id, 0, 0, 0);
+    drm_output->cursor_visible = false;
+  }
+  for (uint32_t i = 0; i < 2; i++) {
+    if (drm_output->cursor_bos[i]) {
+      gbm_bo_destroy(drm_output->cursor_bos[i]);
+      drm_output->cursor_bos[i] = NULL;
+    }
+  }
+  for (uint32_t i = 0; i < _DRM_PRIME_COPY_BUFFERS; i++) {
+    if (drm_output->prime_copies[i].handle) _drm_destroy_dumb_buffer(drm, &drm_output->prime_copies[i]);
+  }
+  // The renderer's surface sits on top of the GBM surface and 
+  // the dumb buffers, so it has to go first.
+  if (output->user_data_render && 
+    !drm->comp->renderer->impl.destroy_renderable_output(drm->comp->renderer, output)) {
+    VT_ERROR(drm->comp->log, "Cannot destroy renderable output of output %p.", output);
+  }
   if (drm_output->gbm_surf) {
     gbm_surface_destroy(drm_output->gbm_surf);
     drm_output->gbm_surf = NULL;
-  
-    if(!drm->comp->renderer->impl.destroy_renderable_output(drm->comp->renderer, output)) return false;
   }
+  for (uint32_t i = 0; i < 2; i++) {
+    if (drm_output->sw_buffers[i].handle) _drm_destroy_dumb_buffer(drm, &drm_output->sw_buffers[i]);
+  }
+  drm_output->sw_target.data = NULL;
+  // The renderer let go of its imports above
+  _drm_destroy_render_bos(output);
 
+  free(output->user_data);
   output->user_data = NULL;
 
   wl_list_remove(&output->link_local);
+  vt_comp_remove_output(drm->comp, output);
 
-  output = NULL;
+  pixman_region32_fini(&output->damage);
+  free(output);
 
   return true;
 }
@@ -815,6 +2386,7 @@ _drm_terminate_for_device(struct drm_backend_state_t* drm) {
   struct vt_compositor_t* comp = drm->comp; 
 
   if (!comp->suspended && drm->drm_fd > 0) {
+    _drm_flush_staged_commit(drm);
     bool any_inflight;
     do {
       any_inflight = false;
@@ -830,6 +2402,14 @@ _drm_terminate_for_device(struct drm_backend_state_t* drm) {
     } while (any_inflight);
   }
 
+  if(drm->commit_timer) {
+    wl_event_source_remove(drm->commit_timer);
+    close(drm->commit_timer_fd);
+    drm->commit_timer = NULL;
+    drm->commit_timer_fd = -1;
+  }
+  drm->commit_deadline = 0;
+
   if(drm->res)
     drmModeFreeResources(drm->res);
 
@@ -839,6 +2419,13 @@ _drm_terminate_for_device(struct drm_backend_state_t* drm) {
     _drm_destroy_output_for_device(drm, output);
   }
 
+  for (uint32_t i = 0; i < drm->n_overlays; i++) {
+    _drm_free_format_set(&drm->overlays[i].formats);
+  }
+  free(drm->overlays);
+  drm->overlays = NULL;
+  drm->n_overlays = 0;
+
   comp->renderer->impl.destroy(comp->renderer);
 
   if (drm->gbm_dev) {
@@ -882,6 +2469,9 @@ void _drm_on_seat_disable(struct wl_listener* listener, void* data) {
     BACKEND_DATA(session->comp->backend, struct drm_backend_master_state_t);
 
   VT_TRACE(session->comp->log, "Seat disable event (VT switch away)");
+  if (session->comp->suspended) return;
+  // Set for the whole session, every GPU has to be suspended
+  session->comp->suspended = true;
 
   struct drm_backend_state_t* drm;
   wl_list_for_each(drm, &drm_master->backends, link) {
@@ -905,6 +2495,27 @@ _drm_keybind_switch_vt(struct vt_compositor_t* comp, void* user_data) {
 }
 
 
+void 
+_drm_on_card_change(struct wl_listener* listener, void* data) {
+  if (!data) return;
+  struct drm_backend_master_state_t* drm_master = 
+    wl_container_of(listener, drm_master, change_card_listener);
+  struct vt_session_drm_event_t* ev = (struct vt_session_drm_event_t*)data;
+
+  // Connectors cannot be probed without DRM master, they are 
+  // re-probed once the seat is enabled again.
+  if (drm_master->comp->suspended) return;
+
+  struct drm_backend_state_t* drm;
+  wl_list_for_each(drm, &drm_master->backends, link) {
+    const char* name = strrchr(drm->dev->path, '/');
+    name = name ? name + 1 : drm->dev->path;
+    if (strcmp(name, ev->device_node_name) != 0) continue;
+    _drm_update_outputs_for_device(drm);
+    return;
+  }
+}
+
 void _drm_on_seat_enable(struct wl_listener *listener, void *data) {
   if (!data) return;
 
@@ -913,11 +2524,17 @@ void _drm_on_seat_enable(struct wl_listener *listener, void *data) {
     BACKEND_DATA(session->comp->backend, struct drm_backend_master_state_t);
 
   VT_TRACE(session->comp->log, "Seat enable event (VT switch back)");
+  if (!session->comp->suspended) return;
+  session->comp->suspended = false;
 
   struct drm_backend_state_t* drm;
   wl_list_for_each(drm, &drm_master->backends, link) {
     _drm_resume(drm);
   }
+  // Monitors may have been plugged or unplugged while we were away
+  wl_list_for_each(drm, &drm_master->backends, link) {
+    _drm_update_outputs_for_device(drm);
+  }
   
   struct vt_input_backend_t* input = session->comp->input_backend;
   if(input && input->impl.resume)
@@ -932,7 +2549,6 @@ _drm_handle_frame_for_device(struct drm_backend_state_t* drm, struct vt_output_t
   struct vt_compositor_t* comp = drm->comp;
 
   VT_TRACE(comp->log, "Handling frame...");
-  vt_comp_repaint_scene(comp, output);
 
   if (!comp->renderer) {
     VT_ERROR(comp->log, "Renderer backend not initialized before handling frame.");
@@ -941,54 +2557,45 @@ _drm_handle_frame_for_device(struct drm_backend_state_t* drm, struct vt_output_t
 
   struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t); 
 
-  // Retrieve the front buffer that we rendered to with the renderer 
-  struct gbm_bo *bo = gbm_surface_lock_front_buffer(drm_output->gbm_surf);
-  // If we could not get the front buffer, we'll try again next frame.
-  if (!bo) {
-    VT_WARN(comp->log, "Failed to get the GBM front buffer for frame in output %p.", output);
-    output->needs_repaint = true; 
-    return true;
-  }
-
-  uint32_t w = gbm_bo_get_width(bo);
-  uint32_t h = gbm_bo_get_height(bo);
-  uint32_t fmt = gbm_bo_get_format(bo);
-  uint32_t handle = gbm_bo_get_handle(bo).u32;
-  uint32_t stride = gbm_bo_get_stride(bo);
-  uint32_t fb;
-  uint32_t handles[4] = { gbm_bo_get_handle(bo).u32 };
-  uint32_t strides[4] = { gbm_bo_get_stride(bo) };
-  uint32_t offsets[4] = { 0 };
-
-  uint64_t modifier = gbm_bo_get_modifier(bo);
-
-  int ret;
-  // If the BO wants modifiers, add the FB with modifier arguments
-  if (modifier != DRM_FORMAT_MOD_INVALID) {
-    uint64_t mods[4] = { modifier, 0, 0, 0 };
-    ret = drmModeAddFB2WithModifiers(drm->drm_fd, w, h, fmt,
-                                     handles, strides, offsets, mods, &fb,
-                                     DRM_MODE_FB_MODIFIERS);
+  // Software rendered frames are already in the back dumb buffer
+  struct gbm_bo *bo = NULL;
+  uint32_t fb = 0;
+  if (drm_output->software) {
+    fb = drm_output->sw_buffers[drm_output->back_idx].fb_id;
+  } else if (drm_output->bo_rendering) {
+    // The BOs are ours, they stay out of the GBM surface rotation 
+    struct gbm_bo* back = drm_output->bos[drm_output->back_idx];
+    fb = drm_output->prime ? _drm_prime_fb_from_bo(drm, output, back) : _drm_fb_from_bo(drm, output, back);
+    drm_output->bo_fbs[drm_output->back_idx] = fb;
   } else {
-    ret = drmModeAddFB2(drm->drm_fd, w, h, fmt,
-                        handles, strides, offsets, &fb, 0);
+    // Retrieve the front buffer that we rendered to with the renderer 
+    bo = gbm_surface_lock_front_buffer(drm_output->gbm_surf);
+    // If we could not get the front buffer, we'll try again next frame.
+    if (!bo) {
+      VT_WARN(comp->log, "Failed to get the GBM front buffer for frame in output %p.", output);
+      output->needs_repaint = true; 
+      return false;
+    }
+
+    // Look up the cached frame buffer of the BO, creating it on first use. 
+    // Frames of secondary GPU outputs come from the main device.
+    fb = drm_output->prime ? _drm_prime_fb_from_bo(drm, output, bo) : _drm_fb_from_bo(drm, output, bo);
   }
 
   // If we could not create a DRM frame buffer...
-  if (ret != 0) {
-    gbm_surface_release_buffer(drm_output->gbm_surf, bo);
+  if (!fb) {
+    if (bo) gbm_surface_release_buffer(drm_output->gbm_surf, bo);
     // Try again next farme
     output->needs_repaint = true;
-    VT_ERROR(comp->log, "canot create DRM frame buffer for output %p: drmModeAddFB2(%ux%u, fmt=0x%08x) failed: %s",
-             output, w, h, fmt, strerror(errno));
+    VT_ERROR(comp->log, "canot get DRM frame buffer for output %p.", output);
     return false;
   }
 
-  if (drm_output->needs_modeset) {
+  // Atomic devices apply the mode together with the first commit
+  if (!drm_output->atomic && drm_output->needs_modeset) {
     if (drmModeSetCrtc(drm->drm_fd, drm_output->crtc_id, fb,
                        0, 0, &drm_output->conn_id, 1, &drm_output->mode) != 0) {
-      drmModeRmFB(drm->drm_fd, fb);
-      gbm_surface_release_buffer(drm_output->gbm_surf, bo);
+      if (bo) gbm_surface_release_buffer(drm_output->gbm_surf, bo);
       // Try again next farme
       output->needs_repaint = true;
       VT_ERROR(comp->log, "cannot set CRTC mode for output %p: drmModeSetCrtc() failed: %s",
@@ -1000,7 +2607,6 @@ _drm_handle_frame_for_device(struct drm_backend_state_t* drm, struct vt_output_t
 
     // Release the old buffer 
     if (drm_output->current_bo) {
-      drmModeRmFB(drm->drm_fd, drm_output->current_fb);
       gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->current_bo);
     }
 
@@ -1021,32 +2627,287 @@ _drm_handle_frame_for_device(struct drm_backend_state_t* drm, struct vt_output_t
       drm_output->modeset_bootstrapped = true;
       VT_TRACE(comp->log, "Successfully bootstrapped the first frame for output %p.", output);
     }
+    // The mode set put the frame on screen without a flip event
+    vt_comp_frame_presented(comp, output);
     return true;
   }
 
   // Set pending buffer and eventually assign to 
-  // current in _drm_page_flip_handler() (after flip completes)
+  // current in _drm_finish_flip_for_output() (after flip completes)
   drm_output->pending_bo = bo;
   drm_output->pending_fb = fb;
 
-  if( 
-    drmModePageFlip(drm->drm_fd, drm_output->crtc_id, fb,
-                    DRM_MODE_PAGE_FLIP_EVENT, output) != 0) {
+  if(!_drm_queue_flip_for_output(drm, output)) {
     // Flip refused; free pending and try again later
-    drmModeRmFB(drm->drm_fd, drm_output->pending_fb);
-    gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->pending_bo);
+    if (bo) gbm_surface_release_buffer(drm_output->gbm_surf, drm_output->pending_bo);
     drm_output->pending_bo = NULL; drm_output->pending_fb = 0;
     output->needs_repaint = true;
-    VT_ERROR(comp->log, "cannot do a page flip: drmModePageFlip() failed: %s",
-             strerror(errno));
     return false;
   }
-  VT_TRACE(comp->log, "Successfully performed drmModePageFlip() call.");
 
-  drm_output->flip_inflight = true;
+  return true;
+}
 
-  // we’ve submitted a frame so clear the desire until something else changes
-  output->needs_repaint = false;
+bool
+_drm_scanout_surface_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, struct vt_surface_t* surf) {
+  struct vt_compositor_t* comp = drm->comp;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  struct vt_linux_dmabuf_v1_buffer_t* buf = surf->locked_dmabuf;
+
+  // Client buffers are only flipped on devices that can validate them with 
+  // a test commit first, mode sets always go through the renderer.
+  if(!drm_output->atomic || drm_output->needs_modeset || !buf) return false;
+
+  // Fences of explicitly synchronized surfaces are handled by the renderer
+  if(surf->sync.res) return false;
+
+  if(buf->attr.width != (int32_t)output->width || buf->attr.height != (int32_t)output->height) return false;
+
+  // Anything that shows through the buffer has to be composited
+  if(!_drm_surface_is_opaque(surf, buf)) return false;
+
+  if(!_drm_format_set_has(&drm_output->scanout_formats, buf->attr.format, buf->attr.mod)) return false;
+
+  struct drm_fb_t* fb = _drm_fb_from_dmabuf(drm, output, buf);
+  if(!fb) return false;
+
+  // The buffer covers the whole output, so overlays are turned off
+  _drm_reset_pending_overlays(drm_output);
+  if(!_drm_test_scanout_fb(drm, output, fb)) return false;
+  vt_scene_assign_planes(comp, output, NULL, NULL);
+
+  // The buffer stays locked until the flip after the next one 
+  // completed, see _drm_finish_flip_for_output()
+  vt_proto_linux_dmabuf_v1_buffer_lock(buf);
+  drm_output->pending_bo = NULL;
+  drm_output->pending_fb = fb->fb_id;
+  drm_output->pending_dmabuf = buf;
+
+  if(!_drm_queue_flip_for_output(drm, output)) {
+    vt_proto_linux_dmabuf_v1_buffer_unlock(buf);
+    drm_output->pending_fb = 0;
+    drm_output->pending_dmabuf = NULL;
+    return false;
+  }
+
+  // The surface counts as presented so that its frame callbacks go out with the flip
+  vt_util_output_mask_set(&surf->_mask_outputs_presented_on, output->id);
+
+  VT_TRACE(comp->log, "Scanning out DMABUF %p of surface %p directly on output %p (FB %u).",
+           buf, surf, output, fb->fb_id);
+  return true;
+}
+
+bool
+_drm_set_cursor_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, struct vt_surface_t* surf, int32_t hotspot_x, int32_t hotspot_y) {
+  struct vt_compositor_t* comp = drm->comp;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  if(!surf) {
+    if(drm_output->cursor_visible && drmModeSetCursor(drm->drm_fd, drm_output->crtc_id, 0, 0, 0) != 0) {
+      VT_WARN(comp->log, "Cannot hide cursor on CRTC %u: %s", drm_output->crtc_id, strerror(errno));
+      return false;
+    }
+    drm_output->cursor_visible = false;
+    return true;
+  }
+
+  struct vt_cursor_image_t* img = &surf->cursor_image;
+  if(!img->pixels || img->width > drm->cursor_width || img->height > drm->cursor_height) return false;
+
+  // Write to the buffer that is currently not scanned out
+  uint32_t back = drm_output->cursor_front ^ 1;
+  if(!drm_output->cursor_bos[back]) {
+    drm_output->cursor_bos[back] = gbm_bo_create(
+      drm->gbm_dev, drm->cursor_width, drm->cursor_height, 
+      GBM_FORMAT_ARGB8888, GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
+    if(!drm_output->cursor_bos[back]) {
+      VT_WARN(comp->log, "Cannot allocate %" PRIu64 "x%" PRIu64 " cursor buffer on GPU %s.", 
+              drm->cursor_width, drm->cursor_height, drm->dev->path);
+      return false;
+    }
+  }
+  struct gbm_bo* bo = drm_output->cursor_bos[back];
+
+  uint32_t stride = gbm_bo_get_stride(bo);
+  uint8_t* staging = calloc(drm->cursor_height, stride);
+  if(!staging) return false;
+  for(uint32_t y = 0; y < img->height; y++) {
+    memcpy(staging + (size_t)y * stride, img->pixels + (size_t)y * img->width, img->width * 4);
+  }
+  int ret = gbm_bo_write(bo, staging, (size_t)drm->cursor_height * stride);
+  free(staging);
+  if(ret != 0) {
+    VT_WARN(comp->log, "Cannot write cursor image to buffer %p: %s", bo, strerror(errno));
+    return false;
+  }
+
+  uint32_t handle = gbm_bo_get_handle(bo).u32;
+  if(drmModeSetCursor2(drm->drm_fd, drm_output->crtc_id, handle, 
+                       drm->cursor_width, drm->cursor_height, hotspot_x, hotspot_y) != 0 &&
+    drmModeSetCursor(drm->drm_fd, drm_output->crtc_id, handle, 
+                     drm->cursor_width, drm->cursor_height) != 0) {
+    VT_WARN(comp->log, "Cannot set cursor on CRTC %u: %s", drm_output->crtc_id, strerror(errno));
+    return false;
+  }
+
+  drm_output->cursor_front = back;
+  drm_output->cursor_visible = true;
+  return true;
+}
+
+bool
+_drm_move_cursor_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, int32_t x, int32_t y) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  if(!drm_output->cursor_visible) return true;
+
+  if(drmModeMoveCursor(drm->drm_fd, drm_output->crtc_id, x, y) != 0) {
+    VT_WARN(drm->comp->log, "Cannot move cursor on CRTC %u: %s", drm_output->crtc_id, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool
+_drm_claim_overlay(struct vt_output_t* output, struct vt_surface_t* surf, void* user_data) {
+  struct drm_backend_state_t* drm = (struct drm_backend_state_t*)user_data;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  struct vt_linux_dmabuf_v1_buffer_t* buf = surf->locked_dmabuf;
+
+  if(!buf || surf->sync.res || surf->buffer_scale != 1) return false;
+  if(drm_output->n_pending_overlays >= _DRM_MAX_OVERLAYS_PER_OUTPUT) return false;
+
+  // Overlays show the buffer as is, without scaling or blending
+  if(buf->attr.width != (int32_t)surf->width || buf->attr.height != (int32_t)surf->height) return false;
+  if(!_drm_surface_is_opaque(surf, buf)) return false;
+
+  const int32_t x = surf->x - output->x, y = surf->y - output->y;
+  if(x < 0 || y < 0 || 
+    x + buf->attr.width > (int32_t)output->width || y + buf->attr.height > (int32_t)output->height) return false;
+
+  // Find a free overlay that can be put on top of the primary plane
+  struct drm_plane_t* plane = NULL;
+  for(uint32_t i = 0; i < drm->n_overlays && !plane; i++) {
+    struct drm_plane_t* p = &drm->overlays[i];
+    if(!(p->possible_crtcs & (1u << drm_output->crtc_idx))) continue;
+    if(p->output && p->output != output) continue;
+    if(p->has_zpos && drm_output->has_primary_zpos && p->zpos <= drm_output->primary_zpos) continue;
+    if(!_drm_format_set_has(&p->formats, buf->attr.format, buf->attr.mod)) continue;
+    bool taken = false;
+    for(uint32_t j = 0; j < drm_output->n_pending_overlays; j++) {
+      if(drm_output->pending_overlays[j].plane == p) taken = true;
+    }
+    if(!taken) plane = p;
+  }
+  if(!plane) return false;
+
+  struct drm_fb_t* fb = _drm_fb_from_dmabuf(drm, output, buf);
+  if(!fb) return false;
+
+  uint32_t idx = drm_output->n_pending_overlays;
+  struct drm_overlay_t* o = &drm_output->pending_overlays[idx];
+  *o = (struct drm_overlay_t){
+    .plane = plane, .dmabuf = buf, .fb_id = fb->fb_id, 
+    .format = buf->attr.format, .mod = buf->attr.mod,
+    .x = x, .y = y, .w = buf->attr.width, .h = buf->attr.height,
+  };
+  drm_output->n_pending_overlays++;
+
+  // A layout that is on screen already does not need to be tested again
+  bool known = idx < drm_output->n_current_overlays;
+  for(uint32_t i = 0; i <= idx && known; i++) {
+    const struct drm_overlay_t* a = &drm_output->pending_overlays[i], *b = &drm_output->current_overlays[i];
+    known = a->plane == b->plane && a->format == b->format && a->mod == b->mod &&
+      a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h;
+  }
+
+  bool passed = known;
+  if(!passed) {
+    drmModeAtomicReq* req = drmModeAtomicAlloc();
+    if(req) {
+      // Test against the frame that is on screen, the next one has the same layout
+      uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY;
+      drm_output->pending_fb = drm_output->current_fb;
+      passed = _drm_atomic_add_output(drm, req, output, &flags) &&
+        drmModeAtomicCommit(drm->drm_fd, req, flags, NULL) == 0;
+      drm_output->pending_fb = 0;
+      drmModeAtomicFree(req);
+    }
+    VT_TRACE(drm->comp->log, "Overlay test of surface %p on plane %u of CRTC %u %s.",
+             surf, plane->id, drm_output->crtc_id, passed ? "passed" : "failed");
+  }
+  if(!passed) {
+    drm_output->n_pending_overlays--;
+    return false;
+  }
+
+  // Held until the flip after the next one completed, like directly scanned out buffers
+  vt_proto_linux_dmabuf_v1_buffer_lock(buf);
+  plane->output = output;
+  vt_util_output_mask_set(&surf->_mask_outputs_presented_on, output->id);
+  return true;
+}
+
+bool
+_drm_assign_planes_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  _drm_reset_pending_overlays(drm_output);
+  // Overlays the output turned off with its last commit are free for others
+  for(uint32_t i = 0; i < drm->n_overlays; i++) {
+    if(drm->overlays[i].output == output && !(drm_output->overlay_mask & (1u << i)))
+      drm->overlays[i].output = NULL;
+  }
+
+  // Overlays are validated against the frame on screen, so mode sets 
+  // and the legacy path compose everything.
+  bool usable = drm_output->atomic && drm->n_overlays && !drm_output->needs_modeset && drm_output->current_fb;
+  uint32_t n = vt_scene_assign_planes(drm->comp, output, usable ? _drm_claim_overlay : NULL, drm);
+  if(n) {
+    VT_TRACE(drm->comp->log, "Put %u surface(s) on overlay planes of output %p.", n, output);
+  }
+  return n != 0;
+}
+
+bool
+_drm_set_vrr_for_device(struct drm_backend_state_t* drm, struct vt_output_t* output, bool enabled) {
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  if(!drm_output->atomic || !drm_output->crtc_props.vrr_enabled) return false;
+
+  // Validate against the frame on screen, mode sets apply the state anyway
+  bool passed = drm_output->needs_modeset || !drm_output->current_fb;
+  if(!passed) {
+    drmModeAtomicReq* req = drmModeAtomicAlloc();
+    if(!req) return false;
+    uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY;
+    bool was_enabled = drm_output->vrr_enabled, was_dirty = drm_output->vrr_dirty;
+    drm_output->vrr_enabled = enabled;
+    drm_output->vrr_dirty = true;
+    drm_output->pending_fb = drm_output->current_fb;
+    passed = _drm_atomic_add_output(drm, req, output, &flags) &&
+      drmModeAtomicCommit(drm->drm_fd, req, flags, NULL) == 0;
+    drm_output->pending_fb = 0;
+    drm_output->vrr_enabled = was_enabled;
+    drm_output->vrr_dirty = was_dirty;
+    drmModeAtomicFree(req);
+  }
+  if(!passed && enabled) {
+    VT_WARN(drm->comp->log, "CRTC %u refused to enable adaptive sync.", drm_output->crtc_id);
+    // Do not retry every frame
+    output->vrr_capable = false;
+    return false;
+  }
+  if(!passed) {
+    // Staying in adaptive sync is not an option, so the next 
+    // commit turns it off with a full mode set.
+    VT_WARN(drm->comp->log, "CRTC %u refused to disable adaptive sync, forcing it with a mode set.", drm_output->crtc_id);
+    drm_output->needs_modeset = true;
+  }
+
+  drm_output->vrr_enabled = enabled;
+  drm_output->vrr_dirty = true;
+  output->vrr_enabled = enabled;
+  return true;
 }
 
 // ===================================================
@@ -1080,6 +2941,10 @@ backend_init_drm(struct vt_backend_t* backend) {
   drm_master->seat_disable_listener.notify = _drm_on_seat_disable; 
   wl_signal_add(&session_drm->ev_seat_disable, &drm_master->seat_disable_listener);
 
+  // Connector hotplug (monitors, docks) arrives as change event of the card
+  drm_master->change_card_listener.notify = _drm_on_card_change; 
+  wl_signal_add(&session_drm->ev_drm_change_card, &drm_master->change_card_listener);
+
   // Create a DRM backend state for all the enumerated GPUs
   const uint8_t max_gpus = 16;
   struct vt_device_t* gpus[max_gpus];
@@ -1099,6 +2964,13 @@ backend_init_drm(struct vt_backend_t* backend) {
     log_fatal(drm_master->comp->log, "Failed to find renderable DRM device.");
   }
 
+  // Outputs of every GPU are rendered by the main device, so 
+  // they can only be set up once it is known.
+  struct drm_backend_state_t* drm;
+  wl_list_for_each(drm, &drm_master->backends, link) {
+    _drm_init_active_outputs_for_device(drm);
+  }
+
   if(backend->comp->have_proto_dmabuf) {
     // initialize the dmabuf protocol with default feedback
     struct vt_dmabuf_feedback_t* default_feedback = calloc(1, sizeof(*default_feedback));
@@ -1128,6 +3000,13 @@ backend_init_drm(struct vt_backend_t* backend) {
     wl_array_release(&default_feedback->tranches);
 
     free(default_feedback);
+  } else {
+    // SHM formats are otherwise advertised together with the DMABUF feedback
+    uint32_t shm_formats[] = { DRM_FORMAT_XRGB8888, DRM_FORMAT_ARGB8888 };
+    if(!vt_proto_wl_shm_init(backend->comp, shm_formats, 2)) {
+      VT_ERROR(backend->comp->log, "Failed to initialize WL SHM protcol.");
+      return false;
+    }
   }
 
   // init explicit sync
@@ -1171,7 +3050,9 @@ backend_handle_frame_drm(struct vt_backend_t* backend, struct vt_output_t* outpu
     VT_ERROR(backend->comp->log, "No main render device available for frame handling.");
     return false;
   }
-  return _drm_handle_frame_for_device(drm_master->main_drm, output);
+  // The main device renders, the device the output is connected to flips
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  return _drm_handle_frame_for_device(drm_output->drm_backend, output);
 }
 
 
@@ -1182,10 +3063,12 @@ backend_terminate_drm(struct vt_backend_t* backend) {
     VT_PARAM_CHECK_FAIL(backend->comp);
     return false;
   }
+  // Secondary GPU outputs hold buffers of the main device, so it goes last
   struct drm_backend_state_t* drm;
   wl_list_for_each(drm, &drm_master->backends, link) {
-    _drm_terminate_for_device(drm);
+    if(drm != drm_master->main_drm) _drm_terminate_for_device(drm);
   }
+  if(drm_master->main_drm) _drm_terminate_for_device(drm_master->main_drm);
 
   if(backend->user_data) {
     backend->user_data = NULL;
@@ -1213,6 +3096,53 @@ backend_is_dmabuf_importable_drm(struct vt_backend_t* backend, struct vt_dmabuf_
 }
 
 
+bool 
+backend_scanout_surface_drm(struct vt_backend_t* backend, struct vt_output_t* output, struct vt_surface_t* surf) {
+  if(!backend || !backend->user_data || !output || !output->user_data || !surf) return false;
+  struct drm_backend_master_state_t* drm_master = BACKEND_DATA(backend, struct drm_backend_master_state_t); 
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  // Clients allocate their buffers for the main device, other GPUs would need a copy
+  if(drm_output->drm_backend != drm_master->main_drm) return false;
+
+  return _drm_scanout_surface_for_device(drm_output->drm_backend, output, surf);
+}
+
+bool 
+backend_set_cursor_drm(struct vt_backend_t* backend, struct vt_output_t* output, struct vt_surface_t* surf, int32_t hotspot_x, int32_t hotspot_y) {
+  if(!backend || !output || !output->user_data) return false;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  return _drm_set_cursor_for_device(drm_output->drm_backend, output, surf, hotspot_x, hotspot_y);
+}
+
+bool 
+backend_move_cursor_drm(struct vt_backend_t* backend, struct vt_output_t* output, int32_t x, int32_t y) {
+  if(!backend || !output || !output->user_data) return false;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  return _drm_move_cursor_for_device(drm_output->drm_backend, output, x, y);
+}
+
+bool 
+backend_assign_planes_drm(struct vt_backend_t* backend, struct vt_output_t* output) {
+  if(!backend || !backend->user_data || !output || !output->user_data) return false;
+  struct drm_backend_master_state_t* drm_master = BACKEND_DATA(backend, struct drm_backend_master_state_t); 
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+
+  // Clients allocate their buffers for the main device, other GPUs would need a copy
+  if(drm_output->drm_backend != drm_master->main_drm) {
+    vt_scene_assign_planes(backend->comp, output, NULL, NULL);
+    return false;
+  }
+  return _drm_assign_planes_for_device(drm_output->drm_backend, output);
+}
+
+bool 
+backend_set_vrr_drm(struct vt_backend_t* backend, struct vt_output_t* output, bool enabled) {
+  if(!backend || !output || !output->user_data) return false;
+  struct drm_output_state_t* drm_output = BACKEND_DATA(output, struct drm_output_state_t);
+  return _drm_set_vrr_for_device(drm_output->drm_backend, output, enabled);
+}
+
 bool 
 backend_prepare_output_frame_drm(struct vt_backend_t* backend, struct vt_output_t* output) {
   (void)backend;
@@ -1220,6 +3150,17 @@ backend_prepare_output_frame_drm(struct vt_backend_t* backend, struct vt_output_
   if(drm_output->flip_inflight) return false;
   if(!output->needs_repaint && drm_output->modeset_bootstrapped) return false;
 
+  if(drm_output->software) {
+    // Render into whichever buffer is not on screen
+    drm_output->back_idx = drm_output->sw_buffers[0].fb_id == drm_output->current_fb ? 1 : 0;
+    struct drm_dumb_buffer_t* back = &drm_output->sw_buffers[drm_output->back_idx];
+    drm_output->sw_target.data = back->map;
+    drm_output->sw_target.stride = back->stride;
+  } else if(drm_output->bo_rendering) {
+    drm_output->back_idx = drm_output->bo_fbs[0] && drm_output->bo_fbs[0] == drm_output->current_fb ? 1 : 0;
+    output->native_window = &drm_output->bo_targets[drm_output->back_idx];
+  }
+
   return true;
 }
 
@@ -1237,6 +3178,11 @@ backend_implement_drm(struct vt_compositor_t* comp) {
     .handle_frame = backend_handle_frame_drm,
     .terminate = backend_terminate_drm,
     .prepare_output_frame = backend_prepare_output_frame_drm,
+    .scanout_surface = backend_scanout_surface_drm,
+    .set_cursor = backend_set_cursor_drm,
+    .move_cursor = backend_move_cursor_drm,
+    .assign_planes = backend_assign_planes_drm,
+    .set_vrr = backend_set_vrr_drm,
   };
 
   comp->session->impl = (struct vt_session_interface_t){
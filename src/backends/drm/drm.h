@@ -13,3 +13,13 @@ bool backend_handle_frame_drm(struct vt_backend_t* backend, struct vt_output_t*
 bool backend_terminate_drm(struct vt_backend_t* backend);
 
 bool backend_prepare_output_frame_drm(struct vt_backend_t* backend, struct vt_output_t* output);
+
+bool backend_scanout_surface_drm(struct vt_backend_t* backend, struct vt_output_t* output, struct vt_surface_t* surf);
+
+bool backend_set_cursor_drm(struct vt_backend_t* backend, struct vt_output_t* output, struct vt_surface_t* surf, int32_t hotspot_x, int32_t hotspot_y);
+
+bool backend_move_cursor_drm(struct vt_backend_t* backend, struct vt_output_t* output, int32_t x, int32_t y);
+
+bool backend_assign_planes_drm(struct vt_backend_t* backend, struct vt_output_t* output);
+
+bool backend_set_vrr_drm(struct vt_backend_t* backend, struct vt_output_t* output, bool enabled);
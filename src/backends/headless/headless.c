@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+#include "headless.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "core/compositor.h"
+#include "render/renderer.h"
+#include "protocols/wl_shm.h"
+#include "protocols/presentation_time.h"
+
+#define _HEADLESS_DEFAULT_OUTPUT_WIDTH 1920
+#define _HEADLESS_DEFAULT_OUTPUT_HEIGHT 1080
+#define _HEADLESS_DEFAULT_REFRESH_RATE 60.0f
+
+#define _SUBSYS_NAME "HEADLESS"
+
+#define _vt_fourcc_code(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+  ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define _VT_DRM_FORMAT_ARGB8888	_vt_fourcc_code('A', 'R', '2', '4') /* [31:0] A:R:G:B 8:8:8:8 little endian */
+#define _VT_DRM_FORMAT_XRGB8888	_vt_fourcc_code('X', 'R', '2', '4') /* [31:0] x:R:G:B 8:8:8:8 little endian */
+
+struct headless_backend_state_t {
+  struct vt_compositor_t* comp;
+};
+
+struct headless_output_state_t {
+  // Timer that emulates the vblank of the virtual output
+  int32_t timer_fd;
+  struct wl_event_source* vblank_source;
+
+  // Length of a refresh cycle and the time of the first vblank,
+  // every following vblank happens on base + n * period.
+  uint64_t refresh_nsec, vblank_base_nsec;
+
+  bool frame_pending;
+};
+
+static uint64_t _headless_get_time_nsec(void);
+
+static int      _headless_handle_vblank(int fd, uint32_t mask, void* data);
+
+static bool     _headless_arm_vblank(struct vt_output_t* output);
+
+static bool     _headless_create_output(struct vt_backend_t* backend, struct vt_output_t* output, uint32_t idx);
+
+static bool     _headless_destroy_output(struct vt_backend_t* backend, struct vt_output_t* output);
+
+static bool     _headless_init_active_outputs(struct vt_backend_t* backend);
+
+static bool     _headless_init_keymap(struct vt_compositor_t* comp);
+
+uint64_t
+_headless_get_time_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int
+_headless_handle_vblank(int fd, uint32_t mask, void* data) {
+  struct vt_output_t* output = data;
+  if(!output || !output->user_data) return 0;
+  struct headless_output_state_t* headless_output = BACKEND_DATA(output, struct headless_output_state_t);
+  struct vt_compositor_t* comp = output->backend->comp;
+
+  // Drain the expiration count, we only care that the vblank happened
+  uint64_t expirations;
+  if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    if(errno != EAGAIN) {
+      VT_ERROR(comp->log, "Failed to read vblank timer of output %p: %s", output, strerror(errno));
+    }
+    return 0;
+  }
+
+  output->last_vblank_ns = _headless_get_time_nsec();
+  output->msc += expirations;
+  output->presentation_flags = VT_PRESENTATION_VSYNC;
+
+  if(!headless_output->frame_pending) return 0;
+  headless_output->frame_pending = false;
+
+  // Send the frame callbacks to all clients, establishing correct frame pacing
+  vt_proto_presentation_presented(output);
+  vt_comp_frame_done(comp, output, vt_util_get_time_msec());
+
+  vt_comp_frame_presented(comp, output);
+
+  return 0;
+}
+
+bool
+_headless_arm_vblank(struct vt_output_t* output) {
+  struct headless_output_state_t* headless_output = BACKEND_DATA(output, struct headless_output_state_t);
+
+  // Snap the next vblank to the refresh grid of the output so that
+  // a late frame does not shift the phase of every following vblank.
+  uint64_t now = _headless_get_time_nsec();
+  uint64_t period = headless_output->refresh_nsec;
+  uint64_t cycles = (now - headless_output->vblank_base_nsec) / period + 1;
+  uint64_t next = headless_output->vblank_base_nsec + cycles * period;
+
+  struct itimerspec its = {0};
+  its.it_value.tv_sec = next / 1000000000ull;
+  its.it_value.tv_nsec = next % 1000000000ull;
+
+  if(timerfd_settime(headless_output->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+    VT_ERROR(output->backend->comp->log, "Failed to arm vblank timer of output %p: %s", output, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool
+_headless_create_output(struct vt_backend_t* backend, struct vt_output_t* output, uint32_t idx) {
+  if(!backend || !output) return false;
+  struct vt_compositor_t* comp = backend->comp;
+
+  VT_TRACE(comp->log, "Creating headless output.");
+  if(!(output->user_data = calloc(1, sizeof(struct headless_output_state_t)))) {
+    return false;
+  }
+  struct headless_output_state_t* headless_output = BACKEND_DATA(output, struct headless_output_state_t);
+
+  output->width = comp->virtual_output_width ? comp->virtual_output_width : _HEADLESS_DEFAULT_OUTPUT_WIDTH;
+  output->height = comp->virtual_output_height ? comp->virtual_output_height : _HEADLESS_DEFAULT_OUTPUT_HEIGHT;
+  output->refresh_rate = comp->virtual_output_refresh > 0.0f ? comp->virtual_output_refresh : _HEADLESS_DEFAULT_REFRESH_RATE;
+  // The layout puts unconfigured outputs left to right
+  snprintf(output->name, sizeof(output->name), "HEADLESS-%u", idx + 1);
+  output->format = _VT_DRM_FORMAT_XRGB8888;
+  output->native_window = NULL;
+
+  headless_output->refresh_nsec = (uint64_t)(1000000000.0 / output->refresh_rate);
+  output->refresh_ns = headless_output->refresh_nsec;
+  headless_output->vblank_base_nsec = _headless_get_time_nsec();
+  headless_output->frame_pending = false;
+
+  headless_output->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(headless_output->timer_fd < 0) {
+    VT_ERROR(comp->log, "Failed to create vblank timer for headless output: %s", strerror(errno));
+    return false;
+  }
+
+  headless_output->vblank_source = wl_event_loop_add_fd(
+    comp->wl.evloop, headless_output->timer_fd, WL_EVENT_READABLE, _headless_handle_vblank, output);
+  if(!headless_output->vblank_source) {
+    VT_ERROR(comp->log, "Failed to add vblank timer of headless output to the event loop.");
+    close(headless_output->timer_fd);
+    headless_output->timer_fd = -1;
+    return false;
+  }
+
+  if(!vt_comp_add_output(comp, output)) {
+    wl_event_source_remove(headless_output->vblank_source);
+    headless_output->vblank_source = NULL;
+    close(headless_output->timer_fd);
+    headless_output->timer_fd = -1;
+    return false;
+  }
+
+  VT_TRACE(comp->log, "Created headless output %i (%ux%u@%.2f).",
+           idx, output->width, output->height, output->refresh_rate);
+
+  return true;
+}
+
+bool
+_headless_destroy_output(struct vt_backend_t* backend, struct vt_output_t* output) {
+  if(!output || !output->user_data) return false;
+
+  struct headless_output_state_t* headless_output = BACKEND_DATA(output, struct headless_output_state_t);
+
+  if(headless_output->vblank_source) {
+    wl_event_source_remove(headless_output->vblank_source);
+    headless_output->vblank_source = NULL;
+  }
+  if(headless_output->timer_fd >= 0) {
+    close(headless_output->timer_fd);
+    headless_output->timer_fd = -1;
+  }
+
+  if(output->user_data_render) {
+    backend->comp->renderer->impl.destroy_renderable_output(backend->comp->renderer, output);
+  }
+
+  vt_comp_cancel_repaint(backend->comp, output);
+  vt_proto_presentation_output_destroy(output);
+
+  free(output->user_data);
+  output->user_data = NULL;
+  pixman_region32_fini(&output->damage);
+  vt_comp_remove_output(backend->comp, output);
+
+  return true;
+}
+
+bool
+_headless_init_active_outputs(struct vt_backend_t* backend) {
+  if(!backend) return false;
+  struct vt_compositor_t* comp = backend->comp;
+
+  VT_TRACE(comp->log, "Initializing active outputs.");
+
+  if (!comp->renderer || !comp->renderer->impl.setup_renderable_output) {
+    VT_ERROR(comp->log, "Renderer backend not initialized before output setup.");
+    return false;
+  }
+
+  uint32_t n_outputs = comp->n_virtual_outputs ? comp->n_virtual_outputs : 1;
+  for (uint32_t i = 0; i < n_outputs; i++) {
+    struct vt_output_t* output = VT_ALLOC(comp, sizeof(struct vt_output_t));
+    output->needs_damage_rebuild = true;
+    pixman_region32_init(&output->damage);
+    output->backend = backend;
+    if (!_headless_create_output(backend, output, i)) {
+      VT_ERROR(comp->log, "Failed to setup headless output.");
+      free(output->user_data);
+      output->user_data = NULL;
+      pixman_region32_fini(&output->damage);
+      continue;
+    }
+    if(!comp->renderer->impl.setup_renderable_output(comp->renderer, output)) {
+      VT_ERROR(comp->log, "Failed to setup renderable output for headless output (%ix%i@%.2f)",
+                output->width, output->height, output->refresh_rate);
+      _headless_destroy_output(backend, output);
+      continue;
+    }
+    vt_comp_schedule_repaint(comp, output);
+  }
+
+  if (wl_list_empty(&comp->outputs)) {
+    VT_ERROR(comp->log, "No outputs have been initialized.");
+    return false;
+  }
+
+  // Pacing is done by the vblank timers, there is no swapchain to wait on.
+  comp->renderer->impl.set_vsync(comp->renderer, false);
+
+  return true;
+}
+
+bool
+_headless_init_keymap(struct vt_compositor_t* comp) {
+  // There are no input devices on a headless host, but clients that bind
+  // wl_keyboard still expect a keymap, so provide the default one.
+  struct vt_input_backend_t* input = comp->input_backend;
+  if(!(input->kb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS))) {
+    VT_ERROR(comp->log, "Failed to create XKB context.");
+    return false;
+  }
+  if(!(input->keymap = xkb_keymap_new_from_names(input->kb_context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS))) {
+    VT_ERROR(comp->log, "Failed to compile default XKB keymap.");
+    return false;
+  }
+  if(!(input->kb_state = xkb_state_new(input->keymap))) {
+    VT_ERROR(comp->log, "Failed to create XKB state.");
+    return false;
+  }
+  return true;
+}
+
+// ===================================================
+// =================== PUBLIC API ====================
+// ===================================================
+bool
+backend_init_headless(struct vt_backend_t* backend) {
+  if(!backend) return false;
+  if(!(backend->user_data = VT_ALLOC(backend->comp, sizeof(struct headless_backend_state_t)))) return false;
+  struct vt_compositor_t* c = backend->comp;
+  struct headless_backend_state_t* headless = BACKEND_DATA(backend, struct headless_backend_state_t);
+  headless->comp = c;
+
+  VT_TRACE(c->log, "Initializing headless backend...");
+
+  // The surfaceless platform has no native display, EGL picks the default device.
+  if(!c->renderer->impl.init(backend, c->renderer, NULL)) {
+    VT_ERROR(c->log, "Failed to initialize renderer on the surfaceless platform.");
+    return false;
+  }
+
+  // Without a scanout device there is nothing to negotiate DMABUF feedback
+  // against, so clients are served over SHM only.
+  if(c->have_proto_dmabuf || c->have_proto_dmabuf_explicit_sync) {
+    VT_TRACE(c->log, "Headless backend does not support linux-dmabuf, disabling DMABUF protocols.");
+    c->have_proto_dmabuf = false;
+    c->have_proto_dmabuf_explicit_sync = false;
+  }
+
+  uint32_t shm_formats[] = { _VT_DRM_FORMAT_XRGB8888, _VT_DRM_FORMAT_ARGB8888 };
+  if(!vt_proto_wl_shm_init(c, shm_formats, 2)) {
+    VT_ERROR(c->log, "Failed to initialize WL SHM protcol.");
+    return false;
+  }
+
+  if(!_headless_init_keymap(c)) {
+    VT_ERROR(c->log, "Failed to initialize default keymap.");
+    return false;
+  }
+
+  if(!_headless_init_active_outputs(backend)) return false;
+
+  VT_TRACE(c->log, "Successfully initialized headless backend.");
+
+  return true;
+}
+
+bool
+backend_is_dmabuf_importable_headless(struct vt_backend_t* backend, struct vt_dmabuf_attr_t* attr, int32_t device_fd) {
+  (void)backend;
+  (void)attr;
+  (void)device_fd;
+  return false;
+}
+
+bool
+backend_handle_frame_headless(struct vt_backend_t* backend, struct vt_output_t* output) {
+  if(!backend || !output || !output->user_data) return false;
+  struct headless_output_state_t* headless_output = BACKEND_DATA(output, struct headless_output_state_t);
+
+  // The scene was already rendered into the output's FBO,
+  // "presenting" it just means waiting for the next vblank.
+  if(!_headless_arm_vblank(output)) {
+    output->needs_repaint = true;
+    return false;
+  }
+
+  headless_output->frame_pending = true;
+
+  return true;
+}
+
+bool
+backend_prepare_output_frame_headless(struct vt_backend_t* backend, struct vt_output_t* output) {
+  (void)backend;
+  struct headless_output_state_t* headless_output = BACKEND_DATA(output, struct headless_output_state_t);
+  if(headless_output->frame_pending) return false;
+
+  return true;
+}
+
+bool
+backend_terminate_headless(struct vt_backend_t* backend) {
+  if(!backend || !backend->user_data) return false;
+
+  struct vt_output_t* output, *tmp;
+  wl_list_for_each_safe(output, tmp, &backend->comp->outputs, link_global) {
+    _headless_destroy_output(backend, output);
+  }
+
+  struct vt_input_backend_t* input = backend->comp->input_backend;
+  if(input->kb_state) {
+    xkb_state_unref(input->kb_state);
+    input->kb_state = NULL;
+  }
+  if(input->keymap) {
+    xkb_keymap_unref(input->keymap);
+    input->keymap = NULL;
+  }
+  if(input->kb_context) {
+    xkb_context_unref(input->kb_context);
+    input->kb_context = NULL;
+  }
+
+  backend->user_data = NULL;
+
+  return true;
+}
+
+bool
+backend_implement_headless(struct vt_compositor_t* comp) {
+  if(!comp || !comp->backend) return false;
+
+  VT_TRACE(comp->log, "Implementing backend...");
+
+  comp->backend->platform = VT_BACKEND_SURFACELESS;
+  comp->backend->impl = (struct vt_backend_interface_t){
+    .init = backend_init_headless,
+    .is_dmabuf_importable = backend_is_dmabuf_importable_headless,
+    .handle_frame = backend_handle_frame_headless,
+    .terminate = backend_terminate_headless,
+    .prepare_output_frame = backend_prepare_output_frame_headless,
+  };
+
+  // No session on a headless host
+  memset(&comp->session->impl, 0, sizeof(comp->session->impl));
+
+  return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../../core/core_types.h"
+
+bool backend_init_headless(struct vt_backend_t* backend);
+
+bool backend_is_dmabuf_importable_headless(struct vt_backend_t* backend, struct vt_dmabuf_attr_t* attr, int32_t device_fd);
+
+bool backend_implement_headless(struct vt_compositor_t* comp);
+  
+bool backend_handle_frame_headless(struct vt_backend_t* backend, struct vt_output_t* output);
+  
+bool backend_terminate_headless(struct vt_backend_t* backend);
+
+bool backend_prepare_output_frame_headless(struct vt_backend_t* backend, struct vt_output_t* output);
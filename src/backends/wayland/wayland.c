@@ -13,16 +13,30 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/sysmacros.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <time.h>
 
 #include "xdg-shell-client-protocol.h"
+#include "linux-dmabuf-v1-client-protocol.h"
+#include "presentation-time-client-protocol.h"
 #include "../../render/renderer.h"
 #include "../../core/compositor.h"
 #include "../../protocols/linux_dmabuf.h"
 #include "../../protocols/wl_shm.h"
 #include "../../protocols/linux_explicit_sync.h"
+#include "../../protocols/presentation_time.h"
+#include "../../core/scene.h"
+#include "../../core/output_layout.h"
 
 #define _WL_DEFAULT_OUTPUT_WIDTH 1280
 #define _WL_DEFAULT_OUTPUT_HEIGHT 720
+#define _WL_MAX_PASSTHROUGH_SURFACES 8
+#define _WL_DEFAULT_REFRESH_NS 16666667ull
+// Missed parent frame callbacks before the fallback timer paces the output
+#define _WL_THROTTLE_GRACE_FRAMES 2
+// Pace of a toplevel the parent marked as suspended
+#define _WL_SUSPENDED_TICK_NS 1000000000ull
 
 #define _SUBSYS_NAME "WL"
 
@@ -30,17 +44,70 @@ typedef struct {
   bool nested;
   struct wl_display* parent_display;
   struct wl_compositor* parent_compositor;
+  struct wl_subcompositor* parent_subcompositor;
+  struct zwp_linux_dmabuf_v1* parent_dmabuf;
+  struct wp_presentation* parent_presentation;
+  // Clock of the parent's presentation timestamps
+  uint32_t parent_clock_id;
   struct xdg_wm_base* parent_xdg_wm_base;
   struct wl_seat* parent_seat;
   struct vt_compositor_t* comp;
+
+  // Client DMABUFs are handed to the parent as is instead of being composited
+  bool passthrough;
 } wayland_backend_state_t;
 
+enum wayland_passthrough_buffer_state_t {
+  WL_PASSTHROUGH_BUFFER_PENDING = 0,
+  WL_PASSTHROUGH_BUFFER_READY,
+  WL_PASSTHROUGH_BUFFER_FAILED,
+};
+
+// Parent wl_buffer wrapping a client DMABUF, kept in the user data of the DMABUF
+typedef struct {
+  struct vt_linux_dmabuf_v1_buffer_t* dmabuf;
+  struct zwp_linux_buffer_params_v1* params;
+  struct wl_buffer* buffer;
+  struct vt_compositor_t* comp;
+  enum wayland_passthrough_buffer_state_t state;
+  // The parent reads from the buffer, it holds a lock on the DMABUF until released
+  bool busy;
+} wayland_passthrough_buffer_t;
+
+// Parent subsurface that shows a client buffer above the composited output
+typedef struct {
+  struct wl_surface* surface;
+  struct wl_subsurface* subsurface;
+  wayland_passthrough_buffer_t* buffer;
+  int32_t x, y;
+} wayland_passthrough_slot_t;
+
+// Presentation feedback the parent gives for one of our commits
+typedef struct {
+  struct wp_presentation_feedback* feedback;
+  struct vt_output_t* output;
+  // Frame of the output whose client feedback this resolves
+  uint64_t frame_seq;
+  struct wl_list link;
+} wayland_parent_feedback_t;
+
 typedef struct {
   struct wl_surface *parent_surface;
   struct xdg_surface *parent_xdg_surface;
   struct xdg_toplevel *parent_xdg_toplevel;
   struct wl_callback* parent_frame_cb;
 
+  // Ordered from top to bottom, the first 'n_passthrough' are in use
+  wayland_passthrough_slot_t passthrough[_WL_MAX_PASSTHROUGH_SURFACES];
+  uint32_t n_passthrough;
+
+  // Presentation feedback of the frames committed to the parent, oldest first
+  struct wl_list parent_feedbacks;
+
+  // Completes frames the parent does not call back for (occluded or suspended window)
+  int32_t fallback_timer_fd;
+  struct wl_event_source* fallback_timer;
+  bool throttled, suspended;
 } wayland_output_state_t;
 
 
@@ -77,6 +144,49 @@ static bool _wl_backend_create_output(struct vt_backend_t* backend, struct vt_ou
 
 static bool _wl_backend_init_active_outputs(struct vt_backend_t* backend);
 
+static void _wl_passthrough_params_created(void* data, struct zwp_linux_buffer_params_v1* params, struct wl_buffer* buffer);
+
+static void _wl_passthrough_params_failed(void* data, struct zwp_linux_buffer_params_v1* params);
+
+static void _wl_passthrough_buffer_release(void* data, struct wl_buffer* buffer);
+
+static void _wl_passthrough_buffer_destroy(struct vt_linux_dmabuf_v1_buffer_t* buf, void* data);
+
+static wayland_passthrough_buffer_t* _wl_passthrough_buffer_from_dmabuf(wayland_backend_state_t* wl, struct vt_linux_dmabuf_v1_buffer_t* buf);
+
+static bool _wl_claim_passthrough(struct vt_output_t* output, struct vt_surface_t* surf, void* user_data);
+
+static void _wl_passthrough_slot_unmap(wayland_passthrough_slot_t* slot);
+
+static void _wl_parent_presentation_clock_id(void* data, struct wp_presentation* presentation, uint32_t clk_id);
+
+static void _wl_parent_feedback_sync_output(void* data, struct wp_presentation_feedback* feedback, struct wl_output* output);
+
+static void _wl_parent_feedback_presented(
+  void* data, struct wp_presentation_feedback* feedback,
+  uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+  uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags);
+
+static void _wl_parent_feedback_discarded(void* data, struct wp_presentation_feedback* feedback);
+
+static void _wl_parent_feedback_destroy(wayland_parent_feedback_t* pfb);
+
+static void _wl_parent_feedbacks_clear(wayland_output_state_t* wl_output);
+
+static void _wl_output_complete_frame(struct vt_output_t* output, uint32_t time);
+
+static bool _wl_arm_fallback_timer(struct vt_output_t* output);
+
+static int  _wl_handle_fallback_timer(int fd, uint32_t mask, void* data);
+
+#ifdef XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION
+static void _wl_parent_xdg_toplevel_configure_bounds(void* data, struct xdg_toplevel* toplevel, int32_t w, int32_t h);
+#endif
+
+#ifdef XDG_TOPLEVEL_WM_CAPABILITIES_SINCE_VERSION
+static void _wl_parent_xdg_toplevel_wm_capabilities(void* data, struct xdg_toplevel* toplevel, struct wl_array* caps);
+#endif
+
 static struct wl_callback_listener parent_surface_frame_listener = {
   .done = _wl_parent_frame_done 
 };
@@ -97,6 +207,31 @@ static const struct xdg_surface_listener parent_xdg_surface_listener = {
 static const struct xdg_toplevel_listener parent_toplevel_listener = {
   .configure = _wl_parent_xdg_toplevel_configure,
   .close = _wl_parent_xdg_toplevel_close,
+#ifdef XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION
+  .configure_bounds = _wl_parent_xdg_toplevel_configure_bounds,
+#endif
+#ifdef XDG_TOPLEVEL_WM_CAPABILITIES_SINCE_VERSION
+  .wm_capabilities = _wl_parent_xdg_toplevel_wm_capabilities,
+#endif
+};
+
+static const struct wp_presentation_listener parent_presentation_listener = {
+  .clock_id = _wl_parent_presentation_clock_id,
+};
+
+static const struct wp_presentation_feedback_listener parent_feedback_listener = {
+  .sync_output = _wl_parent_feedback_sync_output,
+  .presented = _wl_parent_feedback_presented,
+  .discarded = _wl_parent_feedback_discarded,
+};
+
+static const struct zwp_linux_buffer_params_v1_listener passthrough_params_listener = {
+  .created = _wl_passthrough_params_created,
+  .failed = _wl_passthrough_params_failed,
+};
+
+static const struct wl_buffer_listener passthrough_buffer_listener = {
+  .release = _wl_passthrough_buffer_release,
 };
 
 
@@ -107,8 +242,18 @@ _wl_parent_registry_add(
   wayland_backend_state_t* wl = data;
   if (strcmp(iface, wl_compositor_interface.name) == 0) {
     wl->parent_compositor = wl_registry_bind(reg, id, &wl_compositor_interface, 4);
+  } else if (strcmp(iface, wl_subcompositor_interface.name) == 0) {
+    wl->parent_subcompositor = wl_registry_bind(reg, id, &wl_subcompositor_interface, 1);
+  } else if (strcmp(iface, zwp_linux_dmabuf_v1_interface.name) == 0 && ver >= 2) {
+    // Buffers are created asynchronously, so that the parent can refuse them without an error
+    wl->parent_dmabuf = wl_registry_bind(reg, id, &zwp_linux_dmabuf_v1_interface, ver < 3 ? ver : 3);
+  } else if (strcmp(iface, wp_presentation_interface.name) == 0) {
+    wl->parent_presentation = wl_registry_bind(reg, id, &wp_presentation_interface, 1);
+    wp_presentation_add_listener(wl->parent_presentation, &parent_presentation_listener, wl);
   } else if (strcmp(iface, xdg_wm_base_interface.name) == 0) {
-    wl->parent_xdg_wm_base = wl_registry_bind(reg, id, &xdg_wm_base_interface, 1);
+    // Version 6 tells us when the parent suspends the window
+    uint32_t max_ver = xdg_wm_base_interface.version < 6 ? xdg_wm_base_interface.version : 6;
+    wl->parent_xdg_wm_base = wl_registry_bind(reg, id, &xdg_wm_base_interface, ver < max_ver ? ver : max_ver);
   } else if (strcmp(iface, wl_seat_interface.name) == 0) {
     wl->parent_seat = wl_registry_bind(reg, id, &wl_seat_interface, 7);
     wl->comp->session->native_handle = wl->parent_seat;
@@ -135,6 +280,7 @@ static void _output_handle_render_resize(struct vt_output_t* output, int32_t w,
 
     output->width = w;
     output->height = h;
+      vt_output_layout_update(r->comp->output_layout, output);
       r->impl.resize_renderable_output(r, output, w, h);
       output->resize_pending = true;
     }
@@ -149,6 +295,20 @@ _wl_parent_xdg_toplevel_configure(void *data,
   if(!output || !output->user_data) return;
   wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t);
   if(!wl_output) return;
+
+  bool suspended = false;
+#ifdef XDG_TOPLEVEL_STATE_SUSPENDED_SINCE_VERSION
+  uint32_t* state;
+  wl_array_for_each(state, states) {
+    if(*state == XDG_TOPLEVEL_STATE_SUSPENDED) suspended = true;
+  }
+#endif
+  if(suspended != wl_output->suspended) {
+    // The parent will not call back while suspended, the fallback timer drops to a low rate
+    wl_output->suspended = suspended;
+    VT_TRACE(output->backend->comp->log, "Parent %s output %p.", suspended ? "suspended" : "resumed", output);
+    if(wl_output->parent_frame_cb) _wl_arm_fallback_timer(output);
+  }
   
   // Handle resize output in renderer
   if(w != output->width || h != output->height) {
@@ -173,6 +333,20 @@ _wl_parent_xdg_surface_configure(void *data,
    }
 }
 
+#ifdef XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION
+void 
+_wl_parent_xdg_toplevel_configure_bounds(void* data, struct xdg_toplevel* toplevel, int32_t w, int32_t h) {
+  (void)data; (void)toplevel; (void)w; (void)h;
+}
+#endif
+
+#ifdef XDG_TOPLEVEL_WM_CAPABILITIES_SINCE_VERSION
+void 
+_wl_parent_xdg_toplevel_wm_capabilities(void* data, struct xdg_toplevel* toplevel, struct wl_array* caps) {
+  (void)data; (void)toplevel; (void)caps;
+}
+#endif
+
 void 
 _wl_parent_xdg_toplevel_close(void *data, struct xdg_toplevel *toplevel) {
   struct vt_output_t* output = data;
@@ -205,8 +379,298 @@ _wl_parent_frame_done(void *data,
   wl_callback_destroy(wl_callback);
   wl_output->parent_frame_cb = NULL;
 
+  // The parent paces us again
+  wl_output->throttled = false;
+  _wl_output_complete_frame(output, time);
+}
+
+void 
+_wl_output_complete_frame(struct vt_output_t* output, uint32_t time) {
+  wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t); 
+  struct vt_compositor_t* comp = output->backend->comp;
+
+  if(wl_output->fallback_timer_fd >= 0) {
+    struct itimerspec its = {0};
+    timerfd_settime(wl_output->fallback_timer_fd, 0, &its, NULL);
+  }
+
+  // Without the parent's presentation feedback, the frame callback is 
+  // the closest thing to a vblank we get, so it is not hardware timed.
+  if(wl_list_empty(&wl_output->parent_feedbacks)) {
+    output->last_vblank_ns = vt_util_get_time_nsec();
+    output->msc++;
+    output->presentation_flags = 0;
+    vt_proto_presentation_presented(output);
+  }
+
   vt_comp_frame_done(comp, output, time); 
 
+  vt_comp_frame_presented(comp, output);
+}
+
+void 
+_wl_parent_presentation_clock_id(void* data, struct wp_presentation* presentation, uint32_t clk_id) {
+  (void)presentation;
+  wayland_backend_state_t* wl = data;
+  wl->parent_clock_id = clk_id;
+}
+
+void 
+_wl_parent_feedback_sync_output(void* data, struct wp_presentation_feedback* feedback, struct wl_output* output) {
+  (void)data; (void)feedback; (void)output;
+}
+
+void 
+_wl_parent_feedback_presented(
+  void* data, struct wp_presentation_feedback* feedback,
+  uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+  uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags) {
+  (void)feedback;
+  wayland_parent_feedback_t* pfb = data;
+  struct vt_output_t* output = pfb->output;
+  const uint64_t frame_seq = pfb->frame_seq;
+  wayland_backend_state_t* wl = BACKEND_DATA(output->backend, wayland_backend_state_t); 
+  _wl_parent_feedback_destroy(pfb);
+
+  // Our frames reach the screen with the parent's, so its timing is ours
+  const uint64_t sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo;
+  output->last_vblank_ns = wl->parent_clock_id == CLOCK_MONOTONIC ? 
+    sec * 1000000000ull + tv_nsec : vt_util_get_time_nsec();
+  output->msc = ((uint64_t)seq_hi << 32) | seq_lo;
+  output->presentation_flags = flags & 
+    (VT_PRESENTATION_VSYNC | VT_PRESENTATION_HW_CLOCK | VT_PRESENTATION_HW_COMPLETION);
+  if(refresh) {
+    output->refresh_ns = refresh;
+    output->refresh_rate = 1e9f / (float)refresh;
+  }
+  vt_proto_presentation_presented_frame(output, frame_seq);
+}
+
+void 
+_wl_parent_feedback_discarded(void* data, struct wp_presentation_feedback* feedback) {
+  (void)feedback;
+  wayland_parent_feedback_t* pfb = data;
+  struct vt_output_t* output = pfb->output;
+  const uint64_t frame_seq = pfb->frame_seq;
+  _wl_parent_feedback_destroy(pfb);
+
+  // The parent replaced or hid the frame, so the content our clients committed was never seen
+  vt_proto_presentation_discarded_frame(output, frame_seq);
+}
+
+void 
+_wl_parent_feedback_destroy(wayland_parent_feedback_t* pfb) {
+  wp_presentation_feedback_destroy(pfb->feedback);
+  wl_list_remove(&pfb->link);
+  free(pfb);
+}
+
+void 
+_wl_parent_feedbacks_clear(wayland_output_state_t* wl_output) {
+  wayland_parent_feedback_t* pfb, *tmp;
+  wl_list_for_each_safe(pfb, tmp, &wl_output->parent_feedbacks, link) {
+    _wl_parent_feedback_destroy(pfb);
+  }
+}
+
+bool 
+_wl_arm_fallback_timer(struct vt_output_t* output) {
+  wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t); 
+  struct vt_compositor_t* comp = output->backend->comp;
+
+  if(!wl_output->fallback_timer) {
+    wl_output->fallback_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(wl_output->fallback_timer_fd < 0) {
+      VT_ERROR(comp->log, "Failed to create fallback frame timer for output %p: %s", output, strerror(errno));
+      return false;
+    }
+    wl_output->fallback_timer = wl_event_loop_add_fd(
+      comp->wl.evloop, wl_output->fallback_timer_fd, WL_EVENT_READABLE, _wl_handle_fallback_timer, output);
+    if(!wl_output->fallback_timer) {
+      close(wl_output->fallback_timer_fd);
+      wl_output->fallback_timer_fd = -1;
+      return false;
+    }
+  }
+
+  // Give the parent a few refresh cycles before taking over, once 
+  // throttled, the output runs at its nominal refresh on its own.
+  const uint64_t refresh = output->refresh_ns ? output->refresh_ns : _WL_DEFAULT_REFRESH_NS;
+  uint64_t delay = wl_output->suspended ? _WL_SUSPENDED_TICK_NS : 
+    wl_output->throttled ? refresh : refresh * _WL_THROTTLE_GRACE_FRAMES;
+
+  struct itimerspec its = {0};
+  its.it_value.tv_sec = delay / 1000000000ull;
+  its.it_value.tv_nsec = delay % 1000000000ull;
+  if(timerfd_settime(wl_output->fallback_timer_fd, 0, &its, NULL) != 0) {
+    VT_ERROR(comp->log, "Failed to arm fallback frame timer for output %p: %s", output, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+int 
+_wl_handle_fallback_timer(int fd, uint32_t mask, void* data) {
+  (void)mask;
+  struct vt_output_t* output = data;
+  if(!output || !output->user_data) return 0;
+  wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t); 
+
+  uint64_t expirations;
+  if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return 0;
+  if(!wl_output->parent_frame_cb) return 0;
+
+  // The parent stopped calling back, so its callback (and the feedback 
+  // of the frame) are dropped and the frame is completed by us.
+  if(!wl_output->throttled) {
+    VT_TRACE(output->backend->comp->log, "Parent throttles output %p, pacing it with the fallback timer.", output);
+  }
+  wl_output->throttled = true;
+  wl_callback_destroy(wl_output->parent_frame_cb);
+  wl_output->parent_frame_cb = NULL;
+  _wl_parent_feedbacks_clear(wl_output);
+
+  _wl_output_complete_frame(output, vt_util_get_time_msec());
+  return 0;
+}
+
+void 
+_wl_passthrough_params_created(void* data, struct zwp_linux_buffer_params_v1* params, struct wl_buffer* buffer) {
+  wayland_passthrough_buffer_t* pb = data;
+  zwp_linux_buffer_params_v1_destroy(params);
+  pb->params = NULL;
+  pb->buffer = buffer;
+  pb->state = WL_PASSTHROUGH_BUFFER_READY;
+  wl_buffer_add_listener(buffer, &passthrough_buffer_listener, pb);
+
+  VT_TRACE(pb->comp->log, "Parent accepted DMABUF %p for passthrough.", pb->dmabuf);
+
+  // The surface can go on a subsurface with the next frame
+  struct vt_output_t* output;
+  wl_list_for_each(output, &pb->comp->outputs, link_global) {
+    vt_comp_schedule_repaint(pb->comp, output);
+  }
+}
+
+void 
+_wl_passthrough_params_failed(void* data, struct zwp_linux_buffer_params_v1* params) {
+  wayland_passthrough_buffer_t* pb = data;
+  zwp_linux_buffer_params_v1_destroy(params);
+  pb->params = NULL;
+  // The buffer stays composited for its whole lifetime
+  pb->state = WL_PASSTHROUGH_BUFFER_FAILED;
+
+  VT_TRACE(pb->comp->log, "Parent refused DMABUF %p (format 0x%08x), compositing it instead.", 
+           pb->dmabuf, pb->dmabuf->attr.format);
+}
+
+void 
+_wl_passthrough_buffer_release(void* data, struct wl_buffer* buffer) {
+  (void)buffer;
+  wayland_passthrough_buffer_t* pb = data;
+  if(!pb->busy) return;
+  pb->busy = false;
+  vt_proto_linux_dmabuf_v1_buffer_unlock(pb->dmabuf);
+}
+
+void 
+_wl_passthrough_buffer_destroy(struct vt_linux_dmabuf_v1_buffer_t* buf, void* data) {
+  (void)buf;
+  wayland_passthrough_buffer_t* pb = data;
+  if(!pb) return;
+  if(pb->params) zwp_linux_buffer_params_v1_destroy(pb->params);
+  if(pb->buffer) wl_buffer_destroy(pb->buffer);
+  free(pb);
+}
+
+wayland_passthrough_buffer_t* 
+_wl_passthrough_buffer_from_dmabuf(wayland_backend_state_t* wl, struct vt_linux_dmabuf_v1_buffer_t* buf) {
+  wayland_passthrough_buffer_t* pb = buf->user_data;
+  if(pb) return pb->state == WL_PASSTHROUGH_BUFFER_READY ? pb : NULL;
+
+  if(!(pb = calloc(1, sizeof(*pb)))) return NULL;
+  pb->dmabuf = buf;
+  pb->comp = wl->comp;
+  pb->state = WL_PASSTHROUGH_BUFFER_PENDING;
+
+  // The parent gets its own reference to the planes, the FDs stay with the client buffer
+  pb->params = zwp_linux_dmabuf_v1_create_params(wl->parent_dmabuf);
+  for(int32_t i = 0; i < buf->attr.num_planes; i++) {
+    zwp_linux_buffer_params_v1_add(pb->params, buf->attr.fds[i], i, 
+                                   buf->attr.offsets[i], buf->attr.strides[i], 
+                                   buf->attr.mod >> 32, buf->attr.mod & 0xffffffff);
+  }
+  zwp_linux_buffer_params_v1_add_listener(pb->params, &passthrough_params_listener, pb);
+  zwp_linux_buffer_params_v1_create(pb->params, buf->attr.width, buf->attr.height, buf->attr.format, 0);
+  vt_proto_linux_dmabuf_v1_buffer_set_user_data(buf, pb, _wl_passthrough_buffer_destroy);
+
+  // Composited until the parent answered
+  return NULL;
+}
+
+bool 
+_wl_claim_passthrough(struct vt_output_t* output, struct vt_surface_t* surf, void* user_data) {
+  wayland_backend_state_t* wl = user_data;
+  wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t);
+  struct vt_linux_dmabuf_v1_buffer_t* buf = surf->locked_dmabuf;
+
+  if(!buf || surf->sync.res || surf->buffer_scale != 1) return false;
+  if(wl_output->n_passthrough >= _WL_MAX_PASSTHROUGH_SURFACES) return false;
+
+  // Subsurfaces show the buffer unscaled and must not stick out of the output window
+  if(buf->attr.width != (int32_t)surf->width || buf->attr.height != (int32_t)surf->height) return false;
+  const int32_t x = surf->x - output->x, y = surf->y - output->y;
+  if(x < 0 || y < 0 || 
+    x + buf->attr.width > (int32_t)output->width || y + buf->attr.height > (int32_t)output->height) return false;
+
+  wayland_passthrough_buffer_t* pb = _wl_passthrough_buffer_from_dmabuf(wl, buf);
+  if(!pb) return false;
+
+  const uint32_t idx = wl_output->n_passthrough;
+  wayland_passthrough_slot_t* slot = &wl_output->passthrough[idx];
+  if(!slot->surface) {
+    slot->surface = wl_compositor_create_surface(wl->parent_compositor);
+    slot->subsurface = wl_subcompositor_get_subsurface(wl->parent_subcompositor, slot->surface, wl_output->parent_surface);
+    // Input goes to the output window, which routes it to the right client
+    struct wl_region* empty = wl_compositor_create_region(wl->parent_compositor);
+    wl_surface_set_input_region(slot->surface, empty);
+    wl_region_destroy(empty);
+    slot->x = slot->y = INT32_MIN;
+  }
+
+  // The scene is walked front to back, so every slot goes below the one before it. 
+  // Subsurfaces are synchronized, all of this is applied with the commit of the output.
+  if(idx == 0) {
+    wl_subsurface_place_above(slot->subsurface, wl_output->parent_surface);
+  } else {
+    wl_subsurface_place_below(slot->subsurface, wl_output->passthrough[idx - 1].surface);
+  }
+  if(slot->x != x || slot->y != y) {
+    wl_subsurface_set_position(slot->subsurface, x, y);
+    slot->x = x; slot->y = y;
+  }
+
+  // The parent holds on to the buffer until it releases it
+  if(!pb->busy) {
+    vt_proto_linux_dmabuf_v1_buffer_lock(buf);
+    pb->busy = true;
+  }
+  wl_surface_attach(slot->surface, pb->buffer, 0, 0);
+  wl_surface_damage_buffer(slot->surface, 0, 0, buf->attr.width, buf->attr.height);
+  wl_surface_commit(slot->surface);
+  slot->buffer = pb;
+
+  wl_output->n_passthrough++;
+  vt_util_output_mask_set(&surf->_mask_outputs_presented_on, output->id);
+  return true;
+}
+
+void 
+_wl_passthrough_slot_unmap(wayland_passthrough_slot_t* slot) {
+  if(!slot->surface || !slot->buffer) return;
+  wl_surface_attach(slot->surface, NULL, 0, 0);
+  wl_surface_commit(slot->surface);
+  slot->buffer = NULL;
 }
 
 bool 
@@ -263,6 +727,8 @@ _wl_backend_create_output(struct vt_backend_t* backend, struct vt_output_t* outp
 
   wayland_backend_state_t* wl = BACKEND_DATA(backend, wayland_backend_state_t);
   wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t);
+  wl_output->fallback_timer_fd = -1;
+  wl_list_init(&wl_output->parent_feedbacks);
   wl_output->parent_surface = wl_compositor_create_surface(wl->parent_compositor);
   wl_output->parent_xdg_surface =
     xdg_wm_base_get_xdg_surface(wl->parent_xdg_wm_base, wl_output->parent_surface);
@@ -288,16 +754,15 @@ _wl_backend_create_output(struct vt_backend_t* backend, struct vt_output_t* outp
 
   output->native_window = wl_output->parent_surface;  
 
-  output->id = wl_list_length(&backend->comp->outputs);
   output->refresh_rate = 60;
-  output->x = 0;
-  output->y = 0;
+  output->refresh_ns = _WL_DEFAULT_REFRESH_NS;
+  snprintf(output->name, sizeof(output->name), "WL-%i", wl_list_length(&backend->comp->outputs) + 1);
   output->width = _WL_DEFAULT_OUTPUT_WIDTH;  
   output->height = _WL_DEFAULT_OUTPUT_HEIGHT; 
   output->resize_pending = true;
 
 
-  wl_list_insert(&backend->comp->outputs, &output->link_global);
+  if(!vt_comp_add_output(backend->comp, output)) return false;
  
   return true;
 }
@@ -313,6 +778,27 @@ _wl_backend_destroy_output(struct vt_backend_t* backend, struct vt_output_t* out
   wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t);
   if(!wl_output) return false;
 
+  if (wl_output->fallback_timer) {
+    wl_event_source_remove(wl_output->fallback_timer);
+    wl_output->fallback_timer = NULL;
+  }
+  if (wl_output->fallback_timer_fd >= 0) {
+    close(wl_output->fallback_timer_fd);
+    wl_output->fallback_timer_fd = -1;
+  }
+  _wl_parent_feedbacks_clear(wl_output);
+  if (wl_output->parent_frame_cb) {
+    wl_callback_destroy(wl_output->parent_frame_cb);
+    wl_output->parent_frame_cb = NULL;
+  }
+
+  for (uint32_t i = 0; i < _WL_MAX_PASSTHROUGH_SURFACES; i++) {
+    wayland_passthrough_slot_t* slot = &wl_output->passthrough[i];
+    if (slot->subsurface) wl_subsurface_destroy(slot->subsurface);
+    if (slot->surface) wl_surface_destroy(slot->surface);
+    memset(slot, 0, sizeof(*slot));
+  }
+
   if (wl_output->parent_xdg_toplevel) {
     xdg_toplevel_destroy(wl_output->parent_xdg_toplevel);
     wl_output->parent_xdg_toplevel = NULL;
@@ -328,11 +814,13 @@ _wl_backend_destroy_output(struct vt_backend_t* backend, struct vt_output_t* out
     wl_output->parent_surface = NULL;
   }
 
+  vt_proto_presentation_output_destroy(output);
+
   if(!backend->comp->renderer->impl.destroy_renderable_output(backend->comp->renderer, output)) return false;
 
   output->user_data = NULL;
    
-  wl_list_remove(&output->link_global);
+  vt_comp_remove_output(backend->comp, output);
   output = NULL;
 
   return true;
@@ -446,6 +934,16 @@ backend_init_wl(struct vt_backend_t* backend) {
 
   xdg_wm_base_add_listener(wl->parent_xdg_wm_base, &parent_wm_listener, c);
 
+  // VT_WL_PASSTHROUGH forwards client DMABUFs to the parent on subsurfaces
+  if (getenv("VT_WL_PASSTHROUGH")) {
+    wl->passthrough = wl->parent_subcompositor && wl->parent_dmabuf && c->have_proto_dmabuf;
+    if (!wl->passthrough) {
+      VT_WARN(c->log, "Parent compositor lacks wl_subcompositor or zwp_linux_dmabuf_v1, DMABUF passthrough is disabled.");
+    } else {
+      VT_TRACE(c->log, "Forwarding client DMABUFs to the parent compositor.");
+    }
+  }
+
   int pfd = wl_display_get_fd(wl->parent_display);
   wl_event_loop_add_fd(c->wl.evloop, pfd,
                        WL_EVENT_READABLE, _wl_parent_dispatch, wl);
@@ -529,6 +1027,7 @@ backend_implement_wl(struct vt_compositor_t* comp) {
     .handle_frame = backend_handle_frame_wl,
     .terminate = backend_terminate_wl,
     .prepare_output_frame = backend_prepare_output_frame_wl,
+    .assign_planes = backend_assign_planes_wl,
   };
 
   // No session in Wayland nested
@@ -537,13 +1036,30 @@ backend_implement_wl(struct vt_compositor_t* comp) {
 
 bool 
 backend_handle_frame_wl(struct vt_backend_t* backend, struct vt_output_t* output){
-  // Fully driven by the parent surface's .done event (see _wl_parent_frame_done)
+  // Fully driven by the parent surface's .done event (see _wl_parent_frame_done), 
+  // a frame that is still waiting for it is paced by the same callback.
+  wayland_backend_state_t* wl = BACKEND_DATA(backend, wayland_backend_state_t); 
   wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t); 
-  wl_output->parent_frame_cb = wl_surface_frame(wl_output->parent_surface);
-  wl_callback_add_listener(wl_output->parent_frame_cb, &parent_surface_frame_listener, output);
+  if(!wl_output->parent_frame_cb) {
+    wl_output->parent_frame_cb = wl_surface_frame(wl_output->parent_surface);
+    wl_callback_add_listener(wl_output->parent_frame_cb, &parent_surface_frame_listener, output);
+  }
+  wayland_parent_feedback_t* pfb;
+  if(wl->parent_presentation && (pfb = calloc(1, sizeof(*pfb)))) {
+    // Every commit gets its own feedback, the parent resolves them in order 
+    // and each one only answers the client feedback latched for its frame.
+    pfb->output = output;
+    pfb->frame_seq = output->presentation_seq;
+    pfb->feedback = wp_presentation_feedback(wl->parent_presentation, wl_output->parent_surface);
+    wp_presentation_feedback_add_listener(pfb->feedback, &parent_feedback_listener, pfb);
+    wl_list_insert(wl_output->parent_feedbacks.prev, &pfb->link);
+  }
 
   wl_surface_commit(wl_output->parent_surface);
 
+  // Takes over if the parent stops calling back
+  _wl_arm_fallback_timer(output);
+
   
   return true;
 } 
@@ -577,3 +1093,22 @@ backend_prepare_output_frame_wl(struct vt_backend_t* backend, struct vt_output_t
   (void)output;
   return true;
 }
+
+bool 
+backend_assign_planes_wl(struct vt_backend_t* backend, struct vt_output_t* output) {
+  if(!backend || !backend->user_data || !output || !output->user_data) return false;
+  wayland_backend_state_t* wl = BACKEND_DATA(backend, wayland_backend_state_t);
+  wayland_output_state_t* wl_output = BACKEND_DATA(output, wayland_output_state_t);
+
+  wl_output->n_passthrough = 0;
+  uint32_t n = vt_scene_assign_planes(backend->comp, output, wl->passthrough ? _wl_claim_passthrough : NULL, wl);
+
+  // Slots that are no longer needed show nothing
+  for(uint32_t i = wl_output->n_passthrough; i < _WL_MAX_PASSTHROUGH_SURFACES; i++) {
+    _wl_passthrough_slot_unmap(&wl_output->passthrough[i]);
+  }
+  if(n) {
+    VT_TRACE(backend->comp->log, "Forwarded %u surface(s) to the parent on output %p.", n, output);
+  }
+  return n != 0;
+}
@@ -13,4 +13,6 @@ bool backend_handle_frame_wl(struct vt_backend_t* backend, struct vt_output_t* o
 bool backend_terminate_wl(struct vt_backend_t* backend);
 
 bool backend_prepare_output_frame_wl(struct vt_backend_t* backend, struct vt_output_t* output);
+
+bool backend_assign_planes_wl(struct vt_backend_t* backend, struct vt_output_t* output);
   
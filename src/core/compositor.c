@@ -6,23 +6,30 @@
 #include "src/protocols/xdg_shell.h"
 #include "src/protocols/linux_dmabuf.h"
 #include "src/protocols/wl_surface.h"
+#include "src/protocols/presentation_time.h"
+#include "src/protocols/tearing_control.h"
 #include "src/render/renderer.h"
 
 #include <linux/vt.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <dlfcn.h>
 #include <dirent.h>
 #include <signal.h>
 #include <execinfo.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/timerfd.h>
 
 #include <glad.h>
 #include <wayland-server.h>
 
 #include "config.h"
 #include "scene.h"
+#include "output_layout.h"
 #include "surface.h"
 #include "core_types.h"
 
@@ -30,10 +37,32 @@
 
 #define _SUBSYS_NAME "COMPOSITOR"
 
+// Time a repaint starts ahead of the predicted render time, 
+// covers scheduling jitter and the commit to the hardware.
+#define _VT_REPAINT_SAFETY_MARGIN_NS 1500000ull
+// Presented frames of an output between two summaries of its frame stats
+#define _VT_FRAME_STATS_INTERVAL 3600
+
 static void _vt_comp_frame_handler(void* data);
 
+static int _vt_comp_repaint_timer_handler(int fd, uint32_t mask, void* data);
+
+static uint64_t _vt_comp_predict_render_time(struct vt_output_t* output);
+
+static uint64_t _vt_comp_repaint_deadline(struct vt_output_t* output, uint64_t now);
+
+static bool _vt_comp_arm_repaint_timer(struct vt_compositor_t* c, struct vt_output_t* output, uint64_t deadline);
+
+static void _vt_comp_update_vrr(struct vt_compositor_t* c, struct vt_output_t* output);
+static void _vt_comp_update_tearing(struct vt_compositor_t* c, struct vt_output_t* output);
+static struct vt_surface_t* _vt_comp_fullscreen_focus(struct vt_compositor_t* c, struct vt_output_t* output);
+
 static bool _vt_comp_render_output(struct vt_compositor_t* c, struct vt_output_t* output);
 
+static void _vt_comp_frame_transition(struct vt_compositor_t* c, struct vt_output_t* output, enum vt_output_frame_state_t state);
+
+static void _vt_comp_log_frame_stats(struct vt_compositor_t* c, struct vt_output_t* output);
+
 
 static void _vt_comp_log_help();
 
@@ -87,34 +116,191 @@ static const struct wl_region_interface region_impl = {
 
 static void* _vt_comp_dl_handle = NULL;
 
+static const char* _vt_comp_frame_state_names[] = {
+  [VT_OUTPUT_FRAME_IDLE]      = "idle",
+  [VT_OUTPUT_FRAME_SCHEDULED] = "scheduled",
+  [VT_OUTPUT_FRAME_RENDERING] = "rendering",
+  [VT_OUTPUT_FRAME_SUBMITTED] = "submitted",
+  [VT_OUTPUT_FRAME_PRESENTED] = "presented",
+};
+
+// States each frame state may move on to
+static const uint32_t _vt_comp_frame_transitions[] = {
+  [VT_OUTPUT_FRAME_IDLE]      = 1u << VT_OUTPUT_FRAME_SCHEDULED,
+  [VT_OUTPUT_FRAME_SCHEDULED] = 1u << VT_OUTPUT_FRAME_RENDERING | 1u << VT_OUTPUT_FRAME_IDLE,
+  [VT_OUTPUT_FRAME_RENDERING] = 1u << VT_OUTPUT_FRAME_SUBMITTED | 1u << VT_OUTPUT_FRAME_IDLE,
+  [VT_OUTPUT_FRAME_SUBMITTED] = 1u << VT_OUTPUT_FRAME_PRESENTED | 1u << VT_OUTPUT_FRAME_IDLE,
+  [VT_OUTPUT_FRAME_PRESENTED] = 1u << VT_OUTPUT_FRAME_SCHEDULED | 1u << VT_OUTPUT_FRAME_IDLE,
+};
+
+void
+_vt_comp_frame_transition(struct vt_compositor_t* c, struct vt_output_t* output, enum vt_output_frame_state_t state) {
+  if(!(_vt_comp_frame_transitions[output->frame_state] & (1u << state))) {
+    VT_ERROR(c->log, "Invalid frame state transition on output %p: %s -> %s.", output,
+             _vt_comp_frame_state_names[output->frame_state], _vt_comp_frame_state_names[state]);
+    output->frame_stats.invalid_transitions++;
+  }
+  output->frame_state = state;
+}
+
+void
+_vt_comp_log_frame_stats(struct vt_compositor_t* c, struct vt_output_t* output) {
+  const struct vt_output_frame_stats_t* st = &output->frame_stats;
+  VT_TRACE(c->log, "Frames of output %p: %" PRIu64 " rendered, %" PRIu64 " submitted, %" PRIu64 " presented, %" PRIu64 " discarded.",
+           output, st->rendered, st->submitted, st->presented, st->discarded);
+  uint64_t fb_lookups = st->fb_cache_hits + st->fb_cache_misses;
+  if(fb_lookups) {
+    VT_TRACE(c->log, "Framebuffer cache of output %p: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate).",
+             output, st->fb_cache_hits, st->fb_cache_misses, 100.0 * (double)st->fb_cache_hits / (double)fb_lookups);
+  }
+  if(st->double_renders || st->dropped_flips || st->stray_frame_handlers || st->invalid_transitions) {
+    VT_WARN(c->log, "Frame pipeline of output %p misbehaved: %" PRIu64 " double renders, %" PRIu64 " dropped flips, "
+            "%" PRIu64 " stray frame handlers, %" PRIu64 " invalid transitions.",
+            output, st->double_renders, st->dropped_flips, st->stray_frame_handlers, st->invalid_transitions);
+  }
+}
+
 void 
 _vt_comp_frame_handler(void *data) {
   struct vt_output_t* output = data;
   if(!output) return;
   struct vt_compositor_t* c = output->backend->comp;
   if(!c) return;
+  // The event loop removes idle sources once they are dispatched
+  output->repaint_source = NULL;
+  if(output->frame_state != VT_OUTPUT_FRAME_SCHEDULED) {
+    // Rendering now would submit a second frame while the last one is in flight
+    VT_ERROR(c->log, "Frame handler of output %p ran while the frame is %s.", output,
+             _vt_comp_frame_state_names[output->frame_state]);
+    output->frame_stats.stray_frame_handlers++;
+    return;
+  }
   if(output->backend->comp->suspended) {
-    // Avoid busy loop
-    output->repaint_pending = false;
+    _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_IDLE);
     return;
   }
 
   if(!c->backend->impl.prepare_output_frame(c->backend, output)) {
-    // Avoid busy loop
-    output->repaint_pending = false;
+    // Avoid busy loop, the backend repaints once it is ready again
+    _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_IDLE);
     return;
   }
+
+  _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_RENDERING);
+  output->frame_renders = 0;
+  // Whatever changes from here on needs another frame
+  output->needs_repaint = false;
+
   if(!_vt_comp_render_output(c, output)) {
     // Avoid busy loop
-    output->repaint_pending = false;
+    _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_IDLE);
     return;
   }
   VT_TRACE(c->log, "Pending repaint on output %p got satisfied.", output);
-  if(output->repaint_source) {
-    wl_event_source_remove(output->repaint_source);
-    output->repaint_source = NULL;
+}
+
+int
+_vt_comp_repaint_timer_handler(int fd, uint32_t mask, void* data) {
+  struct vt_output_t* output = data;
+  (void)mask;
+
+  uint64_t expirations;
+  if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return 0;
+
+  _vt_comp_frame_handler(output);
+  return 0;
+}
+
+uint64_t
+_vt_comp_predict_render_time(struct vt_output_t* output) {
+  // Plan for the slowest of the recent frames, a single 
+  // fast frame must not make the next one miss its vblank.
+  uint64_t t = 0;
+  for(uint32_t i = 0; i < VT_RENDER_TIME_SAMPLES; i++) {
+    if(output->render_times_ns[i] > t) t = output->render_times_ns[i];
+  }
+  // Nothing measured yet, assume half a refresh cycle
+  return t ? t : output->refresh_ns / 2;
+}
+
+uint64_t
+_vt_comp_repaint_deadline(struct vt_output_t* output, uint64_t now) {
+  // With adaptive sync the vblank waits for the frame, so there is nothing to wait for. 
+  // Tearing flips do not wait for a vblank at all.
+  if(output->vrr_enabled || output->tearing) return 0;
+  if(!output->refresh_ns || !output->last_vblank_ns) return 0;
+
+  // Vblanks keep happening on the grid of the last one, even if nothing was presented since
+  uint64_t next = output->last_vblank_ns + output->refresh_ns;
+  if(next <= now) {
+    next += ((now - next) / output->refresh_ns + 1) * output->refresh_ns;
+  }
+
+  uint64_t budget = _vt_comp_predict_render_time(output) + _VT_REPAINT_SAFETY_MARGIN_NS;
+  if(budget >= output->refresh_ns || next - budget <= now) return 0;
+  return next - budget;
+}
+
+void
+_vt_comp_update_vrr(struct vt_compositor_t* c, struct vt_output_t* output) {
+  if(!output->vrr_capable || !c->backend->impl.set_vrr) return;
+
+  bool enable = c->vrr_policy && c->vrr_policy(c, output);
+  if(enable == output->vrr_enabled) return;
+
+  if(c->backend->impl.set_vrr(c->backend, output, enable)) {
+    VT_TRACE(c->log, "%s adaptive sync on output %p.", enable ? "Enabled" : "Disabled", output);
   }
-  output->repaint_pending = false;
+}
+
+void
+_vt_comp_update_tearing(struct vt_compositor_t* c, struct vt_output_t* output) {
+  // Only the focused fullscreen surface gets to tear, it is the only thing on screen
+  struct vt_surface_t* surf = output->tearing_capable ? _vt_comp_fullscreen_focus(c, output) : NULL;
+  bool tearing = surf && surf->tearing.async;
+  if(tearing == output->tearing) return;
+
+  output->tearing = tearing;
+  VT_TRACE(c->log, "%s tearing page flips on output %p.", tearing ? "Enabled" : "Disabled", output);
+}
+
+struct vt_surface_t*
+_vt_comp_fullscreen_focus(struct vt_compositor_t* c, struct vt_output_t* output) {
+  if(!c || !c->seat || !output) return NULL;
+  struct vt_surface_t* surf = c->seat->kb_focus.surf;
+  if(!surf || !surf->mapped) return NULL;
+
+  if(surf->x <= output->x && surf->y <= output->y &&
+    surf->x + (int32_t)surf->width >= output->x + (int32_t)output->width &&
+    surf->y + (int32_t)surf->height >= output->y + (int32_t)output->height) return surf;
+  return NULL;
+}
+
+bool
+_vt_comp_arm_repaint_timer(struct vt_compositor_t* c, struct vt_output_t* output, uint64_t deadline) {
+  if(!output->repaint_timer) {
+    output->repaint_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(output->repaint_timer_fd < 0) {
+      VT_ERROR(c->log, "Failed to create repaint timer for output %p: %s", output, strerror(errno));
+      return false;
+    }
+    output->repaint_timer = wl_event_loop_add_fd(
+      c->wl.evloop, output->repaint_timer_fd, WL_EVENT_READABLE, _vt_comp_repaint_timer_handler, output);
+    if(!output->repaint_timer) {
+      close(output->repaint_timer_fd);
+      output->repaint_timer_fd = -1;
+      return false;
+    }
+  }
+
+  struct itimerspec its = {0};
+  its.it_value.tv_sec = deadline / 1000000000ull;
+  its.it_value.tv_nsec = deadline % 1000000000ull;
+  if(timerfd_settime(output->repaint_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+    VT_ERROR(c->log, "Failed to arm repaint timer of output %p: %s", output, strerror(errno));
+    return false;
+  }
+  return true;
 }
 
 /* Heed my words struggeler... */
@@ -130,9 +316,9 @@ vt_comp_frame_done(struct vt_compositor_t *c, struct vt_output_t* output, uint32
   wl_list_for_each(surf, &c->surfaces, link) {
     if(!surf->needs_frame_done) continue; 
 
-    if(!(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
+    if(!vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
 
-    if((surf->_mask_outputs_presented_on & surf->_mask_outputs_visible_on) == surf->_mask_outputs_visible_on) {
+    if(vt_util_output_mask_contains(&surf->_mask_outputs_presented_on, &surf->_mask_outputs_visible_on)) {
       for (uint32_t i = 0; i < surf->cb_pool.n_cbs; i++) {
         if(!surf->cb_pool.cbs[i]) continue;
         wl_callback_send_done(surf->cb_pool.cbs[i], t);
@@ -141,12 +327,11 @@ vt_comp_frame_done(struct vt_compositor_t *c, struct vt_output_t* output, uint32
       }
       surf->needs_frame_done = false;
       surf->cb_pool.n_cbs = 0;
-      surf->_mask_outputs_presented_on = 0;
+      vt_util_output_mask_reset(&surf->_mask_outputs_presented_on);
       VT_TRACE(surf->comp->log, "Sent wl_callback.done() for all pending frame callbacks on output %p.", output);
     }
   }
   c->any_frame_cb_pending = false;
-
 }
 
 void 
@@ -176,10 +361,53 @@ bool
 _vt_comp_render_output(struct vt_compositor_t* c, struct vt_output_t* output) {
   if(!c || !c->backend || !c->backend->impl.handle_frame || !output) return false;
 
+  _vt_comp_update_vrr(c, output);
+  _vt_comp_update_tearing(c, output);
+
+  // A single opaque surface covering the output can be handed to the 
+  // backend as is, which skips compositing the output entirely.
+  struct vt_surface_t* scanout = c->backend->impl.scanout_surface ? 
+    vt_scene_scanout_candidate(c, output) : NULL;
+  if(scanout && c->backend->impl.scanout_surface(c->backend, output, scanout)) {
+    pixman_region32_clear(&output->damage);
+    output->direct_scanout = true;
+    _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_SUBMITTED);
+    output->frame_stats.submitted++;
+    vt_proto_presentation_latch(output);
+    return true;
+  }
+  if(output->direct_scanout) {
+    // The render target missed every frame that got scanned out, redraw all of it 
+    output->direct_scanout = false;
+    pixman_region32_union_rect(&output->damage, &output->damage,
+                               0, 0, output->width, output->height);
+    output->needs_damage_rebuild = true;
+  }
+
+  // Let the backend take surfaces off the scene before it is composited
+  if(c->backend->impl.assign_planes) {
+    c->backend->impl.assign_planes(c->backend, output);
+  }
+
+  vt_proto_presentation_latch(output);
+
+  uint64_t start = vt_util_get_time_nsec();
+
+  // The scene is rendered exactly once here, the backend only submits it
   vt_comp_repaint_scene(c, output);
-  c->backend->impl.handle_frame(c->backend, output);
-  output->repaint_pending = false;
 
+  // Backends may present synchronously (e.g. legacy mode sets), 
+  // so the frame counts as submitted before handle_frame() runs.
+  _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_SUBMITTED);
+  output->frame_stats.submitted++;
+  bool submitted = c->backend->impl.handle_frame(c->backend, output);
+
+  output->render_times_ns[output->render_time_idx] = vt_util_get_time_nsec() - start;
+  output->render_time_idx = (output->render_time_idx + 1) % VT_RENDER_TIME_SAMPLES;
+
+  if(!submitted) {
+    vt_comp_frame_discarded(c, output);
+  }
   return true;
 }
 
@@ -236,6 +464,7 @@ static char** _scan_valid_backends(size_t *count_out) {
 
 const char*
 _vt_comp_handle_cmd_flags(struct vt_compositor_t* c, int argc, char** argv) {
+  const char* backend = NULL;
   if(argc > 1) {
     for(uint32_t i = 1; i < argc; i++) {
       char* flag = argv[i];
@@ -279,7 +508,8 @@ _vt_comp_handle_cmd_flags(struct vt_compositor_t* c, int argc, char** argv) {
           free(valid_backends);
           exit(1);
         }
-        return backend_str;
+        // Keep parsing, backend specific flags may follow
+        backend = backend_str;
       } 
       else if(_flag_cmp(flag, "-bp", "--backend-path")) {
         if (i + 1 >= argc) {
@@ -294,11 +524,61 @@ _vt_comp_handle_cmd_flags(struct vt_compositor_t* c, int argc, char** argv) {
           VT_ERROR(c->log, "Missing value for %s", flag);
           exit(1);
         }
-        c->n_virtual_outputs = atoi(argv[++i]);
-        if (c->n_virtual_outputs <= 0);
-          c->n_virtual_outputs = 1;
+        int32_t n = atoi(argv[++i]);
+        c->n_virtual_outputs = n > 0 ? n : 1;
         VT_TRACE(c->log, "Virtual outputs set to %d", c->n_virtual_outputs);
       }
+      else if(_flag_cmp(flag, "-vm", "--virtual-mode")) {
+        if (i + 1 >= argc) {
+          VT_ERROR(c->log, "Missing value for %s", flag);
+          exit(1);
+        }
+        uint32_t w = 0, h = 0;
+        float refresh = 0.0f;
+        int32_t n = sscanf(argv[++i], "%ux%u@%f", &w, &h, &refresh);
+        if(n < 2 || !w || !h || (n == 3 && refresh <= 0.0f)) {
+          VT_ERROR(c->log, "Invalid virtual output mode '%s', expected <width>x<height>[@<refresh>]", argv[i]);
+          exit(1);
+        }
+        c->virtual_output_width = w;
+        c->virtual_output_height = h;
+        if(n == 3) c->virtual_output_refresh = refresh;
+        VT_TRACE(c->log, "Virtual output mode set to %ux%u@%.2f", w, h, c->virtual_output_refresh);
+      }
+      else if(_flag_cmp(flag, "-ol", "--output-layout")) {
+        if (i + 1 >= argc) {
+          VT_ERROR(c->log, "Missing value for %s", flag);
+          exit(1);
+        }
+        c->_cmd_line_output_layout_path = argv[++i];
+        VT_TRACE(c->log, "Output layout configuration set to %s", c->_cmd_line_output_layout_path);
+      }
+      else if(_flag_cmp(flag, "-r", "--renderer")) {
+        if (i + 1 >= argc) {
+          VT_ERROR(c->log, "Missing value for %s", flag);
+          exit(1);
+        }
+        char* renderer_str = argv[++i];
+        if(strcmp(renderer_str, "gl") == 0) {
+          vt_renderer_implement(c->renderer, VT_RENDERING_BACKEND_EGL_OPENGL);
+        } else if(strcmp(renderer_str, "pixman") == 0) {
+          vt_renderer_implement(c->renderer, VT_RENDERING_BACKEND_PIXMAN);
+          // Client buffers are read on the CPU, so they have to come over SHM
+          c->have_proto_dmabuf = false;
+          c->have_proto_dmabuf_explicit_sync = false;
+        } else if(strcmp(renderer_str, "vulkan") == 0) {
+#ifdef VT_HAVE_VULKAN
+          vt_renderer_implement(c->renderer, VT_RENDERING_BACKEND_VULKAN);
+#else
+          VT_ERROR(c->log, "vortex was built without the Vulkan renderer.");
+          exit(1);
+#endif
+        } else {
+          VT_ERROR(c->log, "Invalid renderer '%s', valid renderers are: [ 'gl', 'pixman', 'vulkan' ]", renderer_str);
+          exit(1);
+        }
+        VT_TRACE(c->log, "Renderer set to %s", renderer_str);
+      }
       else if(_flag_cmp(flag, "-expt", "--exclude-protocol")) {
         if (i + 1 >= argc) {
           VT_ERROR(c->log, "Missing value for %s", flag);
@@ -331,7 +611,7 @@ _vt_comp_handle_cmd_flags(struct vt_compositor_t* c, int argc, char** argv) {
       }
     }
   }
-  return NULL;
+  return backend;
 }
 
 void _vt_comp_log_help() {
@@ -343,7 +623,11 @@ void _vt_comp_log_help() {
   printf("%-35s %s\n", "-lf, --logfile", 
          "Write logs to a logfile (~/.local/state/vortex/logs/ or if available $XDG_STATE_HOME/vortex/logs)");
   printf("%-35s %s\n", "-q, --quiet", "Run in quiet mode (no logging)");
-  printf("%-35s %s\n", "-vo, --virtual-outputs [val]", "Specify the number of virtual outputs (windows) in nested mode");
+  printf("%-35s %s\n", "-vo, --virtual-outputs [val]", "Specify the number of virtual outputs (windows) in nested and headless mode");
+  printf("%-35s %s\n", "-vm, --virtual-mode [WxH@Hz]", "Specify the size and refresh rate of virtual outputs in headless mode (e.g. 1920x1080@60)");
+  printf("%-35s %s\n", "-ol, --output-layout [path]", 
+         "Read output placements from a file (default: $XDG_CONFIG_HOME/vortex/outputs.conf or ~/.config/vortex/outputs.conf)");
+  printf("%-35s %s\n", "-r, --renderer [val]", "Specifies the renderer. Valid options are: 'gl' (default), 'pixman' (software, SHM clients only), 'vulkan'");
   printf("%-35s %s\n", "-expt, --exclude-protocol [val]", "Specifies optional protocols to exlcude. Valid options are: 'linux-dmabuf', 'linux-dmabuf-explicit-sync");
   printf("%-35s %s", "-b, --backend [val]", "Specifies the sink backend of the compositor.");
   printf(" Valid options for backends are: [ "); 
@@ -413,14 +697,16 @@ _vt_comp_load_backend(struct vt_compositor_t* c, const char* backend_name, const
 
 void _vt_comp_associate_surface_with_output(struct vt_compositor_t* c, struct vt_surface_t* surf, struct vt_output_t* output) {
   // Skip if surface and output don’t intersect
-  if (surf->x + surf->width  <= output->x ||
-    surf->x >= output->x + output->width ||
-    surf->y + surf->height <= output->y ||
-    surf->y >= output->y + output->height) return;
+  pixman_box32_t box;
+  vt_output_layout_get_box(output, &box);
+  if (surf->x + (int32_t)surf->width  <= box.x1 ||
+    surf->x >= box.x2 ||
+    surf->y + (int32_t)surf->height <= box.y1 ||
+    surf->y >= box.y2) return;
 
-  bool visibility_updated = !(surf->_mask_outputs_visible_on & (1u << output->id));
+  bool visibility_updated = !vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id);
 
-  surf->_mask_outputs_visible_on |= (1u << output->id);
+  vt_util_output_mask_set(&surf->_mask_outputs_visible_on, output->id);
 
   if(visibility_updated) {
     output->needs_damage_rebuild = true;
@@ -451,6 +737,7 @@ _vt_comp_wl_surface_create(
   pixman_region32_init(&surf->pending_damage);
   pixman_region32_init(&surf->opaque_region);
   pixman_region32_init(&surf->input_region);
+  pixman_region32_init(&surf->tex_back_damage);
 
   // Add the surface to list of surfaces in the compositor
   wl_list_insert(&c->surfaces, &surf->link);
@@ -612,6 +899,16 @@ _vt_comp_wl_init(struct vt_compositor_t* c) {
     return false;
   }
 
+  if(!vt_proto_presentation_init(c, 1)) {
+    VT_ERROR(c->log, "Cannot initialize presentation time protocol.");
+    return false;
+  }
+
+  if(!vt_proto_tearing_control_v1_init(c, 1)) {
+    VT_ERROR(c->log, "Cannot initialize tearing control protocol.");
+    return false;
+  }
+
   const char *socket_name = wl_display_add_socket_auto(c->wl.dsp);
   if (!socket_name) {
     VT_ERROR(c->log, "Failed to create Wayland socket: no clients will be able to connect.");
@@ -680,6 +977,8 @@ vt_comp_init(struct vt_compositor_t* c, int argc, char** argv) {
   c->have_proto_dmabuf = true;
   c->have_proto_dmabuf_explicit_sync = true;
 
+  c->vrr_policy = vt_comp_vrr_policy_fullscreen;
+
   const char* backend_str = _vt_comp_handle_cmd_flags(c, argc, argv);
   if(!backend_str) {
     if(getenv("WAYLAND_DISPLAY"))
@@ -688,11 +987,15 @@ vt_comp_init(struct vt_compositor_t* c, int argc, char** argv) {
       backend_str = "drm";
   }
 
-  if(strcmp(backend_str, "wl") == 0 && !c->n_virtual_outputs);
+  if((strcmp(backend_str, "wl") == 0 || strcmp(backend_str, "headless") == 0) && !c->n_virtual_outputs)
     c->n_virtual_outputs = 1;
 
   _vt_comp_load_backend(c, backend_str, c->_cmd_line_backend_path);
 
+  // Outputs are placed in the layout as soon as the backend creates them
+  c->output_layout = VT_ALLOC(c, sizeof(*c->output_layout));
+  vt_output_layout_init(c->output_layout, c, c->_cmd_line_output_layout_path);
+
   if(!_vt_comp_wl_init(c)) {
     VT_ERROR(c->log, "Failed to initialize wayland state.");
     return false;
@@ -718,6 +1021,10 @@ vt_comp_init(struct vt_compositor_t* c, int argc, char** argv) {
     case VT_BACKEND_WAYLAND:
       input_backend = VT_INPUT_WAYLAND;
       break;
+    case VT_BACKEND_SURFACELESS:
+      // No input devices on headless hosts
+      input_backend = VT_INPUT_UNKNOWN;
+      break;
   }
   vt_input_implement(c->input_backend, input_backend); 
 
@@ -731,14 +1038,12 @@ vt_comp_init(struct vt_compositor_t* c, int argc, char** argv) {
     
   VT_TRACE(c->log, "Initialized wayland seat.");
  
-  uint32_t root_w = 0, root_h = 0;
   struct vt_output_t* output;
   wl_list_for_each(output, &c->outputs, link_global) {
-    output->repaint_pending = false;
     vt_comp_schedule_repaint(c, output);
-    root_w += output->width;
-    root_h += output->height;
   }
+  uint32_t root_w = c->output_layout->extents.x2 - c->output_layout->extents.x1;
+  uint32_t root_h = c->output_layout->extents.y2 - c->output_layout->extents.y1;
 
   
   c->root_node = vt_scene_node_create(
@@ -762,11 +1067,22 @@ vt_comp_init(struct vt_compositor_t* c, int argc, char** argv) {
   c->root_cursor->buffer_scale = 1;
   wl_list_init(&c->root_cursor->link_focus);
 
+  // Image of the root cursor for hardware cursor planes
+  c->root_cursor->cursor_image.width  = c->root_cursor->width;
+  c->root_cursor->cursor_image.height = c->root_cursor->height;
+  c->root_cursor->cursor_image.pixels = malloc(
+    sizeof(uint32_t) * c->root_cursor->width * c->root_cursor->height);
+  if(c->root_cursor->cursor_image.pixels) {
+    for(uint32_t i = 0; i < c->root_cursor->width * c->root_cursor->height; i++) 
+      c->root_cursor->cursor_image.pixels[i] = 0xffff0000;
+  }
+
   // Init the damage regions
   pixman_region32_init(&c->root_cursor->current_damage);
   pixman_region32_init(&c->root_cursor->pending_damage);
   pixman_region32_init(&c->root_cursor->opaque_region);
   pixman_region32_init(&c->root_cursor->input_region);
+  pixman_region32_init(&c->root_cursor->tex_back_damage);
 
   //wl_list_insert(&c->surfaces, &c->root_cursor->link);
 
@@ -797,12 +1113,16 @@ vt_comp_terminate(struct vt_compositor_t *c) {
 
   vt_seat_terminate(c->seat);
   
-  c->input_backend->impl.terminate(c->input_backend);
+  if(c->input_backend->impl.terminate) {
+    c->input_backend->impl.terminate(c->input_backend);
+  }
 
   if(c->session->impl.terminate) {
     c->session->impl.terminate(c->session);
   }
 
+  vt_output_layout_finish(c->output_layout);
+
   // Shut down wayland 
   if (c->wl.dsp) {
     wl_display_destroy_clients(c->wl.dsp);
@@ -833,23 +1153,92 @@ vt_comp_schedule_repaint(struct vt_compositor_t *c, struct vt_output_t* output)
     VT_WARN(c->log, "Trying to schedule repaint while compositor is suspended.");
     return;
   }
-  if (output->repaint_pending) {
+  output->needs_repaint = true;
+  // A frame that is being rendered or waits for its flip picks 
+  // the repaint up once it is presented, see vt_comp_frame_presented().
+  if(output->frame_state != VT_OUTPUT_FRAME_IDLE && 
+    output->frame_state != VT_OUTPUT_FRAME_PRESENTED) {
     return;
   }
-  output->needs_repaint = true;
-  if(!output->repaint_pending) {
-    output->repaint_pending = true;
-    output->repaint_source = wl_event_loop_add_idle(c->wl.evloop, _vt_comp_frame_handler, output);
+  _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_SCHEDULED);
+
+  // Start rendering as late as possible before the next vblank so that  
+  // input and client commits that arrive meanwhile make it into the frame.
+  uint64_t now = vt_util_get_time_nsec();
+  uint64_t deadline = _vt_comp_repaint_deadline(output, now);
+  if(deadline && _vt_comp_arm_repaint_timer(c, output, deadline)) {
+    VT_TRACE(c->log, "Scheduling repaint on output %p in %.3fms.", output, (double)(deadline - now) / 1e6);
+    return;
   }
 
+  output->repaint_source = wl_event_loop_add_idle(c->wl.evloop, _vt_comp_frame_handler, output);
+
   VT_TRACE(c->log, "Scheduling repaint on output %p.", output);
 
 }
 
+void 
+vt_comp_cancel_repaint(struct vt_compositor_t *c, struct vt_output_t* output) {
+  if(!c || !output) return;
+  if(output->repaint_source) {
+    wl_event_source_remove(output->repaint_source);
+    output->repaint_source = NULL;
+  }
+  if(output->repaint_timer) {
+    wl_event_source_remove(output->repaint_timer);
+    output->repaint_timer = NULL;
+    close(output->repaint_timer_fd);
+    output->repaint_timer_fd = -1;
+  }
+  if(output->frame_state == VT_OUTPUT_FRAME_SCHEDULED) {
+    _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_IDLE);
+  }
+}
+
 void vt_comp_repaint_scene(struct vt_compositor_t *c, struct vt_output_t *output) {
   if (!c || !output || !c->backend || !c->renderer) return;
 
+  // Compositing outside of the frame handler or twice for 
+  // the same frame throws away a whole render of the output.
+  if(output->frame_state != VT_OUTPUT_FRAME_RENDERING || output->frame_renders++) {
+    VT_ERROR(c->log, "Scene of output %p rendered more than once for a frame (frame is %s).", output,
+             _vt_comp_frame_state_names[output->frame_state]);
+    output->frame_stats.double_renders++;
+  }
+
   vt_scene_render(c->renderer, output, c->root_node);
+  output->frame_stats.rendered++;
+}
+
+void 
+vt_comp_frame_presented(struct vt_compositor_t *c, struct vt_output_t* output) {
+  if(!c || !output) return;
+  // Parents of nested outputs may call back for frames that were already
+  // completed by a fallback timer, they do not belong to the current frame.
+  if(output->frame_state != VT_OUTPUT_FRAME_SUBMITTED) {
+    VT_TRACE(c->log, "Ignoring presentation of output %p, frame is %s.", output,
+             _vt_comp_frame_state_names[output->frame_state]);
+    return;
+  }
+  _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_PRESENTED);
+  output->frame_stats.presented++;
+  if(output->frame_stats.presented % _VT_FRAME_STATS_INTERVAL == 0) {
+    _vt_comp_log_frame_stats(c, output);
+  }
+
+  if(output->needs_repaint) {
+    vt_comp_schedule_repaint(c, output);
+  }
+}
+
+void 
+vt_comp_frame_discarded(struct vt_compositor_t *c, struct vt_output_t* output) {
+  if(!c || !output) return;
+  if(output->frame_state != VT_OUTPUT_FRAME_SUBMITTED) return;
+  _vt_comp_frame_transition(c, output, VT_OUTPUT_FRAME_IDLE);
+  output->frame_stats.discarded++;
+  // Not rescheduled right away, a backend that keeps failing would busy loop
+  output->needs_repaint = true;
 }
 
 void vt_comp_invalidate_all_surfaces(struct vt_compositor_t *comp) {
@@ -873,7 +1262,7 @@ void vt_comp_invalidate_all_surfaces(struct vt_compositor_t *comp) {
     }
 
     // Force re-import
-    surf->_mask_outputs_visible_on = 0;
+    vt_util_output_mask_reset(&surf->_mask_outputs_visible_on);
 
 
     // Optionally, if the client still has a buffer attached, ask it to repaint
@@ -910,7 +1299,7 @@ vt_comp_damage_entire_surface(struct vt_compositor_t *comp, struct vt_surface_t*
   surf->damaged = true;
   struct vt_output_t* output;
   wl_list_for_each(output, &comp->outputs, link_global) {
-    if(surf != comp->root_cursor && !(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
+    if(surf != comp->root_cursor && !vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
 
     if(x == surf->x && y == surf->y) {
     pixman_region32_union_rect(
@@ -938,8 +1327,136 @@ vt_comp_surf_mark_damaged(struct vt_compositor_t *comp, struct vt_surface_t* sur
   surf->damaged = true;
   struct vt_output_t* output;
   wl_list_for_each(output, &comp->outputs, link_global) {
-    if(surf != comp->root_cursor && !(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
+    if(surf != comp->root_cursor && !vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
     output->needs_damage_rebuild = true;
     vt_comp_schedule_repaint(comp, output);
   }
 }
+
+void 
+vt_comp_output_layout_changed(struct vt_compositor_t *c, struct vt_output_t* output) {
+  if(!c || !output) return;
+  // Only the visibility of surfaces on this output is recomputed, 
+  // their textures and damage on other outputs stay as they are.
+  struct vt_surface_t* surf;
+  wl_list_for_each(surf, &c->surfaces, link) {
+    vt_util_output_mask_clear(&surf->_mask_outputs_visible_on, output->id);
+    vt_util_output_mask_clear(&surf->_mask_outputs_presented_on, output->id);
+    vt_util_output_mask_clear(&surf->_mask_outputs_on_plane, output->id);
+    _vt_comp_associate_surface_with_output(c, surf, output);
+  }
+
+  pixman_region32_union_rect(&output->damage, &output->damage,
+                             0, 0, output->width, output->height);
+  output->needs_damage_rebuild = true;
+  vt_comp_schedule_repaint(c, output);
+}
+
+bool 
+vt_comp_add_output(struct vt_compositor_t *c, struct vt_output_t* output) {
+  if(!c || !output) return false;
+  // IDs are kept dense so that the surface masks stay small
+  uint32_t id = vt_util_output_mask_first_free(&c->output_ids);
+  if(id >= VT_MAX_OUTPUTS) {
+    VT_ERROR(c->log, "Cannot add output %p, all %i output slots are in use.", output, VT_MAX_OUTPUTS);
+    return false;
+  }
+  vt_util_output_mask_set(&c->output_ids, id);
+  output->id = id;
+  wl_list_insert(&c->outputs, &output->link_global);
+  vt_output_layout_add(c->output_layout, output);
+  VT_TRACE(c->log, "Added output %p with ID %u.", output, id);
+  return true;
+}
+
+void 
+vt_comp_remove_output(struct vt_compositor_t *c, struct vt_output_t* output) {
+  if(!c || !output || wl_list_empty(&output->link_global)) return;
+  _vt_comp_log_frame_stats(c, output);
+  wl_list_remove(&output->link_global);
+  wl_list_init(&output->link_global);
+  vt_output_layout_remove(c->output_layout, output);
+
+  // The ID is handed out again, so no surface may keep it in its masks
+  uint32_t t = vt_util_get_time_msec();
+  struct vt_surface_t* surf;
+  wl_list_for_each(surf, &c->surfaces, link) {
+    vt_util_output_mask_clear(&surf->_mask_outputs_presented_on, output->id);
+    vt_util_output_mask_clear(&surf->_mask_outputs_on_plane, output->id);
+    if(!vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
+    vt_util_output_mask_clear(&surf->_mask_outputs_visible_on, output->id);
+
+    // No output is going to present the surface anymore, so its 
+    // client would wait for the pending frame callbacks forever.
+    if(!vt_util_output_mask_empty(&surf->_mask_outputs_visible_on) || !surf->needs_frame_done) continue;
+    for (uint32_t i = 0; i < surf->cb_pool.n_cbs; i++) {
+      if(!surf->cb_pool.cbs[i]) continue;
+      wl_callback_send_done(surf->cb_pool.cbs[i], t);
+      wl_resource_destroy(surf->cb_pool.cbs[i]);
+    }
+    surf->needs_frame_done = false;
+    surf->cb_pool.n_cbs = 0;
+    vt_util_output_mask_reset(&surf->_mask_outputs_presented_on);
+  }
+  vt_util_output_mask_clear(&c->output_ids, output->id);
+  VT_TRACE(c->log, "Removed output %p with ID %u.", output, output->id);
+}
+
+bool 
+vt_comp_update_cursor(struct vt_compositor_t *c) {
+  if(!c || !c->backend || !c->backend->impl.set_cursor || c->suspended) return false;
+
+  int32_t x = 0, y = 0, hx = 0, hy = 0;
+  struct vt_surface_t* cursor = vt_scene_get_cursor(c, &x, &y, &hx, &hy);
+  // Scaled cursors need to be rendered
+  bool usable = !cursor || (cursor->cursor_image.pixels && cursor->buffer_scale == 1);
+
+  bool all_hw = true;
+  struct vt_output_t* output;
+  wl_list_for_each(output, &c->outputs, link_global) {
+    bool hw = usable && 
+      c->backend->impl.set_cursor(c->backend, output, cursor, hx, hy) &&
+      (!cursor || c->backend->impl.move_cursor(c->backend, output, x - output->x, y - output->y));
+    if(!hw && output->hw_cursor) {
+      c->backend->impl.set_cursor(c->backend, output, NULL, 0, 0);
+    }
+
+    if(hw != output->hw_cursor) {
+      // The cursor moves in or out of the composited scene 
+      output->hw_cursor = hw;
+      pixman_region32_union_rect(&output->damage, &output->damage,
+                                 0, 0, output->width, output->height);
+      output->needs_damage_rebuild = true;
+      vt_comp_schedule_repaint(c, output);
+    }
+    if(hw && cursor) {
+      vt_util_output_mask_set(&cursor->_mask_outputs_presented_on, output->id);
+    }
+    all_hw &= hw;
+  }
+
+  return all_hw;
+}
+
+bool 
+vt_comp_move_cursor(struct vt_compositor_t *c) {
+  if(!c || !c->backend || !c->backend->impl.move_cursor || c->suspended) return false;
+
+  int32_t x = 0, y = 0, hx = 0, hy = 0;
+  struct vt_surface_t* cursor = vt_scene_get_cursor(c, &x, &y, &hx, &hy);
+  if(!cursor) return true;
+
+  struct vt_output_t* output;
+  wl_list_for_each(output, &c->outputs, link_global) {
+    if(!output->hw_cursor) return false;
+    if(!c->backend->impl.move_cursor(c->backend, output, x - output->x, y - output->y)) 
+      return false;
+  }
+  return true;
+}
+
+bool 
+vt_comp_vrr_policy_fullscreen(struct vt_compositor_t *c, struct vt_output_t* output) {
+  // Fullscreen games and videos set the pace of their output 
+  return _vt_comp_fullscreen_focus(c, output) != NULL;
+}
@@ -17,8 +17,18 @@ void vt_comp_frame_done_all(struct vt_compositor_t *c, uint32_t t);
 
 void vt_comp_schedule_repaint(struct vt_compositor_t *c, struct vt_output_t* output);
 
+void vt_comp_cancel_repaint(struct vt_compositor_t *c, struct vt_output_t* output);
+
 void vt_comp_repaint_scene(struct vt_compositor_t *c, struct vt_output_t* output);
 
+// Called by backends once the frame submitted by handle_frame() is on screen,
+// a pending repaint of the output gets scheduled from here.
+void vt_comp_frame_presented(struct vt_compositor_t *c, struct vt_output_t* output);
+
+// Called by backends if a submitted frame never reaches the screen (e.g. the 
+// commit got refused), the output is repainted with the next damage.
+void vt_comp_frame_discarded(struct vt_compositor_t *c, struct vt_output_t* output);
+
 void vt_comp_invalidate_all_surfaces(struct vt_compositor_t *comp);
 
 struct vt_surface_t* vt_comp_pick_surface(struct vt_compositor_t *comp, double x, double y);
@@ -26,3 +36,19 @@ struct vt_surface_t* vt_comp_pick_surface(struct vt_compositor_t *comp, double x
 void vt_comp_damage_entire_surface(struct vt_compositor_t *comp, struct vt_surface_t* surf, int32_t x, int32_t y); 
 
 void vt_comp_surf_mark_damaged(struct vt_compositor_t *comp, struct vt_surface_t* surf); 
+
+// Output hotplug: re-associates surfaces with the area an output covers and repaints it
+void vt_comp_output_layout_changed(struct vt_compositor_t *c, struct vt_output_t* output);
+
+// Gives the output the lowest free ID and adds it to the output list
+bool vt_comp_add_output(struct vt_compositor_t *c, struct vt_output_t* output);
+
+// Removes the output from the list and the surface masks, its ID is free again afterwards
+void vt_comp_remove_output(struct vt_compositor_t *c, struct vt_output_t* output);
+
+bool vt_comp_update_cursor(struct vt_compositor_t *c);
+
+bool vt_comp_move_cursor(struct vt_compositor_t *c);
+
+// Default adaptive sync policy: VRR is on while the focused surface fills the output
+bool vt_comp_vrr_policy_fullscreen(struct vt_compositor_t *c, struct vt_output_t* output);
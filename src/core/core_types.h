@@ -14,6 +14,13 @@
 
 #define BACKEND_DATA(b, type) ((type *)((b)->user_data))
 #define VT_MAX_DAMAGE_RECTS 64
+#define VT_RENDER_TIME_SAMPLES 16
+#define VT_OUTPUT_NAME_MAX 32
+
+// How a frame reached the screen, same values as wp_presentation_feedback.kind
+#define VT_PRESENTATION_VSYNC         0x1
+#define VT_PRESENTATION_HW_CLOCK      0x2
+#define VT_PRESENTATION_HW_COMPLETION 0x4
 
 #define VT_ALLOC(c, size) vt_util_alloc(&(c)->arena, (size))
 #define VT_ALLOC_FRAME(c, size) vt_util_alloc(&(c)->frame_arena, (size))
@@ -22,6 +29,7 @@ struct vt_renderer_t;
 struct vt_surface_t;
 struct vt_backend_t;
 struct vt_output_t;
+struct vt_output_layout_t;
 
 struct log_state_t {
   FILE* stream;
@@ -34,6 +42,28 @@ struct wl_state_t {
   struct wl_compositor* compositor;
 };
 
+// Per-output frame pipeline, driven by compositor.c:
+// IDLE -> SCHEDULED -> RENDERING -> SUBMITTED -> PRESENTED -> SCHEDULED ...
+// Backends only submit the rendered frame and report back once it is on screen.
+enum vt_output_frame_state_t {
+  VT_OUTPUT_FRAME_IDLE = 0,
+  VT_OUTPUT_FRAME_SCHEDULED,
+  VT_OUTPUT_FRAME_RENDERING,
+  VT_OUTPUT_FRAME_SUBMITTED,
+  VT_OUTPUT_FRAME_PRESENTED,
+};
+
+struct vt_output_frame_stats_t {
+  uint64_t rendered, submitted, presented, discarded;
+  // These stay at 0 unless the pipeline is broken: scenes composited more
+  // than once for a frame, flips queued while another one is in flight, 
+  // frame handlers that ran without a scheduled frame and transitions 
+  // the frame state machine does not allow.
+  uint64_t double_renders, dropped_flips, stray_frame_handlers, invalid_transitions;
+  // Lookups of KMS framebuffers for the frame's buffers, misses create one
+  uint64_t fb_cache_hits, fb_cache_misses;
+};
+
 enum vt_backend_platform_t {
   VT_BACKEND_DRM_GBM = 0,
   VT_BACKEND_WAYLAND,
@@ -48,9 +78,25 @@ struct vt_region_t {
 struct vt_backend_interface_t {
   bool (*init)(struct vt_backend_t* backend);
   bool (*is_dmabuf_importable)(struct vt_backend_t* backend, struct vt_dmabuf_attr_t* attr, int32_t device_fd);
+  // Submits the frame that was just rendered. Returning true means the frame is 
+  // in flight and the backend calls vt_comp_frame_presented() once it is on screen.
   bool (*handle_frame)(struct vt_backend_t* backend, struct vt_output_t* output);
   bool (*prepare_output_frame)(struct vt_backend_t* backend, struct vt_output_t* output);
   bool (*terminate)(struct vt_backend_t* backend);
+  // Optional: put the buffer of a surface that covers the whole output on 
+  // screen without compositing. Returns false if the surface has to be rendered.
+  bool (*scanout_surface)(struct vt_backend_t* backend, struct vt_output_t* output, struct vt_surface_t* surf);
+  // Optional: show the cursor image of a surface on a hardware plane (NULL hides 
+  // the plane) and move it in output coordinates. Returning false makes the 
+  // compositor draw the cursor as part of the scene.
+  bool (*set_cursor)(struct vt_backend_t* backend, struct vt_output_t* output, struct vt_surface_t* surf, int32_t hotspot_x, int32_t hotspot_y);
+  bool (*move_cursor)(struct vt_backend_t* backend, struct vt_output_t* output, int32_t x, int32_t y);
+  // Optional: claim surfaces for overlay planes before the output gets composited 
+  // (see vt_scene_assign_planes()). The claimed surfaces go out with the next frame.
+  bool (*assign_planes)(struct vt_backend_t* backend, struct vt_output_t* output);
+  // Optional: turn adaptive sync of a VRR capable output on or off, 
+  // it takes effect with the next frame.
+  bool (*set_vrr)(struct vt_backend_t* backend, struct vt_output_t* output, bool enabled);
 };
 
 struct vt_backend_t {
@@ -68,17 +114,54 @@ struct vt_output_t {
   void* native_window;
   void* render_surface;
 
+  // Stable name (e.g. connector name) the layout configuration refers to
+  char name[VT_OUTPUT_NAME_MAX];
+
   uint32_t width, height;
+  // Position in the output layout, see output_layout.h
   int32_t x, y;
+  // enum wl_output_transform, the layout swaps width and height for 90/270°
+  int32_t transform;
   float refresh_rate;
   uint32_t format, id;
 
-  bool needs_repaint, repaint_pending, resize_pending;
+  bool needs_repaint, resize_pending;
+
+  enum vt_output_frame_state_t frame_state;
+  struct vt_output_frame_stats_t frame_stats;
+  // Scene renders since the output entered VT_OUTPUT_FRAME_RENDERING
+  uint32_t frame_renders;
+
+  // Set while the output shows a client buffer directly instead of the composited scene
+  bool direct_scanout;
+
+  // Set while the cursor is shown on a hardware plane instead of being composited
+  bool hw_cursor;
+
+  // Adaptive sync: while enabled, frames are presented as soon as they are ready
+  bool vrr_capable, vrr_enabled;
+
+  // Tearing: while set, the backend flips without waiting for vblank
+  bool tearing_capable, tearing;
 
   void* user_data, *user_data_render;
 
   struct wl_event_source* repaint_source;
 
+  // Frame scheduling: length of a refresh cycle and time of the last 
+  // vblank (CLOCK_MONOTONIC), backends leave them at 0 if unknown.
+  uint64_t refresh_ns, last_vblank_ns;
+  // Counter of the vblank in last_vblank_ns and VT_PRESENTATION_* flags of how it was timed
+  uint64_t msc;
+  uint32_t presentation_flags;
+  // Sequence of the last frame presentation feedback was latched to
+  uint64_t presentation_seq;
+  // Durations of the most recent renders, a repaint starts as late as they allow
+  uint64_t render_times_ns[VT_RENDER_TIME_SAMPLES];
+  uint32_t render_time_idx;
+  int32_t repaint_timer_fd;
+  struct wl_event_source* repaint_timer;
+
   pixman_region32_t damage; 
 
   pixman_box32_t cached_damage[VT_MAX_DAMAGE_RECTS];
@@ -100,9 +183,15 @@ struct vt_compositor_t {
   bool sent_frame_cbs, any_frame_cb_pending;
 
   uint32_t n_virtual_outputs;
+  uint32_t virtual_output_width, virtual_output_height;
+  float virtual_output_refresh;
   const char* _cmd_line_backend_path;
 
   struct wl_list outputs;
+  // IDs of the outputs in 'outputs'
+  struct vt_output_mask_t output_ids;
+  struct vt_output_layout_t* output_layout;
+  const char* _cmd_line_output_layout_path;
 
   struct vt_session_t* session;
   struct vt_seat_t* seat;
@@ -115,6 +204,9 @@ struct vt_compositor_t {
 
   struct vt_scene_node_t* root_node;
 
+  // Decides which outputs run with adaptive sync (NULL keeps it off)
+  bool (*vrr_policy)(struct vt_compositor_t* comp, struct vt_output_t* output);
+
   bool nogger;
 };
 
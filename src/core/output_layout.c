@@ -0,0 +1,326 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "output_layout.h"
+#include "util.h"
+
+#define _SUBSYS_NAME "LAYOUT"
+
+static const char* _transform_names[] = {
+  "normal", "90", "180", "270",
+  "flipped", "flipped-90", "flipped-180", "flipped-270"
+};
+
+static void _vt_layout_default_path(char* path, size_t size);
+static bool _vt_layout_load(struct vt_output_layout_t* layout);
+static int32_t _vt_layout_parse_transform(const char* str);
+static struct vt_output_layout_config_t* _vt_layout_find_config(struct vt_output_layout_t* layout, const char* name);
+static void _vt_layout_rebuild_index(struct vt_output_layout_t* layout);
+static void _vt_layout_cell_range(struct vt_output_layout_t* layout, const pixman_box32_t* box,
+                                  int32_t* cx1, int32_t* cy1, int32_t* cx2, int32_t* cy2);
+
+void
+_vt_layout_default_path(char* path, size_t size) {
+  // $XDG_CONFIG_HOME/vortex/outputs.conf, ~/.config/vortex/outputs.conf otherwise
+  const char* config_home = getenv("XDG_CONFIG_HOME");
+  const char* home = getenv("HOME");
+  if(config_home && config_home[0] != '\0') {
+    snprintf(path, size, "%s/%s/outputs.conf", config_home, _BRAND_NAME);
+  } else if(home) {
+    snprintf(path, size, "%s/.config/%s/outputs.conf", home, _BRAND_NAME);
+  } else {
+    path[0] = '\0';
+  }
+}
+
+bool
+_vt_layout_load(struct vt_output_layout_t* layout) {
+  if(layout->config_path[0] == '\0') return false;
+  FILE* f = fopen(layout->config_path, "r");
+  if(!f) {
+    VT_TRACE(layout->comp->log, "No output layout configuration at %s.", layout->config_path);
+    return false;
+  }
+
+  // Every line places one output: <name> <x> <y> [transform]
+  char line[256];
+  uint32_t n_line = 0;
+  while(fgets(line, sizeof(line), f)) {
+    n_line++;
+    char* start = line + strspn(line, " \t");
+    if(*start == '#' || *start == '\n' || *start == '\0') continue;
+
+    struct vt_output_layout_config_t config = {0};
+    char transform[16] = "normal";
+    int32_t n = sscanf(start, "%31s %d %d %15s", config.name, &config.x, &config.y, transform);
+    config.transform = _vt_layout_parse_transform(transform);
+    if(n < 3 || config.transform < 0) {
+      VT_WARN(layout->comp->log, "Ignoring invalid line %u in %s.", n_line, layout->config_path);
+      continue;
+    }
+
+    struct vt_output_layout_config_t* dst = _vt_layout_find_config(layout, config.name);
+    if(!dst && !(dst = wl_array_add(&layout->configs, sizeof(*dst)))) break;
+    *dst = config;
+  }
+  fclose(f);
+
+  VT_TRACE(layout->comp->log, "Loaded %zu output placement(s) from %s.",
+           layout->configs.size / sizeof(struct vt_output_layout_config_t), layout->config_path);
+  return true;
+}
+
+int32_t
+_vt_layout_parse_transform(const char* str) {
+  for(uint32_t i = 0; i < sizeof(_transform_names) / sizeof(*_transform_names); i++) {
+    if(strcmp(str, _transform_names[i]) == 0) return (int32_t)i;
+  }
+  return -1;
+}
+
+struct vt_output_layout_config_t*
+_vt_layout_find_config(struct vt_output_layout_t* layout, const char* name) {
+  if(!name || name[0] == '\0') return NULL;
+  struct vt_output_layout_config_t* config;
+  wl_array_for_each(config, &layout->configs) {
+    if(strcmp(config->name, name) == 0) return config;
+  }
+  return NULL;
+}
+
+void
+_vt_layout_rebuild_index(struct vt_output_layout_t* layout) {
+  memset(layout->cells, 0, sizeof(layout->cells));
+  memset(&layout->extents, 0, sizeof(layout->extents));
+
+  bool first = true;
+  vt_output_mask_for_each(id, &layout->ids) {
+    pixman_box32_t box;
+    vt_output_layout_get_box(layout->outputs[id], &box);
+    if(first) {
+      layout->extents = box;
+      first = false;
+      continue;
+    }
+    layout->extents.x1 = VT_MIN(layout->extents.x1, box.x1);
+    layout->extents.y1 = VT_MIN(layout->extents.y1, box.y1);
+    layout->extents.x2 = VT_MAX(layout->extents.x2, box.x2);
+    layout->extents.y2 = VT_MAX(layout->extents.y2, box.y2);
+  }
+
+  const int32_t w = layout->extents.x2 - layout->extents.x1;
+  const int32_t h = layout->extents.y2 - layout->extents.y1;
+  layout->cell_w = (w + VT_OUTPUT_LAYOUT_GRID - 1) / VT_OUTPUT_LAYOUT_GRID;
+  layout->cell_h = (h + VT_OUTPUT_LAYOUT_GRID - 1) / VT_OUTPUT_LAYOUT_GRID;
+  if(layout->cell_w < 1) layout->cell_w = 1;
+  if(layout->cell_h < 1) layout->cell_h = 1;
+
+  vt_output_mask_for_each(id, &layout->ids) {
+    pixman_box32_t box;
+    vt_output_layout_get_box(layout->outputs[id], &box);
+    int32_t cx1, cy1, cx2, cy2;
+    _vt_layout_cell_range(layout, &box, &cx1, &cy1, &cx2, &cy2);
+    for(int32_t cy = cy1; cy <= cy2; cy++) {
+      for(int32_t cx = cx1; cx <= cx2; cx++) {
+        vt_util_output_mask_set(&layout->cells[cy * VT_OUTPUT_LAYOUT_GRID + cx], id);
+      }
+    }
+  }
+}
+
+void
+_vt_layout_cell_range(struct vt_output_layout_t* layout, const pixman_box32_t* box,
+                      int32_t* cx1, int32_t* cy1, int32_t* cx2, int32_t* cy2) {
+  const int32_t last = VT_OUTPUT_LAYOUT_GRID - 1;
+  *cx1 = (box->x1 - layout->extents.x1) / layout->cell_w;
+  *cy1 = (box->y1 - layout->extents.y1) / layout->cell_h;
+  // The boxes are exclusive at x2/y2
+  *cx2 = (box->x2 - 1 - layout->extents.x1) / layout->cell_w;
+  *cy2 = (box->y2 - 1 - layout->extents.y1) / layout->cell_h;
+  *cx1 = *cx1 < 0 ? 0 : (*cx1 > last ? last : *cx1);
+  *cy1 = *cy1 < 0 ? 0 : (*cy1 > last ? last : *cy1);
+  *cx2 = *cx2 < 0 ? 0 : (*cx2 > last ? last : *cx2);
+  *cy2 = *cy2 < 0 ? 0 : (*cy2 > last ? last : *cy2);
+}
+
+// ===================================================
+// =================== PUBLIC API ====================
+// ===================================================
+bool
+vt_output_layout_init(struct vt_output_layout_t* layout, struct vt_compositor_t* comp, const char* config_path) {
+  if(!layout || !comp) return false;
+  memset(layout, 0, sizeof(*layout));
+  layout->comp = comp;
+  wl_array_init(&layout->configs);
+
+  if(config_path) {
+    snprintf(layout->config_path, sizeof(layout->config_path), "%s", config_path);
+  } else {
+    _vt_layout_default_path(layout->config_path, sizeof(layout->config_path));
+  }
+  _vt_layout_load(layout);
+  return true;
+}
+
+void
+vt_output_layout_finish(struct vt_output_layout_t* layout) {
+  if(!layout) return;
+  wl_array_release(&layout->configs);
+  wl_array_init(&layout->configs);
+  vt_util_output_mask_reset(&layout->ids);
+}
+
+bool
+vt_output_layout_add(struct vt_output_layout_t* layout, struct vt_output_t* output) {
+  if(!layout || !output || output->id >= VT_MAX_OUTPUTS) return false;
+
+  struct vt_output_layout_config_t* config = _vt_layout_find_config(layout, output->name);
+  if(config) {
+    output->x = config->x;
+    output->y = config->y;
+    output->transform = config->transform;
+  } else if(vt_util_output_mask_empty(&layout->ids)) {
+    output->x = 0;
+    output->y = 0;
+  } else {
+    // Unconfigured outputs go right of everything else
+    output->x = layout->extents.x2;
+    output->y = layout->extents.y1;
+  }
+
+  layout->outputs[output->id] = output;
+  vt_util_output_mask_set(&layout->ids, output->id);
+  _vt_layout_rebuild_index(layout);
+
+  VT_TRACE(layout->comp->log, "Placed output %s (%p) at %i,%i (%s%s).",
+           output->name, output, output->x, output->y,
+           _transform_names[output->transform & 7], config ? ", configured" : "");
+  return true;
+}
+
+void
+vt_output_layout_remove(struct vt_output_layout_t* layout, struct vt_output_t* output) {
+  if(!layout || !output || output->id >= VT_MAX_OUTPUTS) return;
+  if(layout->outputs[output->id] != output) return;
+
+  // The other outputs stay where they are
+  layout->outputs[output->id] = NULL;
+  vt_util_output_mask_clear(&layout->ids, output->id);
+  _vt_layout_rebuild_index(layout);
+}
+
+void
+vt_output_layout_update(struct vt_output_layout_t* layout, struct vt_output_t* output) {
+  if(!layout || !output || output->id >= VT_MAX_OUTPUTS) return;
+  if(layout->outputs[output->id] != output) return;
+  _vt_layout_rebuild_index(layout);
+}
+
+bool
+vt_output_layout_move(struct vt_output_layout_t* layout, struct vt_output_t* output,
+                      int32_t x, int32_t y, int32_t transform) {
+  if(!layout || !output || transform < 0 || transform > 7) return false;
+
+  output->x = x;
+  output->y = y;
+  output->transform = transform;
+  vt_output_layout_update(layout, output);
+
+  if(output->name[0] == '\0') return true;
+  struct vt_output_layout_config_t* config = _vt_layout_find_config(layout, output->name);
+  if(!config && !(config = wl_array_add(&layout->configs, sizeof(*config)))) return false;
+  snprintf(config->name, sizeof(config->name), "%s", output->name);
+  config->x = x;
+  config->y = y;
+  config->transform = transform;
+  return vt_output_layout_save(layout);
+}
+
+bool
+vt_output_layout_save(struct vt_output_layout_t* layout) {
+  if(!layout || layout->config_path[0] == '\0') return false;
+
+  // Create the directory of the file if it does not exist yet
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", layout->config_path);
+  char* slash = strrchr(dir, '/');
+  if(slash && slash != dir) {
+    *slash = '\0';
+    mkdir(dir, 0755);
+  }
+
+  FILE* f = fopen(layout->config_path, "w");
+  if(!f) {
+    VT_ERROR(layout->comp->log, "Cannot write output layout to %s: %s", layout->config_path, strerror(errno));
+    return false;
+  }
+  fprintf(f, "# <name> <x> <y> [transform]\n");
+  struct vt_output_layout_config_t* config;
+  wl_array_for_each(config, &layout->configs) {
+    fprintf(f, "%s %i %i %s\n", config->name, config->x, config->y, _transform_names[config->transform & 7]);
+  }
+  fclose(f);
+
+  VT_TRACE(layout->comp->log, "Saved output layout to %s.", layout->config_path);
+  return true;
+}
+
+void
+vt_output_layout_get_box(struct vt_output_t* output, pixman_box32_t* box) {
+  // Odd transforms (90°, 270° and their flipped variants) turn the output on its side
+  const bool rotated = output->transform & 1;
+  const int32_t w = (int32_t)(rotated ? output->height : output->width);
+  const int32_t h = (int32_t)(rotated ? output->width : output->height);
+  box->x1 = output->x;
+  box->y1 = output->y;
+  box->x2 = output->x + w;
+  box->y2 = output->y + h;
+}
+
+struct vt_output_t*
+vt_output_layout_output_at(struct vt_output_layout_t* layout, double x, double y) {
+  if(!layout || vt_util_output_mask_empty(&layout->ids)) return NULL;
+  if(x < layout->extents.x1 || y < layout->extents.y1 ||
+     x >= layout->extents.x2 || y >= layout->extents.y2) return NULL;
+
+  int32_t cx = ((int32_t)x - layout->extents.x1) / layout->cell_w;
+  int32_t cy = ((int32_t)y - layout->extents.y1) / layout->cell_h;
+  if(cx >= VT_OUTPUT_LAYOUT_GRID) cx = VT_OUTPUT_LAYOUT_GRID - 1;
+  if(cy >= VT_OUTPUT_LAYOUT_GRID) cy = VT_OUTPUT_LAYOUT_GRID - 1;
+
+  vt_output_mask_for_each(id, &layout->cells[cy * VT_OUTPUT_LAYOUT_GRID + cx]) {
+    pixman_box32_t box;
+    vt_output_layout_get_box(layout->outputs[id], &box);
+    if(x >= box.x1 && x < box.x2 && y >= box.y1 && y < box.y2) return layout->outputs[id];
+  }
+  return NULL;
+}
+
+void
+vt_output_layout_outputs_in_rect(struct vt_output_layout_t* layout, const pixman_box32_t* rect,
+                                 struct vt_output_mask_t* mask) {
+  vt_util_output_mask_reset(mask);
+  if(!layout || !rect || vt_util_output_mask_empty(&layout->ids)) return;
+  if(rect->x2 <= layout->extents.x1 || rect->y2 <= layout->extents.y1 ||
+     rect->x1 >= layout->extents.x2 || rect->y1 >= layout->extents.y2 ||
+     rect->x1 >= rect->x2 || rect->y1 >= rect->y2) return;
+
+  // Gather the candidates of all cells the rect touches, then test them exactly
+  struct vt_output_mask_t candidates = {0};
+  int32_t cx1, cy1, cx2, cy2;
+  _vt_layout_cell_range(layout, rect, &cx1, &cy1, &cx2, &cy2);
+  for(int32_t cy = cy1; cy <= cy2; cy++) {
+    for(int32_t cx = cx1; cx <= cx2; cx++) {
+      vt_util_output_mask_union(&candidates, &layout->cells[cy * VT_OUTPUT_LAYOUT_GRID + cx]);
+    }
+  }
+
+  vt_output_mask_for_each(id, &candidates) {
+    pixman_box32_t box;
+    vt_output_layout_get_box(layout->outputs[id], &box);
+    if(rect->x2 <= box.x1 || rect->x1 >= box.x2 || rect->y2 <= box.y1 || rect->y1 >= box.y2) continue;
+    vt_util_output_mask_set(mask, id);
+  }
+}
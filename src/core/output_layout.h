@@ -0,0 +1,61 @@
+#pragma once
+
+#include <limits.h>
+
+#include "core_types.h"
+
+// The spatial index splits the layout extents into this many cells per axis
+#define VT_OUTPUT_LAYOUT_GRID 8
+
+// Placement of an output in the global compositor space, matched by name
+struct vt_output_layout_config_t {
+  char name[VT_OUTPUT_NAME_MAX];
+  int32_t x, y;
+  int32_t transform; // enum wl_output_transform
+};
+
+struct vt_output_layout_t {
+  struct vt_compositor_t* comp;
+
+  // Outputs in the layout, indexed by their ID
+  struct vt_output_t* outputs[VT_MAX_OUTPUTS];
+  struct vt_output_mask_t ids;
+
+  // Bounding box of all outputs
+  pixman_box32_t extents;
+
+  // Every cell of the grid over the extents knows the outputs that overlap it
+  int32_t cell_w, cell_h;
+  struct vt_output_mask_t cells[VT_OUTPUT_LAYOUT_GRID * VT_OUTPUT_LAYOUT_GRID];
+
+  // Persisted placements (array of vt_output_layout_config_t)
+  struct wl_array configs;
+  char config_path[PATH_MAX];
+};
+
+bool vt_output_layout_init(struct vt_output_layout_t* layout, struct vt_compositor_t* comp, const char* config_path);
+
+void vt_output_layout_finish(struct vt_output_layout_t* layout);
+
+// Places the output where its configuration says, or right of all other outputs
+bool vt_output_layout_add(struct vt_output_layout_t* layout, struct vt_output_t* output);
+
+void vt_output_layout_remove(struct vt_output_layout_t* layout, struct vt_output_t* output);
+
+// Has to be called after the size of an output in the layout changed
+void vt_output_layout_update(struct vt_output_layout_t* layout, struct vt_output_t* output);
+
+// Moves the output and stores the placement in the configuration file
+bool vt_output_layout_move(struct vt_output_layout_t* layout, struct vt_output_t* output,
+                           int32_t x, int32_t y, int32_t transform);
+
+bool vt_output_layout_save(struct vt_output_layout_t* layout);
+
+// Area the output covers in the layout, width and height are swapped by 90/270° transforms
+void vt_output_layout_get_box(struct vt_output_t* output, pixman_box32_t* box);
+
+struct vt_output_t* vt_output_layout_output_at(struct vt_output_layout_t* layout, double x, double y);
+
+// Fills 'mask' with the outputs that intersect 'rect'
+void vt_output_layout_outputs_in_rect(struct vt_output_layout_t* layout, const pixman_box32_t* rect,
+                                      struct vt_output_mask_t* mask);
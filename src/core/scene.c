@@ -6,6 +6,7 @@
 #include "src/core/util.h"
 #include "src/render/renderer.h"
 #include <wayland-util.h>
+#include <wayland-server-protocol.h>
 
 #define _SCENE_CHILD_CAP_INIT 4
 
@@ -159,6 +160,55 @@ static void _get_cursor_hotspot(struct vt_surface_t *surf, int32_t *hx, int32_t
 
 
 
+// Walks the surfaces front to back and collects the ones that still show within 
+// 'uncovered' once the opaque parts of the surfaces above them are subtracted, 
+// so 'visible' ends up front to back. Leaves 'uncovered' with what no opaque 
+// surface covers, which is all that remains of the background. Surfaces the 
+// renderer cannot draw this frame hide nothing.
+static uint32_t _occlusion_pass(struct vt_renderer_t* r, struct vt_output_t* output, 
+                                struct vt_surface_t** visible, pixman_region32_t* uncovered) {
+  pixman_region32_t damage, surf_damage, opaque;
+  pixman_region32_init(&damage);
+  pixman_region32_copy(&damage, uncovered);
+  pixman_region32_init(&surf_damage);
+  pixman_region32_init(&opaque);
+
+  uint32_t n_visible = 0;
+  struct vt_surface_t* surf;
+  wl_list_for_each(surf, &r->comp->surfaces, link) {
+    if(!surf->mapped || surf->type == VT_SURFACE_TYPE_CURSOR) continue;
+    // Surfaces on hardware planes are put on screen by the backend
+    if(vt_util_output_mask_has(&surf->_mask_outputs_on_plane, output->id)) continue;
+
+    pixman_box32_t box = { surf->x, surf->y, surf->x + surf->width, surf->y + surf->height };
+    pixman_region32_intersect_rect(&surf_damage, uncovered, surf->x, surf->y, surf->width, surf->height);
+    if(!pixman_region32_not_empty(&surf_damage)) {
+      // Hidden surfaces still count as presented, so their clients keep getting frame callbacks
+      if(pixman_region32_contains_rectangle(&damage, &box) != PIXMAN_REGION_OUT) {
+        vt_util_output_mask_set(&surf->_mask_outputs_presented_on, output->id);
+      }
+      continue;
+    }
+    if(!r->impl.is_surface_drawable(r, surf)) continue;
+    visible[n_visible++] = surf;
+
+    // Buffers without alpha hide everything below them, others only where the client says so
+    if(surf->opaque_buffer) {
+      pixman_region32_reset(&opaque, &box);
+    } else {
+      pixman_region32_copy(&opaque, &surf->opaque_region);
+      pixman_region32_translate(&opaque, surf->x, surf->y);
+      pixman_region32_intersect_rect(&opaque, &opaque, surf->x, surf->y, surf->width, surf->height);
+    }
+    pixman_region32_subtract(uncovered, uncovered, &opaque);
+  }
+
+  pixman_region32_fini(&damage);
+  pixman_region32_fini(&surf_damage);
+  pixman_region32_fini(&opaque);
+  return n_visible;
+}
+
 static float prev_cur_x = 0, prev_cur_y = 0, prev_cur_w = 0, prev_cur_h = 0;
 static void _composite_pass(struct vt_renderer_t* renderer, struct vt_output_t *output, struct vt_scene_node_t* root, bool care_for_damage) {
   struct vt_renderer_t* r = renderer;
@@ -167,28 +217,41 @@ static void _composite_pass(struct vt_renderer_t* renderer, struct vt_output_t *
 
   r->impl.begin_scene(r, output);
 
+  pixman_region32_t uncovered;
   if(care_for_damage) {
-  r->impl.draw_rect(r, 0, 0, output->width, output->height, 0xffffff); 
+    pixman_region32_init_rects(&uncovered, output->cached_damage, output->n_damage_boxes);
   } else {
+    pixman_region32_init_rect(&uncovered, 0, 0, output->width, output->height);
     r->impl.set_clear_color(r, output, 0xffffff);
   }
 
-  struct vt_surface_t* surf;
-  wl_list_for_each_reverse(surf, &renderer->comp->surfaces, link) {
-    if(!surf) continue;
-    if(!surf->mapped || !_surf_intersects_damage(surf, output->cached_damage, output->n_damage_boxes) || surf->type == VT_SURFACE_TYPE_CURSOR) {
-      continue;
+  struct vt_surface_t** visible = VT_ALLOC_FRAME(renderer->comp, 
+                                                 sizeof(*visible) * (wl_list_length(&renderer->comp->surfaces) + 1));
+  uint32_t n_visible = visible ? _occlusion_pass(renderer, output, visible, &uncovered) : 0;
+
+  // The background only shows where no opaque surface is drawn over it
+  if(care_for_damage) {
+    int32_t n_boxes = 0;
+    pixman_box32_t* boxes = pixman_region32_rectangles(&uncovered, &n_boxes);
+    for(int32_t i = 0; i < n_boxes; i++) {
+      r->impl.draw_rect(r, boxes[i].x1, boxes[i].y1, boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1, 0xffffff); 
     }
-    renderer->impl.draw_surface(renderer, output, surf, surf->x, surf->y); 
   }
+  pixman_region32_fini(&uncovered);
 
-  if(!renderer->comp->seat->ptr_focus.surf) {
+  // Back to front, so that translucent surfaces blend over what is below them
+  for(uint32_t i = n_visible; i-- > 0;) {
+    renderer->impl.draw_surface(renderer, output, visible[i], visible[i]->x, visible[i]->y); 
+  }
+
+  // Cursors on hardware planes are not part of the composited scene
+  if(!output->hw_cursor && !renderer->comp->seat->ptr_focus.surf) {
     if(!renderer->comp->seat->ptr_focus.surf &&  _surf_intersects_damage(renderer->comp->root_cursor, output->cached_damage, output->n_damage_boxes)) {
     renderer->impl.draw_rect(
       renderer, renderer->comp->root_cursor->x,
       renderer->comp->root_cursor->y, renderer->comp->root_cursor->width, renderer->comp->root_cursor->height, 0xff0000);
     }
-  } else {
+  } else if(!output->hw_cursor) {
     struct vt_surface_t* cursor_focus = _get_focused_cursor_surface(renderer->comp->seat);
     if(cursor_focus && cursor_focus->mapped && cursor_focus->comp->seat->ptr_focus.surf) { 
       struct vt_seat_t* seat = cursor_focus->comp->seat;
@@ -219,7 +282,7 @@ static void _damage_pass(struct vt_renderer_t* r, struct vt_output_t *output) {
 
   struct vt_surface_t* surf;
   wl_list_for_each(surf, &r->comp->surfaces, link) {
-    if(surf && surf->damaged && surf->type == VT_SURFACE_TYPE_CURSOR) {
+    if(surf && surf->damaged && surf->type == VT_SURFACE_TYPE_CURSOR && !output->hw_cursor) {
       struct vt_seat_t* seat = surf->comp->seat;
       if(prev_cur_w != 0) {
         pixman_region32_union_rect(
@@ -280,3 +343,108 @@ void vt_scene_render(struct vt_renderer_t* renderer, struct vt_output_t *output,
   output->needs_repaint = false;
 
 }
+
+struct vt_surface_t* 
+vt_scene_scanout_candidate(struct vt_compositor_t* c, struct vt_output_t* output) {
+  if(!c || !output) return NULL;
+
+  // The surface list is ordered front to back, so the first surface 
+  // visible on the output is the topmost one.
+  struct vt_surface_t* surf, *top = NULL;
+  wl_list_for_each(surf, &c->surfaces, link) {
+    if(!surf->mapped || surf->type == VT_SURFACE_TYPE_CURSOR) continue;
+    if(!vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
+    top = surf;
+    break;
+  }
+  if(!top) return NULL;
+
+  // The buffer has to cover the output exactly, as it is shown without any scaling
+  if(top->x != output->x || top->y != output->y || 
+    top->width != output->width || top->height != output->height ||
+    top->buffer_scale != 1 || top->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+    return NULL;
+  }
+
+  // A composited cursor must not be on the output
+  int32_t cx, cy, hx, hy;
+  struct vt_surface_t* cursor = output->hw_cursor ? NULL : vt_scene_get_cursor(c, &cx, &cy, &hx, &hy);
+  if(cursor && _box_intersect_box(
+    cx, cy, cursor->width * cursor->buffer_scale, cursor->height * cursor->buffer_scale,
+    output->x, output->y, output->width, output->height)) {
+    return NULL;
+  }
+
+  return top;
+}
+
+struct vt_surface_t* 
+vt_scene_get_cursor(struct vt_compositor_t* c, int32_t* x, int32_t* y, int32_t* hotspot_x, int32_t* hotspot_y) {
+  if(!c || !c->seat) return NULL;
+  *x = *y = *hotspot_x = *hotspot_y = 0;
+
+  // Without pointer focus, the compositor shows its own cursor
+  if(!c->seat->ptr_focus.surf) {
+    if(!c->root_cursor) return NULL;
+    *x = c->seat->pointer_x;
+    *y = c->seat->pointer_y;
+    return c->root_cursor;
+  }
+
+  struct vt_surface_t* cursor_focus = _get_focused_cursor_surface(c->seat);
+  if(!cursor_focus || !cursor_focus->mapped) return NULL;
+
+  _get_cursor_hotspot(cursor_focus, hotspot_x, hotspot_y);
+  *x = c->seat->pointer_x - *hotspot_x;
+  *y = c->seat->pointer_y - *hotspot_y;
+  return cursor_focus;
+}
+
+uint32_t 
+vt_scene_assign_planes(struct vt_compositor_t* c, struct vt_output_t* output, 
+                       vt_scene_plane_claim_func_t claim, void* user_data) {
+  if(!c || !output) return 0;
+
+  // Everything that stays composited and lies above a surface has 
+  // to be drawn over it, which a plane below the scene cannot do.
+  pixman_region32_t above;
+  pixman_region32_init(&above);
+
+  int32_t cx, cy, hx, hy;
+  struct vt_surface_t* cursor = output->hw_cursor ? NULL : vt_scene_get_cursor(c, &cx, &cy, &hx, &hy);
+  if(cursor) {
+    pixman_region32_union_rect(&above, &above, cx, cy, 
+                               cursor->width * cursor->buffer_scale, cursor->height * cursor->buffer_scale);
+  }
+
+  uint32_t n_claimed = 0;
+  struct vt_surface_t* surf;
+  wl_list_for_each(surf, &c->surfaces, link) {
+    if(surf->type == VT_SURFACE_TYPE_CURSOR) continue;
+    const bool was_claimed = vt_util_output_mask_has(&surf->_mask_outputs_on_plane, output->id);
+    vt_util_output_mask_clear(&surf->_mask_outputs_on_plane, output->id);
+    if(!surf->mapped || !vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
+
+    pixman_box32_t box = { surf->x, surf->y, surf->x + surf->width, surf->y + surf->height };
+    bool claimed = claim && 
+      pixman_region32_contains_rectangle(&above, &box) == PIXMAN_REGION_OUT &&
+      claim(output, surf, user_data);
+
+    if(claimed) {
+      vt_util_output_mask_set(&surf->_mask_outputs_on_plane, output->id);
+      n_claimed++;
+    }
+    // Planes do not overlap either, their stacking order is up to the hardware
+    pixman_region32_union_rect(&above, &above, surf->x, surf->y, surf->width, surf->height);
+
+    // The area of the surface on the composited scene changes with its plane
+    if(claimed != was_claimed) {
+      pixman_region32_union_rect(&output->damage, &output->damage, 
+                                 surf->x, surf->y, surf->width, surf->height);
+      output->needs_damage_rebuild = true;
+    }
+  }
+
+  pixman_region32_fini(&above);
+  return n_claimed;
+}
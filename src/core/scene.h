@@ -38,3 +38,17 @@ struct vt_output_t;
 void vt_scene_node_render(struct vt_renderer_t* renderer,  struct vt_output_t* output, struct vt_scene_node_t* node, bool care_for_damage, vt_scene_node_filter_func_t filter); 
 
 void vt_scene_render(struct vt_renderer_t* renderer,  struct vt_output_t* output, struct vt_scene_node_t* root); 
+
+struct vt_surface_t* vt_scene_scanout_candidate(struct vt_compositor_t* c, struct vt_output_t* output);
+
+typedef bool (*vt_scene_plane_claim_func_t)(struct vt_output_t* output, struct vt_surface_t* surf, void* user_data);
+
+// Offers the surfaces on the output that nothing composited is drawn over to 
+// 'claim', front to back. Claimed surfaces are skipped by the composite pass.
+// Passing NULL as 'claim' drops all claims on the output.
+uint32_t vt_scene_assign_planes(struct vt_compositor_t* c, struct vt_output_t* output, 
+                                vt_scene_plane_claim_func_t claim, void* user_data);
+
+// Returns the cursor surface that is shown on top of the scene (NULL if none) 
+// along with the position of its top left corner and its hotspot.
+struct vt_surface_t* vt_scene_get_cursor(struct vt_compositor_t* c, int32_t* x, int32_t* y, int32_t* hotspot_x, int32_t* hotspot_y);
@@ -6,6 +6,8 @@
 #include "src/protocols/xdg_shell.h"
 #include <wayland-server-protocol.h>
 #include <wayland-util.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define _SUBSYS_NAME "SURFACE"
 
@@ -84,3 +86,46 @@ vt_surface_unmapped(struct vt_surface_t* surf) {
   vt_seat_set_keyboard_focus(seat, new_focus);
 
 }
+
+bool
+vt_surface_copy_cursor_image(struct vt_surface_t* surf) {
+  if(!surf) return false;
+  struct wl_shm_buffer* shm = surf->buf_res ? wl_shm_buffer_get(surf->buf_res) : NULL;
+  uint32_t fmt = shm ? wl_shm_buffer_get_format(shm) : 0;
+  // Only SHM cursors can be copied on the CPU, everything else stays composited
+  if(!shm || (fmt != WL_SHM_FORMAT_ARGB8888 && fmt != WL_SHM_FORMAT_XRGB8888)) {
+    free(surf->cursor_image.pixels);
+    surf->cursor_image.pixels = NULL;
+    surf->cursor_image.width = surf->cursor_image.height = 0;
+    return false;
+  }
+
+  uint32_t w = wl_shm_buffer_get_width(shm), h = wl_shm_buffer_get_height(shm);
+  int32_t stride = wl_shm_buffer_get_stride(shm);
+  if(w != surf->cursor_image.width || h != surf->cursor_image.height || !surf->cursor_image.pixels) {
+    uint32_t* pixels = realloc(surf->cursor_image.pixels, (size_t)w * h * 4);
+    if(!pixels) {
+      VT_ERROR(surf->comp->log, "Cannot allocate %ix%i cursor image.", w, h);
+      free(surf->cursor_image.pixels);
+      surf->cursor_image.pixels = NULL;
+      surf->cursor_image.width = surf->cursor_image.height = 0;
+      return false;
+    }
+    surf->cursor_image.pixels = pixels;
+    surf->cursor_image.width  = w;
+    surf->cursor_image.height = h;
+  }
+
+  wl_shm_buffer_begin_access(shm);
+  const uint8_t* src = wl_shm_buffer_get_data(shm);
+  for(uint32_t y = 0; y < h; y++) {
+    uint32_t* dst = surf->cursor_image.pixels + (size_t)y * w;
+    memcpy(dst, src + (size_t)y * stride, (size_t)w * 4);
+    if(fmt == WL_SHM_FORMAT_XRGB8888) {
+      for(uint32_t x = 0; x < w; x++) dst[x] |= 0xff000000;
+    }
+  }
+  wl_shm_buffer_end_access(shm);
+
+  return true;
+}
@@ -20,6 +20,13 @@ struct vt_surface_sync_state_t {
   struct wl_resource* res;
 };
 
+// wp_tearing_control_v1 presentation hint, 'async' asks for 
+// frames to be shown right away, even if that tears.
+struct vt_surface_tearing_state_t {
+  struct wl_resource* res;
+  bool pending_async, async;
+};
+
 enum vt_surface_type_t {
   VT_SURFACE_TYPE_NORMAL = 0,
   VT_SURFACE_TYPE_CURSOR = 1,
@@ -27,6 +34,13 @@ enum vt_surface_type_t {
 
 struct vt_linux_dmabuf_v1_surface_t;
 
+// CPU copy of the contents of a cursor surface, backends upload 
+// it to hardware cursor planes.
+struct vt_cursor_image_t {
+  uint32_t* pixels; // ARGB8888, tightly packed
+  uint32_t width, height;
+};
+
 struct vt_surface_t {
   struct wl_resource* surf_res;
   struct wl_resource* buf_res;
@@ -35,6 +49,10 @@ struct vt_surface_t {
 
   RnTexture tex; 
   void* render_tex_handle;
+  // SHM contents are uploaded into tex_back which is then swapped with 
+  // tex, tex_back_damage is what tex_back misses compared to tex.
+  RnTexture tex_back;
+  pixman_region32_t tex_back_damage;
 
   struct wl_list link, link_focus;
   
@@ -50,8 +68,10 @@ struct vt_surface_t {
 
   bool has_buffer, mapped;
 
-  uint32_t _mask_outputs_visible_on;
-  uint32_t _mask_outputs_presented_on;
+  struct vt_output_mask_t _mask_outputs_visible_on;
+  struct vt_output_mask_t _mask_outputs_presented_on;
+  // Outputs on which the backend shows the surface on a hardware plane
+  struct vt_output_mask_t _mask_outputs_on_plane;
 
   void* user_data;
 
@@ -60,6 +80,10 @@ struct vt_surface_t {
   pixman_region32_t opaque_region;
   pixman_region32_t input_region;
 
+  // The committed buffer has no alpha channel, so all of the 
+  // surface is opaque regardless of opaque_region.
+  bool opaque_buffer;
+
   int32_t buffer_transform;
   int32_t buffer_scale;
 
@@ -69,13 +93,23 @@ struct vt_surface_t {
 
   struct vt_surface_sync_state_t sync;
 
+  struct vt_surface_tearing_state_t tearing;
+
   struct vt_linux_dmabuf_v1_surface_t* dmabuf_surf;
 
+  // Currently committed DMABUF, locked until the next 
+  // buffer is committed or the surface is destroyed.
+  struct vt_linux_dmabuf_v1_buffer_t* locked_dmabuf;
+
   enum vt_surface_type_t type;
 
+  struct vt_cursor_image_t cursor_image;
+
   struct vt_scene_node_t* scene_node;
 };
 
 void vt_surface_mapped(struct vt_surface_t* surf);
 
 void vt_surface_unmapped(struct vt_surface_t* surf);
+
+bool vt_surface_copy_cursor_image(struct vt_surface_t* surf);
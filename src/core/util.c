@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <sys/mman.h>
+#include <drm/drm_fourcc.h>
 
 #define _SUBSYS_NAME "UTIL"
 
@@ -27,6 +28,13 @@ vt_util_get_time_msec(void) {
   return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 }
 
+uint64_t
+vt_util_get_time_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 void 
 vt_util_arena_init(struct vt_arena_t* a, size_t capacity) {
   a->base = (uint8_t*)malloc(capacity);
@@ -205,12 +213,6 @@ vt_util_allocate_shm_rwro_pair(struct vt_compositor_t* comp, size_t size, int* r
   return true;
 }
 
-#define fourcc_code(a, b, c, d) ((__u32)(a) | ((__u32)(b) << 8) | \
-  ((__u32)(c) << 16) | ((__u32)(d) << 24))
-
-#define DRM_FORMAT_XRGB8888	fourcc_code('X', 'R', '2', '4') /* [31:0] x:R:G:B 8:8:8:8 little endian */
-#define DRM_FORMAT_ARGB8888	fourcc_code('A', 'R', '2', '4') /* [31:0] A:R:G:B 8:8:8:8 little endian */
-
 uint32_t 
 vt_util_convert_wl_shm_format_to_drm(enum wl_shm_format fmt) {
   switch (fmt) {
@@ -223,6 +225,73 @@ vt_util_convert_wl_shm_format_to_drm(enum wl_shm_format fmt) {
   }
 }
 
+bool
+vt_util_drm_format_has_alpha(uint32_t fmt) {
+  switch(fmt) {
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_RGBA8888:
+    case DRM_FORMAT_BGRA8888:
+    case DRM_FORMAT_ARGB2101010:
+    case DRM_FORMAT_ABGR2101010:
+    case DRM_FORMAT_RGBA1010102:
+    case DRM_FORMAT_BGRA1010102:
+    case DRM_FORMAT_ARGB16161616F:
+    case DRM_FORMAT_ABGR16161616F:
+    case DRM_FORMAT_ARGB4444:
+    case DRM_FORMAT_ABGR4444:
+    case DRM_FORMAT_ARGB1555:
+    case DRM_FORMAT_ABGR1555:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t
+vt_util_drm_format_bpp(uint32_t fmt) {
+  switch(fmt) {
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+    case DRM_FORMAT_XRGB4444:
+    case DRM_FORMAT_ARGB4444:
+    case DRM_FORMAT_XBGR4444:
+    case DRM_FORMAT_ABGR4444:
+    case DRM_FORMAT_XRGB1555:
+    case DRM_FORMAT_ARGB1555:
+    case DRM_FORMAT_XBGR1555:
+    case DRM_FORMAT_ABGR1555:
+      return 16;
+    case DRM_FORMAT_RGB888:
+    case DRM_FORMAT_BGR888:
+      return 24;
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_RGBX8888:
+    case DRM_FORMAT_RGBA8888:
+    case DRM_FORMAT_BGRX8888:
+    case DRM_FORMAT_BGRA8888:
+    case DRM_FORMAT_XRGB2101010:
+    case DRM_FORMAT_ARGB2101010:
+    case DRM_FORMAT_XBGR2101010:
+    case DRM_FORMAT_ABGR2101010:
+    case DRM_FORMAT_RGBX1010102:
+    case DRM_FORMAT_RGBA1010102:
+    case DRM_FORMAT_BGRX1010102:
+    case DRM_FORMAT_BGRA1010102:
+      return 32;
+    case DRM_FORMAT_XRGB16161616F:
+    case DRM_FORMAT_ARGB16161616F:
+    case DRM_FORMAT_XBGR16161616F:
+    case DRM_FORMAT_ABGR16161616F:
+      return 64;
+    default:
+      return 0;
+  }
+}
+
 enum wl_shm_format 
 vt_util_convert_drm_format_to_wl_shm(uint32_t fmt) {
   switch (fmt) {
@@ -234,3 +303,67 @@ vt_util_convert_drm_format_to_wl_shm(uint32_t fmt) {
       return (enum wl_shm_format)fmt;
   }
 }
+
+void 
+vt_util_output_mask_set(struct vt_output_mask_t* mask, uint32_t id) {
+  if(id >= VT_MAX_OUTPUTS) return;
+  mask->words[id / 64] |= 1ull << (id % 64);
+}
+
+void 
+vt_util_output_mask_clear(struct vt_output_mask_t* mask, uint32_t id) {
+  if(id >= VT_MAX_OUTPUTS) return;
+  mask->words[id / 64] &= ~(1ull << (id % 64));
+}
+
+bool 
+vt_util_output_mask_has(const struct vt_output_mask_t* mask, uint32_t id) {
+  if(id >= VT_MAX_OUTPUTS) return false;
+  return (mask->words[id / 64] >> (id % 64)) & 1ull;
+}
+
+void 
+vt_util_output_mask_reset(struct vt_output_mask_t* mask) {
+  memset(mask, 0, sizeof(*mask));
+}
+
+bool 
+vt_util_output_mask_empty(const struct vt_output_mask_t* mask) {
+  for(uint32_t i = 0; i < VT_MAX_OUTPUTS / 64; i++) {
+    if(mask->words[i]) return false;
+  }
+  return true;
+}
+
+bool 
+vt_util_output_mask_contains(const struct vt_output_mask_t* mask, const struct vt_output_mask_t* sub) {
+  for(uint32_t i = 0; i < VT_MAX_OUTPUTS / 64; i++) {
+    if((mask->words[i] & sub->words[i]) != sub->words[i]) return false;
+  }
+  return true;
+}
+
+void 
+vt_util_output_mask_union(struct vt_output_mask_t* mask, const struct vt_output_mask_t* other) {
+  for(uint32_t i = 0; i < VT_MAX_OUTPUTS / 64; i++) {
+    mask->words[i] |= other->words[i];
+  }
+}
+
+uint32_t 
+vt_util_output_mask_next(const struct vt_output_mask_t* mask, uint32_t id) {
+  while(id < VT_MAX_OUTPUTS) {
+    uint64_t word = mask->words[id / 64] >> (id % 64);
+    if(word) return id + (uint32_t)__builtin_ctzll(word);
+    id = (id / 64 + 1) * 64;
+  }
+  return VT_MAX_OUTPUTS;
+}
+
+uint32_t 
+vt_util_output_mask_first_free(const struct vt_output_mask_t* mask) {
+  for(uint32_t i = 0; i < VT_MAX_OUTPUTS / 64; i++) {
+    if(~mask->words[i]) return i * 64 + (uint32_t)__builtin_ctzll(~mask->words[i]);
+  }
+  return VT_MAX_OUTPUTS;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <wayland-server-core.h>
@@ -131,6 +132,20 @@ void vt_util_log_header(FILE* stream, log_level_t lvl);
 
 char* vt_util_log_get_filepath();
 
+// Upper bound for simultaneously existing outputs, their IDs are dense 
+// indices below it (see vt_comp_add_output()).
+#define VT_MAX_OUTPUTS 256
+
+// Set of outputs, indexed by vt_output_t.id
+struct vt_output_mask_t {
+  uint64_t words[VT_MAX_OUTPUTS / 64];
+};
+
+// Iterates the IDs of all outputs in the mask
+#define vt_output_mask_for_each(id, mask)                                           \
+  for (uint32_t id = vt_util_output_mask_next((mask), 0);                           \
+       id < VT_MAX_OUTPUTS; id = vt_util_output_mask_next((mask), id + 1))
+
 struct vt_arena_t {
     uint8_t *base;
     size_t   offset;
@@ -139,6 +154,8 @@ struct vt_arena_t {
 
 uint64_t vt_util_get_time_msec(void);
 
+uint64_t vt_util_get_time_nsec(void);
+
 void vt_util_arena_init(struct vt_arena_t *a, size_t capacity);
 
 void* vt_util_alloc(struct vt_arena_t *a, size_t size);
@@ -157,3 +174,30 @@ bool vt_util_allocate_shm_rwro_pair(struct vt_compositor_t* comp, size_t size, i
 uint32_t vt_util_convert_wl_shm_format_to_drm(enum wl_shm_format fmt);
 
 enum wl_shm_format vt_util_convert_drm_format_to_wl_shm(uint32_t fmt);
+
+// Whether buffers of the DRM format can be (partially) transparent
+bool vt_util_drm_format_has_alpha(uint32_t fmt);
+
+// Bits per pixel of single plane RGB DRM formats, 0 for anything else
+uint32_t vt_util_drm_format_bpp(uint32_t fmt);
+
+void vt_util_output_mask_set(struct vt_output_mask_t* mask, uint32_t id);
+
+void vt_util_output_mask_clear(struct vt_output_mask_t* mask, uint32_t id);
+
+bool vt_util_output_mask_has(const struct vt_output_mask_t* mask, uint32_t id);
+
+void vt_util_output_mask_reset(struct vt_output_mask_t* mask);
+
+bool vt_util_output_mask_empty(const struct vt_output_mask_t* mask);
+
+// True if every output in 'sub' is also in 'mask'
+bool vt_util_output_mask_contains(const struct vt_output_mask_t* mask, const struct vt_output_mask_t* sub);
+
+void vt_util_output_mask_union(struct vt_output_mask_t* mask, const struct vt_output_mask_t* other);
+
+// Lowest output in the mask starting at 'id', VT_MAX_OUTPUTS if there is none
+uint32_t vt_util_output_mask_next(const struct vt_output_mask_t* mask, uint32_t id);
+
+// Lowest output not in the mask, VT_MAX_OUTPUTS if all are
+uint32_t vt_util_output_mask_first_free(const struct vt_output_mask_t* mask);
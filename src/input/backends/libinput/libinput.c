@@ -3,6 +3,7 @@
 #include "src/core/core_types.h"
 #include "src/core/session.h"
 #include "src/core/util.h"
+#include "src/core/output_layout.h"
 #include "src/input/input.h"
 #include "src/input/wl_seat.h"
 #include <errno.h>
@@ -128,29 +129,20 @@ _vt_li_input_handle_pointer_motion_event(struct vt_input_backend_li_t* li, struc
   if (type == LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE) {
 
     uint32_t output_width = 0, output_height = 0;
+    struct vt_output_layout_t* layout = li->comp->output_layout;
     struct vt_surface_t* ptr_focus = li->comp->seat->ptr_focus.surf;
+    struct vt_output_t* output = NULL;
     if(ptr_focus) {
-      struct vt_output_t* output;
-      wl_list_for_each(output, &li->comp->outputs, link_global) {
-        if(!(ptr_focus->_mask_outputs_visible_on & (1u << output->id))) continue;
-        output_width = output->width;
-        output_height = output->height;
-        break;
-      } 
+      uint32_t id = vt_util_output_mask_next(&ptr_focus->_mask_outputs_visible_on, 0);
+      if(id < VT_MAX_OUTPUTS) output = layout->outputs[id];
     } else {
-      struct vt_output_t* output;
-      wl_list_for_each(output, &li->comp->outputs, link_global) {
-        if(
-          li->comp->seat->pointer_x >= output->x && 
-          li->comp->seat->pointer_x < output->x + output->width && 
-          li->comp->seat->pointer_y >= output->y && 
-          li->comp->seat->pointer_y < output->y + output->height
-        ) {
-          output_width = output->width;
-          output_height = output->height;
-          break;
-        }
-      } 
+      output = vt_output_layout_output_at(layout, li->comp->seat->pointer_x, li->comp->seat->pointer_y);
+    }
+    if(output) {
+      pixman_box32_t box;
+      vt_output_layout_get_box(output, &box);
+      output_width = box.x2 - box.x1;
+      output_height = box.y2 - box.y1;
     }
     if(!output_width || !output_height) {
       VT_WARN(li->comp->log, "Cannot retrieve output dimensions.");
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "input.h"
 #include "src/input/backends/libinput/libinput.h"
 #include "src/input/backends/wayland/wayland_input.h"
@@ -25,6 +27,10 @@ vt_input_implement(struct vt_input_backend_t* backend, enum vt_input_backend_pla
       .suspend = input_backend_suspend_wl
     };
   }
+  else if(platform == VT_INPUT_UNKNOWN) {
+    // Backends without input devices (headless)
+    memset(&backend->impl, 0, sizeof(backend->impl));
+  }
   else {
     VT_ERROR(backend->comp->log, "Invalid input backend.");
   }
@@ -12,6 +12,7 @@
 
 #include "src/core/compositor.h"
 #include "src/core/util.h"
+#include "src/core/output_layout.h"
 #include "src/protocols/xdg_shell.h"
 
 #define _SUBSYS_NAME "SEAT"
@@ -23,6 +24,7 @@ static bool _wl_handle_global_keybind(struct vt_seat_t* seat, uint32_t keycode,
 
 static void _wl_handle_keybind_exit(struct vt_compositor_t* comp, void* user_data);
 static void _wl_handle_keybind_term(struct vt_compositor_t* comp, void* user_data);
+static void _wl_handle_keybind_move_output(struct vt_compositor_t* comp, void* user_data);
 
 static void _wl_seat_get_pointer(struct wl_client* client, struct wl_resource* seat_res, uint32_t id);
 static void _wl_seat_get_keyboard(struct wl_client* client, struct wl_resource* seat_res, uint32_t id);
@@ -136,6 +138,36 @@ _wl_handle_keybind_term(struct vt_compositor_t* comp, void* user_data) {
   VT_TRACE(comp->log, "Doing: '%s'", buf);
   system(buf);
 }
+void
+_wl_handle_keybind_move_output(struct vt_compositor_t* comp, void* user_data) {
+  // Swaps the output under the pointer with its neighbour to the left (-1) or right (1)
+  const int32_t dir = (int32_t)(intptr_t)user_data;
+  struct vt_output_layout_t* layout = comp->output_layout;
+  struct vt_output_t* output = vt_output_layout_output_at(layout, comp->seat->pointer_x, comp->seat->pointer_y);
+  if(!output) return;
+
+  struct vt_output_t *neighbour = NULL, *other;
+  wl_list_for_each(other, &comp->outputs, link_global) {
+    if(other == output || (other->x - output->x) * dir <= 0) continue;
+    if(!neighbour || (other->x - neighbour->x) * dir < 0) neighbour = other;
+  }
+  if(!neighbour) return;
+
+  pixman_box32_t a, b;
+  vt_output_layout_get_box(output, &a);
+  vt_output_layout_get_box(neighbour, &b);
+  const int32_t wa = a.x2 - a.x1, wb = b.x2 - b.x1;
+  // The pair keeps covering the same span, just in the other order
+  int32_t xa = dir > 0 ? b.x2 - wa : b.x1;
+  int32_t xb = dir > 0 ? a.x1 : a.x2 - wb;
+  vt_output_layout_move(layout, output, xa, output->y, output->transform);
+  vt_output_layout_move(layout, neighbour, xb, neighbour->y, neighbour->transform);
+
+  VT_TRACE(comp->log, "Swapped outputs %s and %s in the layout.", output->name, neighbour->name);
+  vt_comp_output_layout_changed(comp, output);
+  vt_comp_output_layout_changed(comp, neighbour);
+}
+
 void 
 _wl_handle_keybind_nogger(struct vt_compositor_t* comp, void* user_data) {
   comp->nogger = !comp->nogger;
@@ -203,7 +235,6 @@ _wl_seat_pointer_set_cursor(
     surf = wl_resource_get_user_data(surface);
     surf->type = VT_SURFACE_TYPE_CURSOR;
     surf->mapped = true;
-    vt_comp_surf_mark_damaged(surf->comp, surf); 
   } 
 
   struct vt_pointer_t* ptr = wl_resource_get_user_data(resource);
@@ -212,6 +243,10 @@ _wl_seat_pointer_set_cursor(
   ptr->cursor.surf = surf; 
   ptr->cursor.hotspot_x = hotspot_x;
   ptr->cursor.hotspot_y = hotspot_y;
+
+  if(!vt_comp_update_cursor(ptr->seat->comp) && surf) {
+    vt_comp_surf_mark_damaged(surf->comp, surf); 
+  }
 }
 
 void 
@@ -422,14 +457,21 @@ vt_seat_handle_pointer_motion(struct vt_seat_t* seat, double x, double y, uint32
   seat->pointer_x = x;
   seat->pointer_y = y;
 
-  if(!seat->ptr_focus.surf) {
-    vt_comp_damage_entire_surface(
-      seat->comp, seat->comp->root_cursor, x, y); 
-  }
-  struct vt_pointer_t *ptr;
-  wl_list_for_each(ptr, &seat->pointers, link) {
-    if (ptr->cursor.surf) {
-      vt_comp_surf_mark_damaged(seat->comp, ptr->cursor.surf);  
+  // Cursors on hardware planes only need to be moved, 
+  // which does not require any repaint.
+  if(vt_comp_move_cursor(seat->comp)) {
+    seat->comp->root_cursor->x = x;
+    seat->comp->root_cursor->y = y;
+  } else {
+    if(!seat->ptr_focus.surf) {
+      vt_comp_damage_entire_surface(
+        seat->comp, seat->comp->root_cursor, x, y); 
+    }
+    struct vt_pointer_t *ptr;
+    wl_list_for_each(ptr, &seat->pointers, link) {
+      if (ptr->cursor.surf) {
+        vt_comp_surf_mark_damaged(seat->comp, ptr->cursor.surf);  
+      }
     }
   }
   if (!surf || !seat->ptr_focus.res)
@@ -590,9 +632,11 @@ vt_seat_set_pointer_focus(struct vt_seat_t *seat,
   // Reset focus
   seat->ptr_focus.surf = surf;
   seat->ptr_focus.res  = NULL;
-  // If no new surface, done
-  if (!surf)
+  // If no new surface, the compositor cursor takes over and we're done
+  if (!surf) {
+    vt_comp_update_cursor(seat->comp);
     return;
+  }
 
   // Find the pointer resource for this client
   struct wl_client* client = wl_resource_get_client(surf->surf_res);
@@ -601,14 +645,20 @@ vt_seat_set_pointer_focus(struct vt_seat_t *seat,
     wl_list_for_each(ptr, &seat->pointers, link) {
       if (wl_resource_get_client(ptr->res) == client) {
         seat->ptr_focus.res = ptr->res;
-        if(ptr->cursor.surf) {
-          vt_comp_surf_mark_damaged(seat->comp, ptr->cursor.surf); 
-        }
         break;
       }
     }
   }
 
+  // The cursor of the newly focused client replaces the previous one
+  if(!vt_comp_update_cursor(seat->comp)) {
+    struct vt_pointer_t* ptr;
+    wl_list_for_each(ptr, &seat->pointers, link) {
+      if(ptr->res == seat->ptr_focus.res && ptr->cursor.surf) {
+        vt_comp_surf_mark_damaged(seat->comp, ptr->cursor.surf); 
+      }
+    }
+  }
 
   if (!seat->ptr_focus.res)
     return;
@@ -632,6 +682,8 @@ vt_seat_bind_global_keybinds(struct vt_seat_t* seat) {
   vt_seat_add_global_keybind(seat, XKB_KEY_Escape, mods.alt, _wl_handle_keybind_exit, NULL);
   vt_seat_add_global_keybind(seat, XKB_KEY_e, mods.alt, _wl_handle_keybind_term, NULL);
   vt_seat_add_global_keybind(seat, XKB_KEY_n, mods.alt, _wl_handle_keybind_nogger, NULL);
+  vt_seat_add_global_keybind(seat, XKB_KEY_Left, mods.alt | mods.shift, _wl_handle_keybind_move_output, (void*)(intptr_t)-1);
+  vt_seat_add_global_keybind(seat, XKB_KEY_Right, mods.alt | mods.shift, _wl_handle_keybind_move_output, (void*)(intptr_t)1);
 }
 
 bool
@@ -125,6 +125,10 @@ static void _linux_dmabuf_v1_buffer_handle_res_destroy(
   struct wl_resource* resource
 );
 
+static void _linux_dmabuf_buffer_free(
+  struct vt_linux_dmabuf_v1_buffer_t* buf
+);
+
 static void _linux_dmabuf_v1_surf_feedback_handle_res_destroy(
   struct wl_resource* resource
 );
@@ -780,6 +784,22 @@ _linux_dmabuf_v1_buffer_handle_res_destroy(
 
   buf->res = NULL;
   wl_resource_set_user_data(resource, NULL);
+
+  // A locked buffer is still read from (e.g scanned out), 
+  // it is freed once the last lock is dropped.
+  if(!buf->n_locks) {
+    _linux_dmabuf_buffer_free(buf);
+  }
+}
+
+void
+_linux_dmabuf_buffer_free(struct vt_linux_dmabuf_v1_buffer_t* buf) {
+  if(buf->destroy_user_data) {
+    buf->destroy_user_data(buf, buf->user_data);
+  }
+  for (int32_t i = 0; i < buf->attr.num_planes; i++) {
+    if (buf->attr.fds[i] >= 0) close(buf->attr.fds[i]);
+  }
   free(buf);
 }
 
@@ -1111,17 +1131,23 @@ _linux_dmabuf_pack_feedback(
     tranche_packed->flags = tranche->flags;
     wl_array_init(&tranche_packed->indices);
 
+    // The table holds one entry per format/modifier pair, so a 
+    // format covers as many indices as it has modifiers.
+    size_t entry_base = 0;
     for (size_t j = 0; j < n_all_formats; j++) {
       if (_format_exists(&tranche->formats, &all_fmt_data[j])) {
-        uint16_t* add = wl_array_add(&tranche_packed->indices, sizeof(*add));
-        if (!add) {
-          VT_ERROR(feedback->comp->log, "Out of memory.");
-          close(ro_fd);
-          wl_array_release(&all_formats);
-          return false;
+        for (size_t k = 0; k < all_fmt_data[j].len; k++) {
+          uint16_t* add = wl_array_add(&tranche_packed->indices, sizeof(*add));
+          if (!add) {
+            VT_ERROR(feedback->comp->log, "Out of memory.");
+            close(ro_fd);
+            wl_array_release(&all_formats);
+            return false;
+          }
+          *add = entry_base + k;
         }
-        *add = j;
       }
+      entry_base += all_fmt_data[j].len;
     }
   }
 
@@ -1393,6 +1419,36 @@ vt_proto_linux_dmabuf_v1_from_buffer_res(struct wl_resource* res) {
   return buf;
 }
 
+void
+vt_proto_linux_dmabuf_v1_buffer_lock(struct vt_linux_dmabuf_v1_buffer_t* buf) {
+  if (!buf) return;
+  buf->n_locks++;
+}
+
+void
+vt_proto_linux_dmabuf_v1_buffer_unlock(struct vt_linux_dmabuf_v1_buffer_t* buf) {
+  if (!buf || !buf->n_locks) return;
+  if (--buf->n_locks) return;
+
+  // Nobody reads from the buffer anymore, hand it back to the client 
+  // or free it if the client already destroyed it.
+  if (buf->res) {
+    wl_buffer_send_release(buf->res);
+  } else {
+    _linux_dmabuf_buffer_free(buf);
+  }
+}
+
+void
+vt_proto_linux_dmabuf_v1_buffer_set_user_data(
+  struct vt_linux_dmabuf_v1_buffer_t* buf, 
+  void* data, 
+  vt_linux_dmabuf_v1_buffer_data_destroy_func_t destroy) {
+  if (!buf) return;
+  buf->user_data = data;
+  buf->destroy_user_data = destroy;
+}
+
 void 
 vt_proto_linux_dmabuf_v1_surface_destroy(struct vt_surface_t* surf) {
   /* 1. Validate surface pointer */
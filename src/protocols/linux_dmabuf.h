@@ -4,10 +4,25 @@
 #include "../render/dmabuf.h"
 #include "../core/surface.h"
 
+struct vt_linux_dmabuf_v1_buffer_t;
+
+typedef void (*vt_linux_dmabuf_v1_buffer_data_destroy_func_t)(
+    struct vt_linux_dmabuf_v1_buffer_t* buf, void* data);
+
 struct vt_linux_dmabuf_v1_buffer_t {
   uint32_t w, h;
   struct vt_dmabuf_attr_t attr;
   struct wl_resource* res;
+
+  // Number of users that still read from the buffer (the surface it is 
+  // committed to, a KMS plane that scans it out...). The client only gets 
+  // the buffer back once the last lock is dropped.
+  uint32_t n_locks;
+
+  // Data attached by a backend (e.g a KMS framebuffer), destroyed together 
+  // with the buffer
+  void* user_data;
+  vt_linux_dmabuf_v1_buffer_data_destroy_func_t destroy_user_data;
 };
 
 struct vt_linux_dmabuf_v1_surface_t {
@@ -28,6 +43,17 @@ bool vt_proto_linux_dmabuf_v1_init(
 struct vt_linux_dmabuf_v1_buffer_t* vt_proto_linux_dmabuf_v1_from_buffer_res(
     struct wl_resource* res);
 
+void vt_proto_linux_dmabuf_v1_buffer_lock(
+    struct vt_linux_dmabuf_v1_buffer_t* buf);
+
+void vt_proto_linux_dmabuf_v1_buffer_unlock(
+    struct vt_linux_dmabuf_v1_buffer_t* buf);
+
+void vt_proto_linux_dmabuf_v1_buffer_set_user_data(
+    struct vt_linux_dmabuf_v1_buffer_t* buf, 
+    void* data, 
+    vt_linux_dmabuf_v1_buffer_data_destroy_func_t destroy);
+
 void vt_proto_linux_dmabuf_v1_surface_destroy(struct vt_surface_t* surf);
 
 bool vt_proto_linux_dmabuf_v1_set_surface_feedback(struct vt_surface_t* surf);
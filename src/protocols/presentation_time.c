@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+
+#include "presentation_time.h"
+#include "src/core/core_types.h"
+#include "src/core/surface.h"
+#include "src/core/util.h"
+
+#include <time.h>
+#include <presentation-time-server-protocol.h>
+#include <wayland-server-core.h>
+#include <wayland-util.h>
+
+#define _SUBSYS_NAME "VT_PROTO_PRESENTATION"
+
+enum vt_presentation_feedback_state_t {
+  // Requested, waiting for the next commit of the surface
+  VT_PRESENTATION_FEEDBACK_PENDING = 0,
+  // Committed, waiting for a frame that shows the content
+  VT_PRESENTATION_FEEDBACK_COMMITTED,
+  // Part of a frame that was submitted on 'output'
+  VT_PRESENTATION_FEEDBACK_LATCHED,
+};
+
+struct vt_presentation_feedback_t {
+  struct wl_resource* res;
+  struct vt_surface_t* surf;
+  struct vt_output_t* output;
+  // Sequence of the frame on 'output' the feedback was latched to
+  uint64_t frame_seq;
+  enum vt_presentation_feedback_state_t state;
+  bool zero_copy;
+  struct wl_list link;
+};
+
+/* ===================================================
+ * ========== STATIC FUNCTION DECLARATIONS ===========
+ * =================================================== */
+static void _presentation_destroy(
+  struct wl_client* client,
+  struct wl_resource* resource);
+
+static void _presentation_feedback(
+  struct wl_client* client,
+  struct wl_resource* resource,
+  struct wl_resource* surface,
+  uint32_t callback);
+
+static void _presentation_bind(
+  struct wl_client* client,
+  void* data,
+  uint32_t version,
+  uint32_t id);
+
+static void _presentation_feedback_handle_destroy(struct wl_resource* resource);
+
+static void _presentation_feedback_discard(struct vt_presentation_feedback_t* fb);
+
+static void _presentation_send_presented(struct vt_output_t* output, bool any_frame, uint64_t seq);
+
+static void _presentation_send_discarded(struct vt_output_t* output, bool any_frame, uint64_t seq);
+
+static const struct wp_presentation_interface _presentation_impl = {
+  .destroy = _presentation_destroy,
+  .feedback = _presentation_feedback,
+};
+
+struct vt_proto_presentation_t {
+  struct vt_compositor_t* comp;
+  // Every feedback object that did not get an event yet 
+  struct wl_list feedbacks;
+};
+
+static struct vt_proto_presentation_t _proto;
+
+void 
+_presentation_destroy(struct wl_client* client, struct wl_resource* resource) {
+  (void)client;
+  wl_resource_destroy(resource);
+}
+
+void 
+_presentation_feedback(
+  struct wl_client* client,
+  struct wl_resource* resource,
+  struct wl_resource* surface,
+  uint32_t callback) {
+  /* 1. Retrieve internal surface handle */
+  struct vt_surface_t* surf = surface ? wl_resource_get_user_data(surface) : NULL;
+  if(!surf) {
+    VT_PARAM_CHECK_FAIL(_proto.comp);
+    return;
+  }
+
+  /* 2. Allocate the feedback object */
+  struct vt_presentation_feedback_t* fb = calloc(1, sizeof(*fb));
+  if(!fb) {
+    VT_WL_OUT_OF_MEMORY(_proto.comp, client);
+    return;
+  }
+  fb->res = wl_resource_create(client, &wp_presentation_feedback_interface, 
+                               wl_resource_get_version(resource), callback);
+  if(!fb->res) {
+    free(fb);
+    VT_WL_OUT_OF_MEMORY(_proto.comp, client);
+    return;
+  }
+  wl_resource_set_implementation(fb->res, NULL, fb, _presentation_feedback_handle_destroy);
+
+  /* 3. The feedback belongs to the next commit of the surface */
+  fb->surf = surf;
+  fb->state = VT_PRESENTATION_FEEDBACK_PENDING;
+  wl_list_insert(_proto.feedbacks.prev, &fb->link);
+
+  VT_TRACE(_proto.comp->log, "presentation.feedback: Created feedback %p for surface %p.", fb, surf);
+}
+
+void 
+_presentation_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+  /* 1. Create global interface resource */
+  struct vt_compositor_t* comp = (struct vt_compositor_t*)data;
+  struct wl_resource* res = wl_resource_create(client, &wp_presentation_interface, version, id);
+  if(!res) {
+    VT_WL_OUT_OF_MEMORY(comp, client);
+    return;
+  }
+
+  /* 2. Set implementation and announce the clock of all timestamps */
+  wl_resource_set_implementation(res, &_presentation_impl, comp, NULL);
+  wp_presentation_send_clock_id(res, CLOCK_MONOTONIC);
+
+  VT_TRACE(comp->log, "presentation.bind: client bound with version %i.", version);
+}
+
+void 
+_presentation_feedback_handle_destroy(struct wl_resource* resource) {
+  struct vt_presentation_feedback_t* fb = wl_resource_get_user_data(resource);
+  if(!fb) return;
+  wl_list_remove(&fb->link);
+  free(fb);
+}
+
+void 
+_presentation_feedback_discard(struct vt_presentation_feedback_t* fb) {
+  wp_presentation_feedback_send_discarded(fb->res);
+  wl_resource_destroy(fb->res);
+}
+
+void 
+_presentation_send_presented(struct vt_output_t* output, bool any_frame, uint64_t seq) {
+  if(!_proto.comp || !output) return;
+
+  const uint64_t t = output->last_vblank_ns ? output->last_vblank_ns : vt_util_get_time_nsec();
+  const uint64_t sec = t / 1000000000ull;
+  const uint32_t nsec = t % 1000000000ull;
+  // A variable refresh or tearing flips have no fixed interval to predict
+  const uint32_t refresh = (output->vrr_enabled || output->tearing) ? 0 : (uint32_t)output->refresh_ns;
+
+  struct vt_presentation_feedback_t* fb, *tmp;
+  wl_list_for_each_safe(fb, tmp, &_proto.feedbacks, link) {
+    if(fb->state != VT_PRESENTATION_FEEDBACK_LATCHED || fb->output != output) continue;
+    if(!any_frame && fb->frame_seq != seq) continue;
+    uint32_t flags = output->presentation_flags;
+    if(fb->zero_copy) flags |= WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY;
+    wp_presentation_feedback_send_presented(
+      fb->res, sec >> 32, sec & 0xffffffff, nsec, refresh,
+      output->msc >> 32, output->msc & 0xffffffff, flags);
+    wl_resource_destroy(fb->res);
+  }
+}
+
+void 
+_presentation_send_discarded(struct vt_output_t* output, bool any_frame, uint64_t seq) {
+  if(!_proto.comp || !output) return;
+  struct vt_presentation_feedback_t* fb, *tmp;
+  wl_list_for_each_safe(fb, tmp, &_proto.feedbacks, link) {
+    if(fb->state != VT_PRESENTATION_FEEDBACK_LATCHED || fb->output != output) continue;
+    if(!any_frame && fb->frame_seq != seq) continue;
+    _presentation_feedback_discard(fb);
+  }
+}
+
+/* ===================================================
+ * =================== PUBLIC API ====================
+ * =================================================== */
+bool 
+vt_proto_presentation_init(struct vt_compositor_t* comp, uint32_t version) {
+  /* 1. Register global for wp_presentation interface */
+  if(!wl_global_create(comp->wl.dsp, &wp_presentation_interface, version, comp, _presentation_bind)) {
+    VT_ERROR(comp->log, "Cannot implement wp_presentation interface.");
+    return false;
+  }
+
+  _proto.comp = comp;
+  wl_list_init(&_proto.feedbacks);
+
+  VT_TRACE(comp->log, "Initialized presentation time protocol.");
+  return true;
+}
+
+void 
+vt_proto_presentation_surface_commit(struct vt_surface_t* surf) {
+  if(!_proto.comp || !surf) return;
+  struct vt_presentation_feedback_t* fb, *tmp;
+  wl_list_for_each_safe(fb, tmp, &_proto.feedbacks, link) {
+    if(fb->surf != surf) continue;
+    if(fb->state == VT_PRESENTATION_FEEDBACK_COMMITTED) {
+      // Replaced before it made it into any frame
+      _presentation_feedback_discard(fb);
+    } else if(fb->state == VT_PRESENTATION_FEEDBACK_PENDING) {
+      fb->state = VT_PRESENTATION_FEEDBACK_COMMITTED;
+    }
+  }
+}
+
+void 
+vt_proto_presentation_surface_destroy(struct vt_surface_t* surf) {
+  if(!_proto.comp || !surf) return;
+  struct vt_presentation_feedback_t* fb, *tmp;
+  wl_list_for_each_safe(fb, tmp, &_proto.feedbacks, link) {
+    if(fb->surf == surf) _presentation_feedback_discard(fb);
+  }
+}
+
+uint64_t 
+vt_proto_presentation_latch(struct vt_output_t* output) {
+  if(!_proto.comp || !output) return 0;
+  const uint64_t seq = ++output->presentation_seq;
+  struct vt_presentation_feedback_t* fb;
+  wl_list_for_each(fb, &_proto.feedbacks, link) {
+    if(fb->state != VT_PRESENTATION_FEEDBACK_COMMITTED) continue;
+    if(!vt_util_output_mask_has(&fb->surf->_mask_outputs_visible_on, output->id)) continue;
+    fb->state = VT_PRESENTATION_FEEDBACK_LATCHED;
+    fb->output = output;
+    fb->frame_seq = seq;
+    // The client buffer itself goes on screen, nothing was copied
+    fb->zero_copy = output->direct_scanout || vt_util_output_mask_has(&fb->surf->_mask_outputs_on_plane, output->id);
+  }
+  return seq;
+}
+
+void 
+vt_proto_presentation_presented(struct vt_output_t* output) {
+  _presentation_send_presented(output, true, 0);
+}
+
+void 
+vt_proto_presentation_presented_frame(struct vt_output_t* output, uint64_t seq) {
+  _presentation_send_presented(output, false, seq);
+}
+
+void 
+vt_proto_presentation_discarded(struct vt_output_t* output) {
+  _presentation_send_discarded(output, true, 0);
+}
+
+void 
+vt_proto_presentation_discarded_frame(struct vt_output_t* output, uint64_t seq) {
+  _presentation_send_discarded(output, false, seq);
+}
+
+void 
+vt_proto_presentation_output_destroy(struct vt_output_t* output) {
+  // Nothing that is latched to the output can be presented anymore
+  vt_proto_presentation_discarded(output);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../core/core_types.h"
+
+bool vt_proto_presentation_init(
+    struct vt_compositor_t* comp, 
+    uint32_t version);
+
+/* Feedback requested since the last commit belongs to the committed 
+ * content, feedback of older, never shown content is discarded. */
+void vt_proto_presentation_surface_commit(struct vt_surface_t* surf);
+
+void vt_proto_presentation_surface_destroy(struct vt_surface_t* surf);
+
+/* Ties the committed feedback of every surface on the output to 
+ * the frame that is about to be submitted and returns the sequence 
+ * of that frame (also kept in output->presentation_seq). */
+uint64_t vt_proto_presentation_latch(struct vt_output_t* output);
+
+/* Sends the presentation time of the frame that just became visible on 
+ * the output, using the output's vblank timestamp, refresh and MSC. 
+ * Resolves all feedback latched to the output. */
+void vt_proto_presentation_presented(struct vt_output_t* output);
+
+/* Same as above, but only for the feedback latched to frame 'seq' */
+void vt_proto_presentation_presented_frame(struct vt_output_t* output, uint64_t seq);
+
+/* The frame submitted on the output never became visible */
+void vt_proto_presentation_discarded(struct vt_output_t* output);
+
+void vt_proto_presentation_discarded_frame(struct vt_output_t* output, uint64_t seq);
+
+void vt_proto_presentation_output_destroy(struct vt_output_t* output);
@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+
+#include "tearing_control.h"
+#include "src/core/core_types.h"
+#include "src/core/surface.h"
+#include "src/core/util.h"
+
+#include <inttypes.h>
+#include <tearing-control-v1-server-protocol.h>
+#include <wayland-server-core.h>
+
+#define _SUBSYS_NAME "VT_PROTO_TEARING_CONTROL"
+
+/* ===================================================
+ * ========== STATIC FUNCTION DECLARATIONS ===========
+ * =================================================== */
+static void _tearing_control_manager_v1_destroy(
+  struct wl_client* client,
+  struct wl_resource* resource);
+
+static void _tearing_control_manager_v1_get_tearing_control(
+  struct wl_client* client,
+  struct wl_resource* resource,
+  uint32_t id,
+  struct wl_resource* surface_resource);
+
+static void _tearing_control_manager_v1_bind(
+  struct wl_client* client,
+  void* data,
+  uint32_t version,
+  uint32_t id);
+
+static void _tearing_control_v1_set_presentation_hint(
+  struct wl_client* client,
+  struct wl_resource* resource,
+  uint32_t hint);
+
+static void _tearing_control_v1_destroy(
+  struct wl_client* client,
+  struct wl_resource* resource);
+
+static void _tearing_control_handle_destroy(struct wl_resource* resource);
+
+static const struct wp_tearing_control_manager_v1_interface _tearing_control_manager_v1_impl = {
+  .destroy = _tearing_control_manager_v1_destroy,
+  .get_tearing_control = _tearing_control_manager_v1_get_tearing_control,
+};
+
+static const struct wp_tearing_control_v1_interface _tearing_control_v1_impl = {
+  .set_presentation_hint = _tearing_control_v1_set_presentation_hint,
+  .destroy = _tearing_control_v1_destroy,
+};
+
+struct vt_proto_tearing_control_v1_t {
+  struct vt_compositor_t* comp;
+};
+
+static struct vt_proto_tearing_control_v1_t _proto;
+
+void 
+_tearing_control_manager_v1_destroy(struct wl_client* client, struct wl_resource* resource) {
+  (void)client;
+  wl_resource_destroy(resource);
+}
+
+void 
+_tearing_control_manager_v1_get_tearing_control(
+  struct wl_client* client,
+  struct wl_resource* resource,
+  uint32_t id,
+  struct wl_resource* surface_resource) {
+  /* 1. Retrieve internal surface handle */
+  struct vt_surface_t* surf = surface_resource ? wl_resource_get_user_data(surface_resource) : NULL;
+  if (!surf) {
+    VT_PARAM_CHECK_FAIL(_proto.comp);
+    return;
+  }
+
+  /* 2. Check if surface already has a tearing control object */
+  if (surf->tearing.res) {
+    wl_resource_post_error(
+      resource,
+      WP_TEARING_CONTROL_MANAGER_V1_ERROR_TEARING_CONTROL_EXISTS,
+      "wl_surface@%" PRIu32 " already has a tearing control object",
+      wl_resource_get_id(surface_resource));
+    return;
+  }
+
+  /* 3. Allocate resource for the tearing control interface */
+  struct wl_resource* res = wl_resource_create(
+    client,
+    &wp_tearing_control_v1_interface,
+    wl_resource_get_version(resource),
+    id);
+
+  if (!res) {
+    VT_WL_OUT_OF_MEMORY(surf->comp, client);
+    return;
+  }
+
+  /* 4. Surfaces are synchronized to vblank until they ask otherwise */
+  surf->tearing.res = res;
+  surf->tearing.pending_async = false;
+
+  wl_resource_set_implementation(
+    res, &_tearing_control_v1_impl,
+    surf, _tearing_control_handle_destroy);
+
+  VT_TRACE(surf->comp->log, "tearing_control.get_tearing_control: created tearing control for surface %p.", surf);
+}
+
+void 
+_tearing_control_manager_v1_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id) {
+  /* 1. Create global interface resource */
+  struct vt_compositor_t* comp = (struct vt_compositor_t*)data;
+  struct wl_resource* res = wl_resource_create(
+    client,
+    &wp_tearing_control_manager_v1_interface,
+    version,
+    id);
+
+  if (!res) {
+    VT_WL_OUT_OF_MEMORY(comp, client);
+    return;
+  }
+
+  /* 2. Set implementation and data */
+  wl_resource_set_implementation(res, &_tearing_control_manager_v1_impl, comp, NULL);
+
+  VT_TRACE(comp->log, "tearing_control.bind: client bound with version %i.", version);
+}
+
+void 
+_tearing_control_v1_set_presentation_hint(
+  struct wl_client* client,
+  struct wl_resource* resource,
+  uint32_t hint) {
+  (void)client;
+  /* The surface is gone, the object is inert */
+  struct vt_surface_t* surf = wl_resource_get_user_data(resource);
+  if (!surf) return;
+
+  /* Double buffered, applied with the next surface commit */
+  surf->tearing.pending_async = (hint == WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC);
+
+  VT_TRACE(surf->comp->log, "tearing_control.set_presentation_hint: surface %p requested %s presentation.", 
+           surf, surf->tearing.pending_async ? "async" : "vsync");
+}
+
+void 
+_tearing_control_v1_destroy(struct wl_client* client, struct wl_resource* resource) {
+  (void)client;
+  wl_resource_destroy(resource);
+}
+
+void 
+_tearing_control_handle_destroy(struct wl_resource* resource) {
+  struct vt_surface_t* surf = wl_resource_get_user_data(resource);
+  if (!surf) return;
+
+  /* Without the object, the surface goes back to vsync with the next commit */
+  surf->tearing.res = NULL;
+  surf->tearing.pending_async = false;
+}
+
+/* ===================================================
+ * =================== PUBLIC API ====================
+ * =================================================== */
+bool 
+vt_proto_tearing_control_v1_init(struct vt_compositor_t* comp, uint32_t version) {
+  /* 1. Register global for wp_tearing_control_manager_v1 interface */
+  if(!wl_global_create(comp->wl.dsp, &wp_tearing_control_manager_v1_interface, version, comp, _tearing_control_manager_v1_bind)) {
+    VT_ERROR(comp->log, "Cannot implement wp_tearing_control_manager_v1 interface.");
+    return false;
+  }
+
+  _proto.comp = comp;
+
+  VT_TRACE(comp->log, "Initialized tearing control protocol.");
+  return true;
+}
+
+void 
+vt_proto_tearing_control_v1_surface_commit(struct vt_surface_t* surf) {
+  if(!surf) return;
+  surf->tearing.async = surf->tearing.pending_async;
+}
+
+void 
+vt_proto_tearing_control_v1_surface_destroy(struct vt_surface_t* surf) {
+  if(!surf || !surf->tearing.res) return;
+  /* Keep the client's object alive but detach it from the surface */
+  wl_resource_set_user_data(surf->tearing.res, NULL);
+  surf->tearing.res = NULL;
+}
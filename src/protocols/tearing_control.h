@@ -0,0 +1,12 @@
+#pragma once
+
+#include "../core/core_types.h"
+
+bool vt_proto_tearing_control_v1_init(
+    struct vt_compositor_t* comp, 
+    uint32_t version);
+
+/* Applies the presentation hint that was set since the last commit */
+void vt_proto_tearing_control_v1_surface_commit(struct vt_surface_t* surf);
+
+void vt_proto_tearing_control_v1_surface_destroy(struct vt_surface_t* surf);
@@ -1,7 +1,10 @@
 #include "wl_surface.h"
 #include "src/core/compositor.h"
+#include "src/core/output_layout.h"
 #include "src/core/util.h"
 #include "src/input/wl_seat.h"
+#include "src/protocols/presentation_time.h"
+#include "src/protocols/tearing_control.h"
 #include "src/render/renderer.h"
 #include <stdbool.h>
 #include <wayland-server-core.h>
@@ -73,11 +76,6 @@ static void _wl_surface_destroy(
 
 static void _wl_surface_handle_resource_destroy(struct wl_resource* resource);
 
-static void _wl_surface_associate_with_output(
-  struct vt_compositor_t* c, 
-  struct vt_surface_t* surf
-  , struct vt_output_t* output);
-
 
 static const struct wl_surface_interface surface_impl = {
   .attach = _wl_surface_attach,
@@ -142,6 +140,10 @@ _wl_surface_commit(
 
   if (!surf) { VT_ERROR(surf->comp->log, "surface_commit: NULL user_data"); return; }
 
+  /* Feedback requested before this commit now refers to its contents */
+  vt_proto_presentation_surface_commit(surf);
+  vt_proto_tearing_control_v1_surface_commit(surf);
+
   /* If there is no buffer attached, this commit has no contents */
   surf->has_buffer = (surf->buf_res != NULL);
   if (!surf->has_buffer) {
@@ -154,11 +156,12 @@ _wl_surface_commit(
 
   /* 1. If the size of the surface changed, we need to 
    * recalculate the outputs that the surface is visible on */
+  struct vt_output_mask_t prev_outputs = surf->_mask_outputs_visible_on;
   if(surf->width != surf->tex.width || surf->height != surf->tex.height) {
-    surf->_mask_outputs_visible_on = 0;
+    vt_util_output_mask_reset(&surf->_mask_outputs_visible_on);
   }
 
-  if(surf->_mask_outputs_visible_on){
+  if(!vt_util_output_mask_empty(&surf->_mask_outputs_visible_on)){
     /*  Commit the accumulated pending damage to the current damage. */
     if (!surf->current_damage.data) pixman_region32_init(&surf->current_damage);
 
@@ -182,8 +185,25 @@ _wl_surface_commit(
   struct vt_renderer_t* r = surf->comp->renderer;
   if(r && r->impl.import_buffer) {
     r->impl.import_buffer(r, surf, surf->buf_res);
-    // Tell the client we're finsied uploading its buffer
-    wl_buffer_send_release(surf->buf_res);
+    // Keep a copy of cursor images for hardware cursor planes
+    if(surf->type == VT_SURFACE_TYPE_CURSOR) {
+      vt_surface_copy_cursor_image(surf);
+    }
+    // SHM contents got copied so the client can have its buffer back right away. 
+    // DMABUFs are read from directly (and may be scanned out by the backend), 
+    // so they are held until the surface commits another buffer.
+    struct vt_linux_dmabuf_v1_buffer_t* dmabuf = vt_proto_linux_dmabuf_v1_from_buffer_res(surf->buf_res);
+    struct wl_shm_buffer* shm = wl_shm_buffer_get(surf->buf_res);
+    surf->opaque_buffer = dmabuf ? !vt_util_drm_format_has_alpha(dmabuf->attr.format) : 
+      shm && wl_shm_buffer_get_format(shm) == WL_SHM_FORMAT_XRGB8888;
+    if(dmabuf) {
+      vt_proto_linux_dmabuf_v1_buffer_lock(dmabuf);
+    } else {
+      // Tell the client we're finsied uploading its buffer
+      wl_buffer_send_release(surf->buf_res);
+    }
+    vt_proto_linux_dmabuf_v1_buffer_unlock(surf->locked_dmabuf);
+    surf->locked_dmabuf = dmabuf;
   }
 
   bool is_valid_xdg_surf =  surf->xdg_surf &&
@@ -203,12 +223,15 @@ _wl_surface_commit(
     printf("assigned geom: %i, %i\n", surf->geom_width, surf->geom_height);
   }
   /* 4. Calculate current damage region  */
-  if(!surf->_mask_outputs_visible_on) {
-    /* Re-populate the output bitfield of the surface */
-    struct vt_output_t* output;
-    wl_list_for_each(output, &surf->comp->outputs, link_global) {
-      _wl_surface_associate_with_output(surf->comp, surf, output);
-      output->needs_damage_rebuild = true;
+  if(vt_util_output_mask_empty(&surf->_mask_outputs_visible_on)) {
+    /* Re-populate the output bitfield of the surface from the layout, 
+     * outputs it covered before and covers now need new damage. */
+    struct vt_output_layout_t* layout = surf->comp->output_layout;
+    pixman_box32_t box = { surf->x, surf->y, surf->x + surf->width, surf->y + surf->height };
+    vt_output_layout_outputs_in_rect(layout, &box, &surf->_mask_outputs_visible_on);
+    vt_util_output_mask_union(&prev_outputs, &surf->_mask_outputs_visible_on);
+    vt_output_mask_for_each(id, &prev_outputs) {
+      if(layout->outputs[id]) layout->outputs[id]->needs_damage_rebuild = true;
     }
     /* Mark entire surface as needing redraw (damage entire surface)*/
     pixman_region32_clear(&surf->current_damage);
@@ -224,6 +247,7 @@ _wl_surface_commit(
         ptr->cursor.hotspot_y -= surf->dy;
       }
     }
+    vt_comp_update_cursor(surf->comp);
   }
 
   /* 5. If the surface has not yet been mapped and has a 
@@ -235,11 +259,13 @@ _wl_surface_commit(
 
   /* 6. Set damage regions and schedule a repaint for 
    * all outputs that the surface intersects with */
-  struct vt_output_t* output;
-  wl_list_for_each(output, &surf->comp->outputs, link_global) {
-    if(!(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
-
+  if(!vt_util_output_mask_empty(&surf->_mask_outputs_visible_on)) {
     pixman_region32_translate(&surf->current_damage, surf->x, surf->y);
+  }
+  vt_output_mask_for_each(id, &surf->_mask_outputs_visible_on) {
+    struct vt_output_t* output = surf->comp->output_layout->outputs[id];
+    if(!output) continue;
+
     pixman_region32_union(
       &output->damage, &output->damage,
       &surf->current_damage);
@@ -309,7 +335,7 @@ _wl_surface_damage(
    * rebuild. */
   struct vt_output_t* output;
   wl_list_for_each(output, &surf->comp->outputs, link_global) {
-    if (!(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
+    if (!vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
     output->needs_damage_rebuild = true;
   }
 
@@ -340,7 +366,7 @@ _wl_surface_damage_buffer(
    * rebuild. */
   struct vt_output_t* output;
   wl_list_for_each(output, &surf->comp->outputs, link_global) {
-    if (!(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
+    if (!vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
 
     output->needs_damage_rebuild = true;
   }
@@ -468,7 +494,7 @@ _wl_surface_offset(struct wl_client* client,
 
   exit(1);
   // Force re-evaluation on next commit
-  surf->_mask_outputs_visible_on = 0; 
+  vt_util_output_mask_reset(&surf->_mask_outputs_visible_on); 
 
   VT_TRACE(surf->comp->log, "surface_offset: moved surface %p to %d,%d", surf, x, y);
 }
@@ -504,6 +530,7 @@ _wl_surface_handle_resource_destroy(struct wl_resource* resource) {
   pixman_region32_fini(&surf->current_damage);
   pixman_region32_fini(&surf->input_region);
   pixman_region32_fini(&surf->opaque_region);
+  pixman_region32_fini(&surf->tex_back_damage);
 
   /* Destroy the attached render texture */
   struct vt_output_t* output;
@@ -514,9 +541,27 @@ _wl_surface_handle_resource_destroy(struct wl_resource* resource) {
 
   /* destroy dmabuf resources of the surface */
   vt_proto_linux_dmabuf_v1_surface_destroy(surf);
+  vt_proto_linux_dmabuf_v1_buffer_unlock(surf->locked_dmabuf);
+
+  /* The surface will never be presented again */
+  vt_proto_presentation_surface_destroy(surf);
+  vt_proto_tearing_control_v1_surface_destroy(surf);
+  surf->locked_dmabuf = NULL;
+
+  free(surf->cursor_image.pixels);
+  surf->cursor_image.pixels = NULL;
+
+  /* Drop the surface from pointers that use it as their cursor */
+  if(surf->type == VT_SURFACE_TYPE_CURSOR) {
+    struct vt_pointer_t* ptr;
+    wl_list_for_each(ptr, &surf->comp->seat->pointers, link) {
+      if(ptr->cursor.surf == surf) ptr->cursor.surf = NULL;
+    }
+    vt_comp_update_cursor(surf->comp);
+  }
 
   wl_list_for_each(output, &surf->comp->outputs, link_global) {
-    if(!(surf->_mask_outputs_visible_on & (1u << output->id))) continue;
+    if(!vt_util_output_mask_has(&surf->_mask_outputs_visible_on, output->id)) continue;
     // Damage the part of the screen where the surface was located 
     // and schedule a repaint
     pixman_region32_union_rect(
@@ -533,16 +578,6 @@ _wl_surface_handle_resource_destroy(struct wl_resource* resource) {
   surf = NULL;
 }
 
-void 
-_wl_surface_associate_with_output(
-  struct vt_compositor_t* c, struct vt_surface_t* surf, struct vt_output_t* output) {
-  if (surf->x + surf->width  <= output->x ||
-    surf->x >= output->x + output->width ||
-    surf->y + surf->height <= output->y ||
-    surf->y >= output->y + output->height) return;
-  surf->_mask_outputs_visible_on |= (1u << output->id);
-}
-
 
 
 bool
@@ -1,6 +1,9 @@
 #include <EGL/eglplatform.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include <wayland-util.h>
 
 #include "linux-explicit-synchronization-v1-server-protocol.h"
@@ -37,6 +40,31 @@
 
 #define _VT_GBM_FORMAT_XRGB8888	__vt_gbm_fourcc_code('X', 'R', '2', '4') /* [31:0] x:R:G:B 8:8:8:8 little endian */
 
+#ifndef EGL_BUFFER_AGE_EXT
+#define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
+// Frames of damage kept per output, back buffers older than that get a full blit
+#define _EGL_DAMAGE_RING_SIZE 4
+// Up to this many damage boxes the scene is replayed once per box under a 
+// scissor, beyond that marking the damage in the stencil buffer is cheaper
+#define _EGL_SCISSOR_MAX_BOXES 8
+
+// Staging memory of SHM uploads. Segments are only written again once the 
+// uploads sourced from them completed, uploads larger than a segment are 
+// done from client memory.
+#define _EGL_UPLOAD_RING_SIZE (64u << 20)
+#define _EGL_UPLOAD_RING_SEGMENTS 4
+#define _EGL_UPLOAD_SEGMENT_SIZE (_EGL_UPLOAD_RING_SIZE / _EGL_UPLOAD_RING_SEGMENTS)
+// SHM damage is uploaded per rectangle, regions with more rectangles than 
+// this go up as their extents.
+#define _EGL_UPLOAD_MAX_BOXES 16
+// Two upload rectangles get merged when that adds no more undamaged pixels 
+// than this plus a quarter of their area, cheaper than another upload call.
+#define _EGL_UPLOAD_MERGE_SLACK 4096
+// SHM commits between two summaries of the upload stats in the log
+#define _EGL_UPLOAD_STATS_INTERVAL 600
+
 
 // Damage swapping
 static PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC eglSwapBuffersWithDamageEXT_ptr   = NULL;
@@ -55,6 +83,24 @@ static PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR_ptr                       = NU
 static PFNEGLWAITSYNCKHRPROC eglWaitSyncKHR_ptr                             = NULL;
 static PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID_ptr       = NULL;
 
+// Persistently mapped pixel unpack buffer the SHM commits copy into
+struct egl_upload_ring_t {
+  GLuint pbo;
+  uint8_t* map;
+  size_t head;
+  uint32_t segment;
+  GLsync fences[_EGL_UPLOAD_RING_SEGMENTS];
+  bool failed;
+};
+
+// Totals of all SHM uploads (commits and rectangles). Uploaded exceeds 
+// damaged by what merging upload rectangles pulled in, buffer is what 
+// uploading the whole buffers would have cost.
+struct egl_upload_stats_t {
+  uint64_t uploads, boxes;
+  uint64_t bytes_uploaded, bytes_damaged, bytes_buffer;
+};
+
 struct egl_backend_state_t {
   EGLDisplay egl_dsp;
   EGLContext egl_ctx;
@@ -62,25 +108,68 @@ struct egl_backend_state_t {
   EGLint egl_native_vis;
 
   bool has_dmabuf_modifiers_support, has_dmabuf_support, has_explicit_sync_support;
+  bool has_buffer_age;
+  // Outputs are composited straight into their EGL back buffers instead of an 
+  // intermediate FBO, needs buffer age and a stencil buffer in the config.
+  bool render_direct;
 
   RnState* render;
+  // Output between begin_frame and end_frame, draw_rect gets none passed
+  struct vt_output_t* output;
+
+  struct egl_upload_ring_t upload_ring;
+  struct egl_upload_stats_t upload_stats;
 
   struct wl_array formats;
   bool need_fence;
 }; 
 
+// A draw recorded while the scene is clipped with scissors, tex.id is 0 for rects
+struct egl_draw_op_t {
+  RnTexture tex;
+  float x, y, w, h;
+  uint32_t col;
+};
+
 struct egl_output_state_t {
   GLint fbo_id, fbo_tex_id, rbo_tex_depth; 
   EGLSyncKHR end_sync;
+
+  // Damage of the most recent frames, damage_ring_head is the slot of the 
+  // oldest one. Tells what a back buffer of a given age misses from the FBO.
+  pixman_region32_t damage_ring[_EGL_DAMAGE_RING_SIZE];
+  uint32_t damage_ring_head;
+  // EGL_EXT_buffer_age of the back buffer the current frame renders into
+  EGLint back_age;
+
+  // Damage is clipped with one scissor per box instead of the stencil buffer, 
+  // the scene's draws are recorded into ops and replayed at end_scene.
+  bool scissor;
+  // Set during the damage pass in scissor mode, which has nothing to mark
+  bool discard;
+  struct wl_array ops;
 };
 
 static const char*  _egl_err_str(EGLint error);
 static bool         _egl_gl_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t *surf, struct wl_shm_buffer *shm_buf);
+static bool         _egl_upload_ring_init(struct vt_renderer_t* r, struct egl_upload_ring_t* ring);
+static void         _egl_upload_ring_destroy(struct egl_upload_ring_t* ring);
+static uint8_t*     _egl_upload_ring_alloc(struct egl_upload_ring_t* ring, size_t size, GLintptr* offset);
+static void         _egl_shm_texture_alloc(RnTexture* tex, int width, int height);
+static int32_t      _egl_plan_shm_upload(pixman_region32_t* region, pixman_box32_t* boxes);
+static void         _egl_log_upload_stats(struct vt_renderer_t* r, struct egl_backend_state_t* egl);
+static void         _egl_upload_shm_box(struct egl_upload_ring_t* ring, const uint8_t* data, int stride, pixman_box32_t box, GLenum format, GLenum type);
 static bool         _egl_pick_config_from_format(struct vt_compositor_t* c, struct egl_backend_state_t* egl, uint32_t format);
 static bool         _egl_pick_config(struct vt_compositor_t *comp, struct egl_backend_state_t *egl, struct vt_backend_t *backend);
 static bool         _egl_surface_is_ready(struct vt_renderer_t* renderer, struct vt_surface_t* surf); 
 static bool         _egl_send_surface_release_fences(struct vt_renderer_t* renderer, struct vt_output_t* output); 
 static bool         _egl_gl_create_output_fbo(struct vt_output_t *output); 
+static void         _egl_output_state_destroy(struct vt_output_t* output); 
+static void         _egl_damage_ring_collect(struct vt_output_t* output, EGLint age, pixman_region32_t* frame_damage, pixman_region32_t* out); 
+static void         _egl_swap_buffers(struct egl_backend_state_t* egl, struct vt_output_t* output, pixman_region32_t* damage); 
+static void         _egl_blit_output_fbo(struct egl_backend_state_t* egl, struct vt_output_t* output, pixman_region32_t* frame_damage); 
+static void         _egl_record_op(struct egl_output_state_t* egl_output, RnTexture tex, float x, float y, float w, float h, uint32_t col); 
+static void         _egl_replay_scissored(struct egl_backend_state_t* egl, struct vt_output_t* output); 
 static bool         _egl_create_renderer(
   struct vt_renderer_t* renderer, enum vt_backend_platform_t platform, void* native_handle, 
   bool log_error); 
@@ -110,6 +199,7 @@ _egl_err_str(EGLint error) {
 bool
 _egl_gl_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t *surf,
                           struct wl_shm_buffer *shm_buf) {
+  struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
   int width = wl_shm_buffer_get_width(shm_buf);
   int height = wl_shm_buffer_get_height(shm_buf);
   int stride = wl_shm_buffer_get_stride(shm_buf);
@@ -117,7 +207,6 @@ _egl_gl_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t *surf,
 
   GLenum format = GL_BGRA;
   GLenum type   = GL_UNSIGNED_INT_8_8_8_8_REV;
-  GLenum internal_format = GL_RGBA8;
 
   switch (fmt) {
     case WL_SHM_FORMAT_ARGB8888:
@@ -128,48 +217,237 @@ _egl_gl_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t *surf,
       return false;
   }
 
-  wl_shm_buffer_begin_access(shm_buf);
-  void *data = wl_shm_buffer_get_data(shm_buf);
+  if(!egl->upload_ring.pbo && !egl->upload_ring.failed) {
+    _egl_upload_ring_init(r, &egl->upload_ring);
+  }
+  // The texture still samples the DMABUF the surface had attached before
+  if(surf->render_tex_handle && surf->render_tex_handle != EGL_NO_IMAGE_KHR) {
+    eglDestroyImageKHR_ptr(egl->egl_dsp, (EGLImageKHR)surf->render_tex_handle);
+    surf->render_tex_handle = EGL_NO_IMAGE_KHR;
+    if(surf->tex.id) glDeleteTextures(1, &surf->tex.id);
+    surf->tex = (RnTexture){0};
+  }
 
-  bool need_regen = surf->tex.width != width || surf->tex.height != height || !surf->tex.id;
+  bool need_regen = surf->tex.width != width || surf->tex.height != height || 
+    !surf->tex.id || !surf->tex_back.id;
   if (need_regen) {
-    if (!surf->tex.id)
-      glGenTextures(1, &surf->tex.id);
+    _egl_shm_texture_alloc(&surf->tex, width, height);
+    _egl_shm_texture_alloc(&surf->tex_back, width, height);
+    pixman_region32_fini(&surf->tex_back_damage);
+    pixman_region32_init_rect(&surf->tex_back_damage, 0, 0, width, height);
+  }
 
-    glBindTexture(GL_TEXTURE_2D, surf->tex.id);
+  // Uploads go into the back texture, which misses the damage of the 
+  // previous upload on top of this commit's.
+  pixman_region32_t upload;
+  pixman_region32_init(&upload);
+  pixman_region32_union(&upload, &surf->current_damage, &surf->tex_back_damage);
+  pixman_region32_intersect_rect(&upload, &upload, 0, 0, width, height);
 
-    if (fmt == WL_SHM_FORMAT_XRGB8888)
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ONE);
+  glBindTexture(GL_TEXTURE_2D, surf->tex_back.id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, 
+                  fmt == WL_SHM_FORMAT_XRGB8888 ? GL_ONE : GL_ALPHA);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format,
-                 width, height, 0, format, type, data);
+  wl_shm_buffer_begin_access(shm_buf);
+  const uint8_t *data = wl_shm_buffer_get_data(shm_buf);
+
+  pixman_box32_t boxes[_EGL_UPLOAD_MAX_BOXES];
+  int32_t n_boxes = _egl_plan_shm_upload(&upload, boxes);
+  uint64_t bytes_uploaded = 0;
+  for(int32_t i = 0; i < n_boxes; i++) {
+    _egl_upload_shm_box(egl->upload_ring.pbo ? &egl->upload_ring : NULL, data, stride, 
+                        boxes[i], format, type);
+    bytes_uploaded += (uint64_t)(boxes[i].x2 - boxes[i].x1) * (boxes[i].y2 - boxes[i].y1) * 4;
+  }
+  if(n_boxes) {
+    int32_t n_damaged;
+    pixman_box32_t* damaged = pixman_region32_rectangles(&upload, &n_damaged);
+    for(int32_t i = 0; i < n_damaged; i++) {
+      egl->upload_stats.bytes_damaged += 
+        (uint64_t)(damaged[i].x2 - damaged[i].x1) * (damaged[i].y2 - damaged[i].y1) * 4;
+    }
+    const uint64_t bytes_buffer = (uint64_t)width * height * 4;
+    egl->upload_stats.uploads++;
+    egl->upload_stats.boxes += n_boxes;
+    egl->upload_stats.bytes_uploaded += bytes_uploaded;
+    egl->upload_stats.bytes_buffer += bytes_buffer;
+    VT_TRACE(r->comp->log, "Uploaded %i SHM rects of surface %p (%" PRIu64 " of %" PRIu64 " bytes of the buffer).", 
+             n_boxes, surf, bytes_uploaded, bytes_buffer);
+    if(egl->upload_stats.uploads % _EGL_UPLOAD_STATS_INTERVAL == 0) {
+      _egl_log_upload_stats(r, egl);
+    }
+  }
+
+  wl_shm_buffer_end_access(shm_buf);
 
-    surf->tex.width = width;
-    surf->tex.height = height;
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Present the freshly uploaded texture, the one that was presented so far 
+  // only misses the damage of this commit.
+  RnTexture front = surf->tex;
+  surf->tex = surf->tex_back;
+  surf->tex_back = front;
+  pixman_region32_intersect_rect(&surf->tex_back_damage, &surf->current_damage, 0, 0, width, height);
+  pixman_region32_fini(&upload);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return true;
+}
+
+bool
+_egl_upload_ring_init(struct vt_renderer_t* r, struct egl_upload_ring_t* ring) {
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+  glGenBuffers(1, &ring->pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+  glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _EGL_UPLOAD_RING_SIZE, NULL, flags);
+  ring->map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _EGL_UPLOAD_RING_SIZE, flags);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if(!ring->map) {
+    VT_WARN(r->comp->log, "Cannot map SHM upload ring (0x%04x), uploading from client memory.", glGetError());
+    glDeleteBuffers(1, &ring->pbo);
+    ring->pbo = 0;
+    ring->failed = true;
+    return false;
   }
 
-  glBindTexture(GL_TEXTURE_2D, surf->tex.id);
+  VT_TRACE(r->comp->log, "Mapped %u bytes of SHM upload ring.", _EGL_UPLOAD_RING_SIZE);
+  return true;
+}
 
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 4);
+void
+_egl_upload_ring_destroy(struct egl_upload_ring_t* ring) {
+  for(uint32_t i = 0; i < _EGL_UPLOAD_RING_SEGMENTS; i++) {
+    if(ring->fences[i]) glDeleteSync(ring->fences[i]);
+    ring->fences[i] = NULL;
+  }
+  if(ring->pbo) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &ring->pbo);
+  }
+  ring->pbo = 0;
+  ring->map = NULL;
+}
 
-  if(!need_regen) {
-    pixman_box32_t ext = *pixman_region32_extents(&surf->current_damage);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, ext.x1, ext.y1, ext.x2 - ext.x1, ext.y2 - ext.y1, format, type, data + ext.y1 * stride + ext.x1 * 4);
+uint8_t*
+_egl_upload_ring_alloc(struct egl_upload_ring_t* ring, size_t size, GLintptr* offset) {
+  if(!ring || !size || size > _EGL_UPLOAD_SEGMENT_SIZE) return NULL;
+
+  // Texel aligned, unpack offsets must be a multiple of the pixel size
+  size_t head = (ring->head + 15) & ~(size_t)15;
+  if(head + size > _EGL_UPLOAD_RING_SIZE) head = 0;
+
+  uint32_t first = head / _EGL_UPLOAD_SEGMENT_SIZE;
+  uint32_t last  = (head + size - 1) / _EGL_UPLOAD_SEGMENT_SIZE;
+  for(uint32_t s = first; s <= last; s++) {
+    if(s == ring->segment) continue;
+    // Fence the uploads of the segment we leave, and wait 
+    // for the GPU to be done with the one we enter.
+    ring->fences[ring->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring->segment = s;
+    if(ring->fences[s]) {
+      glClientWaitSync(ring->fences[s], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      glDeleteSync(ring->fences[s]);
+      ring->fences[s] = NULL;
+    }
   }
 
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  *offset = (GLintptr)head;
+  ring->head = head + size;
+  return ring->map + head;
+}
 
-  wl_shm_buffer_end_access(shm_buf);
+void
+_egl_log_upload_stats(struct vt_renderer_t* r, struct egl_backend_state_t* egl) {
+  const struct egl_upload_stats_t* st = &egl->upload_stats;
+  if(!st->uploads) return;
+  VT_TRACE(r->comp->log, "SHM uploads: %" PRIu64 " commits in %" PRIu64 " rects, %" PRIu64 " bytes uploaded for %" PRIu64 
+           " damaged, %" PRIu64 " for whole buffers (%.1f%%).", 
+           st->uploads, st->boxes, st->bytes_uploaded, st->bytes_damaged, st->bytes_buffer, 
+           st->bytes_buffer ? 100.0 * (double)st->bytes_uploaded / (double)st->bytes_buffer : 0.0);
+}
 
-  glBindTexture(GL_TEXTURE_2D, 0);
+int32_t
+_egl_plan_shm_upload(pixman_region32_t* region, pixman_box32_t* boxes) {
+  int32_t n;
+  pixman_box32_t* rects = pixman_region32_rectangles(region, &n);
+  if(!n) return 0;
+  if(n > _EGL_UPLOAD_MAX_BOXES) {
+    boxes[0] = *pixman_region32_extents(region);
+    return 1;
+  }
+  memcpy(boxes, rects, sizeof(*boxes) * n);
+
+  // Greedily merge pairs while a merge is cheap enough, merged boxes 
+  // may overlap others which only uploads a few pixels twice.
+  bool merged = true;
+  while(merged && n > 1) {
+    merged = false;
+    for(int32_t i = 0; i < n && !merged; i++) {
+      for(int32_t j = i + 1; j < n; j++) {
+        pixman_box32_t a = boxes[i], b = boxes[j];
+        pixman_box32_t u = {
+          .x1 = a.x1 < b.x1 ? a.x1 : b.x1, .y1 = a.y1 < b.y1 ? a.y1 : b.y1,
+          .x2 = a.x2 > b.x2 ? a.x2 : b.x2, .y2 = a.y2 > b.y2 ? a.y2 : b.y2,
+        };
+        int64_t area = (int64_t)(a.x2 - a.x1) * (a.y2 - a.y1) + 
+          (int64_t)(b.x2 - b.x1) * (b.y2 - b.y1);
+        int64_t area_u = (int64_t)(u.x2 - u.x1) * (u.y2 - u.y1);
+        if(area_u - area > _EGL_UPLOAD_MERGE_SLACK + area / 4) continue;
+
+        boxes[i] = u;
+        boxes[j] = boxes[--n];
+        merged = true;
+        break;
+      }
+    }
+  }
+  return n;
+}
 
-  return true;
+void
+_egl_shm_texture_alloc(RnTexture* tex, int width, int height) {
+  if(!tex->id) glGenTextures(1, &tex->id);
+
+  glBindTexture(GL_TEXTURE_2D, tex->id);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, 
+               GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  tex->width = width;
+  tex->height = height;
+}
+
+void
+_egl_upload_shm_box(struct egl_upload_ring_t* ring, const uint8_t* data, int stride, pixman_box32_t box, GLenum format, GLenum type) {
+  int32_t w = box.x2 - box.x1, h = box.y2 - box.y1;
+  size_t row = (size_t)w * 4;
+  const uint8_t* src = data + (size_t)box.y1 * stride + (size_t)box.x1 * 4;
+
+  GLintptr offset;
+  uint8_t* dst = _egl_upload_ring_alloc(ring, row * h, &offset);
+  if(!dst) {
+    // Does not fit the ring, the driver copies from client memory
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, box.x1, box.y1, w, h, format, type, src);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    return;
+  }
+
+  for(int32_t y = 0; y < h; y++) {
+    memcpy(dst + y * row, src + (size_t)y * stride, row);
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, box.x1, box.y1, w, h, format, type, (const void*)offset);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 
@@ -189,6 +467,15 @@ _egl_gl_import_buffer_dmabuf(struct vt_renderer_t* r,
     VT_ERROR(r->comp->log, "Invalid dmabuf attributes for import.");
     return false;
   }
+  // Textures of SHM uploads are never bound to an EGLImage, the 
+  // DMABUF gets a texture of its own.
+  if(surf->tex_back.id) {
+    glDeleteTextures(1, &surf->tex_back.id);
+    if(surf->tex.id) glDeleteTextures(1, &surf->tex.id);
+    surf->tex_back = (RnTexture){0};
+    surf->tex = (RnTexture){0};
+    pixman_region32_clear(&surf->tex_back_damage);
+  }
   if(!surf->render_tex_handle || a->width != surf->width || a->height != surf->height) {
     if (a->mod != _VT_DRM_FORMAT_MOD_INVALID &&
       a->mod != _VT_DRM_FORMAT_MOD_LINEAR &&
@@ -335,10 +622,14 @@ bool _egl_pick_config_from_format(struct vt_compositor_t* c,
   eglGetConfigs(egl->egl_dsp, configs, num, &num);
 
   EGLConfig match = NULL;
-  EGLint vis;
+  EGLint vis, stencil;
   for (int i = 0; i < num; i++) {
     eglGetConfigAttrib(egl->egl_dsp, configs[i], EGL_NATIVE_VISUAL_ID, &vis);
-    if ((uint32_t)vis == format) {
+    if ((uint32_t)vis != format) continue;
+    if (!match) match = configs[i];
+    // Prefer a stencil buffer, it lets us render without an intermediate FBO
+    eglGetConfigAttrib(egl->egl_dsp, configs[i], EGL_STENCIL_SIZE, &stencil);
+    if (stencil >= 8) {
       match = configs[i];
       break;
     }
@@ -382,12 +673,17 @@ _egl_pick_config(struct vt_compositor_t *comp, struct egl_backend_state_t *egl,
         EGL_BLUE_SIZE,  8,
         EGL_ALPHA_SIZE, 0,
         EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        // Dropped again if no config has it, see render_direct
+        EGL_STENCIL_SIZE, 8,
         EGL_NONE
       };
       EGLint n = 0;
       if (!eglChooseConfig(egl->egl_dsp, attrs, &egl->egl_conf, 1, &n) || n == 0) {
-        VT_ERROR(comp->log, "no valid configs for Wayland backend");
-        return false;
+        attrs[sizeof(attrs) / sizeof(attrs[0]) - 3] = EGL_NONE;
+        if (!eglChooseConfig(egl->egl_dsp, attrs, &egl->egl_conf, 1, &n) || n == 0) {
+          VT_ERROR(comp->log, "no valid configs for Wayland backend");
+          return false;
+        }
       }
       eglGetConfigAttrib(egl->egl_dsp, egl->egl_conf, EGL_NATIVE_VISUAL_ID, &egl->egl_native_vis);
       return true;
@@ -434,11 +730,13 @@ bool _egl_surface_is_ready(struct vt_renderer_t* renderer, struct vt_surface_t*
     EGLSyncKHR sync = eglCreateSyncKHR_ptr(
       egl->egl_dsp, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
 
-    surf->sync.acquire_fence_fd = -1;
-
+    // The fence stays with the surface if it cannot be imported, 
+    // so the surface keeps being reported as not ready.
     if (sync == EGL_NO_SYNC_KHR)
       return false;
 
+    surf->sync.acquire_fence_fd = -1;
+
     eglWaitSyncKHR_ptr(egl->egl_dsp, sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR);
 
     eglDestroySyncKHR_ptr(egl->egl_dsp, sync);
@@ -480,7 +778,7 @@ bool _egl_send_surface_release_fences(struct vt_renderer_t* renderer, struct vt_
     struct vt_surface_t* surf;
 
     wl_list_for_each_reverse(surf, &comp->surfaces, link) {
-      if (!(surf->_mask_outputs_presented_on & (1u << output->id))) continue;
+      if (!vt_util_output_mask_has(&surf->_mask_outputs_presented_on, output->id)) continue;
       if (!surf->buf_res) continue;
       if (!surf->sync.res_release) continue;
 
@@ -542,6 +840,141 @@ _egl_gl_create_output_fbo(struct vt_output_t *output) {
 
   return true;
 }
+
+void
+_egl_damage_ring_collect(struct vt_output_t* output, EGLint age, pixman_region32_t* frame_damage, pixman_region32_t* out) {
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  // A back buffer of age N shows the frame from N swaps ago, so it misses 
+  // the damage of the N - 1 frames since then on top of this frame's. 
+  // Unknown contents (age 0) or ages beyond the ring get all of the FBO.
+  if(age <= 0 || age > _EGL_DAMAGE_RING_SIZE) {
+    pixman_region32_init_rect(out, 0, 0, output->width, output->height);
+  } else {
+    pixman_region32_init(out);
+    pixman_region32_copy(out, frame_damage);
+    for(EGLint i = 1; i < age; i++) {
+      uint32_t idx = (egl_output->damage_ring_head + _EGL_DAMAGE_RING_SIZE - i) % _EGL_DAMAGE_RING_SIZE;
+      pixman_region32_union(out, out, &egl_output->damage_ring[idx]);
+    }
+    pixman_region32_intersect_rect(out, out, 0, 0, output->width, output->height);
+  }
+
+  // This frame becomes the newest entry, replacing the oldest one
+  pixman_region32_copy(&egl_output->damage_ring[egl_output->damage_ring_head], frame_damage);
+  egl_output->damage_ring_head = (egl_output->damage_ring_head + 1) % _EGL_DAMAGE_RING_SIZE;
+}
+
+void
+_egl_blit_output_fbo(struct egl_backend_state_t* egl, struct vt_output_t* output, pixman_region32_t* frame_damage) {
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  // The FBO always holds the whole frame, the back buffer 
+  // only needs what changed since it was last on screen.
+  EGLint age = 0;
+  if(egl->has_buffer_age && 
+    !eglQuerySurface(egl->egl_dsp, output->render_surface, EGL_BUFFER_AGE_EXT, &age)) {
+    age = 0;
+  }
+  pixman_region32_t blit_damage;
+  _egl_damage_ring_collect(output, age, frame_damage, &blit_damage);
+
+  int32_t n_boxes = 0;
+  pixman_box32_t* boxes = pixman_region32_rectangles(&blit_damage, &n_boxes);
+  if(n_boxes > VT_MAX_DAMAGE_RECTS) {
+    // Past that many draws one big blit is cheaper
+    boxes = pixman_region32_extents(&blit_damage);
+    n_boxes = 1;
+  }
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, egl_output->fbo_id);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  for(int32_t i = 0; i < n_boxes; i++) {
+    // GL's origin is the bottom left corner
+    GLint y1 = output->height - boxes[i].y2, y2 = output->height - boxes[i].y1;
+    glBlitFramebuffer(boxes[i].x1, y1, boxes[i].x2, y2,
+                      boxes[i].x1, y1, boxes[i].x2, y2, 
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  }
+  pixman_region32_fini(&blit_damage);
+}
+
+void
+_egl_output_state_destroy(struct vt_output_t* output) {
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+  if(!egl_output) return;
+
+  for(uint32_t i = 0; i < _EGL_DAMAGE_RING_SIZE; i++) {
+    pixman_region32_fini(&egl_output->damage_ring[i]);
+  }
+  wl_array_release(&egl_output->ops);
+  if (egl_output->fbo_tex_id) glDeleteTextures(1, &egl_output->fbo_tex_id);
+  if (egl_output->fbo_id) glDeleteFramebuffers(1, &egl_output->fbo_id);
+  if (egl_output->rbo_tex_depth) glDeleteRenderbuffers(1, &egl_output->rbo_tex_depth);
+
+  free(egl_output);
+  output->user_data_render = NULL;
+}
+
+void
+_egl_record_op(struct egl_output_state_t* egl_output, RnTexture tex, float x, float y, float w, float h, uint32_t col) {
+  struct egl_draw_op_t* op = wl_array_add(&egl_output->ops, sizeof(*op));
+  if(!op) return;
+  *op = (struct egl_draw_op_t){ .tex = tex, .x = x, .y = y, .w = w, .h = h, .col = col };
+}
+
+void
+_egl_replay_scissored(struct egl_backend_state_t* egl, struct vt_output_t* output) {
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  glEnable(GL_SCISSOR_TEST);
+  for(int32_t i = 0; i < output->n_damage_boxes; i++) {
+    pixman_box32_t box = output->cached_damage[i];
+    if(box.x2 <= box.x1 || box.y2 <= box.y1) continue;
+    // Output coordinates are top-down, GL's origin is the bottom left
+    glScissor(box.x1, output->height - box.y2, box.x2 - box.x1, box.y2 - box.y1);
+
+    rn_begin(egl->render);
+    struct egl_draw_op_t* op;
+    wl_array_for_each(op, &egl_output->ops) {
+      if(op->x >= box.x2 || op->y >= box.y2 || 
+        op->x + op->w <= box.x1 || op->y + op->h <= box.y1) continue;
+      if(op->tex.id) {
+        rn_image_render(egl->render, (vec2s){op->x, op->y}, RN_WHITE, op->tex);
+      } else {
+        rn_rect_render(egl->render, (vec2s){op->x, op->y}, (vec2s){op->w, op->h}, rn_color_from_hex(op->col)); 
+      }
+    }
+    rn_end(egl->render);
+  }
+  glDisable(GL_SCISSOR_TEST);
+}
+
+void
+_egl_swap_buffers(struct egl_backend_state_t* egl, struct vt_output_t* output, pixman_region32_t* damage) {
+  int32_t n_boxes = 0;
+  pixman_box32_t* boxes = pixman_region32_rectangles(damage, &n_boxes);
+
+  // Consumers of the swap want what changed since the previous 
+  // frame, not what this particular back buffer was missing.
+  if (!n_boxes || (!eglSwapBuffersWithDamageKHR_ptr && !eglSwapBuffersWithDamageEXT_ptr)) {
+    eglSwapBuffers(egl->egl_dsp, output->render_surface);
+    return;
+  }
+  EGLint egl_rects[n_boxes * 4];
+  for (int32_t i = 0; i < n_boxes; i++) {
+    egl_rects[i * 4 + 0] = boxes[i].x1;
+    egl_rects[i * 4 + 1] = output->height - boxes[i].y2;
+    egl_rects[i * 4 + 2] = boxes[i].x2 - boxes[i].x1;
+    egl_rects[i * 4 + 3] = boxes[i].y2 - boxes[i].y1;
+  }
+  if(eglSwapBuffersWithDamageKHR_ptr)
+    eglSwapBuffersWithDamageKHR_ptr(
+      egl->egl_dsp, output->render_surface, egl_rects, n_boxes);
+  else
+    eglSwapBuffersWithDamageEXT_ptr(
+      egl->egl_dsp, output->render_surface, egl_rects, n_boxes);
+}
 EGLDisplay _egl_create_display(
   struct vt_compositor_t* comp,
   enum vt_backend_platform_t platform,
@@ -587,7 +1020,8 @@ bool
 _egl_create_renderer(
   struct vt_renderer_t* renderer, enum vt_backend_platform_t platform,
   void* native_handle, bool log_error) {
-  if(!native_handle) return false;
+  // The surfaceless platform has no native display handle
+  if(!native_handle && platform != VT_BACKEND_SURFACELESS) return false;
 
   renderer->user_data = VT_ALLOC(renderer->comp, sizeof(struct egl_backend_state_t));
   struct egl_backend_state_t* egl = BACKEND_DATA(renderer, struct egl_backend_state_t);
@@ -606,7 +1040,7 @@ _egl_create_renderer(
 
 bool
 renderer_init_egl(struct vt_backend_t* backend, struct vt_renderer_t *r, void* native_handle) {
-  if (!r || !native_handle) return false;
+  if (!r || !backend || (!native_handle && backend->platform != VT_BACKEND_SURFACELESS)) return false;
 
   r->backend = backend;
   r->rendering_backend = VT_RENDERING_BACKEND_EGL_OPENGL;
@@ -642,6 +1076,10 @@ renderer_init_egl(struct vt_backend_t* backend, struct vt_renderer_t *r, void* n
   const char* version = eglQueryString(egl->egl_dsp, EGL_VERSION);
 
   const char* exts = eglQueryString(egl->egl_dsp, EGL_EXTENSIONS);
+  if(backend->platform == VT_BACKEND_SURFACELESS && !strstr(exts, "EGL_KHR_surfaceless_context")) {
+    VT_ERROR(r->comp->log, "EGL_KHR_surfaceless_context is not supported, cannot render without surfaces.");
+    return false;
+  }
   if(strstr(exts, "EGL_EXT_swap_buffers_with_damage")) {
     eglSwapBuffersWithDamageEXT_ptr =
       (PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC)
@@ -652,6 +1090,18 @@ renderer_init_egl(struct vt_backend_t* backend, struct vt_renderer_t *r, void* n
       (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
       eglGetProcAddress("eglSwapBuffersWithDamageKHR");
   }
+  // Without it, back buffers are treated as undefined and get fully blitted
+  egl->has_buffer_age = strstr(exts, "EGL_EXT_buffer_age") != NULL;
+
+  // Compositing straight into the back buffers saves a full-output 
+  // copy per frame. The stencil damage pass then runs on the window's own 
+  // stencil buffer and buffer age tells which parts are stale.
+  EGLint stencil_bits = 0;
+  eglGetConfigAttrib(egl->egl_dsp, egl->egl_conf, EGL_STENCIL_SIZE, &stencil_bits);
+  egl->render_direct = backend->platform != VT_BACKEND_SURFACELESS && 
+    egl->has_buffer_age && stencil_bits >= 8 && !getenv("VT_EGL_NO_DIRECT");
+  VT_TRACE(r->comp->log, "Rendering outputs %s.", 
+           egl->render_direct ? "directly into their back buffers" : "through an intermediate FBO");
 
   egl->has_dmabuf_support = true;
   egl->has_dmabuf_modifiers_support = true;
@@ -895,11 +1345,19 @@ renderer_query_dmabuf_formats_with_renderer_egl(struct vt_renderer_t* renderer,
 
 bool
 renderer_setup_renderable_output_egl(struct vt_renderer_t *r, struct vt_output_t* output) {
-  if (!r || !output || !r->user_data || !output->native_window) return false;
+  if (!r || !output || !r->user_data) return false;
+  bool surfaceless = r->backend->platform == VT_BACKEND_SURFACELESS;
+  if (!output->native_window && !surfaceless) return false;
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
 
-  output->user_data_render = VT_ALLOC(r->comp, sizeof(*output->user_data_render));
+  // Outputs come and go with hotplug, so their state lives outside the arena
+  output->user_data_render = calloc(1, sizeof(struct egl_output_state_t));
   struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+  if(!egl_output) return false;
+  for(uint32_t i = 0; i < _EGL_DAMAGE_RING_SIZE; i++) {
+    pixman_region32_init(&egl_output->damage_ring[i]);
+  }
+  wl_array_init(&egl_output->ops);
  
   // If we're running the wayland sink backend, we create the egl_window 
   // handle and use it as the native window handle to create the EGL 
@@ -912,13 +1370,17 @@ renderer_setup_renderable_output_egl(struct vt_renderer_t *r, struct vt_output_t
     output->native_window = egl_win; 
   }
 
-  // Creating the EGL surface for the output
-  EGLSurface egl_surf =
-    eglCreateWindowSurface(egl->egl_dsp, egl->egl_conf,
-                           (EGLNativeWindowType)output->native_window, NULL);
-  if (egl_surf == EGL_NO_SURFACE) {
+  // Creating the EGL surface for the output, surfaceless outputs 
+  // only ever render into their offscreen FBO.
+  EGLSurface egl_surf = EGL_NO_SURFACE;
+  if(!surfaceless) {
+    egl_surf = eglCreateWindowSurface(egl->egl_dsp, egl->egl_conf,
+                                      (EGLNativeWindowType)output->native_window, NULL);
+  }
+  if (egl_surf == EGL_NO_SURFACE && !surfaceless) {
     EGLint err = eglGetError();
     VT_ERROR(r->comp->log, "eglCreateWindowSurface failed: 0x%04x (%s)", err, _egl_err_str(err));
+    _egl_output_state_destroy(output);
     return false;
   }
 
@@ -926,7 +1388,8 @@ renderer_setup_renderable_output_egl(struct vt_renderer_t *r, struct vt_output_t
   if (!eglMakeCurrent(egl->egl_dsp, egl_surf, egl_surf, egl->egl_ctx)) {
     EGLint err = eglGetError();
     VT_ERROR(r->comp->log, "eglMakeCurrent failed: 0x%04x (%s)", err, _egl_err_str(err));
-    eglDestroySurface(egl->egl_dsp, egl_surf);
+    if(egl_surf != EGL_NO_SURFACE) eglDestroySurface(egl->egl_dsp, egl_surf);
+    _egl_output_state_destroy(output);
     return false;
   }
 
@@ -947,8 +1410,8 @@ renderer_setup_renderable_output_egl(struct vt_renderer_t *r, struct vt_output_t
     &output->damage, &output->damage,
     0, 0, output->width, output->height);
   
-  // Create EGL FBOs for output
-  if(!_egl_gl_create_output_fbo(output)) return false;
+  // Create EGL FBOs for output, outputs rendering directly do not need them
+  if(!egl->render_direct && !_egl_gl_create_output_fbo(output)) return false;
 
   vt_comp_schedule_repaint(r->comp, output);
 
@@ -965,7 +1428,8 @@ renderer_resize_renderable_output_egl(struct vt_renderer_t* r, struct vt_output_
   if(!egl_win) return false;
 
   printf("called here.\n");
-  if(!_egl_gl_create_output_fbo(output)) return false;
+  struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
+  if(!egl->render_direct && !_egl_gl_create_output_fbo(output)) return false;
   
   wl_egl_window_resize(egl_win, w, h, 0, 0);
 
@@ -979,13 +1443,24 @@ renderer_resize_renderable_output_egl(struct vt_renderer_t* r, struct vt_output_
 
 bool 
 renderer_destroy_renderable_output_egl(struct vt_renderer_t *r, struct vt_output_t* output) {
-  if (!r || !r->user_data || !output->render_surface ||
-    r->backend->platform == VT_BACKEND_SURFACELESS) return false;
+  if (!r || !r->user_data || !output) return false;
 
   if(r->rendering_backend != VT_RENDERING_BACKEND_EGL_OPENGL) return false;
 
   struct egl_backend_state_t *egl = BACKEND_DATA(r, struct egl_backend_state_t);
 
+  if(r->backend->platform == VT_BACKEND_SURFACELESS) {
+    // Surfaceless outputs only own their offscreen FBO
+    if(!output->user_data_render) return false;
+    _egl_output_state_destroy(output);
+    VT_TRACE(r->comp->log, "Destroyed offscreen render target."); 
+    return true;
+  }
+
+  if(!output->render_surface) return false;
+
+  _egl_output_state_destroy(output);
+
   if(r->backend->platform == VT_BACKEND_WAYLAND) {
     struct wl_egl_window* egl_win = (struct wl_egl_window*)output->native_window; 
     wl_egl_window_destroy(egl_win);
@@ -1035,6 +1510,9 @@ bool renderer_destroy_surface_texture_egl(struct vt_renderer_t* r, struct vt_sur
   glBindTexture(GL_TEXTURE_2D, 0);
   if(surf->tex.id)
     glDeleteTextures(1, &surf->tex.id);
+  if(surf->tex_back.id)
+    glDeleteTextures(1, &surf->tex_back.id);
+  surf->tex_back = (RnTexture){0};
 
   if (surf->render_tex_handle && surf->render_tex_handle != EGL_NO_IMAGE_KHR) {
     eglDestroyImageKHR_ptr(egl->egl_dsp, (EGLImageKHR)surf->render_tex_handle);
@@ -1082,7 +1560,32 @@ renderer_stencil_damage_pass_egl(struct vt_renderer_t* r, struct vt_output_t* ou
   if(!r || !output || !output->user_data_render) return;
 
   struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+  struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
 
+  if(egl->render_direct) {
+    // The damage is final now (cursor included). The back buffer also 
+    // misses whatever changed since it was last on screen, so that gets 
+    // composited as well while the ring only remembers this frame's damage.
+    pixman_region32_t stale;
+    _egl_damage_ring_collect(output, egl_output->back_age, &output->damage, &stale);
+    int32_t n_boxes = 0;
+    pixman_box32_t* boxes = pixman_region32_rectangles(&stale, &n_boxes);
+    if(n_boxes > VT_MAX_DAMAGE_RECTS) {
+      boxes = pixman_region32_extents(&stale);
+      n_boxes = 1;
+    }
+    memcpy(output->cached_damage, boxes, sizeof(*boxes) * n_boxes);
+    output->n_damage_boxes = n_boxes;
+    pixman_region32_fini(&stale);
+  }
+
+  // A few boxes are cheaper to clip with scissors, replaying the scene once 
+  // per box, than to mark them in the stencil buffer with an extra pass.
+  egl_output->scissor = output->n_damage_boxes <= _EGL_SCISSOR_MAX_BOXES;
+  if(egl_output->scissor) {
+    egl_output->discard = true;
+    return;
+  }
   
     glEnable(GL_STENCIL_TEST);
 
@@ -1102,7 +1605,14 @@ renderer_composite_pass_egl(struct vt_renderer_t* r, struct vt_output_t* output)
 
   struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
 
+  egl_output->discard = false;
+  if(egl_output->scissor) {
+    glDisable(GL_STENCIL_TEST);
+    return;
+  }
+
     // ========== PASS 2: SCENE ==========
+    glEnable(GL_STENCIL_TEST);
     glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     glStencilMask(0x00);
     glStencilFunc(GL_EQUAL, 1, 0xFF);
@@ -1123,6 +1633,13 @@ renderer_begin_scene_egl(struct vt_renderer_t *r, struct vt_output_t *output) {
   }
 
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  if(egl_output->discard) return;
+  if(egl_output->scissor) {
+    egl_output->ops.size = 0;
+    return;
+  }
 
   rn_begin(egl->render);
 
@@ -1157,11 +1674,34 @@ renderer_begin_frame_egl(struct vt_renderer_t *r, struct vt_output_t *output) {
   }
  
   egl->need_fence = false;
+  egl->output = output;
 
-  glBindFramebuffer(GL_FRAMEBUFFER, egl_output->fbo_id);
+  if(!egl->render_direct) {
+    glBindFramebuffer(GL_FRAMEBUFFER, egl_output->fbo_id);
+    return;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if(!eglQuerySurface(egl->egl_dsp, surface, EGL_BUFFER_AGE_EXT, &egl_output->back_age)) {
+    egl_output->back_age = 0;
+  }
+  // The damage of the back buffer is only known in the damage pass
+  output->needs_damage_rebuild = true;
+
+  // Depth and stencil are rebuilt every frame, and a back buffer of unknown 
+  // age gets fully repainted, so tilers need not load any of that.
+  GLenum attachments[] = { GL_COLOR, GL_DEPTH, GL_STENCIL };
+  bool full = egl_output->back_age <= 0 || egl_output->back_age > _EGL_DAMAGE_RING_SIZE;
+  glInvalidateFramebuffer(GL_FRAMEBUFFER, full ? 3 : 2, full ? attachments : attachments + 1);
 }
 
 
+bool
+renderer_is_surface_drawable_egl(struct vt_renderer_t* r, struct vt_surface_t* surface) {
+  if(!surface || !surface->tex.id) return false;
+  return _egl_surface_is_ready(r, surface);
+}
+
 void 
 renderer_draw_surface_egl(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y) {
   if(!surface) return;
@@ -1172,16 +1712,22 @@ renderer_draw_surface_egl(struct vt_renderer_t* r, struct vt_output_t* output, s
   }
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
 
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  if(egl_output->discard) return;
   if(!_egl_surface_is_ready(r, surface)) return;
 
-  rn_image_render(
-    egl->render, (vec2s){x,y}, RN_WHITE, (RnTexture){
-      .id = surface->tex.id,
-      .width = surface->tex.width * surface->buffer_scale,
-      .height = surface->tex.height * surface->buffer_scale}
-  ); 
+  RnTexture tex = (RnTexture){
+    .id = surface->tex.id,
+    .width = surface->tex.width * surface->buffer_scale,
+    .height = surface->tex.height * surface->buffer_scale};
+  if(egl_output->scissor) {
+    _egl_record_op(egl_output, tex, x, y, tex.width, tex.height, 0);
+  } else {
+    rn_image_render(egl->render, (vec2s){x,y}, RN_WHITE, tex); 
+  }
   
-  surface->_mask_outputs_presented_on |= (1u << output->id);
+  vt_util_output_mask_set(&surface->_mask_outputs_presented_on, output->id);
 
   surface->damaged = false;
 
@@ -1193,12 +1739,20 @@ renderer_draw_surface_egl(struct vt_renderer_t* r, struct vt_output_t* output, s
 void 
 renderer_draw_image_egl(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t tex_id, uint32_t width, uint32_t height, float x, float y) {
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  if(egl_output->discard) return;
 
-  rn_image_render(egl->render, (vec2s){x,y}, RN_WHITE, (RnTexture) {
+  RnTexture tex = (RnTexture) {
     .id = tex_id,
     .width = width,
     .height = height
-  });
+  };
+  if(egl_output->scissor) {
+    _egl_record_op(egl_output, tex, x, y, width, height, 0);
+    return;
+  }
+  rn_image_render(egl->render, (vec2s){x,y}, RN_WHITE, tex);
 }
 void 
 renderer_draw_rect_egl(struct vt_renderer_t* r, float x, float y, float w, float h, uint32_t col) {
@@ -1208,6 +1762,14 @@ renderer_draw_rect_egl(struct vt_renderer_t* r, float x, float y, float w, float
   }
 
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
+  struct egl_output_state_t* egl_output = egl->output ? 
+    (struct egl_output_state_t*)egl->output->user_data_render : NULL; 
+
+  if(egl_output && egl_output->discard) return;
+  if(egl_output && egl_output->scissor) {
+    _egl_record_op(egl_output, (RnTexture){0}, x, y, w, h, col);
+    return;
+  }
   rn_rect_render(egl->render, (vec2s){x,y}, (vec2s){w,h}, rn_color_from_hex(col)); 
 }
 
@@ -1219,6 +1781,13 @@ renderer_end_scene_egl(struct vt_renderer_t *r, struct vt_output_t *output) {
   }
   
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
+  struct egl_output_state_t* egl_output = (struct egl_output_state_t*)output->user_data_render; 
+
+  if(egl_output->discard) return;
+  if(egl_output->scissor) {
+    _egl_replay_scissored(egl, output);
+    return;
+  }
 
   rn_end(egl->render);
 
@@ -1241,6 +1810,9 @@ renderer_end_frame_egl(struct vt_renderer_t *r, struct vt_output_t *output,  con
 
   if(!egl || !egl_output) return;
 
+  // Draws outside of a frame go to runara directly again
+  egl->output = NULL;
+
   if(r->backend->comp->have_proto_dmabuf_explicit_sync && egl->has_explicit_sync_support) {
     egl_output->end_sync = eglCreateSyncKHR_ptr(
       egl->egl_dsp, 
@@ -1248,28 +1820,26 @@ renderer_end_frame_egl(struct vt_renderer_t *r, struct vt_output_t *output,  con
       &(EGLint){EGL_NONE});
   }
 
-  glBindFramebuffer(GL_READ_FRAMEBUFFER, egl_output->fbo_id);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-  glBlitFramebuffer(0, 0, output->width, output->height,
-                    0, 0, output->width, output->height, 
-                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
-
-  if (n_damaged) {
-    EGLint egl_rects[n_damaged * 4];
-    for (int i = 0; i < n_damaged; i++) {
-      egl_rects[i * 4 + 0] = damaged[i].x1;
-      egl_rects[i * 4 + 1] = output->height - damaged[i].y2;
-      egl_rects[i * 4 + 2] = damaged[i].x2 - damaged[i].x1;
-      egl_rects[i * 4 + 3] = damaged[i].y2 - damaged[i].y1;
-    }
-    if(eglSwapBuffersWithDamageKHR_ptr)
-      eglSwapBuffersWithDamageKHR_ptr(
-        egl->egl_dsp, output->render_surface, egl_rects, n_damaged);
-    else if (eglSwapBuffersWithDamageEXT_ptr) 
-      eglSwapBuffersWithDamageEXT_ptr(
-        egl->egl_dsp, output->render_surface, egl_rects, n_damaged);
+  if(r->backend->platform == VT_BACKEND_SURFACELESS) {
+    // Nothing to present, the frame stays in the output's FBO. Flush so 
+    // the GPU work is actually submitted before the next vblank.
+    glFlush();
   } else {
-    eglSwapBuffers(egl->egl_dsp, output->render_surface);
+    pixman_region32_t frame_damage;
+    if(egl->render_direct) {
+      // The ring's newest entry is this frame's own damage
+      uint32_t newest = (egl_output->damage_ring_head + _EGL_DAMAGE_RING_SIZE - 1) % _EGL_DAMAGE_RING_SIZE;
+      pixman_region32_init(&frame_damage);
+      pixman_region32_copy(&frame_damage, &egl_output->damage_ring[newest]);
+      // Nothing reads depth or stencil after this frame
+      GLenum attachments[] = { GL_DEPTH, GL_STENCIL };
+      glInvalidateFramebuffer(GL_FRAMEBUFFER, 2, attachments);
+    } else {
+      pixman_region32_init_rects(&frame_damage, (pixman_box32_t*)damaged, n_damaged);
+      _egl_blit_output_fbo(egl, output, &frame_damage);
+    }
+    _egl_swap_buffers(egl, output, &frame_damage);
+    pixman_region32_fini(&frame_damage);
   }
 
   if(!_egl_send_surface_release_fences(r, output)) {
@@ -1286,6 +1856,8 @@ renderer_destroy_egl(struct vt_renderer_t* r) {
   }
   struct egl_backend_state_t* egl = BACKEND_DATA(r, struct egl_backend_state_t);
 
+  _egl_log_upload_stats(r, egl);
+  _egl_upload_ring_destroy(&egl->upload_ring);
   rn_terminate(egl->render);
 
   eglMakeCurrent(egl->egl_dsp, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT); 
@@ -40,6 +40,8 @@ void renderer_begin_scene_egl(struct vt_renderer_t* r, struct vt_output_t* outpu
   
 void renderer_init_surface_egl(struct vt_renderer_t* r, struct vt_surface_t* surf);
 
+bool renderer_is_surface_drawable_egl(struct vt_renderer_t* r, struct vt_surface_t* surface);
+
 void renderer_draw_surface_egl(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y);
   
 void renderer_draw_image_egl(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t tex_id, uint32_t width, uint32_t height, float x, float y);
@@ -0,0 +1,460 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+#include <wayland-server.h>
+
+#include "src/core/compositor.h"
+#include "src/core/surface.h"
+#include "src/core/core_types.h"
+#include "src/core/util.h"
+#include "src/render/renderer.h"
+
+#include <pixman.h>
+
+#include "pixman_sw.h"
+
+#define _SUBSYS_NAME "PIXMAN"
+
+#define __vt_pixman_fourcc_code(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+  ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// Outputs are composited in the layout of DRM_FORMAT_XRGB8888
+#define _VT_PIXMAN_DRM_FORMAT_XRGB8888 __vt_pixman_fourcc_code('X', 'R', '2', '4')
+
+struct pixman_backend_state_t {
+  // Output that is currently rendered, draw_rect() does not get it passed
+  struct vt_output_t* output;
+};
+
+struct pixman_output_state_t {
+  // The complete contents of the output, frames only redraw the damaged parts
+  pixman_image_t* shadow;
+  // Damage of the frame in progress, every draw is clipped to it
+  pixman_region32_t clip;
+  // Damage of the previous frame, the target buffer we present into
+  // next is a frame behind and misses it
+  pixman_region32_t prev_damage;
+  // Set during the damage pass, whose draws only exist to mark the
+  // damage and must not reach the image (like the color mask in GL)
+  bool discard;
+};
+
+static bool           _pixman_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t *surf, struct wl_shm_buffer *shm_buf);
+static bool           _pixman_create_output_image(struct vt_renderer_t* r, struct vt_output_t* output, int32_t w, int32_t h);
+static pixman_color_t _pixman_color_from_hex(uint32_t col);
+static void           _pixman_fill(struct pixman_output_state_t* pix_output, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t col);
+
+bool
+_pixman_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t *surf,
+                          struct wl_shm_buffer *shm_buf) {
+  int width = wl_shm_buffer_get_width(shm_buf);
+  int height = wl_shm_buffer_get_height(shm_buf);
+  int stride = wl_shm_buffer_get_stride(shm_buf);
+  uint32_t fmt = wl_shm_buffer_get_format(shm_buf);
+
+  pixman_format_code_t format;
+  switch (fmt) {
+    case WL_SHM_FORMAT_ARGB8888: format = PIXMAN_a8r8g8b8; break;
+    case WL_SHM_FORMAT_XRGB8888: format = PIXMAN_x8r8g8b8; break;
+    default:
+      VT_WARN(r->comp->log, "Unsupported wl_shm format %u", fmt);
+      return false;
+  }
+
+  // The client gets its buffer back once the commit is done, so the
+  // contents are copied into an image that belongs to the surface.
+  pixman_image_t* img = (pixman_image_t*)surf->render_tex_handle;
+  bool need_regen = !img || surf->tex.width != width || surf->tex.height != height ||
+    pixman_image_get_format(img) != format;
+  if (need_regen) {
+    if (img) pixman_image_unref(img);
+    if (!(img = pixman_image_create_bits(format, width, height, NULL, 0))) {
+      VT_ERROR(r->comp->log, "Cannot create %ix%i image for surface %p.", width, height, surf);
+      surf->render_tex_handle = NULL;
+      return false;
+    }
+    surf->render_tex_handle = img;
+    surf->tex.width = width;
+    surf->tex.height = height;
+  }
+
+  // Only the damaged rectangles are copied unless the image is new
+  int32_t n_boxes = 1;
+  pixman_box32_t full = { 0, 0, width, height };
+  const pixman_box32_t* boxes = &full;
+  if (!need_regen) {
+    boxes = pixman_region32_rectangles(&surf->current_damage, &n_boxes);
+  }
+  if (!n_boxes) return true;
+
+  wl_shm_buffer_begin_access(shm_buf);
+  pixman_image_t* src = pixman_image_create_bits_no_clear(
+    format, width, height, wl_shm_buffer_get_data(shm_buf), stride);
+  if (!src) {
+    wl_shm_buffer_end_access(shm_buf);
+    return false;
+  }
+
+  for (int32_t i = 0; i < n_boxes; i++) {
+    pixman_image_composite32(
+      PIXMAN_OP_SRC, src, NULL, img,
+      boxes[i].x1, boxes[i].y1, 0, 0, boxes[i].x1, boxes[i].y1,
+      boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1);
+  }
+
+  pixman_image_unref(src);
+  wl_shm_buffer_end_access(shm_buf);
+
+  return true;
+}
+
+bool
+_pixman_create_output_image(struct vt_renderer_t* r, struct vt_output_t* output, int32_t w, int32_t h) {
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+
+  if (pix_output->shadow) pixman_image_unref(pix_output->shadow);
+  if (!(pix_output->shadow = pixman_image_create_bits(PIXMAN_x8r8g8b8, w, h, NULL, 0))) {
+    VT_ERROR(r->comp->log, "Cannot create %ix%i image for output %p.", w, h, output);
+    return false;
+  }
+
+  // Whatever the target buffers hold is stale now
+  pixman_region32_clear(&pix_output->prev_damage);
+  pixman_region32_union_rect(&pix_output->prev_damage, &pix_output->prev_damage, 0, 0, w, h);
+  pixman_region32_union_rect(&output->damage, &output->damage, 0, 0, w, h);
+  return true;
+}
+
+pixman_color_t
+_pixman_color_from_hex(uint32_t col) {
+  // 8 bit channels are widened to 16 bit by repeating them
+  return (pixman_color_t){
+    .red   = ((col >> 16) & 0xff) * 0x101,
+    .green = ((col >> 8) & 0xff) * 0x101,
+    .blue  = (col & 0xff) * 0x101,
+    .alpha = 0xffff,
+  };
+}
+
+void
+_pixman_fill(struct pixman_output_state_t* pix_output, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t col) {
+  if (w <= 0 || h <= 0) return;
+  pixman_color_t color = _pixman_color_from_hex(col);
+  pixman_box32_t box = { x, y, x + w, y + h };
+  // Fills respect the clip region of the image, so only damage is touched
+  pixman_image_fill_boxes(PIXMAN_OP_SRC, pix_output->shadow, &color, 1, &box);
+}
+
+
+// ===================================================
+// =================== PUBLIC API ====================
+// ===================================================
+
+bool
+renderer_init_pixman(struct vt_backend_t* backend, struct vt_renderer_t *r, void* native_handle) {
+  if (!r || !backend) return false;
+
+  // The nested backend has no SHM swapchain on the parent compositor yet
+  if (backend->platform == VT_BACKEND_WAYLAND) {
+    VT_ERROR(r->comp->log, "The pixman renderer cannot present on the wayland backend, use the GL renderer instead.");
+    return false;
+  }
+
+  r->backend = backend;
+  r->rendering_backend = VT_RENDERING_BACKEND_PIXMAN;
+  r->_desired_render_buffer_format = _VT_PIXMAN_DRM_FORMAT_XRGB8888;
+
+  if (!r->user_data) {
+    r->user_data = VT_ALLOC(r->comp, sizeof(struct pixman_backend_state_t));
+  }
+
+  VT_TRACE(r->comp->log, "Initialized pixman software renderer.");
+  return true;
+}
+
+bool
+renderer_is_handle_renderable_pixman(struct vt_renderer_t* renderer, void* native_handle) {
+  // Everything is rendered on the CPU, any device can show the result
+  return renderer != NULL;
+}
+
+bool
+renderer_query_dmabuf_formats_pixman(struct vt_compositor_t* comp, void* native_handle, struct wl_array* formats) {
+  // DMABUFs cannot be imported without a GPU context
+  return false;
+}
+
+bool
+renderer_query_dmabuf_formats_with_renderer_pixman(struct vt_renderer_t* renderer, struct wl_array* formats) {
+  return false;
+}
+
+bool
+renderer_setup_renderable_output_pixman(struct vt_renderer_t *r, struct vt_output_t* output) {
+  if (!r || !output || !r->user_data) return false;
+
+  // Outputs come and go with hotplug, so their state lives outside the arena
+  output->user_data_render = calloc(1, sizeof(struct pixman_output_state_t));
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  if (!pix_output) return false;
+  pixman_region32_init(&pix_output->clip);
+  pixman_region32_init(&pix_output->prev_damage);
+
+  if (!_pixman_create_output_image(r, output, output->width, output->height)) return false;
+
+  // The target (if any) is owned by the backend
+  output->render_surface = output->native_window;
+
+  vt_comp_schedule_repaint(r->comp, output);
+
+  VT_TRACE(r->comp->log, "Created render image for output %p (%ux%u)", output, output->width, output->height);
+  return true;
+}
+
+bool
+renderer_resize_renderable_output_pixman(struct vt_renderer_t* r, struct vt_output_t* output, int32_t w, int32_t h) {
+  if (!r || !output || !output->user_data_render || w == 0 || h == 0) return false;
+  return _pixman_create_output_image(r, output, w, h);
+}
+
+bool
+renderer_destroy_renderable_output_pixman(struct vt_renderer_t *r, struct vt_output_t* output) {
+  if (!r || !r->user_data || !output || !output->user_data_render) return false;
+
+  struct pixman_backend_state_t* pix = BACKEND_DATA(r, struct pixman_backend_state_t);
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+
+  if (pix_output->shadow) pixman_image_unref(pix_output->shadow);
+  pixman_region32_fini(&pix_output->clip);
+  pixman_region32_fini(&pix_output->prev_damage);
+  if (pix->output == output) pix->output = NULL;
+
+  free(pix_output);
+  output->user_data_render = NULL;
+  output->render_surface = NULL;
+
+  VT_TRACE(r->comp->log, "Destroyed render image.");
+  return true;
+}
+
+bool renderer_import_buffer_pixman(
+  struct vt_renderer_t *r, struct vt_surface_t *surf,
+  struct wl_resource *buffer_resource) {
+  struct wl_shm_buffer* shmbuf = wl_shm_buffer_get(buffer_resource);
+
+  if (shmbuf) {
+    VT_TRACE(r->comp->log, "Importing buffer as SHM.");
+    return _pixman_import_buffer_shm(r, surf, shmbuf);
+  }
+
+  VT_WARN(r->comp->log, "Cannot import non-SHM buffer of surface %p with the pixman renderer.", surf);
+  return false;
+}
+
+bool renderer_destroy_surface_texture_pixman(struct vt_renderer_t* r, struct vt_surface_t* surf) {
+  if (!surf || !r) return false;
+  if (surf->render_tex_handle) {
+    pixman_image_unref((pixman_image_t*)surf->render_tex_handle);
+    surf->render_tex_handle = NULL;
+  }
+  surf->tex.width = 0;
+  surf->tex.height = 0;
+  return true;
+}
+
+bool
+renderer_drop_context_pixman(struct vt_renderer_t* r) {
+  // There is no context to drop
+  return true;
+}
+
+void
+renderer_set_vsync_pixman(struct vt_renderer_t* r, bool vsync) {
+  // Pacing is up to the backend, presenting never blocks
+}
+
+void
+renderer_set_clear_color_pixman(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t col) {
+  if (!output || !output->user_data_render) return;
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  if (pix_output->discard) return;
+  _pixman_fill(pix_output, 0, 0, output->width, output->height, col);
+}
+
+void
+renderer_stencil_damage_pass_pixman(struct vt_renderer_t* r, struct vt_output_t* output) {
+  if (!r || !output || !output->user_data_render) return;
+  // Clipping to the damage happens in begin_scene(), nothing has to be marked
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  pix_output->discard = true;
+}
+
+void
+renderer_composite_pass_pixman(struct vt_renderer_t* r, struct vt_output_t* output) {
+  if (!r || !output || !output->user_data_render) return;
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  pix_output->discard = false;
+}
+
+void
+renderer_begin_scene_pixman(struct vt_renderer_t *r, struct vt_output_t *output) {
+  if (!r || !r->impl.begin_scene || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before beginning frame.");
+    return;
+  }
+  if (!output->width || !output->height) {
+    VT_WARN(r->comp->log, "Trying to render on invalid output region (%ix%i).", output->width, output->height);
+    return;
+  }
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  if (!pix_output) return;
+
+  // The damage is known once the damage pass ran, from
+  // then on nothing outside of it gets touched.
+  pixman_region32_fini(&pix_output->clip);
+  pixman_region32_init_rects(&pix_output->clip, output->cached_damage, output->n_damage_boxes);
+  pixman_region32_intersect_rect(&pix_output->clip, &pix_output->clip, 0, 0,
+                                 pixman_image_get_width(pix_output->shadow),
+                                 pixman_image_get_height(pix_output->shadow));
+  pixman_image_set_clip_region32(pix_output->shadow, &pix_output->clip);
+}
+
+void
+renderer_begin_frame_pixman(struct vt_renderer_t *r, struct vt_output_t *output) {
+  if (!r || !r->impl.begin_frame || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before beginning frame.");
+    return;
+  }
+  struct pixman_backend_state_t* pix = BACKEND_DATA(r, struct pixman_backend_state_t);
+  pix->output = output;
+}
+
+bool
+renderer_is_surface_drawable_pixman(struct vt_renderer_t* r, struct vt_surface_t* surface) {
+  return surface && surface->render_tex_handle;
+}
+
+void
+renderer_draw_surface_pixman(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y) {
+  if (!surface) return;
+  if (!surface->render_tex_handle) return;
+  if (!r || !r->impl.draw_surface || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before rendering surface.");
+    return;
+  }
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  if (!pix_output || pix_output->discard) return;
+
+  pixman_image_t* img = (pixman_image_t*)surface->render_tex_handle;
+  int32_t scale = surface->buffer_scale > 0 ? surface->buffer_scale : 1;
+  int32_t w = surface->tex.width * scale, h = surface->tex.height * scale;
+
+  // Same size on screen as in the GL renderer
+  if (scale != 1) {
+    pixman_transform_t t;
+    pixman_transform_init_scale(&t, pixman_double_to_fixed(1.0 / scale), pixman_double_to_fixed(1.0 / scale));
+    pixman_image_set_transform(img, &t);
+  }
+
+  // Opaque buffers can be copied, everything else is blended
+  pixman_op_t op = pixman_image_get_format(img) == PIXMAN_x8r8g8b8 ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+  pixman_image_composite32(op, img, NULL, pix_output->shadow,
+                           0, 0, 0, 0, (int32_t)x, (int32_t)y, w, h);
+
+  if (scale != 1) {
+    pixman_image_set_transform(img, NULL);
+  }
+
+  vt_util_output_mask_set(&surface->_mask_outputs_presented_on, output->id);
+
+  surface->damaged = false;
+
+  VT_TRACE(r->comp->log, "Presented surface %p (%.2f,%.2f).", surface, x, y);
+}
+
+void
+renderer_draw_image_pixman(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t tex_id, uint32_t width, uint32_t height, float x, float y) {
+  // Images are GPU textures, there is nothing to sample from on the CPU
+  VT_WARN(r->comp->log, "Cannot draw texture %u with the pixman renderer.", tex_id);
+}
+
+void
+renderer_draw_rect_pixman(struct vt_renderer_t* r, float x, float y, float w, float h, uint32_t col) {
+  if (!r || !r->impl.draw_rect || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before rendering rectangle.");
+    return;
+  }
+
+  struct pixman_backend_state_t* pix = BACKEND_DATA(r, struct pixman_backend_state_t);
+  if (!pix->output || !pix->output->user_data_render) return;
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)pix->output->user_data_render;
+  if (pix_output->discard) return;
+
+  _pixman_fill(pix_output, (int32_t)x, (int32_t)y, (int32_t)w, (int32_t)h, col);
+}
+
+void
+renderer_end_scene_pixman(struct vt_renderer_t *r, struct vt_output_t *output) {
+  if (!r || !r->impl.end_scene || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before ending frame.");
+    return;
+  }
+}
+
+void
+renderer_end_frame_pixman(struct vt_renderer_t *r, struct vt_output_t *output,  const pixman_box32_t* damaged, int32_t n_damaged) {
+  if (!r || !r->impl.end_frame || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before ending frame.");
+    return;
+  }
+
+  struct pixman_backend_state_t* pix = BACKEND_DATA(r, struct pixman_backend_state_t);
+  struct pixman_output_state_t* pix_output = (struct pixman_output_state_t*)output->user_data_render;
+  if (!pix_output) return;
+
+  pixman_image_set_clip_region32(pix_output->shadow, NULL);
+  pix->output = NULL;
+
+  // Headless outputs keep the frame in the shadow image
+  struct vt_renderer_cpu_target_t* target = (struct vt_renderer_cpu_target_t*)output->render_surface;
+  if (target && target->data) {
+    const int32_t w = pixman_image_get_width(pix_output->shadow);
+    const int32_t h = pixman_image_get_height(pix_output->shadow);
+    pixman_image_t* dst = pixman_image_create_bits_no_clear(
+      PIXMAN_x8r8g8b8, w, h, target->data, target->stride);
+    if (!dst) {
+      VT_ERROR(r->comp->log, "Cannot wrap target buffer of output %p.", output);
+      return;
+    }
+
+    // The target shows the frame before the previous one, so it
+    // gets the damage of both frames from the shadow image.
+    pixman_region32_t copy;
+    pixman_region32_init(&copy);
+    pixman_region32_union(&copy, &pix_output->clip, &pix_output->prev_damage);
+
+    int32_t n_boxes = 0;
+    pixman_box32_t* boxes = pixman_region32_rectangles(&copy, &n_boxes);
+    for (int32_t i = 0; i < n_boxes; i++) {
+      pixman_image_composite32(
+        PIXMAN_OP_SRC, pix_output->shadow, NULL, dst,
+        boxes[i].x1, boxes[i].y1, 0, 0, boxes[i].x1, boxes[i].y1,
+        boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1);
+    }
+    pixman_region32_fini(&copy);
+    pixman_image_unref(dst);
+  }
+
+  pixman_region32_copy(&pix_output->prev_damage, &pix_output->clip);
+}
+
+bool
+renderer_destroy_pixman(struct vt_renderer_t* r) {
+  if (!r || !r->impl.destroy || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before destroying backend.");
+    return false;
+  }
+  r->user_data = NULL;
+  return true;
+}
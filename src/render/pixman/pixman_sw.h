@@ -0,0 +1,53 @@
+#pragma once
+
+
+#include "../renderer.h"
+#include "../../core/core_types.h"
+#include "src/core/surface.h"
+
+bool renderer_init_pixman(struct vt_backend_t* backend, struct vt_renderer_t* r, void* native_handle);
+
+bool renderer_is_handle_renderable_pixman(struct vt_renderer_t* renderer, void* native_handle);
+
+bool renderer_query_dmabuf_formats_pixman(struct vt_compositor_t* comp, void* native_handle, struct wl_array* formats);
+
+bool renderer_query_dmabuf_formats_with_renderer_pixman(struct vt_renderer_t* renderer, struct wl_array* formats);
+
+bool renderer_setup_renderable_output_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+bool renderer_resize_renderable_output_pixman(struct vt_renderer_t* r, struct vt_output_t* output, int32_t w, int32_t h);
+
+bool renderer_destroy_renderable_output_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+bool renderer_import_buffer_pixman(struct vt_renderer_t* r, struct vt_surface_t* surf,
+    struct wl_resource *buffer_resource);
+
+bool renderer_destroy_surface_texture_pixman(struct vt_renderer_t* r, struct vt_surface_t* surf);
+
+bool renderer_drop_context_pixman(struct vt_renderer_t* r);
+
+void renderer_set_vsync_pixman(struct vt_renderer_t* r, bool vsync);
+
+void renderer_set_clear_color_pixman(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t col);
+
+void renderer_stencil_damage_pass_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_composite_pass_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_begin_frame_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_begin_scene_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+bool renderer_is_surface_drawable_pixman(struct vt_renderer_t* r, struct vt_surface_t* surface);
+
+void renderer_draw_surface_pixman(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y);
+
+void renderer_draw_image_pixman(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t tex_id, uint32_t width, uint32_t height, float x, float y);
+
+void renderer_draw_rect_pixman(struct vt_renderer_t* r, float x, float y, float w, float h, uint32_t col);
+
+void renderer_end_scene_pixman(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_end_frame_pixman(struct vt_renderer_t* r, struct vt_output_t* output,  const pixman_box32_t* damaged, int32_t n_damaged);
+
+bool renderer_destroy_pixman(struct vt_renderer_t* r);
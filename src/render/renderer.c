@@ -2,6 +2,10 @@
 
 
 #include "gl/egl_gl46.h"
+#include "pixman/pixman_sw.h"
+#ifdef VT_HAVE_VULKAN
+#include "vulkan/vk_renderer.h"
+#endif
 
 void 
 vt_renderer_implement(struct vt_renderer_t* renderer, enum vt_rendering_backend_t backend) {
@@ -23,6 +27,7 @@ vt_renderer_implement(struct vt_renderer_t* renderer, enum vt_rendering_backend_
       .set_clear_color = renderer_set_clear_color_egl,
       .begin_frame = renderer_begin_frame_egl,
       .begin_scene = renderer_begin_scene_egl,
+      .is_surface_drawable = renderer_is_surface_drawable_egl,
       .draw_surface = renderer_draw_surface_egl,
       .draw_rect = renderer_draw_rect_egl,
       .draw_image = renderer_draw_image_egl,
@@ -30,6 +35,63 @@ vt_renderer_implement(struct vt_renderer_t* renderer, enum vt_rendering_backend_
       .end_scene = renderer_end_scene_egl,
       .destroy = renderer_destroy_egl
     };
+  } else if(backend == VT_RENDERING_BACKEND_PIXMAN) {
+    renderer->impl = (struct vt_renderer_interface_t){
+      .init = renderer_init_pixman,
+      .is_handle_renderable = renderer_is_handle_renderable_pixman,
+      .query_dmabuf_formats = renderer_query_dmabuf_formats_pixman,
+      .query_dmabuf_formats_with_renderer = renderer_query_dmabuf_formats_with_renderer_pixman,
+      .setup_renderable_output = renderer_setup_renderable_output_pixman,
+      .resize_renderable_output = renderer_resize_renderable_output_pixman,
+      .destroy_renderable_output = renderer_destroy_renderable_output_pixman,
+      .import_buffer = renderer_import_buffer_pixman,
+      .destroy_surface_texture = renderer_destroy_surface_texture_pixman,
+      .drop_context = renderer_drop_context_pixman,
+      .set_vsync = renderer_set_vsync_pixman,
+      .composite_pass = renderer_composite_pass_pixman,
+      .stencil_damage_pass = renderer_stencil_damage_pass_pixman,
+      .set_clear_color = renderer_set_clear_color_pixman,
+      .begin_frame = renderer_begin_frame_pixman,
+      .begin_scene = renderer_begin_scene_pixman,
+      .is_surface_drawable = renderer_is_surface_drawable_pixman,
+      .draw_surface = renderer_draw_surface_pixman,
+      .draw_rect = renderer_draw_rect_pixman,
+      .draw_image = renderer_draw_image_pixman,
+      .end_frame = renderer_end_frame_pixman,
+      .end_scene = renderer_end_scene_pixman,
+      .destroy = renderer_destroy_pixman
+    };
+  }
+#ifdef VT_HAVE_VULKAN
+  else if(backend == VT_RENDERING_BACKEND_VULKAN) {
+    renderer->impl = (struct vt_renderer_interface_t){
+      .init = renderer_init_vk,
+      .is_handle_renderable = renderer_is_handle_renderable_vk,
+      .query_dmabuf_formats = renderer_query_dmabuf_formats_vk,
+      .query_dmabuf_formats_with_renderer = renderer_query_dmabuf_formats_with_renderer_vk,
+      .setup_renderable_output = renderer_setup_renderable_output_vk,
+      .resize_renderable_output = renderer_resize_renderable_output_vk,
+      .destroy_renderable_output = renderer_destroy_renderable_output_vk,
+      .import_buffer = renderer_import_buffer_vk,
+      .destroy_surface_texture = renderer_destroy_surface_texture_vk,
+      .drop_context = renderer_drop_context_vk,
+      .set_vsync = renderer_set_vsync_vk,
+      .composite_pass = renderer_composite_pass_vk,
+      .stencil_damage_pass = renderer_stencil_damage_pass_vk,
+      .set_clear_color = renderer_set_clear_color_vk,
+      .begin_frame = renderer_begin_frame_vk,
+      .begin_scene = renderer_begin_scene_vk,
+      .is_surface_drawable = renderer_is_surface_drawable_vk,
+      .draw_surface = renderer_draw_surface_vk,
+      .draw_rect = renderer_draw_rect_vk,
+      // Images are GL textures, which the Vulkan renderer cannot sample
+      .draw_image = NULL,
+      .end_frame = renderer_end_frame_vk,
+      .end_scene = renderer_end_scene_vk,
+      .destroy = renderer_destroy_vk
+    };
   }
+#endif
+  renderer->rendering_backend = backend;
 }
 
@@ -1,10 +1,29 @@
 #pragma once
 
 #include "../core/core_types.h"
+#include "dmabuf.h"
 #include <wayland-util.h>
 
 enum vt_rendering_backend_t {
   VT_RENDERING_BACKEND_EGL_OPENGL = 0,
+  VT_RENDERING_BACKEND_PIXMAN,
+  VT_RENDERING_BACKEND_VULKAN,
+};
+
+// Mapped XRGB8888 memory that CPU renderers present into. Backends without
+// a GPU surface point output->native_window to it and alternate 'data'
+// between two buffers from frame to frame (NULL keeps the frame offscreen).
+struct vt_renderer_cpu_target_t {
+  void* data;
+  uint32_t stride;
+};
+
+// GPU buffer for renderers without window system integration. Backends
+// point output->native_window to the buffer of the next frame, buffers keep
+// their 'id' for as long as they live so that renderers can cache imports.
+struct vt_renderer_dmabuf_target_t {
+  struct vt_dmabuf_attr_t attr;
+  uint32_t id;
 };
 
 struct vt_renderer_interface_t {
@@ -25,7 +44,11 @@ struct vt_renderer_interface_t {
   void (*composite_pass)(struct vt_renderer_t* r, struct vt_output_t* output); 
   void (*begin_scene)(struct vt_renderer_t* r, struct vt_output_t* output);
   void (*begin_frame)(struct vt_renderer_t* r, struct vt_output_t* output);
+  // Whether draw_surface can put the surface on screen this frame, 
+  // so that it may hide what is below it.
+  bool (*is_surface_drawable)(struct vt_renderer_t* r, struct vt_surface_t* surface);
   void (*draw_surface)(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y);
+  // Draws a GL texture, NULL for renderers that have no GL context
   void (*draw_image)(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t tex_id, uint32_t width, uint32_t height, float x, float y);
   void (*draw_rect)(struct vt_renderer_t* r, float x, float y, float w, float h, uint32_t col);
   void (*end_scene)(struct vt_renderer_t* r, struct vt_output_t* output);
@@ -0,0 +1,16 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D tex;
+
+// Solid rectangles sample a white texture in their color
+layout(push_constant) uniform quad_t {
+  vec4 rect;
+  vec4 color;
+} quad;
+
+layout(location = 0) in vec2 uv;
+layout(location = 0) out vec4 color;
+
+void main() {
+  color = texture(tex, uv) * quad.color;
+}
@@ -0,0 +1,36 @@
+#version 450
+
+// Must match _VK_DAMAGE_BOXES in vk_renderer.c
+#define MAX_DAMAGE_BOXES 128
+
+// Rectangle in normalized device coordinates (x, y, w, h) and the 
+// color the texture is multiplied with
+layout(push_constant) uniform quad_t {
+  vec4 rect;
+  vec4 color;
+} quad;
+
+// Damaged boxes of the frame in normalized device coordinates (x1, y1, x2, y2)
+layout(set = 0, binding = 1) uniform damage_t {
+  uint count;
+  vec4 boxes[MAX_DAMAGE_BOXES];
+} damage;
+
+layout(location = 0) out vec2 uv;
+
+void main() {
+  // Every instance draws the part of the quad inside one damaged box, 
+  // the instances past the damage collapse to an empty quad.
+  vec2 lo = quad.rect.xy, hi = quad.rect.xy;
+  if (uint(gl_InstanceIndex) < damage.count) {
+    vec4 box = damage.boxes[gl_InstanceIndex];
+    lo = max(quad.rect.xy, box.xy);
+    hi = max(lo, min(quad.rect.xy + quad.rect.zw, box.zw));
+  }
+
+  // The four corners are drawn as triangle strip
+  vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+  vec2 pos = mix(lo, hi, corner);
+  uv = (pos - quad.rect.xy) / quad.rect.zw;
+  gl_Position = vec4(pos, 0.0, 1.0);
+}
@@ -0,0 +1,2463 @@
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/dma-buf.h>
+#include <wayland-util.h>
+#include <wayland-server.h>
+
+#include "linux-explicit-synchronization-v1-server-protocol.h"
+#include "src/core/compositor.h"
+#include "src/core/surface.h"
+#include "src/core/core_types.h"
+#include "src/core/util.h"
+#include "src/protocols/linux_dmabuf.h"
+#include "src/render/dmabuf.h"
+#include "src/render/renderer.h"
+
+#include <gbm.h>
+#include <vulkan/vulkan.h>
+
+// SPIR-V of src/render/vulkan/shaders, generated at build time
+#include "quad_vert_spv.h"
+#include "quad_frag_spv.h"
+
+#include "vk_renderer.h"
+
+#define _SUBSYS_NAME "VULKAN"
+
+#define __vt_vk_fourcc_code(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+  ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define _VT_VK_DRM_FORMAT_XRGB8888 __vt_vk_fourcc_code('X', 'R', '2', '4')
+#define _VT_VK_DRM_FORMAT_ARGB8888 __vt_vk_fourcc_code('A', 'R', '2', '4')
+#define _VT_VK_DRM_FORMAT_XBGR8888 __vt_vk_fourcc_code('X', 'B', '2', '4')
+#define _VT_VK_DRM_FORMAT_ABGR8888 __vt_vk_fourcc_code('A', 'B', '2', '4')
+#define _VT_VK_DRM_FORMAT_MOD_INVALID 0x00ffffffffffffffULL
+
+// Older kernel headers lack the sync_file interop of DMABUFs
+#ifndef DMA_BUF_IOCTL_EXPORT_SYNC_FILE
+struct dma_buf_export_sync_file {
+  __u32 flags;
+  __s32 fd;
+};
+struct dma_buf_import_sync_file {
+  __u32 flags;
+  __s32 fd;
+};
+#define DMA_BUF_IOCTL_EXPORT_SYNC_FILE _IOWR(DMA_BUF_BASE, 2, struct dma_buf_export_sync_file)
+#define DMA_BUF_IOCTL_IMPORT_SYNC_FILE _IOW(DMA_BUF_BASE, 3, struct dma_buf_import_sync_file)
+#endif
+
+// Every output is rendered into B8G8R8A8 (DRM_FORMAT_XRGB8888 in memory)
+#define _VK_TARGET_FORMAT VK_FORMAT_B8G8R8A8_UNORM
+
+// Backend buffers of an output we keep imported (double buffering + 1)
+#define _VK_OUTPUT_TARGETS 3
+
+// DMABUFs of a client swapchain we keep imported per surface
+#define _VK_SURFACE_DMABUFS 4
+
+// Staging buffers of an SHM texture, an upload never waits for the previous one
+#define _VK_STAGING_BUFFERS 2
+
+// Damaged boxes a frame is drawn with, must match MAX_DAMAGE_BOXES in shaders/quad.vert
+#define _VK_DAMAGE_BOXES 128
+
+// Submissions of a render target that can be in flight at once, each 
+// one has its own damage buffer and command buffer.
+#define _VK_TARGET_SLOTS 3
+
+struct vk_format_t {
+  uint32_t drm_format;
+  VkFormat format;
+  bool has_alpha;
+};
+
+static const struct vk_format_t _vk_formats[] = {
+  { _VT_VK_DRM_FORMAT_XRGB8888, VK_FORMAT_B8G8R8A8_UNORM, false },
+  { _VT_VK_DRM_FORMAT_ARGB8888, VK_FORMAT_B8G8R8A8_UNORM, true },
+  { _VT_VK_DRM_FORMAT_XBGR8888, VK_FORMAT_R8G8B8A8_UNORM, false },
+  { _VT_VK_DRM_FORMAT_ABGR8888, VK_FORMAT_R8G8B8A8_UNORM, true },
+};
+
+// Damage buffer of a render target (std140 layout of shaders/quad.vert), 
+// boxes are x1, y1, x2, y2 in normalized device coordinates.
+struct vk_damage_ubo_t {
+  uint32_t count;
+  uint32_t _pad[3];
+  float boxes[_VK_DAMAGE_BOXES][4];
+};
+
+// Objects of a submission that can go once the timeline passed 'point'
+struct vk_garbage_t {
+  uint64_t point;
+  VkSemaphore semaphore;
+  VkCommandBuffer cb;
+  struct vk_texture_t* tex;
+};
+
+struct vk_backend_state_t {
+  VkInstance instance;
+  VkPhysicalDevice phdev;
+  VkDevice dev;
+  VkQueue queue;
+  uint32_t queue_family;
+  VkPhysicalDeviceMemoryProperties mem_props;
+
+  bool has_dmabuf_support, has_explicit_sync_support;
+
+  VkSampler sampler;
+  VkDescriptorSetLayout ds_layout;
+  VkPipelineLayout pipe_layout;
+  VkPipeline pipe;
+  VkCommandPool cmd_pool;
+
+  // 1x1 white texture solid rectangles are drawn with
+  struct vk_texture_t* white;
+
+  // Signaled with a new point by every submission, resources
+  // remember the last point they were used in.
+  VkSemaphore timeline;
+  uint64_t timeline_point;
+
+  // Signaled together with the timeline and exported as sync_file
+  // for release fences and implicitly synchronized DMABUFs
+  VkSemaphore render_done;
+
+  // SHM uploads recorded since the last submission
+  VkCommandBuffer upload_cb;
+
+  // Acquire fences the next frame waits on (array of VkSemaphore)
+  struct wl_array frame_waits;
+  // array of vk_garbage_t
+  struct wl_array garbage;
+
+  // Bumped whenever a texture is created or destroyed, command
+  // buffers recorded with an older generation are stale.
+  uint64_t generation;
+
+  // Output that is currently rendered, draw_rect() does not get it passed
+  struct vt_output_t* output;
+
+  PFN_vkGetMemoryFdPropertiesKHR get_memory_fd_properties;
+  PFN_vkGetSemaphoreFdKHR get_semaphore_fd;
+  PFN_vkImportSemaphoreFdKHR import_semaphore_fd;
+  PFN_vkCmdPushDescriptorSetKHR cmd_push_descriptor_set;
+};
+
+struct vk_texture_t {
+  VkImage image;
+  VkDeviceMemory mem;
+  VkImageView view;
+  uint32_t width, height;
+  bool has_alpha;
+  VkImageLayout layout;
+
+  // SHM: host copies of the buffer the uploads read from, taken in turns 
+  // so that a commit does not wait for the upload of the previous one.
+  VkBuffer staging[_VK_STAGING_BUFFERS];
+  VkDeviceMemory staging_mem[_VK_STAGING_BUFFERS];
+  void* staging_data[_VK_STAGING_BUFFERS];
+  uint64_t staging_points[_VK_STAGING_BUFFERS];
+  uint32_t staging_idx;
+  uint64_t upload_point;
+
+  // DMABUF: owned by the client in between frames
+  bool dmabuf;
+  // Imported buffer, identified by the inodes and the layout of its 
+  // planes (the fds of 'attr' are not kept).
+  struct vt_dmabuf_attr_t attr;
+  ino_t inos[VT_DMABUF_PLANES_CAP];
+  int32_t fd;
+  // The client synchronizes implicitly, the frame's fence is attached to the DMABUF
+  bool needs_read_fence;
+
+  uint64_t last_point;
+};
+
+// Stored in the surface's render_tex_handle
+struct vk_surface_state_t {
+  struct vk_texture_t* current;
+  struct vk_texture_t* shm;
+  struct vk_texture_t* dmabufs[_VK_SURFACE_DMABUFS];
+  uint32_t next_dmabuf;
+};
+
+struct vk_draw_op_t {
+  struct vk_texture_t* tex; // NULL for solid rectangles
+  int32_t x, y, w, h;
+  uint32_t color;
+};
+
+// The command buffer is recorded once and submitted again as long as 
+// the operations and the textures stay the same. The damage is no part 
+// of it, the draws read it from the damage buffer when they run.
+struct vk_target_slot_t {
+  VkCommandBuffer cb;
+  bool reusable;
+  struct wl_array ops;
+  uint64_t generation;
+  uint64_t point;
+
+  VkBuffer damage_buf;
+  VkDeviceMemory damage_mem;
+  struct vk_damage_ubo_t* damage_data;
+};
+
+struct vk_target_t {
+  // Backend ID of the buffer, 0 for offscreen images
+  uint32_t id;
+  VkImage image;
+  VkDeviceMemory mem;
+  VkImageView view;
+  uint32_t width, height;
+  bool dmabuf, initialized;
+  int32_t fd;
+
+  // Submissions take the slots in turns, so the damage of a frame never 
+  // overwrites the one a previous frame of the target still reads.
+  struct vk_target_slot_t slots[_VK_TARGET_SLOTS];
+  uint32_t next_slot;
+  uint64_t point;
+};
+
+struct vk_output_state_t {
+  struct vk_target_t targets[_VK_OUTPUT_TARGETS];
+  struct vk_target_t* current;
+  // Damage of the frame in progress, every draw is clipped to it
+  pixman_region32_t clip;
+  // Damage of the previous frame, backend buffers are a frame behind and miss it
+  pixman_region32_t prev_damage;
+  // Draw operations of the frame in progress (array of vk_draw_op_t)
+  struct wl_array ops;
+  // Set during the damage pass, whose draws only exist to mark the damage
+  bool discard;
+};
+
+static const char*                _vk_result_str(VkResult res);
+static const struct vk_format_t*  _vk_format_from_drm(uint32_t drm_format);
+static bool                       _vk_has_device_ext(VkPhysicalDevice phdev, const char* name);
+static bool                       _vk_create_instance(struct vt_renderer_t* r, struct vk_backend_state_t* vk);
+static bool                       _vk_native_handle_devnum(void* native_handle, dev_t* devnum);
+static VkPhysicalDevice           _vk_pick_physical_device(struct vt_renderer_t* r, struct vk_backend_state_t* vk, const dev_t* devnum);
+static bool                       _vk_create_device(struct vt_renderer_t* r, struct vk_backend_state_t* vk);
+static bool                       _vk_create_pipeline(struct vt_renderer_t* r, struct vk_backend_state_t* vk);
+static int32_t                    _vk_find_memory_type(struct vk_backend_state_t* vk, uint32_t type_bits, VkMemoryPropertyFlags flags);
+static VkImageView                _vk_create_view(struct vk_backend_state_t* vk, VkImage image, VkFormat format, bool has_alpha);
+static bool                       _vk_import_dmabuf_image(struct vt_renderer_t* r, const struct vt_dmabuf_attr_t* attr, VkImageUsageFlags usage, VkImage* image, VkDeviceMemory* mem);
+static void                       _vk_wait_point(struct vk_backend_state_t* vk, uint64_t point);
+static void                       _vk_collect_garbage(struct vk_backend_state_t* vk, bool all);
+static uint64_t                   _vk_submit(struct vt_renderer_t* r, VkCommandBuffer cb, bool signal_render_done);
+static bool                       _vk_begin_uploads(struct vt_renderer_t* r);
+static bool                       _vk_wait_sync_file(struct vk_backend_state_t* vk, int32_t fd);
+static int32_t                    _vk_dmabuf_export_sync_file(int32_t dmabuf_fd, uint32_t flags);
+static bool                       _vk_dmabuf_import_sync_file(int32_t dmabuf_fd, uint32_t flags, int32_t sync_fd);
+static void                       _vk_texture_free(struct vk_backend_state_t* vk, struct vk_texture_t* tex);
+static void                       _vk_texture_destroy(struct vt_renderer_t* r, struct vk_texture_t* tex);
+static bool                       _vk_create_white_texture(struct vt_renderer_t* r, struct vk_backend_state_t* vk);
+static struct vk_surface_state_t* _vk_surface_state(struct vt_surface_t* surf);
+static bool                       _vk_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t* surf, struct wl_shm_buffer* shm_buf);
+static bool                       _vk_dmabuf_texture_matches(const struct vk_texture_t* tex, const struct vt_dmabuf_attr_t* attr, const ino_t* inos);
+static bool                       _vk_import_buffer_dmabuf(struct vt_renderer_t* r, struct vt_surface_t* surf, struct vt_linux_dmabuf_v1_buffer_t* dmabuf);
+static bool                       _vk_target_init(struct vt_renderer_t* r, struct vk_target_t* target, const struct vt_dmabuf_attr_t* attr, uint32_t width, uint32_t height);
+static void                       _vk_target_destroy(struct vt_renderer_t* r, struct vk_target_t* target);
+static bool                       _vk_target_slot_init(struct vt_renderer_t* r, struct vk_target_slot_t* slot);
+static void                       _vk_target_slot_destroy(struct vk_backend_state_t* vk, struct vk_target_slot_t* slot);
+static struct vk_target_t*        _vk_target_from_native(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_renderer_dmabuf_target_t* native);
+static void                       _vk_push_op(struct vk_output_state_t* vk_output, struct vk_texture_t* tex, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+static void                       _vk_write_target_damage(struct vk_target_t* target, struct vk_target_slot_t* slot, pixman_region32_t* damage);
+static void                       _vk_record_target(struct vt_renderer_t* r, struct vk_target_t* target, struct vk_target_slot_t* slot, const struct wl_array* ops);
+static void                       _vk_send_surface_release_fences(struct vt_renderer_t* r, struct vt_output_t* output, int32_t fence_fd);
+
+const char*
+_vk_result_str(VkResult res) {
+  switch (res) {
+    case VK_SUCCESS:                        return "VK_SUCCESS";
+    case VK_NOT_READY:                      return "VK_NOT_READY";
+    case VK_TIMEOUT:                        return "VK_TIMEOUT";
+    case VK_ERROR_OUT_OF_HOST_MEMORY:       return "VK_ERROR_OUT_OF_HOST_MEMORY";
+    case VK_ERROR_OUT_OF_DEVICE_MEMORY:     return "VK_ERROR_OUT_OF_DEVICE_MEMORY";
+    case VK_ERROR_INITIALIZATION_FAILED:    return "VK_ERROR_INITIALIZATION_FAILED";
+    case VK_ERROR_DEVICE_LOST:              return "VK_ERROR_DEVICE_LOST";
+    case VK_ERROR_LAYER_NOT_PRESENT:        return "VK_ERROR_LAYER_NOT_PRESENT";
+    case VK_ERROR_EXTENSION_NOT_PRESENT:    return "VK_ERROR_EXTENSION_NOT_PRESENT";
+    case VK_ERROR_FEATURE_NOT_PRESENT:      return "VK_ERROR_FEATURE_NOT_PRESENT";
+    case VK_ERROR_INCOMPATIBLE_DRIVER:      return "VK_ERROR_INCOMPATIBLE_DRIVER";
+    case VK_ERROR_FORMAT_NOT_SUPPORTED:     return "VK_ERROR_FORMAT_NOT_SUPPORTED";
+    case VK_ERROR_INVALID_EXTERNAL_HANDLE:  return "VK_ERROR_INVALID_EXTERNAL_HANDLE";
+    default:                                return "Unknown Vulkan error";
+  }
+}
+
+const struct vk_format_t*
+_vk_format_from_drm(uint32_t drm_format) {
+  for (size_t i = 0; i < sizeof(_vk_formats) / sizeof(_vk_formats[0]); i++) {
+    if (_vk_formats[i].drm_format == drm_format) return &_vk_formats[i];
+  }
+  return NULL;
+}
+
+bool
+_vk_has_device_ext(VkPhysicalDevice phdev, const char* name) {
+  uint32_t n_exts = 0;
+  vkEnumerateDeviceExtensionProperties(phdev, NULL, &n_exts, NULL);
+  if (!n_exts) return false;
+
+  VkExtensionProperties* exts = calloc(n_exts, sizeof(*exts));
+  if (!exts) return false;
+  vkEnumerateDeviceExtensionProperties(phdev, NULL, &n_exts, exts);
+
+  bool found = false;
+  for (uint32_t i = 0; i < n_exts && !found; i++) {
+    found = strcmp(exts[i].extensionName, name) == 0;
+  }
+  free(exts);
+  return found;
+}
+
+bool
+_vk_create_instance(struct vt_renderer_t* r, struct vk_backend_state_t* vk) {
+  VkApplicationInfo app = {
+    .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+    .pApplicationName = "vortex",
+    .apiVersion = VK_API_VERSION_1_3,
+  };
+
+  // VT_VK_VALIDATION=1 runs the renderer against the Khronos validation layer
+  const char* layers[] = { "VK_LAYER_KHRONOS_validation" };
+  const char* validation = getenv("VT_VK_VALIDATION");
+  bool validate = validation && strcmp(validation, "0") != 0;
+
+  VkInstanceCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+    .pApplicationInfo = &app,
+    .enabledLayerCount = validate ? 1 : 0,
+    .ppEnabledLayerNames = layers,
+  };
+
+  VkResult res = vkCreateInstance(&info, NULL, &vk->instance);
+  if (res != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan instance: %s.", _vk_result_str(res));
+    vk->instance = VK_NULL_HANDLE;
+    return false;
+  }
+  return true;
+}
+
+bool
+_vk_native_handle_devnum(void* native_handle, dev_t* devnum) {
+  if (!native_handle) return false;
+  struct stat st;
+  if (fstat(gbm_device_get_fd((struct gbm_device*)native_handle), &st) != 0) return false;
+  *devnum = st.st_rdev;
+  return true;
+}
+
+VkPhysicalDevice
+_vk_pick_physical_device(struct vt_renderer_t* r, struct vk_backend_state_t* vk, const dev_t* devnum) {
+  uint32_t n_devs = 0;
+  vkEnumeratePhysicalDevices(vk->instance, &n_devs, NULL);
+  if (!n_devs) {
+    VT_ERROR(r->comp->log, "No Vulkan physical devices available.");
+    return VK_NULL_HANDLE;
+  }
+  VkPhysicalDevice devs[n_devs];
+  vkEnumeratePhysicalDevices(vk->instance, &n_devs, devs);
+
+  VkPhysicalDevice best = VK_NULL_HANDLE;
+  int32_t best_score = -1;
+  for (uint32_t i = 0; i < n_devs; i++) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(devs[i], &props);
+    if (props.apiVersion < VK_API_VERSION_1_3) continue;
+    if (!_vk_has_device_ext(devs[i], VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME)) continue;
+
+    // DRM devices need the Vulkan device behind the same node
+    if (devnum) {
+      if (!_vk_has_device_ext(devs[i], VK_EXT_PHYSICAL_DEVICE_DRM_EXTENSION_NAME)) continue;
+      VkPhysicalDeviceDrmPropertiesEXT drm_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DRM_PROPERTIES_EXT,
+      };
+      VkPhysicalDeviceProperties2 props2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &drm_props,
+      };
+      vkGetPhysicalDeviceProperties2(devs[i], &props2);
+      bool primary = drm_props.hasPrimary &&
+        makedev(drm_props.primaryMajor, drm_props.primaryMinor) == *devnum;
+      bool render = drm_props.hasRender &&
+        makedev(drm_props.renderMajor, drm_props.renderMinor) == *devnum;
+      if (!primary && !render) continue;
+      VT_TRACE(r->comp->log, "Using Vulkan device '%s' for DRM device %u:%u.",
+               props.deviceName, major(*devnum), minor(*devnum));
+      return devs[i];
+    }
+
+    // Without a device to match, hardware wins over CPU implementations (lavapipe)
+    int32_t score = 0;
+    switch (props.deviceType) {
+      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   score = 3; break;
+      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score = 2; break;
+      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    score = 1; break;
+      default: break;
+    }
+    if (score > best_score) {
+      best_score = score;
+      best = devs[i];
+    }
+  }
+
+  if (best) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(best, &props);
+    VT_TRACE(r->comp->log, "Using Vulkan device '%s'.", props.deviceName);
+  }
+  return best;
+}
+
+bool
+_vk_create_device(struct vt_renderer_t* r, struct vk_backend_state_t* vk) {
+  vkGetPhysicalDeviceMemoryProperties(vk->phdev, &vk->mem_props);
+
+  uint32_t n_families = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(vk->phdev, &n_families, NULL);
+  VkQueueFamilyProperties families[n_families ? n_families : 1];
+  vkGetPhysicalDeviceQueueFamilyProperties(vk->phdev, &n_families, families);
+  vk->queue_family = UINT32_MAX;
+  for (uint32_t i = 0; i < n_families; i++) {
+    if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      vk->queue_family = i;
+      break;
+    }
+  }
+  if (vk->queue_family == UINT32_MAX) {
+    VT_ERROR(r->comp->log, "Vulkan device has no graphics queue.");
+    return false;
+  }
+
+  VkPhysicalDeviceVulkan13Features features13 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+  };
+  VkPhysicalDeviceVulkan12Features features12 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .pNext = &features13,
+  };
+  VkPhysicalDeviceFeatures2 features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &features12,
+  };
+  vkGetPhysicalDeviceFeatures2(vk->phdev, &features);
+  if (!features12.timelineSemaphore || !features13.synchronization2 || !features13.dynamicRendering) {
+    VT_ERROR(r->comp->log, "Vulkan device lacks timeline semaphores, synchronization2 or dynamic rendering.");
+    return false;
+  }
+
+  const char* exts[8];
+  uint32_t n_exts = 0;
+  exts[n_exts++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+
+  // DMABUF import (clients and KMS buffers)
+  const char* dmabuf_exts[] = {
+    VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+    VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+    VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+    VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME,
+  };
+  vk->has_dmabuf_support = true;
+  for (size_t i = 0; i < sizeof(dmabuf_exts) / sizeof(dmabuf_exts[0]); i++) {
+    vk->has_dmabuf_support &= _vk_has_device_ext(vk->phdev, dmabuf_exts[i]);
+  }
+  if (vk->has_dmabuf_support) {
+    for (size_t i = 0; i < sizeof(dmabuf_exts) / sizeof(dmabuf_exts[0]); i++) {
+      exts[n_exts++] = dmabuf_exts[i];
+    }
+  }
+
+  // Fences are passed around as sync_files
+  vk->has_explicit_sync_support = false;
+  if (_vk_has_device_ext(vk->phdev, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME)) {
+    VkPhysicalDeviceExternalSemaphoreInfo sem_info = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO,
+      .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    };
+    VkExternalSemaphoreProperties sem_props = {
+      .sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES,
+    };
+    vkGetPhysicalDeviceExternalSemaphoreProperties(vk->phdev, &sem_info, &sem_props);
+    const VkExternalSemaphoreFeatureFlags want =
+      VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT | VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT;
+    vk->has_explicit_sync_support = (sem_props.externalSemaphoreFeatures & want) == want;
+    if (vk->has_explicit_sync_support) exts[n_exts++] = VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME;
+  }
+
+  VkPhysicalDeviceVulkan13Features enable13 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+    .synchronization2 = VK_TRUE,
+    .dynamicRendering = VK_TRUE,
+  };
+  VkPhysicalDeviceVulkan12Features enable12 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .pNext = &enable13,
+    .timelineSemaphore = VK_TRUE,
+  };
+  const float priority = 1.0f;
+  VkDeviceQueueCreateInfo queue_info = {
+    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+    .queueFamilyIndex = vk->queue_family,
+    .queueCount = 1,
+    .pQueuePriorities = &priority,
+  };
+  VkDeviceCreateInfo dev_info = {
+    .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    .pNext = &enable12,
+    .queueCreateInfoCount = 1,
+    .pQueueCreateInfos = &queue_info,
+    .enabledExtensionCount = n_exts,
+    .ppEnabledExtensionNames = exts,
+  };
+  VkResult res = vkCreateDevice(vk->phdev, &dev_info, NULL, &vk->dev);
+  if (res != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan device: %s.", _vk_result_str(res));
+    vk->dev = VK_NULL_HANDLE;
+    return false;
+  }
+  vkGetDeviceQueue(vk->dev, vk->queue_family, 0, &vk->queue);
+
+  vk->cmd_push_descriptor_set = (PFN_vkCmdPushDescriptorSetKHR)
+    vkGetDeviceProcAddr(vk->dev, "vkCmdPushDescriptorSetKHR");
+  if (vk->has_dmabuf_support) {
+    vk->get_memory_fd_properties = (PFN_vkGetMemoryFdPropertiesKHR)
+      vkGetDeviceProcAddr(vk->dev, "vkGetMemoryFdPropertiesKHR");
+  }
+  if (vk->has_explicit_sync_support) {
+    vk->get_semaphore_fd = (PFN_vkGetSemaphoreFdKHR)
+      vkGetDeviceProcAddr(vk->dev, "vkGetSemaphoreFdKHR");
+    vk->import_semaphore_fd = (PFN_vkImportSemaphoreFdKHR)
+      vkGetDeviceProcAddr(vk->dev, "vkImportSemaphoreFdKHR");
+  }
+
+  VkCommandPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    .queueFamilyIndex = vk->queue_family,
+  };
+  if (vkCreateCommandPool(vk->dev, &pool_info, NULL, &vk->cmd_pool) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan command pool.");
+    return false;
+  }
+
+  VkSemaphoreTypeCreateInfo timeline_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo sem_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &timeline_info,
+  };
+  if (vkCreateSemaphore(vk->dev, &sem_info, NULL, &vk->timeline) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan timeline semaphore.");
+    return false;
+  }
+
+  if (vk->has_explicit_sync_support) {
+    VkExportSemaphoreCreateInfo export_info = {
+      .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+      .handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    };
+    VkSemaphoreCreateInfo done_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &export_info,
+    };
+    if (vkCreateSemaphore(vk->dev, &done_info, NULL, &vk->render_done) != VK_SUCCESS) {
+      VT_WARN(r->comp->log, "Cannot create exportable Vulkan semaphore, disabling explicit sync.");
+      vk->has_explicit_sync_support = false;
+    }
+  }
+
+  return true;
+}
+
+bool
+_vk_create_pipeline(struct vt_renderer_t* r, struct vk_backend_state_t* vk) {
+  VkSamplerCreateInfo sampler_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter = VK_FILTER_LINEAR,
+    .minFilter = VK_FILTER_LINEAR,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .maxLod = 0.25f,
+  };
+  if (vkCreateSampler(vk->dev, &sampler_info, NULL, &vk->sampler) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan sampler.");
+    return false;
+  }
+
+  // Textures and the damage buffer are pushed right into the command 
+  // buffer, no descriptor pool needed.
+  VkDescriptorSetLayoutBinding bindings[] = {
+    {
+      .binding = 0,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .pImmutableSamplers = &vk->sampler,
+    },
+    {
+      .binding = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+    },
+  };
+  VkDescriptorSetLayoutCreateInfo ds_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR,
+    .bindingCount = 2,
+    .pBindings = bindings,
+  };
+  if (vkCreateDescriptorSetLayout(vk->dev, &ds_info, NULL, &vk->ds_layout) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan descriptor set layout.");
+    return false;
+  }
+
+  // Rectangle of the quad and the color its texture is multiplied with
+  VkPushConstantRange push_range = {
+    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    .offset = 0,
+    .size = sizeof(float) * 8,
+  };
+  VkPipelineLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &vk->ds_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_range,
+  };
+  if (vkCreatePipelineLayout(vk->dev, &layout_info, NULL, &vk->pipe_layout) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan pipeline layout.");
+    return false;
+  }
+
+  VkShaderModule vert = VK_NULL_HANDLE, frag = VK_NULL_HANDLE;
+  VkShaderModuleCreateInfo vert_info = {
+    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+    .codeSize = sizeof(vt_vk_quad_vert_spv),
+    .pCode = vt_vk_quad_vert_spv,
+  };
+  VkShaderModuleCreateInfo frag_info = {
+    .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+    .codeSize = sizeof(vt_vk_quad_frag_spv),
+    .pCode = vt_vk_quad_frag_spv,
+  };
+  if (vkCreateShaderModule(vk->dev, &vert_info, NULL, &vert) != VK_SUCCESS ||
+    vkCreateShaderModule(vk->dev, &frag_info, NULL, &frag) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan shader modules.");
+    vkDestroyShaderModule(vk->dev, vert, NULL);
+    return false;
+  }
+
+  VkPipelineShaderStageCreateInfo stages[] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_VERTEX_BIT,
+      .module = vert,
+      .pName = "main",
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .module = frag,
+      .pName = "main",
+    },
+  };
+  VkPipelineVertexInputStateCreateInfo vertex_input = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+  };
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+  };
+  VkPipelineViewportStateCreateInfo viewport = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+    .viewportCount = 1,
+    .scissorCount = 1,
+  };
+  VkPipelineRasterizationStateCreateInfo raster = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+    .polygonMode = VK_POLYGON_MODE_FILL,
+    .cullMode = VK_CULL_MODE_NONE,
+    .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+    .lineWidth = 1.0f,
+  };
+  VkPipelineMultisampleStateCreateInfo multisample = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+  };
+  // Client buffers are premultiplied
+  VkPipelineColorBlendAttachmentState blend_attachment = {
+    .blendEnable = VK_TRUE,
+    .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+    .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+    .colorBlendOp = VK_BLEND_OP_ADD,
+    .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+    .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+    .alphaBlendOp = VK_BLEND_OP_ADD,
+    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+  };
+  VkPipelineColorBlendStateCreateInfo blend = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+    .attachmentCount = 1,
+    .pAttachments = &blend_attachment,
+  };
+  VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  VkPipelineDynamicStateCreateInfo dynamic = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+    .dynamicStateCount = 2,
+    .pDynamicStates = dynamic_states,
+  };
+  VkFormat color_format = _VK_TARGET_FORMAT;
+  VkPipelineRenderingCreateInfo rendering = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &color_format,
+  };
+  VkGraphicsPipelineCreateInfo pipe_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+    .pNext = &rendering,
+    .stageCount = 2,
+    .pStages = stages,
+    .pVertexInputState = &vertex_input,
+    .pInputAssemblyState = &input_assembly,
+    .pViewportState = &viewport,
+    .pRasterizationState = &raster,
+    .pMultisampleState = &multisample,
+    .pColorBlendState = &blend,
+    .pDynamicState = &dynamic,
+    .layout = vk->pipe_layout,
+  };
+  VkResult res = vkCreateGraphicsPipelines(vk->dev, VK_NULL_HANDLE, 1, &pipe_info, NULL, &vk->pipe);
+
+  vkDestroyShaderModule(vk->dev, vert, NULL);
+  vkDestroyShaderModule(vk->dev, frag, NULL);
+
+  if (res != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot create Vulkan pipeline: %s.", _vk_result_str(res));
+    vk->pipe = VK_NULL_HANDLE;
+    return false;
+  }
+  return true;
+}
+
+int32_t
+_vk_find_memory_type(struct vk_backend_state_t* vk, uint32_t type_bits, VkMemoryPropertyFlags flags) {
+  for (uint32_t i = 0; i < vk->mem_props.memoryTypeCount; i++) {
+    if (!(type_bits & (1u << i))) continue;
+    if ((vk->mem_props.memoryTypes[i].propertyFlags & flags) == flags) return (int32_t)i;
+  }
+  return -1;
+}
+
+VkImageView
+_vk_create_view(struct vk_backend_state_t* vk, VkImage image, VkFormat format, bool has_alpha) {
+  // X formats have undefined alpha bits, the view reads them as opaque
+  VkImageViewCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .image = image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = format,
+    .components = {
+      .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .a = has_alpha ? VK_COMPONENT_SWIZZLE_IDENTITY : VK_COMPONENT_SWIZZLE_ONE,
+    },
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = 1,
+      .layerCount = 1,
+    },
+  };
+  VkImageView view = VK_NULL_HANDLE;
+  if (vkCreateImageView(vk->dev, &info, NULL, &view) != VK_SUCCESS) return VK_NULL_HANDLE;
+  return view;
+}
+
+bool
+_vk_import_dmabuf_image(struct vt_renderer_t* r, const struct vt_dmabuf_attr_t* attr,
+                        VkImageUsageFlags usage, VkImage* image, VkDeviceMemory* mem) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  *image = VK_NULL_HANDLE;
+  *mem = VK_NULL_HANDLE;
+
+  const struct vk_format_t* fmt = _vk_format_from_drm(attr->format);
+  if (!fmt) {
+    VT_WARN(r->comp->log, "Cannot import DMABUF of unsupported format 0x%08x.", attr->format);
+    return false;
+  }
+  if (attr->mod == _VT_VK_DRM_FORMAT_MOD_INVALID) {
+    VT_WARN(r->comp->log, "Cannot import DMABUF without explicit modifier.");
+    return false;
+  }
+  if (attr->num_planes < 1 || attr->num_planes > VT_DMABUF_PLANES_CAP) return false;
+
+  // Disjoint planes would need one allocation per plane
+  for (int32_t i = 1; i < attr->num_planes; i++) {
+    if (attr->fds[i] != attr->fds[0]) {
+      VT_WARN(r->comp->log, "Cannot import disjoint multi-planar DMABUF.");
+      return false;
+    }
+  }
+
+  VkSubresourceLayout planes[VT_DMABUF_PLANES_CAP] = {0};
+  for (int32_t i = 0; i < attr->num_planes; i++) {
+    planes[i].offset = attr->offsets[i];
+    planes[i].rowPitch = attr->strides[i];
+  }
+  VkImageDrmFormatModifierExplicitCreateInfoEXT mod_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+    .drmFormatModifier = attr->mod,
+    .drmFormatModifierPlaneCount = (uint32_t)attr->num_planes,
+    .pPlaneLayouts = planes,
+  };
+  VkExternalMemoryImageCreateInfo external_info = {
+    .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+    .pNext = &mod_info,
+    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+  };
+  VkImageCreateInfo image_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .pNext = &external_info,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = fmt->format,
+    .extent = { (uint32_t)attr->width, (uint32_t)attr->height, 1 },
+    .mipLevels = 1,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+    .usage = usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  VkResult res = vkCreateImage(vk->dev, &image_info, NULL, image);
+  if (res != VK_SUCCESS) {
+    VT_WARN(r->comp->log, "Cannot create image for DMABUF (format 0x%08x, modifier 0x%016lx): %s.",
+            attr->format, attr->mod, _vk_result_str(res));
+    *image = VK_NULL_HANDLE;
+    return false;
+  }
+
+  VkMemoryFdPropertiesKHR fd_props = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR,
+  };
+  if (vk->get_memory_fd_properties(vk->dev, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+                                   attr->fds[0], &fd_props) != VK_SUCCESS) {
+    VT_WARN(r->comp->log, "Cannot query memory properties of DMABUF.");
+    goto fail;
+  }
+
+  VkMemoryRequirements reqs;
+  vkGetImageMemoryRequirements(vk->dev, *image, &reqs);
+  int32_t type = _vk_find_memory_type(vk, reqs.memoryTypeBits & fd_props.memoryTypeBits, 0);
+  if (type < 0) {
+    VT_WARN(r->comp->log, "No memory type to import DMABUF into.");
+    goto fail;
+  }
+
+  // Vulkan owns the fd once the import succeeded
+  int32_t fd = fcntl(attr->fds[0], F_DUPFD_CLOEXEC, 0);
+  if (fd < 0) {
+    VT_WARN(r->comp->log, "Cannot duplicate DMABUF fd: %s.", strerror(errno));
+    goto fail;
+  }
+  VkImportMemoryFdInfoKHR import_info = {
+    .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+    .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+    .fd = fd,
+  };
+  VkMemoryDedicatedAllocateInfo dedicated_info = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+    .pNext = &import_info,
+    .image = *image,
+  };
+  VkMemoryAllocateInfo alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext = &dedicated_info,
+    .allocationSize = reqs.size,
+    .memoryTypeIndex = (uint32_t)type,
+  };
+  if ((res = vkAllocateMemory(vk->dev, &alloc_info, NULL, mem)) != VK_SUCCESS) {
+    VT_WARN(r->comp->log, "Cannot import DMABUF memory: %s.", _vk_result_str(res));
+    close(fd);
+    *mem = VK_NULL_HANDLE;
+    goto fail;
+  }
+  if (vkBindImageMemory(vk->dev, *image, *mem, 0) != VK_SUCCESS) {
+    VT_WARN(r->comp->log, "Cannot bind DMABUF memory.");
+    goto fail;
+  }
+  return true;
+
+fail:
+  vkFreeMemory(vk->dev, *mem, NULL);
+  vkDestroyImage(vk->dev, *image, NULL);
+  *image = VK_NULL_HANDLE;
+  *mem = VK_NULL_HANDLE;
+  return false;
+}
+
+void
+_vk_wait_point(struct vk_backend_state_t* vk, uint64_t point) {
+  if (!point) return;
+  VkSemaphoreWaitInfo info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    .semaphoreCount = 1,
+    .pSemaphores = &vk->timeline,
+    .pValues = &point,
+  };
+  vkWaitSemaphores(vk->dev, &info, UINT64_MAX);
+}
+
+void
+_vk_collect_garbage(struct vk_backend_state_t* vk, bool all) {
+  uint64_t done = 0;
+  if (all) {
+    vkDeviceWaitIdle(vk->dev);
+    done = UINT64_MAX;
+  } else {
+    vkGetSemaphoreCounterValue(vk->dev, vk->timeline, &done);
+  }
+
+  struct vk_garbage_t* items = vk->garbage.data;
+  size_t n = vk->garbage.size / sizeof(*items), kept = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (items[i].point > done) {
+      items[kept++] = items[i];
+      continue;
+    }
+    vkDestroySemaphore(vk->dev, items[i].semaphore, NULL);
+    if (items[i].cb) vkFreeCommandBuffers(vk->dev, vk->cmd_pool, 1, &items[i].cb);
+    if (items[i].tex) _vk_texture_free(vk, items[i].tex);
+  }
+  vk->garbage.size = kept * sizeof(*items);
+}
+
+uint64_t
+_vk_submit(struct vt_renderer_t* r, VkCommandBuffer cb, bool signal_render_done) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+
+  VkCommandBuffer cbs[2];
+  uint32_t n_cbs = 0;
+  if (vk->upload_cb) {
+    vkEndCommandBuffer(vk->upload_cb);
+    cbs[n_cbs++] = vk->upload_cb;
+  }
+  if (cb) cbs[n_cbs++] = cb;
+  if (!n_cbs) return vk->timeline_point;
+
+  // Acquire fences only gate frames, uploads never read client DMABUFs
+  VkSemaphore* waits = cb ? vk->frame_waits.data : NULL;
+  uint32_t n_waits = cb ? vk->frame_waits.size / sizeof(VkSemaphore) : 0;
+  VkPipelineStageFlags wait_stages[n_waits ? n_waits : 1];
+  for (uint32_t i = 0; i < n_waits; i++) {
+    wait_stages[i] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  }
+
+  const uint64_t point = vk->timeline_point + 1;
+  VkSemaphore signals[2] = { vk->timeline, vk->render_done };
+  uint64_t values[2] = { point, 0 };
+  uint32_t n_signals = signal_render_done ? 2 : 1;
+
+  VkTimelineSemaphoreSubmitInfo timeline_info = {
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .signalSemaphoreValueCount = n_signals,
+    .pSignalSemaphoreValues = values,
+  };
+  VkSubmitInfo submit = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext = &timeline_info,
+    .waitSemaphoreCount = n_waits,
+    .pWaitSemaphores = waits,
+    .pWaitDstStageMask = wait_stages,
+    .commandBufferCount = n_cbs,
+    .pCommandBuffers = cbs,
+    .signalSemaphoreCount = n_signals,
+    .pSignalSemaphores = signals,
+  };
+  VkResult res = vkQueueSubmit(vk->queue, 1, &submit, VK_NULL_HANDLE);
+  if (res != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot submit to Vulkan queue: %s.", _vk_result_str(res));
+  }
+
+  // The semaphores and the upload commands live as long as the submission
+  uint64_t release_point = res == VK_SUCCESS ? point : 0;
+  for (uint32_t i = 0; i < n_waits; i++) {
+    struct vk_garbage_t* g = wl_array_add(&vk->garbage, sizeof(*g));
+    if (g) *g = (struct vk_garbage_t){ .point = release_point, .semaphore = waits[i] };
+  }
+  if (n_waits) vk->frame_waits.size = 0;
+  if (vk->upload_cb) {
+    struct vk_garbage_t* g = wl_array_add(&vk->garbage, sizeof(*g));
+    if (g) *g = (struct vk_garbage_t){ .point = release_point, .cb = vk->upload_cb };
+    vk->upload_cb = VK_NULL_HANDLE;
+  }
+
+  if (res != VK_SUCCESS) return 0;
+  vk->timeline_point = point;
+  return point;
+}
+
+bool
+_vk_begin_uploads(struct vt_renderer_t* r) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  if (vk->upload_cb) return true;
+
+  VkCommandBufferAllocateInfo alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool = vk->cmd_pool,
+    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  if (vkAllocateCommandBuffers(vk->dev, &alloc_info, &vk->upload_cb) != VK_SUCCESS) {
+    VT_ERROR(r->comp->log, "Cannot allocate Vulkan upload command buffer.");
+    vk->upload_cb = VK_NULL_HANDLE;
+    return false;
+  }
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(vk->upload_cb, &begin_info);
+  return true;
+}
+
+bool
+_vk_wait_sync_file(struct vk_backend_state_t* vk, int32_t fd) {
+  // sync_files can only be imported into binary semaphores
+  VkSemaphoreCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+  VkSemaphore semaphore;
+  if (vkCreateSemaphore(vk->dev, &info, NULL, &semaphore) != VK_SUCCESS) return false;
+
+  VkImportSemaphoreFdInfoKHR import_info = {
+    .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+    .semaphore = semaphore,
+    .flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT,
+    .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    .fd = fd,
+  };
+  if (vk->import_semaphore_fd(vk->dev, &import_info) != VK_SUCCESS) {
+    vkDestroySemaphore(vk->dev, semaphore, NULL);
+    return false;
+  }
+
+  VkSemaphore* wait = wl_array_add(&vk->frame_waits, sizeof(*wait));
+  if (!wait) {
+    vkDestroySemaphore(vk->dev, semaphore, NULL);
+    return true;
+  }
+  *wait = semaphore;
+  return true;
+}
+
+int32_t
+_vk_dmabuf_export_sync_file(int32_t dmabuf_fd, uint32_t flags) {
+  struct dma_buf_export_sync_file data = { .flags = flags, .fd = -1 };
+  int ret;
+  do {
+    ret = ioctl(dmabuf_fd, DMA_BUF_IOCTL_EXPORT_SYNC_FILE, &data);
+  } while (ret != 0 && (errno == EINTR || errno == EAGAIN));
+  return ret == 0 ? data.fd : -1;
+}
+
+bool
+_vk_dmabuf_import_sync_file(int32_t dmabuf_fd, uint32_t flags, int32_t sync_fd) {
+  struct dma_buf_import_sync_file data = { .flags = flags, .fd = sync_fd };
+  int ret;
+  do {
+    ret = ioctl(dmabuf_fd, DMA_BUF_IOCTL_IMPORT_SYNC_FILE, &data);
+  } while (ret != 0 && (errno == EINTR || errno == EAGAIN));
+  return ret == 0;
+}
+
+void
+_vk_texture_free(struct vk_backend_state_t* vk, struct vk_texture_t* tex) {
+  if (!tex) return;
+  vkDestroyImageView(vk->dev, tex->view, NULL);
+  vkDestroyImage(vk->dev, tex->image, NULL);
+  vkFreeMemory(vk->dev, tex->mem, NULL);
+  for (uint32_t i = 0; i < _VK_STAGING_BUFFERS; i++) {
+    if (tex->staging_data[i]) vkUnmapMemory(vk->dev, tex->staging_mem[i]);
+    vkDestroyBuffer(vk->dev, tex->staging[i], NULL);
+    vkFreeMemory(vk->dev, tex->staging_mem[i], NULL);
+  }
+  if (tex->fd >= 0) close(tex->fd);
+  free(tex);
+}
+
+void
+_vk_texture_destroy(struct vt_renderer_t* r, struct vk_texture_t* tex) {
+  if (!tex) return;
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  vk->generation++;
+
+  // A texture the GPU still reads from or uploads into goes with the 
+  // garbage of that submission instead of being waited for.
+  uint64_t point = tex->last_point > tex->upload_point ? tex->last_point : tex->upload_point;
+  uint64_t done = 0;
+  vkGetSemaphoreCounterValue(vk->dev, vk->timeline, &done);
+  if (point > done) {
+    struct vk_garbage_t* g = wl_array_add(&vk->garbage, sizeof(*g));
+    if (g) {
+      *g = (struct vk_garbage_t){ .point = point, .tex = tex };
+      return;
+    }
+    // Pending uploads into the texture have to be submitted before it can go
+    if (tex->upload_point > vk->timeline_point) _vk_submit(r, VK_NULL_HANDLE, false);
+    _vk_wait_point(vk, point);
+  }
+  _vk_texture_free(vk, tex);
+}
+
+bool
+_vk_create_white_texture(struct vt_renderer_t* r, struct vk_backend_state_t* vk) {
+  struct vk_texture_t* tex = calloc(1, sizeof(*tex));
+  if (!tex) return false;
+  tex->fd = -1;
+  tex->width = 1;
+  tex->height = 1;
+  tex->has_alpha = true;
+
+  VkImageCreateInfo image_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = VK_FORMAT_B8G8R8A8_UNORM,
+    .extent = { 1, 1, 1 },
+    .mipLevels = 1,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  if (vkCreateImage(vk->dev, &image_info, NULL, &tex->image) != VK_SUCCESS) {
+    tex->image = VK_NULL_HANDLE;
+    goto fail;
+  }
+  VkMemoryRequirements reqs;
+  vkGetImageMemoryRequirements(vk->dev, tex->image, &reqs);
+  int32_t type = _vk_find_memory_type(vk, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VkMemoryAllocateInfo alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize = reqs.size,
+    .memoryTypeIndex = (uint32_t)type,
+  };
+  if (type < 0 || vkAllocateMemory(vk->dev, &alloc_info, NULL, &tex->mem) != VK_SUCCESS ||
+    vkBindImageMemory(vk->dev, tex->image, tex->mem, 0) != VK_SUCCESS ||
+    !(tex->view = _vk_create_view(vk, tex->image, VK_FORMAT_B8G8R8A8_UNORM, true)) ||
+    !_vk_begin_uploads(r)) {
+    goto fail;
+  }
+
+  // Cleared along with the first uploads, it is never written again
+  VkImageMemoryBarrier2 to_transfer = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+    .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+    .dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+    .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = tex->image,
+    .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+  };
+  VkDependencyInfo dep = {
+    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &to_transfer,
+  };
+  vkCmdPipelineBarrier2(vk->upload_cb, &dep);
+
+  VkClearColorValue white = { .float32 = { 1.0f, 1.0f, 1.0f, 1.0f } };
+  VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  vkCmdClearColorImage(vk->upload_cb, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &white, 1, &range);
+
+  VkImageMemoryBarrier2 to_sampled = to_transfer;
+  to_sampled.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+  to_sampled.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  to_sampled.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+  to_sampled.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+  to_sampled.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  to_sampled.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  dep.pImageMemoryBarriers = &to_sampled;
+  vkCmdPipelineBarrier2(vk->upload_cb, &dep);
+
+  tex->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  tex->upload_point = vk->timeline_point + 1;
+  vk->white = tex;
+  return true;
+
+fail:
+  VT_ERROR(r->comp->log, "Cannot create Vulkan texture for solid rectangles.");
+  _vk_texture_free(vk, tex);
+  return false;
+}
+
+struct vk_surface_state_t*
+_vk_surface_state(struct vt_surface_t* surf) {
+  if (!surf->render_tex_handle) {
+    surf->render_tex_handle = calloc(1, sizeof(struct vk_surface_state_t));
+  }
+  return (struct vk_surface_state_t*)surf->render_tex_handle;
+}
+
+bool
+_vk_import_buffer_shm(struct vt_renderer_t* r, struct vt_surface_t* surf,
+                      struct wl_shm_buffer* shm_buf) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  int32_t width = wl_shm_buffer_get_width(shm_buf);
+  int32_t height = wl_shm_buffer_get_height(shm_buf);
+  int32_t stride = wl_shm_buffer_get_stride(shm_buf);
+  uint32_t fmt = wl_shm_buffer_get_format(shm_buf);
+
+  bool has_alpha;
+  switch (fmt) {
+    case WL_SHM_FORMAT_ARGB8888: has_alpha = true; break;
+    case WL_SHM_FORMAT_XRGB8888: has_alpha = false; break;
+    default:
+      VT_WARN(r->comp->log, "Unsupported wl_shm format %u", fmt);
+      return false;
+  }
+
+  struct vk_surface_state_t* state = _vk_surface_state(surf);
+  if (!state) return false;
+
+  // The client gets its buffer back once the commit is done, so the
+  // contents live on in a texture that belongs to the surface.
+  struct vk_texture_t* tex = state->shm;
+  bool need_regen = !tex || tex->width != (uint32_t)width || tex->height != (uint32_t)height ||
+    tex->has_alpha != has_alpha;
+  if (need_regen) {
+    _vk_texture_destroy(r, tex);
+    state->shm = NULL;
+    if (state->current == tex) state->current = NULL;
+
+    if (!(tex = calloc(1, sizeof(*tex)))) return false;
+    tex->fd = -1;
+    tex->width = width;
+    tex->height = height;
+    tex->has_alpha = has_alpha;
+    state->shm = tex;
+
+    VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = VK_FORMAT_B8G8R8A8_UNORM,
+      .extent = { (uint32_t)width, (uint32_t)height, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    if (vkCreateImage(vk->dev, &image_info, NULL, &tex->image) != VK_SUCCESS) {
+      tex->image = VK_NULL_HANDLE;
+      VT_ERROR(r->comp->log, "Cannot create %ix%i texture for surface %p.", width, height, surf);
+      goto fail;
+    }
+
+    VkMemoryRequirements image_reqs;
+    vkGetImageMemoryRequirements(vk->dev, tex->image, &image_reqs);
+    int32_t image_type = _vk_find_memory_type(vk, image_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VkMemoryAllocateInfo image_alloc = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = image_reqs.size,
+      .memoryTypeIndex = (uint32_t)image_type,
+    };
+    if (image_type < 0 || vkAllocateMemory(vk->dev, &image_alloc, NULL, &tex->mem) != VK_SUCCESS ||
+      vkBindImageMemory(vk->dev, tex->image, tex->mem, 0) != VK_SUCCESS) {
+      VT_ERROR(r->comp->log, "Cannot allocate %ix%i texture for surface %p.", width, height, surf);
+      goto fail;
+    }
+
+    VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = (VkDeviceSize)width * height * 4,
+      .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    for (uint32_t i = 0; i < _VK_STAGING_BUFFERS; i++) {
+      if (vkCreateBuffer(vk->dev, &buffer_info, NULL, &tex->staging[i]) != VK_SUCCESS) {
+        tex->staging[i] = VK_NULL_HANDLE;
+        VT_ERROR(r->comp->log, "Cannot create staging buffer for surface %p.", surf);
+        goto fail;
+      }
+      VkMemoryRequirements buffer_reqs;
+      vkGetBufferMemoryRequirements(vk->dev, tex->staging[i], &buffer_reqs);
+      int32_t buffer_type = _vk_find_memory_type(vk, buffer_reqs.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+      VkMemoryAllocateInfo buffer_alloc = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = buffer_reqs.size,
+        .memoryTypeIndex = (uint32_t)buffer_type,
+      };
+      if (buffer_type < 0 || vkAllocateMemory(vk->dev, &buffer_alloc, NULL, &tex->staging_mem[i]) != VK_SUCCESS ||
+        vkBindBufferMemory(vk->dev, tex->staging[i], tex->staging_mem[i], 0) != VK_SUCCESS ||
+        vkMapMemory(vk->dev, tex->staging_mem[i], 0, VK_WHOLE_SIZE, 0, &tex->staging_data[i]) != VK_SUCCESS) {
+        tex->staging_data[i] = NULL;
+        VT_ERROR(r->comp->log, "Cannot allocate staging buffer for surface %p.", surf);
+        goto fail;
+      }
+    }
+    if (!(tex->view = _vk_create_view(vk, tex->image, VK_FORMAT_B8G8R8A8_UNORM, has_alpha))) {
+      VT_ERROR(r->comp->log, "Cannot create view of texture for surface %p.", surf);
+      goto fail;
+    }
+  }
+
+  // A recorded upload copies whatever its staging buffer holds at submission, 
+  // so it takes the new contents as well. A submitted one may still read from 
+  // it, the next buffer is used then, which is only waited for if the GPU 
+  // is more than a frame behind.
+  uint32_t slot = tex->staging_idx;
+  uint64_t done = 0;
+  vkGetSemaphoreCounterValue(vk->dev, vk->timeline, &done);
+  if (tex->staging_points[slot] <= vk->timeline_point && tex->staging_points[slot] > done) {
+    slot = (slot + 1) % _VK_STAGING_BUFFERS;
+    if (tex->staging_points[slot] <= vk->timeline_point) _vk_wait_point(vk, tex->staging_points[slot]);
+    tex->staging_idx = slot;
+  }
+  if (!_vk_begin_uploads(r)) return false;
+
+  // Only the damaged rectangles are copied unless the texture is new
+  int32_t n_boxes = 1;
+  pixman_box32_t full = { 0, 0, width, height };
+  const pixman_box32_t* boxes = &full;
+  if (!need_regen) {
+    boxes = pixman_region32_rectangles(&surf->current_damage, &n_boxes);
+  }
+
+  VkBufferImageCopy regions[n_boxes ? n_boxes : 1];
+  uint32_t n_regions = 0;
+
+  wl_shm_buffer_begin_access(shm_buf);
+  const uint8_t* src = wl_shm_buffer_get_data(shm_buf);
+  uint8_t* dst = tex->staging_data[slot];
+  for (int32_t i = 0; i < n_boxes; i++) {
+    int32_t x1 = boxes[i].x1 < 0 ? 0 : boxes[i].x1;
+    int32_t y1 = boxes[i].y1 < 0 ? 0 : boxes[i].y1;
+    int32_t x2 = boxes[i].x2 > width ? width : boxes[i].x2;
+    int32_t y2 = boxes[i].y2 > height ? height : boxes[i].y2;
+    if (x1 >= x2 || y1 >= y2) continue;
+
+    for (int32_t y = y1; y < y2; y++) {
+      memcpy(dst + ((size_t)y * width + x1) * 4, src + (size_t)y * stride + (size_t)x1 * 4,
+             (size_t)(x2 - x1) * 4);
+    }
+    regions[n_regions++] = (VkBufferImageCopy){
+      .bufferOffset = ((VkDeviceSize)y1 * width + x1) * 4,
+      .bufferRowLength = (uint32_t)width,
+      .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+      .imageOffset = { x1, y1, 0 },
+      .imageExtent = { (uint32_t)(x2 - x1), (uint32_t)(y2 - y1), 1 },
+    };
+  }
+  wl_shm_buffer_end_access(shm_buf);
+
+  if (n_regions) {
+    VkImageMemoryBarrier2 to_transfer = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+      .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      .oldLayout = tex->layout,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = tex->image,
+      .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+    };
+    VkDependencyInfo dep = {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .imageMemoryBarrierCount = 1,
+      .pImageMemoryBarriers = &to_transfer,
+    };
+    vkCmdPipelineBarrier2(vk->upload_cb, &dep);
+
+    vkCmdCopyBufferToImage(vk->upload_cb, tex->staging[slot], tex->image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, n_regions, regions);
+
+    VkImageMemoryBarrier2 to_sampled = to_transfer;
+    to_sampled.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    to_sampled.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    to_sampled.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+    to_sampled.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+    to_sampled.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    to_sampled.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    dep.pImageMemoryBarriers = &to_sampled;
+    vkCmdPipelineBarrier2(vk->upload_cb, &dep);
+
+    tex->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    // Uploads go out with the next submission
+    tex->upload_point = vk->timeline_point + 1;
+    tex->staging_points[slot] = tex->upload_point;
+  }
+
+  if (state->current != tex) vk->generation++;
+  state->current = tex;
+  surf->tex.width = width;
+  surf->tex.height = height;
+  return true;
+
+fail:
+  _vk_texture_destroy(r, tex);
+  state->shm = NULL;
+  return false;
+}
+
+bool
+_vk_dmabuf_texture_matches(const struct vk_texture_t* tex, const struct vt_dmabuf_attr_t* attr, const ino_t* inos) {
+  const struct vt_dmabuf_attr_t* key = &tex->attr;
+  if (key->width != attr->width || key->height != attr->height) return false;
+  if (key->format != attr->format || key->mod != attr->mod) return false;
+  if (key->num_planes != attr->num_planes) return false;
+  for (int32_t i = 0; i < attr->num_planes; i++) {
+    if (tex->inos[i] != inos[i]) return false;
+    if (key->offsets[i] != attr->offsets[i] || key->strides[i] != attr->strides[i]) return false;
+  }
+  return true;
+}
+
+bool
+_vk_import_buffer_dmabuf(struct vt_renderer_t* r, struct vt_surface_t* surf,
+                         struct vt_linux_dmabuf_v1_buffer_t* dmabuf) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  const struct vt_dmabuf_attr_t* attr = &dmabuf->attr;
+
+  struct vk_surface_state_t* state = _vk_surface_state(surf);
+  if (!state) return false;
+
+  if (attr->num_planes < 1 || attr->num_planes > VT_DMABUF_PLANES_CAP) return false;
+  ino_t inos[VT_DMABUF_PLANES_CAP] = {0};
+  for (int32_t i = 0; i < attr->num_planes; i++) {
+    struct stat st;
+    if (fstat(attr->fds[i], &st) != 0) return false;
+    inos[i] = st.st_ino;
+  }
+
+  // Clients cycle through a handful of buffers, which stay imported
+  for (uint32_t i = 0; i < _VK_SURFACE_DMABUFS; i++) {
+    struct vk_texture_t* tex = state->dmabufs[i];
+    if (!tex || !_vk_dmabuf_texture_matches(tex, attr, inos)) continue;
+    if (state->current != tex) vk->generation++;
+    state->current = tex;
+    surf->tex.width = tex->width;
+    surf->tex.height = tex->height;
+    return true;
+  }
+
+  const struct vk_format_t* fmt = _vk_format_from_drm(attr->format);
+  if (!fmt) {
+    VT_WARN(r->comp->log, "Cannot import DMABUF of unsupported format 0x%08x.", attr->format);
+    return false;
+  }
+
+  struct vk_texture_t* tex = calloc(1, sizeof(*tex));
+  if (!tex) return false;
+  tex->dmabuf = true;
+  tex->attr = *attr;
+  memcpy(tex->inos, inos, sizeof(inos));
+  for (int32_t i = 0; i < VT_DMABUF_PLANES_CAP; i++) {
+    tex->attr.fds[i] = -1;
+  }
+  tex->width = attr->width;
+  tex->height = attr->height;
+  tex->has_alpha = fmt->has_alpha;
+  tex->layout = VK_IMAGE_LAYOUT_GENERAL;
+  tex->fd = fcntl(attr->fds[0], F_DUPFD_CLOEXEC, 0);
+
+  if (!_vk_import_dmabuf_image(r, attr, VK_IMAGE_USAGE_SAMPLED_BIT, &tex->image, &tex->mem) ||
+    !(tex->view = _vk_create_view(vk, tex->image, fmt->format, fmt->has_alpha))) {
+    VT_ERROR(r->comp->log, "Cannot import DMABUF of surface %p.", surf);
+    _vk_texture_destroy(r, tex);
+    return false;
+  }
+
+  // The oldest buffer of the swapchain makes room
+  uint32_t slot = state->next_dmabuf;
+  state->next_dmabuf = (slot + 1) % _VK_SURFACE_DMABUFS;
+  if (state->dmabufs[slot]) {
+    if (state->current == state->dmabufs[slot]) state->current = NULL;
+    _vk_texture_destroy(r, state->dmabufs[slot]);
+  }
+  state->dmabufs[slot] = tex;
+  state->current = tex;
+  vk->generation++;
+
+  surf->tex.width = tex->width;
+  surf->tex.height = tex->height;
+  return true;
+}
+
+bool
+_vk_target_init(struct vt_renderer_t* r, struct vk_target_t* target,
+                const struct vt_dmabuf_attr_t* attr, uint32_t width, uint32_t height) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+
+  memset(target, 0, sizeof(*target));
+  target->fd = -1;
+
+  if (attr) {
+    // Buffers of the backend, presented by KMS
+    if (!vk->has_dmabuf_support ||
+      !_vk_import_dmabuf_image(r, attr, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &target->image, &target->mem)) {
+      VT_ERROR(r->comp->log, "Cannot import render target buffer (%ix%i).", attr->width, attr->height);
+      goto fail;
+    }
+    target->dmabuf = true;
+    target->fd = fcntl(attr->fds[0], F_DUPFD_CLOEXEC, 0);
+    target->width = attr->width;
+    target->height = attr->height;
+  } else {
+    // Headless outputs keep the frame to themselves
+    VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = _VK_TARGET_FORMAT,
+      .extent = { width, height, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    if (vkCreateImage(vk->dev, &image_info, NULL, &target->image) != VK_SUCCESS) {
+      target->image = VK_NULL_HANDLE;
+      VT_ERROR(r->comp->log, "Cannot create %ux%u render target.", width, height);
+      goto fail;
+    }
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(vk->dev, target->image, &reqs);
+    int32_t type = _vk_find_memory_type(vk, reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = reqs.size,
+      .memoryTypeIndex = (uint32_t)type,
+    };
+    if (type < 0 || vkAllocateMemory(vk->dev, &alloc_info, NULL, &target->mem) != VK_SUCCESS ||
+      vkBindImageMemory(vk->dev, target->image, target->mem, 0) != VK_SUCCESS) {
+      VT_ERROR(r->comp->log, "Cannot allocate %ux%u render target.", width, height);
+      goto fail;
+    }
+    target->width = width;
+    target->height = height;
+  }
+
+  if (!(target->view = _vk_create_view(vk, target->image, _VK_TARGET_FORMAT, true))) {
+    VT_ERROR(r->comp->log, "Cannot create view of render target.");
+    goto fail;
+  }
+
+  for (uint32_t i = 0; i < _VK_TARGET_SLOTS; i++) {
+    if (!_vk_target_slot_init(r, &target->slots[i])) goto fail;
+  }
+  return true;
+
+fail:
+  _vk_target_destroy(r, target);
+  return false;
+}
+
+void
+_vk_target_destroy(struct vt_renderer_t* r, struct vk_target_t* target) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+
+  _vk_wait_point(vk, target->point);
+  for (uint32_t i = 0; i < _VK_TARGET_SLOTS; i++) {
+    _vk_target_slot_destroy(vk, &target->slots[i]);
+  }
+  vkDestroyImageView(vk->dev, target->view, NULL);
+  vkDestroyImage(vk->dev, target->image, NULL);
+  vkFreeMemory(vk->dev, target->mem, NULL);
+  if (target->fd >= 0) close(target->fd);
+  memset(target, 0, sizeof(*target));
+  target->fd = -1;
+}
+
+bool
+_vk_target_slot_init(struct vt_renderer_t* r, struct vk_target_slot_t* slot) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  wl_array_init(&slot->ops);
+
+  VkBufferCreateInfo damage_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = sizeof(struct vk_damage_ubo_t),
+    .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  if (vkCreateBuffer(vk->dev, &damage_info, NULL, &slot->damage_buf) != VK_SUCCESS) {
+    slot->damage_buf = VK_NULL_HANDLE;
+    VT_ERROR(r->comp->log, "Cannot create damage buffer of render target.");
+    return false;
+  }
+  VkMemoryRequirements damage_reqs;
+  vkGetBufferMemoryRequirements(vk->dev, slot->damage_buf, &damage_reqs);
+  int32_t damage_type = _vk_find_memory_type(vk, damage_reqs.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VkMemoryAllocateInfo damage_alloc = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize = damage_reqs.size,
+    .memoryTypeIndex = (uint32_t)damage_type,
+  };
+  if (damage_type < 0 || vkAllocateMemory(vk->dev, &damage_alloc, NULL, &slot->damage_mem) != VK_SUCCESS ||
+    vkBindBufferMemory(vk->dev, slot->damage_buf, slot->damage_mem, 0) != VK_SUCCESS ||
+    vkMapMemory(vk->dev, slot->damage_mem, 0, VK_WHOLE_SIZE, 0, (void**)&slot->damage_data) != VK_SUCCESS) {
+    slot->damage_data = NULL;
+    VT_ERROR(r->comp->log, "Cannot allocate damage buffer of render target.");
+    return false;
+  }
+  memset(slot->damage_data, 0, sizeof(*slot->damage_data));
+
+  VkCommandBufferAllocateInfo cb_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool = vk->cmd_pool,
+    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  if (vkAllocateCommandBuffers(vk->dev, &cb_info, &slot->cb) != VK_SUCCESS) {
+    slot->cb = VK_NULL_HANDLE;
+    VT_ERROR(r->comp->log, "Cannot allocate command buffer of render target.");
+    return false;
+  }
+  return true;
+}
+
+void
+_vk_target_slot_destroy(struct vk_backend_state_t* vk, struct vk_target_slot_t* slot) {
+  if (slot->cb) vkFreeCommandBuffers(vk->dev, vk->cmd_pool, 1, &slot->cb);
+  if (slot->damage_data) vkUnmapMemory(vk->dev, slot->damage_mem);
+  vkDestroyBuffer(vk->dev, slot->damage_buf, NULL);
+  vkFreeMemory(vk->dev, slot->damage_mem, NULL);
+  wl_array_release(&slot->ops);
+}
+
+struct vk_target_t*
+_vk_target_from_native(struct vt_renderer_t* r, struct vt_output_t* output,
+                       struct vt_renderer_dmabuf_target_t* native) {
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+
+  // The backend alternates between the same buffers, which are imported once
+  struct vk_target_t* free_slot = NULL;
+  for (uint32_t i = 0; i < _VK_OUTPUT_TARGETS; i++) {
+    struct vk_target_t* target = &vk_output->targets[i];
+    if (target->image && target->id == native->id) return target;
+    if (!target->image && !free_slot) free_slot = target;
+  }
+  if (!free_slot) {
+    VT_ERROR(r->comp->log, "Output %p has more than %i render target buffers.", output, _VK_OUTPUT_TARGETS);
+    return NULL;
+  }
+  if (!_vk_target_init(r, free_slot, &native->attr, 0, 0)) return NULL;
+  free_slot->id = native->id;
+
+  VT_TRACE(r->comp->log, "Imported render target buffer %u of output %p.", native->id, output);
+  return free_slot;
+}
+
+void
+_vk_push_op(struct vk_output_state_t* vk_output, struct vk_texture_t* tex,
+            int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+  if (w <= 0 || h <= 0) return;
+  struct vk_draw_op_t* op = wl_array_add(&vk_output->ops, sizeof(*op));
+  if (!op) return;
+  // Operations are compared bytewise to find out if the scene changed
+  memset(op, 0, sizeof(*op));
+  op->tex = tex;
+  op->x = x;
+  op->y = y;
+  op->w = w;
+  op->h = h;
+  op->color = color;
+}
+
+void
+_vk_write_target_damage(struct vk_target_t* target, struct vk_target_slot_t* slot, pixman_region32_t* damage) {
+  int32_t n_rects = 0;
+  const pixman_box32_t* rects = pixman_region32_rectangles(damage, &n_rects);
+  // Damage too scattered for the buffer is drawn as its bounding box
+  if (n_rects > _VK_DAMAGE_BOXES) {
+    rects = pixman_region32_extents(damage);
+    n_rects = 1;
+  }
+
+  struct vk_damage_ubo_t ubo = { .count = (uint32_t)n_rects };
+  for (int32_t i = 0; i < n_rects; i++) {
+    ubo.boxes[i][0] = (float)rects[i].x1 / target->width * 2.0f - 1.0f;
+    ubo.boxes[i][1] = (float)rects[i].y1 / target->height * 2.0f - 1.0f;
+    ubo.boxes[i][2] = (float)rects[i].x2 / target->width * 2.0f - 1.0f;
+    ubo.boxes[i][3] = (float)rects[i].y2 / target->height * 2.0f - 1.0f;
+  }
+  const size_t size = offsetof(struct vk_damage_ubo_t, boxes) + (size_t)n_rects * sizeof(ubo.boxes[0]);
+  memcpy(slot->damage_data, &ubo, size);
+}
+
+void
+_vk_record_target(struct vt_renderer_t* r, struct vk_target_t* target, struct vk_target_slot_t* slot,
+                  const struct wl_array* ops_array) {
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  VkCommandBuffer cb = slot->cb;
+
+  const struct vk_draw_op_t* ops = ops_array->data;
+  const uint32_t n_ops = ops_array->size / sizeof(*ops);
+
+  vkResetCommandBuffer(cb, 0);
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+  };
+  vkBeginCommandBuffer(cb, &begin_info);
+
+  // 1. Take the target and the client DMABUFs over from their foreign owners
+  VkImageMemoryBarrier2 barriers[n_ops + 1];
+  uint32_t n_barriers = 0;
+  barriers[n_barriers++] = (VkImageMemoryBarrier2){
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+    .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    .srcAccessMask = target->dmabuf ? 0 : VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+    .dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    .dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+    .oldLayout = !target->initialized ? VK_IMAGE_LAYOUT_UNDEFINED :
+      target->dmabuf ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    .srcQueueFamilyIndex = target->dmabuf && target->initialized ? VK_QUEUE_FAMILY_FOREIGN_EXT : VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = target->dmabuf && target->initialized ? vk->queue_family : VK_QUEUE_FAMILY_IGNORED,
+    .image = target->image,
+    .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+  };
+  for (uint32_t i = 0; i < n_ops; i++) {
+    if (!ops[i].tex || !ops[i].tex->dmabuf) continue;
+    bool seen = false;
+    for (uint32_t j = 0; j < i && !seen; j++) seen = ops[j].tex == ops[i].tex;
+    if (seen) continue;
+    barriers[n_barriers++] = (VkImageMemoryBarrier2){
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+      .dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+      .dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT,
+      .dstQueueFamilyIndex = vk->queue_family,
+      .image = ops[i].tex->image,
+      .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+    };
+  }
+  VkDependencyInfo dep = {
+    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+    .imageMemoryBarrierCount = n_barriers,
+    .pImageMemoryBarriers = barriers,
+  };
+  vkCmdPipelineBarrier2(cb, &dep);
+
+  // 2. Every operation is drawn once per damaged box (instanced), clipped 
+  // to it in the vertex shader. The boxes are read from the damage buffer 
+  // when the commands run, so they stay valid as the damage changes.
+  VkRenderingAttachmentInfo color = {
+    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+    .imageView = target->view,
+    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    .loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+  };
+  VkRenderingInfo rendering = {
+    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+    .renderArea = { { 0, 0 }, { target->width, target->height } },
+    .layerCount = 1,
+    .colorAttachmentCount = 1,
+    .pColorAttachments = &color,
+  };
+  vkCmdBeginRendering(cb, &rendering);
+
+  VkViewport viewport = { 0.0f, 0.0f, (float)target->width, (float)target->height, 0.0f, 1.0f };
+  VkRect2D scissor = { { 0, 0 }, { target->width, target->height } };
+  vkCmdSetViewport(cb, 0, 1, &viewport);
+  vkCmdSetScissor(cb, 0, 1, &scissor);
+  vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->pipe);
+
+  VkDescriptorBufferInfo damage_info = {
+    .buffer = slot->damage_buf,
+    .offset = 0,
+    .range = sizeof(struct vk_damage_ubo_t),
+  };
+  const struct vk_texture_t* bound = NULL;
+  for (uint32_t i = 0; i < n_ops; i++) {
+    const struct vk_draw_op_t* op = &ops[i];
+    // Solid rectangles are the white texture in their color
+    const struct vk_texture_t* tex = op->tex ? op->tex : vk->white;
+
+    if (tex != bound) {
+      VkDescriptorImageInfo image_info = {
+        .imageView = tex->view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      };
+      VkWriteDescriptorSet writes[] = {
+        {
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstBinding = 0,
+          .descriptorCount = 1,
+          .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+          .pImageInfo = &image_info,
+        },
+        {
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstBinding = 1,
+          .descriptorCount = 1,
+          .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+          .pBufferInfo = &damage_info,
+        },
+      };
+      vk->cmd_push_descriptor_set(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->pipe_layout, 0, 2, writes);
+      bound = tex;
+    }
+
+    float quad[8] = {
+      (float)op->x / target->width * 2.0f - 1.0f,
+      (float)op->y / target->height * 2.0f - 1.0f,
+      (float)op->w / target->width * 2.0f,
+      (float)op->h / target->height * 2.0f,
+      1.0f, 1.0f, 1.0f, 1.0f,
+    };
+    if (!op->tex) {
+      quad[4] = ((op->color >> 16) & 0xff) / 255.0f;
+      quad[5] = ((op->color >> 8) & 0xff) / 255.0f;
+      quad[6] = (op->color & 0xff) / 255.0f;
+    }
+    vkCmdPushConstants(cb, vk->pipe_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0, sizeof(quad), quad);
+    vkCmdDraw(cb, 4, _VK_DAMAGE_BOXES, 0, 0);
+  }
+  vkCmdEndRendering(cb);
+
+  // 3. Hand the DMABUFs back to KMS and the clients
+  n_barriers = 0;
+  if (target->dmabuf) {
+    barriers[n_barriers++] = (VkImageMemoryBarrier2){
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+      .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+      .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .srcQueueFamilyIndex = vk->queue_family,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT,
+      .image = target->image,
+      .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+    };
+  }
+  for (uint32_t i = 0; i < n_ops; i++) {
+    if (!ops[i].tex || !ops[i].tex->dmabuf) continue;
+    bool seen = false;
+    for (uint32_t j = 0; j < i && !seen; j++) seen = ops[j].tex == ops[i].tex;
+    if (seen) continue;
+    barriers[n_barriers++] = (VkImageMemoryBarrier2){
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+      .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .srcQueueFamilyIndex = vk->queue_family,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT,
+      .image = ops[i].tex->image,
+      .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+    };
+  }
+  if (n_barriers) {
+    dep.imageMemoryBarrierCount = n_barriers;
+    vkCmdPipelineBarrier2(cb, &dep);
+  }
+
+  vkEndCommandBuffer(cb);
+}
+
+void
+_vk_send_surface_release_fences(struct vt_renderer_t* r, struct vt_output_t* output, int32_t fence_fd) {
+  if (!r->comp->have_proto_dmabuf_explicit_sync || fence_fd < 0) return;
+
+  struct vt_surface_t* surf;
+  wl_list_for_each_reverse(surf, &r->comp->surfaces, link) {
+    if (!vt_util_output_mask_has(&surf->_mask_outputs_presented_on, output->id)) continue;
+    if (!surf->buf_res) continue;
+    if (!surf->sync.res_release) continue;
+
+    zwp_linux_buffer_release_v1_send_fenced_release(surf->sync.res_release, fence_fd);
+
+    // we're finished with this fence
+    wl_resource_destroy(surf->sync.res_release);
+    surf->sync.res_release = NULL;
+    surf->sync.release_fence_fd = -1;
+  }
+}
+
+
+// ===================================================
+// =================== PUBLIC API ====================
+// ===================================================
+
+bool
+renderer_init_vk(struct vt_backend_t* backend, struct vt_renderer_t *r, void* native_handle) {
+  if (!r || !backend) return false;
+
+  // The nested backend renders into wl_egl_windows of the parent compositor
+  if (backend->platform == VT_BACKEND_WAYLAND) {
+    VT_ERROR(r->comp->log, "The Vulkan renderer cannot present on the wayland backend, use the GL renderer instead.");
+    return false;
+  }
+
+  r->backend = backend;
+  r->rendering_backend = VT_RENDERING_BACKEND_VULKAN;
+  r->_desired_render_buffer_format = _VT_VK_DRM_FORMAT_XRGB8888;
+
+  if (!r->user_data) {
+    r->user_data = VT_ALLOC(r->comp, sizeof(struct vk_backend_state_t));
+  }
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  if (vk->dev) return true;
+
+  if (!vk->instance && !_vk_create_instance(r, vk)) return false;
+
+  dev_t devnum;
+  bool match_device = backend->platform == VT_BACKEND_DRM_GBM &&
+    _vk_native_handle_devnum(native_handle, &devnum);
+  if (!(vk->phdev = _vk_pick_physical_device(r, vk, match_device ? &devnum : NULL))) {
+    VT_ERROR(r->comp->log, "No Vulkan 1.3 device with push descriptors available.");
+    return false;
+  }
+  if (!_vk_create_device(r, vk)) return false;
+  if (!_vk_create_pipeline(r, vk)) return false;
+
+  wl_array_init(&vk->frame_waits);
+  wl_array_init(&vk->garbage);
+  if (!_vk_create_white_texture(r, vk)) return false;
+
+  // KMS scans out of DMABUFs we render into
+  if (backend->platform == VT_BACKEND_DRM_GBM && !vk->has_dmabuf_support) {
+    VT_ERROR(r->comp->log, "Vulkan device cannot import DMABUFs, which the DRM backend needs.");
+    return false;
+  }
+  if (!vk->has_dmabuf_support && r->comp->have_proto_dmabuf) {
+    VT_WARN(r->comp->log, "Vulkan device cannot import DMABUFs, disabling linux-dmabuf.");
+    r->comp->have_proto_dmabuf = false;
+    r->comp->have_proto_dmabuf_explicit_sync = false;
+  }
+  if (!vk->has_explicit_sync_support && r->comp->have_proto_dmabuf_explicit_sync) {
+    VT_WARN(r->comp->log, "Vulkan device cannot share sync_files, disabling explicit sync.");
+    r->comp->have_proto_dmabuf_explicit_sync = false;
+  }
+
+  VT_TRACE(r->comp->log, "Initialized Vulkan renderer (DMABUF: %i, explicit sync: %i).",
+           vk->has_dmabuf_support, vk->has_explicit_sync_support);
+  return true;
+}
+
+bool
+renderer_is_handle_renderable_vk(struct vt_renderer_t* renderer, void* native_handle) {
+  if (!renderer) return false;
+  if (!renderer->user_data) {
+    renderer->user_data = VT_ALLOC(renderer->comp, sizeof(struct vk_backend_state_t));
+  }
+  struct vk_backend_state_t* vk = BACKEND_DATA(renderer, struct vk_backend_state_t);
+  if (!vk->instance && !_vk_create_instance(renderer, vk)) return false;
+
+  dev_t devnum;
+  if (!_vk_native_handle_devnum(native_handle, &devnum)) return false;
+  return _vk_pick_physical_device(renderer, vk, &devnum) != VK_NULL_HANDLE;
+}
+
+bool
+renderer_query_dmabuf_formats_vk(struct vt_compositor_t* comp, void* native_handle, struct wl_array* formats) {
+  // Secondary devices are only scanned out from, there is nothing to import on them
+  return false;
+}
+
+bool
+renderer_query_dmabuf_formats_with_renderer_vk(struct vt_renderer_t* renderer, struct wl_array* formats) {
+  if (!renderer || !renderer->user_data || !formats) return false;
+  struct vk_backend_state_t* vk = BACKEND_DATA(renderer, struct vk_backend_state_t);
+  if (!vk->dev || !vk->has_dmabuf_support) return false;
+
+  for (size_t i = 0; i < sizeof(_vk_formats) / sizeof(_vk_formats[0]); i++) {
+    VkDrmFormatModifierPropertiesListEXT mod_list = {
+      .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
+    };
+    VkFormatProperties2 props = {
+      .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+      .pNext = &mod_list,
+    };
+    vkGetPhysicalDeviceFormatProperties2(vk->phdev, _vk_formats[i].format, &props);
+    if (!mod_list.drmFormatModifierCount) continue;
+
+    VkDrmFormatModifierPropertiesEXT mod_props[mod_list.drmFormatModifierCount];
+    mod_list.pDrmFormatModifierProperties = mod_props;
+    vkGetPhysicalDeviceFormatProperties2(vk->phdev, _vk_formats[i].format, &props);
+
+    struct vt_dmabuf_drm_format_t* fmt = wl_array_add(formats, sizeof(*fmt));
+    if (!fmt) return false;
+    fmt->format = _vk_formats[i].drm_format;
+    fmt->len = 0;
+    fmt->mods = calloc(mod_list.drmFormatModifierCount, sizeof(*fmt->mods));
+    if (!fmt->mods) return false;
+
+    for (uint32_t j = 0; j < mod_list.drmFormatModifierCount; j++) {
+      if (!(mod_props[j].drmFormatModifierTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) continue;
+
+      // The modifier has to be importable from a DMABUF, not just usable
+      VkPhysicalDeviceImageDrmFormatModifierInfoEXT mod_info = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT,
+        .drmFormatModifier = mod_props[j].drmFormatModifier,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      };
+      VkPhysicalDeviceExternalImageFormatInfo external_info = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO,
+        .pNext = &mod_info,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+      };
+      VkPhysicalDeviceImageFormatInfo2 format_info = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+        .pNext = &external_info,
+        .format = _vk_formats[i].format,
+        .type = VK_IMAGE_TYPE_2D,
+        .tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+      };
+      VkExternalImageFormatProperties external_props = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES,
+      };
+      VkImageFormatProperties2 format_props = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+        .pNext = &external_props,
+      };
+      if (vkGetPhysicalDeviceImageFormatProperties2(vk->phdev, &format_info, &format_props) != VK_SUCCESS) continue;
+      if (!(external_props.externalMemoryProperties.externalMemoryFeatures &
+        VK_EXTERNAL_MEMORY_FEATURE_IMPORTABLE_BIT)) continue;
+
+      fmt->mods[fmt->len++] = (struct vt_dmabuf_format_modifier_t){
+        .mod = mod_props[j].drmFormatModifier,
+        ._egl_ext_only = false,
+      };
+    }
+
+    if (!fmt->len) {
+      free(fmt->mods);
+      formats->size -= sizeof(*fmt);
+    }
+  }
+
+  return formats->size > 0;
+}
+
+bool
+renderer_setup_renderable_output_vk(struct vt_renderer_t *r, struct vt_output_t* output) {
+  if (!r || !output || !r->user_data) return false;
+
+  // Outputs come and go with hotplug, so their state lives outside the arena
+  output->user_data_render = calloc(1, sizeof(struct vk_output_state_t));
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  if (!vk_output) return false;
+  pixman_region32_init(&vk_output->clip);
+  pixman_region32_init(&vk_output->prev_damage);
+  wl_array_init(&vk_output->ops);
+  for (uint32_t i = 0; i < _VK_OUTPUT_TARGETS; i++) {
+    vk_output->targets[i].fd = -1;
+  }
+
+  // Backends without buffers of their own render offscreen, the others
+  // hand us a new vt_renderer_dmabuf_target_t every frame.
+  if (!output->native_window &&
+    !_vk_target_init(r, &vk_output->targets[0], NULL, output->width, output->height)) {
+    return false;
+  }
+  output->render_surface = output->native_window;
+
+  pixman_region32_union_rect(&vk_output->prev_damage, &vk_output->prev_damage, 0, 0, output->width, output->height);
+  pixman_region32_union_rect(&output->damage, &output->damage, 0, 0, output->width, output->height);
+  vt_comp_schedule_repaint(r->comp, output);
+
+  VT_TRACE(r->comp->log, "Created render target for output %p (%ux%u)", output, output->width, output->height);
+  return true;
+}
+
+bool
+renderer_resize_renderable_output_vk(struct vt_renderer_t* r, struct vt_output_t* output, int32_t w, int32_t h) {
+  if (!r || !output || !output->user_data_render || w == 0 || h == 0) return false;
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+
+  // Backend buffers are reallocated by the backend and come with new IDs
+  for (uint32_t i = 0; i < _VK_OUTPUT_TARGETS; i++) {
+    if (vk_output->targets[i].image) _vk_target_destroy(r, &vk_output->targets[i]);
+  }
+  vk_output->current = NULL;
+  if (!output->native_window && !_vk_target_init(r, &vk_output->targets[0], NULL, w, h)) return false;
+
+  pixman_region32_clear(&vk_output->prev_damage);
+  pixman_region32_union_rect(&vk_output->prev_damage, &vk_output->prev_damage, 0, 0, w, h);
+  pixman_region32_union_rect(&output->damage, &output->damage, 0, 0, w, h);
+  return true;
+}
+
+bool
+renderer_destroy_renderable_output_vk(struct vt_renderer_t *r, struct vt_output_t* output) {
+  if (!r || !r->user_data || !output || !output->user_data_render) return false;
+
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+
+  for (uint32_t i = 0; i < _VK_OUTPUT_TARGETS; i++) {
+    if (vk_output->targets[i].image) _vk_target_destroy(r, &vk_output->targets[i]);
+  }
+  pixman_region32_fini(&vk_output->clip);
+  pixman_region32_fini(&vk_output->prev_damage);
+  wl_array_release(&vk_output->ops);
+  if (vk->output == output) vk->output = NULL;
+
+  free(vk_output);
+  output->user_data_render = NULL;
+  output->render_surface = NULL;
+
+  VT_TRACE(r->comp->log, "Destroyed render targets.");
+  return true;
+}
+
+bool renderer_import_buffer_vk(
+  struct vt_renderer_t *r, struct vt_surface_t *surf,
+  struct wl_resource *buffer_resource) {
+  if (!r || !r->user_data || !surf) return false;
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+
+  struct wl_shm_buffer* shmbuf = wl_shm_buffer_get(buffer_resource);
+  if (shmbuf) {
+    VT_TRACE(r->comp->log, "Importing buffer as SHM.");
+    return _vk_import_buffer_shm(r, surf, shmbuf);
+  }
+
+  struct vt_linux_dmabuf_v1_buffer_t* dmabuf = vt_proto_linux_dmabuf_v1_from_buffer_res(buffer_resource);
+  if (dmabuf && vk->has_dmabuf_support) {
+    VT_TRACE(r->comp->log, "Importing buffer as DMABUF.");
+    return _vk_import_buffer_dmabuf(r, surf, dmabuf);
+  }
+
+  VT_WARN(r->comp->log, "Cannot import buffer of surface %p with the Vulkan renderer.", surf);
+  return false;
+}
+
+bool renderer_destroy_surface_texture_vk(struct vt_renderer_t* r, struct vt_surface_t* surf) {
+  if (!surf || !r) return false;
+  struct vk_surface_state_t* state = (struct vk_surface_state_t*)surf->render_tex_handle;
+  if (state) {
+    _vk_texture_destroy(r, state->shm);
+    for (uint32_t i = 0; i < _VK_SURFACE_DMABUFS; i++) {
+      _vk_texture_destroy(r, state->dmabufs[i]);
+    }
+    free(state);
+    surf->render_tex_handle = NULL;
+  }
+  surf->tex.width = 0;
+  surf->tex.height = 0;
+  return true;
+}
+
+bool
+renderer_drop_context_vk(struct vt_renderer_t* r) {
+  // There is no current context in Vulkan
+  return true;
+}
+
+void
+renderer_set_vsync_vk(struct vt_renderer_t* r, bool vsync) {
+  // Pacing is up to the backend, presenting never blocks
+}
+
+void
+renderer_set_clear_color_vk(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t col) {
+  if (!output || !output->user_data_render) return;
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  if (vk_output->discard) return;
+  _vk_push_op(vk_output, NULL, 0, 0, output->width, output->height, col);
+}
+
+void
+renderer_stencil_damage_pass_vk(struct vt_renderer_t* r, struct vt_output_t* output) {
+  if (!r || !output || !output->user_data_render) return;
+  // Draws are clipped to the damage when recording, nothing has to be marked
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  vk_output->discard = true;
+}
+
+void
+renderer_composite_pass_vk(struct vt_renderer_t* r, struct vt_output_t* output) {
+  if (!r || !output || !output->user_data_render) return;
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  vk_output->discard = false;
+}
+
+void
+renderer_begin_scene_vk(struct vt_renderer_t *r, struct vt_output_t *output) {
+  if (!r || !r->impl.begin_scene || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before beginning frame.");
+    return;
+  }
+  if (!output->width || !output->height) {
+    VT_WARN(r->comp->log, "Trying to render on invalid output region (%ix%i).", output->width, output->height);
+    return;
+  }
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  if (!vk_output) return;
+
+  // The damage is known once the damage pass ran
+  pixman_region32_fini(&vk_output->clip);
+  pixman_region32_init_rects(&vk_output->clip, output->cached_damage, output->n_damage_boxes);
+  pixman_region32_intersect_rect(&vk_output->clip, &vk_output->clip, 0, 0, output->width, output->height);
+}
+
+void
+renderer_begin_frame_vk(struct vt_renderer_t *r, struct vt_output_t *output) {
+  if (!r || !r->impl.begin_frame || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before beginning frame.");
+    return;
+  }
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  if (!vk_output) return;
+
+  vk->output = output;
+  vk_output->ops.size = 0;
+  _vk_collect_garbage(vk, false);
+
+  struct vt_renderer_dmabuf_target_t* native = (struct vt_renderer_dmabuf_target_t*)output->native_window;
+  vk_output->current = native ? _vk_target_from_native(r, output, native) : &vk_output->targets[0];
+}
+
+bool
+renderer_is_surface_drawable_vk(struct vt_renderer_t* r, struct vt_surface_t* surface) {
+  return surface && surface->render_tex_handle && 
+    ((struct vk_surface_state_t*)surface->render_tex_handle)->current;
+}
+
+void
+renderer_draw_surface_vk(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y) {
+  if (!surface) return;
+  if (!surface->render_tex_handle) return;
+  if (!r || !r->impl.draw_surface || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before rendering surface.");
+    return;
+  }
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  if (!vk_output || vk_output->discard) return;
+
+  struct vk_texture_t* tex = ((struct vk_surface_state_t*)surface->render_tex_handle)->current;
+  if (!tex) return;
+
+  // The frame waits on the client's rendering on the GPU instead of
+  // blocking here: explicitly synchronized clients hand us an acquire
+  // fence, the others have theirs attached to the DMABUF.
+  if (tex->dmabuf && vk->has_explicit_sync_support) {
+    int32_t fence_fd = -1;
+    if (surface->sync.res && r->comp->have_proto_dmabuf_explicit_sync) {
+      fence_fd = surface->sync.acquire_fence_fd;
+      surface->sync.acquire_fence_fd = -1;
+    } else if (!surface->sync.res) {
+      fence_fd = _vk_dmabuf_export_sync_file(tex->fd, DMA_BUF_SYNC_READ);
+      tex->needs_read_fence = true;
+    }
+    if (fence_fd >= 0 && !_vk_wait_sync_file(vk, fence_fd)) {
+      VT_WARN(r->comp->log, "Cannot wait on acquire fence of surface %p.", surface);
+      close(fence_fd);
+    }
+  }
+
+  int32_t scale = surface->buffer_scale > 0 ? surface->buffer_scale : 1;
+  _vk_push_op(vk_output, tex, (int32_t)x, (int32_t)y, tex->width * scale, tex->height * scale, 0);
+
+  vt_util_output_mask_set(&surface->_mask_outputs_presented_on, output->id);
+
+  surface->damaged = false;
+
+  VT_TRACE(r->comp->log, "Presented surface %p (%.2f,%.2f).", surface, x, y);
+}
+
+void
+renderer_draw_rect_vk(struct vt_renderer_t* r, float x, float y, float w, float h, uint32_t col) {
+  if (!r || !r->impl.draw_rect || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before rendering rectangle.");
+    return;
+  }
+
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  if (!vk->output || !vk->output->user_data_render) return;
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)vk->output->user_data_render;
+  if (vk_output->discard) return;
+
+  _vk_push_op(vk_output, NULL, (int32_t)x, (int32_t)y, (int32_t)w, (int32_t)h, col);
+}
+
+void
+renderer_end_scene_vk(struct vt_renderer_t *r, struct vt_output_t *output) {
+  if (!r || !r->impl.end_scene || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before ending frame.");
+    return;
+  }
+}
+
+void
+renderer_end_frame_vk(struct vt_renderer_t *r, struct vt_output_t *output,  const pixman_box32_t* damaged, int32_t n_damaged) {
+  if (!r || !r->impl.end_frame || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before ending frame.");
+    return;
+  }
+
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+  struct vk_output_state_t* vk_output = (struct vk_output_state_t*)output->user_data_render;
+  vk->output = NULL;
+  if (!vk_output || !vk_output->current) return;
+  struct vk_target_t* target = vk_output->current;
+
+  // Backend buffers alternate, so they miss the damage of the previous frame too
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  pixman_region32_copy(&damage, &vk_output->clip);
+  if (target->dmabuf) pixman_region32_union(&damage, &damage, &vk_output->prev_damage);
+
+  // 1. The frame takes the next slot of the target, whose last submission 
+  // is done unless the GPU is _VK_TARGET_SLOTS frames behind. Commands are 
+  // only recorded again if the scene changed, the damage of the frame is 
+  // handed to them through the slot's damage buffer.
+  struct vk_target_slot_t* slot = &target->slots[target->next_slot];
+  target->next_slot = (target->next_slot + 1) % _VK_TARGET_SLOTS;
+  _vk_wait_point(vk, slot->point);
+  _vk_write_target_damage(target, slot, &damage);
+  pixman_region32_fini(&damage);
+
+  bool reuse = slot->reusable && slot->generation == vk->generation &&
+    slot->ops.size == vk_output->ops.size &&
+    (!vk_output->ops.size || memcmp(slot->ops.data, vk_output->ops.data, vk_output->ops.size) == 0);
+  if (!reuse) {
+    _vk_record_target(r, target, slot, &vk_output->ops);
+
+    // The first recording discards the old contents and is never replayed
+    slot->reusable = target->initialized;
+    slot->generation = vk->generation;
+    slot->ops.size = 0;
+    if (vk_output->ops.size) {
+      void* ops = wl_array_add(&slot->ops, vk_output->ops.size);
+      if (ops) memcpy(ops, vk_output->ops.data, vk_output->ops.size);
+      else slot->reusable = false;
+    }
+  }
+
+  VT_TRACE(r->comp->log, "%s command buffer of output %p.", reuse ? "Reusing" : "Recorded", output);
+
+  // 2. Submit together with the pending uploads and acquire fences
+  uint64_t point = _vk_submit(r, slot->cb, vk->has_explicit_sync_support);
+  if (!point) return;
+  slot->point = point;
+  target->point = point;
+  target->initialized = true;
+
+  bool implicit_readers = false;
+  struct vk_draw_op_t* op;
+  wl_array_for_each(op, &vk_output->ops) {
+    if (!op->tex) continue;
+    op->tex->last_point = point;
+    implicit_readers |= op->tex->dmabuf && op->tex->needs_read_fence;
+  }
+
+  int32_t fence_fd = -1;
+  if (vk->has_explicit_sync_support) {
+    VkSemaphoreGetFdInfoKHR fd_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+      .semaphore = vk->render_done,
+      .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    };
+    if (vk->get_semaphore_fd(vk->dev, &fd_info, &fence_fd) != VK_SUCCESS) {
+      // The semaphore stays signaled and cannot be signaled again
+      VT_ERROR(r->comp->log, "Cannot export render fence, disabling explicit sync.");
+      vk->has_explicit_sync_support = false;
+      fence_fd = -1;
+    }
+  }
+
+  // 3. KMS and implicitly synchronized clients wait on the fence of the frame,
+  // if it cannot be attached to their DMABUFs the frame has to be done now.
+  bool wait = false;
+  if (target->dmabuf) {
+    wait |= fence_fd < 0 || target->fd < 0 ||
+      !_vk_dmabuf_import_sync_file(target->fd, DMA_BUF_SYNC_WRITE, fence_fd);
+  }
+  if (implicit_readers) {
+    wl_array_for_each(op, &vk_output->ops) {
+      if (!op->tex || !op->tex->dmabuf || !op->tex->needs_read_fence) continue;
+      op->tex->needs_read_fence = false;
+      wait |= fence_fd < 0 || op->tex->fd < 0 ||
+        !_vk_dmabuf_import_sync_file(op->tex->fd, DMA_BUF_SYNC_READ, fence_fd);
+    }
+  }
+  if (wait) _vk_wait_point(vk, point);
+
+  // 4. Explicitly synchronized clients get the fence right away
+  _vk_send_surface_release_fences(r, output, fence_fd);
+  if (fence_fd >= 0) close(fence_fd);
+
+  pixman_region32_copy(&vk_output->prev_damage, &vk_output->clip);
+}
+
+bool
+renderer_destroy_vk(struct vt_renderer_t* r) {
+  if (!r || !r->impl.destroy || !r->user_data) {
+    VT_ERROR(r->comp->log, "Renderer backend not initialized before destroying backend.");
+    return false;
+  }
+  struct vk_backend_state_t* vk = BACKEND_DATA(r, struct vk_backend_state_t);
+
+  if (vk->dev) {
+    if (vk->upload_cb) _vk_submit(r, VK_NULL_HANDLE, false);
+    _vk_collect_garbage(vk, true);
+    _vk_texture_free(vk, vk->white);
+    vk->white = NULL;
+
+    VkSemaphore* semaphore;
+    wl_array_for_each(semaphore, &vk->frame_waits) {
+      vkDestroySemaphore(vk->dev, *semaphore, NULL);
+    }
+    wl_array_release(&vk->frame_waits);
+    wl_array_release(&vk->garbage);
+
+    vkDestroyPipeline(vk->dev, vk->pipe, NULL);
+    vkDestroyPipelineLayout(vk->dev, vk->pipe_layout, NULL);
+    vkDestroyDescriptorSetLayout(vk->dev, vk->ds_layout, NULL);
+    vkDestroySampler(vk->dev, vk->sampler, NULL);
+    vkDestroySemaphore(vk->dev, vk->render_done, NULL);
+    vkDestroySemaphore(vk->dev, vk->timeline, NULL);
+    vkDestroyCommandPool(vk->dev, vk->cmd_pool, NULL);
+    vkDestroyDevice(vk->dev, NULL);
+  }
+  if (vk->instance) vkDestroyInstance(vk->instance, NULL);
+
+  r->user_data = NULL;
+  return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+
+#include "../renderer.h"
+#include "../../core/core_types.h"
+#include "src/core/surface.h"
+
+bool renderer_init_vk(struct vt_backend_t* backend, struct vt_renderer_t* r, void* native_handle);
+
+bool renderer_is_handle_renderable_vk(struct vt_renderer_t* renderer, void* native_handle);
+
+bool renderer_query_dmabuf_formats_vk(struct vt_compositor_t* comp, void* native_handle, struct wl_array* formats);
+
+bool renderer_query_dmabuf_formats_with_renderer_vk(struct vt_renderer_t* renderer, struct wl_array* formats);
+
+bool renderer_setup_renderable_output_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+bool renderer_resize_renderable_output_vk(struct vt_renderer_t* r, struct vt_output_t* output, int32_t w, int32_t h);
+
+bool renderer_destroy_renderable_output_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+bool renderer_import_buffer_vk(struct vt_renderer_t* r, struct vt_surface_t* surf,
+    struct wl_resource *buffer_resource);
+
+bool renderer_destroy_surface_texture_vk(struct vt_renderer_t* r, struct vt_surface_t* surf);
+
+bool renderer_drop_context_vk(struct vt_renderer_t* r);
+
+void renderer_set_vsync_vk(struct vt_renderer_t* r, bool vsync);
+
+void renderer_set_clear_color_vk(struct vt_renderer_t* r, struct vt_output_t* output, uint32_t col);
+
+void renderer_stencil_damage_pass_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_composite_pass_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_begin_frame_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_begin_scene_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+bool renderer_is_surface_drawable_vk(struct vt_renderer_t* r, struct vt_surface_t* surface);
+
+void renderer_draw_surface_vk(struct vt_renderer_t* r, struct vt_output_t* output, struct vt_surface_t* surface, float x, float y);
+
+void renderer_draw_rect_vk(struct vt_renderer_t* r, float x, float y, float w, float h, uint32_t col);
+
+void renderer_end_scene_vk(struct vt_renderer_t* r, struct vt_output_t* output);
+
+void renderer_end_frame_vk(struct vt_renderer_t* r, struct vt_output_t* output,  const pixman_box32_t* damaged, int32_t n_damaged);
+
+bool renderer_destroy_vk(struct vt_renderer_t* r);